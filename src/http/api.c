@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* pread */
 #include "http/api.h"
 
 #include "auth/session.h"
@@ -5,6 +6,7 @@
 #include "db/database.h"
 #include "server/upload.h"
 
+#include <fcntl.h>
 #include <stdint.h>
 #ifdef ENABLE_TLS
 #include <openssl/ssl.h>
@@ -14,11 +16,13 @@
 #include <string.h>
 #include <strings.h>
 #include <limits.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 #define HTTP_MAX_BODY 4096
+#define HTTP_FILE_CHUNK 16384
 
 typedef struct {
     int fd;
@@ -312,6 +316,7 @@ static int handle_admin_delete(api_io_t *io, const http_request_t *req, websocke
         snprintf(cmd, sizeof(cmd), "rm -rf %s", v.segment_path);
         system(cmd);
     }
+    websocket_invalidate_video(ctx, video_id);
     return http_send_response(io, "HTTP/1.1 200 OK\r\n", "Content-Type: text/plain\r\n", "deleted");
 }
 
@@ -383,6 +388,60 @@ static int handle_admin_list(api_io_t *io, const http_request_t *req, websocket_
     }
     return http_send_response(io, "HTTP/1.1 200 OK\r\n", headers, buf);
 }
+static int handle_admin_cache_stats(api_io_t *io, const http_request_t *req, websocket_context_t *ctx) {
+    if (!ctx || !ctx->db) {
+        return http_send_response(io, "HTTP/1.1 503 Service Unavailable\r\n", "Content-Type: text/plain\r\n", "service-unavailable");
+    }
+    if (!is_admin_user(ctx->db, req)) {
+        return http_send_response(io, "HTTP/1.1 403 Forbidden\r\n", "Content-Type: text/plain\r\n", "admin-required");
+    }
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&ctx->segment_cache, &st);
+    manifest_stats_t ms;
+    manifest_index_get_stats(&ctx->manifests, &ms);
+    pthread_mutex_lock(&ctx->lock);
+    uint64_t cancels = ctx->cancels;
+    uint64_t cancel_ws_bytes = ctx->cancel_ws_bytes;
+    pthread_mutex_unlock(&ctx->lock);
+    /* Retransmissions actually replaced by a skip, counted as they come due. */
+    quic_metrics_t qm = {0};
+    if (ctx->quic_engine) {
+        quic_engine_get_metrics(ctx->quic_engine, &qm);
+    }
+    uint64_t lookups = st.hits + st.misses;
+    char buf[1024];
+    int len = snprintf(buf,
+                       sizeof(buf),
+                       "{\"hits\":%llu,\"misses\":%llu,\"hit_ratio\":%.4f,\"coalesced\":%llu,\"loads\":%llu,"
+                       "\"load_failures\":%llu,\"bypassed\":%llu,\"evictions\":%llu,\"invalidations\":%llu,"
+                       "\"bytes\":%llu,\"entries\":%llu,\"capacity\":%llu,"
+                       "\"manifests\":{\"hits\":%llu,\"loads\":%llu,\"load_failures\":%llu,\"invalidations\":%llu,"
+                       "\"entries\":%llu},\"cancellations\":{\"count\":%llu,\"ws_bytes\":%llu,\"quic_bytes\":%llu}}",
+                       (unsigned long long)st.hits,
+                       (unsigned long long)st.misses,
+                       lookups ? (double)st.hits / (double)lookups : 0.0,
+                       (unsigned long long)st.coalesced,
+                       (unsigned long long)st.loads,
+                       (unsigned long long)st.load_failures,
+                       (unsigned long long)st.bypassed,
+                       (unsigned long long)st.evictions,
+                       (unsigned long long)st.invalidations,
+                       (unsigned long long)st.bytes,
+                       (unsigned long long)st.entries,
+                       (unsigned long long)st.capacity,
+                       (unsigned long long)ms.hits,
+                       (unsigned long long)ms.loads,
+                       (unsigned long long)ms.load_failures,
+                       (unsigned long long)ms.invalidations,
+                       (unsigned long long)ms.entries,
+                       (unsigned long long)cancels,
+                       (unsigned long long)cancel_ws_bytes,
+                       (unsigned long long)qm.bytes_cancelled);
+    if (len <= 0 || (size_t)len >= sizeof(buf)) {
+        return http_send_response(io, "HTTP/1.1 500 Internal Server Error\r\n", "Content-Type: text/plain\r\n", "response-too-large");
+    }
+    return http_send_response(io, "HTTP/1.1 200 OK\r\n", "Content-Type: application/json\r\n", buf);
+}
 static int handle_logout(api_io_t *io, const http_request_t *req, websocket_context_t *ctx) {
     if (!ctx || !ctx->db) {
         return http_send_response(io, "HTTP/1.1 503 Service Unavailable\r\n", "Content-Type: text/plain\r\n", "service-unavailable");
@@ -432,11 +491,11 @@ static int handle_upload(api_io_t *io, const http_request_t *req, websocket_cont
 #ifdef ENABLE_TLS
     if (io->ssl) {
         int fd = SSL_get_fd(io->ssl);
-        handle_upload_request(fd, io->ssl, ct, body, body_len, ctx->db);
+        handle_upload_request(fd, io->ssl, ct, body, body_len, ctx->db, ctx);
         return 0;
     }
 #endif
-    handle_upload_request(io->fd, NULL, ct, body, body_len, ctx->db);
+    handle_upload_request(io->fd, NULL, ct, body, body_len, ctx->db, ctx);
     return 0;
 }
 
@@ -475,7 +534,49 @@ static const char *guess_mime(const char *path) {
     return "application/octet-stream";
 }
 
-static int http_send_file(api_io_t *io, const char *status_line, const char *headers, const uint8_t *body, size_t body_len, int send_body) {
+/* Straight from the page cache when the kernel does the (TLS) framing;
+ * otherwise one stack chunk at a time. */
+static int http_write_file(api_io_t *io, int file_fd, size_t len) {
+    off_t off = 0;
+#ifdef ENABLE_TLS
+    if (io->ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+        if (BIO_get_ktls_send(SSL_get_wbio(io->ssl))) {
+            while ((size_t)off < len) {
+                ossl_ssize_t n = SSL_sendfile(io->ssl, file_fd, off, len - (size_t)off, 0);
+                if (n <= 0) {
+                    return -1;
+                }
+                off += (off_t)n;
+            }
+            return 0;
+        }
+#endif
+    } else
+#endif
+    {
+        while ((size_t)off < len) {
+            ssize_t n = sendfile(io->fd, file_fd, &off, len - (size_t)off);
+            if (n <= 0) {
+                break;
+            }
+        }
+        if ((size_t)off == len) {
+            return 0;
+        }
+    }
+    uint8_t chunk[HTTP_FILE_CHUNK];
+    while ((size_t)off < len) {
+        size_t part = len - (size_t)off > sizeof(chunk) ? sizeof(chunk) : len - (size_t)off;
+        if (pread(file_fd, chunk, part, off) != (ssize_t)part || http_write_all(io, chunk, part) != 0) {
+            return -1;
+        }
+        off += (off_t)part;
+    }
+    return 0;
+}
+
+static int http_send_file(api_io_t *io, const char *status_line, const char *headers, int file_fd, size_t body_len, int send_body) {
     if (!status_line || !headers) {
         return -1;
     }
@@ -488,7 +589,7 @@ static int http_send_file(api_io_t *io, const char *status_line, const char *hea
         return -1;
     }
     if (send_body && body_len > 0) {
-        return http_write_all(io, body, body_len);
+        return http_write_file(io, file_fd, body_len);
     }
     return 0;
 }
@@ -557,7 +658,7 @@ static int handle_static_file(api_io_t *io, const http_request_t *req) {
             return http_send_file(io,
                                   "HTTP/1.1 204 No Content\r\n",
                                   "Content-Type: image/x-icon\r\n",
-                                  NULL,
+                                  -1,
                                   0,
                                   0);
         }
@@ -567,32 +668,21 @@ static int handle_static_file(api_io_t *io, const http_request_t *req) {
         return http_send_response(io, "HTTP/1.1 413 Payload Too Large\r\n", "Content-Type: text/plain\r\n", "file-too-large");
     }
 
-    FILE *fp = fopen(fs_path, "rb");
-    if (!fp) {
+    int file_fd = open(fs_path, O_RDONLY);
+    if (file_fd < 0) {
         return http_send_response(io, "HTTP/1.1 500 Internal Server Error\r\n", "Content-Type: text/plain\r\n", "open-failed");
     }
-    uint8_t *buf = malloc((size_t)st.st_size);
-    if (!buf) {
-        fclose(fp);
-        return http_send_response(io, "HTTP/1.1 500 Internal Server Error\r\n", "Content-Type: text/plain\r\n", "oom");
-    }
-    size_t n = fread(buf, 1, (size_t)st.st_size, fp);
-    fclose(fp);
-    if (n != (size_t)st.st_size) {
-        free(buf);
-        return http_send_response(io, "HTTP/1.1 500 Internal Server Error\r\n", "Content-Type: text/plain\r\n", "read-failed");
-    }
 
     const char *mime = guess_mime(fs_path);
     char headers[256];
     int hlen = snprintf(headers, sizeof(headers), "Content-Type: %s\r\n", mime);
     if (hlen < 0 || (size_t)hlen >= sizeof(headers)) {
-        free(buf);
+        close(file_fd);
         return http_send_response(io, "HTTP/1.1 500 Internal Server Error\r\n", "Content-Type: text/plain\r\n", "header-too-long");
     }
 
-    int rc = http_send_file(io, "HTTP/1.1 200 OK\r\n", headers, buf, (size_t)n, strcasecmp(req->method, "HEAD") != 0);
-    free(buf);
+    int rc = http_send_file(io, "HTTP/1.1 200 OK\r\n", headers, file_fd, (size_t)st.st_size, strcasecmp(req->method, "HEAD") != 0);
+    close(file_fd);
     return rc;
 }
 
@@ -658,6 +748,8 @@ int http_api_handle(int fd, SSL *ssl, const http_request_t *req, websocket_conte
         rc = handle_admin_update(&io, req, ctx, body_buf, content_len);
     } else if (strcmp(req->path, "/admin/video/list") == 0) {
         rc = handle_admin_list(&io, req, ctx);
+    } else if (strcmp(req->path, "/admin/cache/stats") == 0) {
+        rc = handle_admin_cache_stats(&io, req, ctx);
     } else {
         rc = handle_static_file(&io, req);
     }
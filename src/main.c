@@ -41,6 +41,8 @@ int main(void) {
 
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    /* OpenSSL writes with write(); a viewer that vanished must not kill the server. */
+    signal(SIGPIPE, SIG_IGN);
 
     quic_engine_t quic_engine;
     websocket_context_t ws_context;
@@ -67,7 +69,9 @@ int main(void) {
     }
     db_initialized = 1;
 
-    if (quic_engine_init(&quic_engine, 9443, quic_default_handler, NULL) != 0) {
+    /* Several backends behind tools/quic_lb on one host each need their own port. */
+    uint16_t quic_port = get_port_from_env(getenv("QUIC_PORT"), 9443);
+    if (quic_engine_init(&quic_engine, quic_port, quic_default_handler, NULL) != 0) {
         fputs("Failed to initialize QUIC engine.\n", stderr);
         exit_code = 1;
         goto cleanup;
@@ -80,16 +84,26 @@ int main(void) {
         goto cleanup;
     }
     quic_started = 1;
+    /* HTTP/WebSocket I/O threads and workers are created below and inherit this mask. */
+    if (quic_engine.latency.enabled && quic_latency_exclude_current_thread(&quic_engine.latency) != 0) {
+        fputs("QUIC low-latency CPUs cover every allowed CPU; other threads will share them.\n", stderr);
+    }
 
     websocket_context_init(&ws_context, &quic_engine, &db);
     ws_initialized = 1;
+    quic_engine_set_early_data_handler(&quic_engine, websocket_on_quic_early_data, &ws_context);
 
     const char *bind_ip = getenv("HOST");
     if (!bind_ip || bind_ip[0] == '\0') {
         bind_ip = "0.0.0.0";
     }
     uint16_t server_port = get_port_from_env(getenv("PORT"), 8080);
-    if (server_init(&server, bind_ip, server_port, 5) != 0) {
+    int max_clients = 16384;
+    const char *max_clients_env = getenv("MAX_CLIENTS");
+    if (max_clients_env && atoi(max_clients_env) > 0) {
+        max_clients = atoi(max_clients_env);
+    }
+    if (server_init(&server, bind_ip, server_port, max_clients) != 0) {
         fputs("Failed to initialize server context.\n", stderr);
         exit_code = 1;
         goto cleanup;
@@ -118,8 +132,8 @@ int main(void) {
     }
     server_started = 1;
 
-    printf("Server is running on TCP:%s:%u (HTTP backend behind Nginx TLS) and UDP:0.0.0.0:9443 (QUIC).\n",
-           bind_ip, (unsigned int)server_port);
+    printf("Server is running on TCP:%s:%u (HTTP backend behind Nginx TLS) and UDP:0.0.0.0:%u (QUIC).\n",
+           bind_ip, (unsigned int)server_port, (unsigned int)quic_port);
 
     while (keep_running) {
         sleep(1);
@@ -135,13 +149,14 @@ cleanup:
     if (server_initialized) {
         server_destroy(&server);
     }
-    if (ws_initialized) {
-        websocket_context_destroy(&ws_context);
-    }
+    /* The engine thread calls into ws_context for early data, so stop it first. */
     if (quic_started) {
         quic_engine_stop(&quic_engine);
         quic_engine_join(&quic_engine);
     }
+    if (ws_initialized) {
+        websocket_context_destroy(&ws_context);
+    }
     if (quic_initialized) {
         quic_engine_destroy(&quic_engine);
     }
@@ -0,0 +1,410 @@
+#include "server/manifest.h"
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct manifest_node {
+    int video_id;
+    manifest_t *manifest; /* the index's own reference */
+    struct manifest_node *next;
+} manifest_node_t;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} manifest_out_t;
+
+static void manifest_printf(manifest_out_t *out, const char *fmt, ...) {
+    if (out->failed) {
+        return;
+    }
+    for (;;) {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(out->data + out->len, out->cap - out->len, fmt, ap);
+        va_end(ap);
+        if (n < 0) {
+            out->failed = 1;
+            return;
+        }
+        if ((size_t)n < out->cap - out->len) {
+            out->len += (size_t)n;
+            return;
+        }
+        size_t cap = out->cap * 2 + (size_t)n + 1;
+        char *grown = realloc(out->data, cap);
+        if (!grown) {
+            out->failed = 1;
+            return;
+        }
+        out->data = grown;
+        out->cap = cap;
+    }
+}
+
+static void manifest_free(manifest_t *m) {
+    free(m->segments);
+    free(m->ws_init);
+    free(m);
+}
+
+static void manifest_release_locked(manifest_t *m) {
+    if (--m->refs == 0) {
+        manifest_free(m);
+    }
+}
+
+/* Value after "key": in a flat JSON text; NULL when absent. */
+static const char *manifest_json_value(const char *json, const char *end, const char *key) {
+    char pattern[48];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    size_t plen = strlen(pattern);
+    for (const char *p = json; p && p + plen <= end; p = strstr(p + 1, pattern)) {
+        if (strncmp(p, pattern, plen) != 0) {
+            continue;
+        }
+        const char *v = p + plen;
+        while (v < end && isspace((unsigned char)*v)) {
+            v++;
+        }
+        if (v < end && *v == ':') {
+            v++;
+            while (v < end && isspace((unsigned char)*v)) {
+                v++;
+            }
+            return v < end ? v : NULL;
+        }
+    }
+    return NULL;
+}
+
+static int manifest_json_number(const char *json, const char *end, const char *key, double *out) {
+    const char *v = manifest_json_value(json, end, key);
+    if (!v) {
+        return -1;
+    }
+    char *stop = NULL;
+    double d = strtod(v, &stop);
+    if (stop == v) {
+        return -1;
+    }
+    *out = d;
+    return 0;
+}
+
+/* Codec names only ever hold these characters; anything else is dropped so
+ * the value can go back out in JSON as is. */
+static void manifest_json_token(const char *json, const char *end, const char *key, char *out, size_t out_size) {
+    out[0] = '\0';
+    const char *v = manifest_json_value(json, end, key);
+    if (!v || *v != '"') {
+        return;
+    }
+    size_t n = 0;
+    for (v++; v < end && *v != '"' && n + 1 < out_size; ++v) {
+        if (isalnum((unsigned char)*v) || *v == '.' || *v == '-' || *v == '_') {
+            out[n++] = *v;
+        }
+    }
+    out[n] = '\0';
+}
+
+static char *manifest_read_file(const char *path, size_t *len_out) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long size = ftell(fp);
+        if (size > 0 && size <= MANIFEST_INFO_MAX && fseek(fp, 0, SEEK_SET) == 0) {
+            buf = malloc((size_t)size + 1);
+            if (buf) {
+                size_t n = fread(buf, 1, (size_t)size, fp);
+                buf[n] = '\0';
+                *len_out = n;
+            }
+        }
+    }
+    fclose(fp);
+    return buf;
+}
+
+/* Segment entries of segment_info.json, in file order. */
+static int manifest_parse_segments(manifest_t *m, const char *json, const char *end) {
+    const char *p = manifest_json_value(json, end, "segments");
+    if (!p || *p != '[') {
+        return 0;
+    }
+    size_t cap = 0;
+    while ((p = strchr(p, '{')) != NULL && p < end && m->total_segments < MANIFEST_MAX_SEGMENTS) {
+        const char *close = strchr(p, '}');
+        if (!close) {
+            break;
+        }
+        double index = 0;
+        manifest_segment_t seg = {0};
+        if (manifest_json_number(p, close, "index", &index) == 0 && index >= 0) {
+            seg.index = (uint32_t)index;
+            manifest_json_number(p, close, "start", &seg.start);
+            manifest_json_number(p, close, "end", &seg.end);
+            manifest_json_number(p, close, "duration", &seg.duration);
+            if (m->total_segments == cap) {
+                cap = cap ? cap * 2 : 64;
+                manifest_segment_t *grown = realloc(m->segments, cap * sizeof(*grown));
+                if (!grown) {
+                    return -1;
+                }
+                m->segments = grown;
+            }
+            m->segments[m->total_segments++] = seg;
+        }
+        p = close + 1;
+    }
+    return 0;
+}
+
+static uint64_t manifest_file_size(const char *dir, const char *name_fmt, uint32_t index, int *exists) {
+    char name[64];
+    char path[512];
+    snprintf(name, sizeof(name), name_fmt, index);
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    struct stat st;
+    *exists = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+    return *exists ? (uint64_t)st.st_size : 0;
+}
+
+static int manifest_render(manifest_t *m) {
+    manifest_out_t out = {.data = malloc(256), .cap = 256};
+    if (!out.data) {
+        return -1;
+    }
+    if (m->has_info) {
+        manifest_printf(&out,
+                        "{\"type\":\"ws_init\",\"status\":\"ok\",\"total_duration\":%.3f,\"total_segments\":%u",
+                        m->total_duration,
+                        m->total_segments);
+        if (m->video_codec[0]) {
+            manifest_printf(&out, ",\"video_codec\":\"%s\"", m->video_codec);
+        }
+        if (m->codec_string[0]) {
+            manifest_printf(&out, ",\"codec_string\":\"%s\"", m->codec_string);
+        }
+        manifest_printf(&out, ",\"init_size\":%llu,\"segments\":[", (unsigned long long)m->init_size);
+        for (uint32_t i = 0; i < m->total_segments; ++i) {
+            const manifest_segment_t *s = &m->segments[i];
+            manifest_printf(&out,
+                            "%s{\"index\":%u,\"start\":%.3f,\"end\":%.3f,\"duration\":%.3f,\"bytes\":%llu}",
+                            i ? "," : "",
+                            s->index,
+                            s->start,
+                            s->end,
+                            s->duration,
+                            (unsigned long long)s->bytes);
+        }
+        manifest_printf(&out, "]}");
+    } else {
+        manifest_printf(&out,
+                        "{\"type\":\"ws_init\",\"status\":\"ok\",\"duration\":%d,\"total_segments\":%u,\"init_size\":%llu}",
+                        (int)m->total_duration,
+                        m->total_segments,
+                        (unsigned long long)m->init_size);
+    }
+    if (out.failed) {
+        free(out.data);
+        return -1;
+    }
+    m->ws_init = out.data;
+    m->ws_init_len = out.len;
+    return 0;
+}
+
+/* Runs without the lock. */
+static manifest_t *manifest_load(const char *base_dir, int video_id, db_context_t *db) {
+    char dir[300];
+    snprintf(dir, sizeof(dir), "%s/%d", base_dir, video_id);
+    int exists = 0;
+    uint64_t init_size = manifest_file_size(dir, "init-stream0.m4s", 0, &exists);
+    if (!exists) {
+        return NULL;
+    }
+    manifest_t *m = calloc(1, sizeof(*m));
+    if (!m) {
+        return NULL;
+    }
+    m->video_id = video_id;
+    m->init_size = init_size;
+
+    char info_path[512];
+    snprintf(info_path, sizeof(info_path), "%s/segment_info.json", dir);
+    size_t info_len = 0;
+    char *info = manifest_read_file(info_path, &info_len);
+    if (info) {
+        const char *end = info + info_len;
+        m->has_info = 1;
+        manifest_json_number(info, end, "total_duration", &m->total_duration);
+        manifest_json_token(info, end, "video_codec", m->video_codec, sizeof(m->video_codec));
+        manifest_json_token(info, end, "codec_string", m->codec_string, sizeof(m->codec_string));
+        int rc = manifest_parse_segments(m, info, end);
+        free(info);
+        if (rc != 0) {
+            manifest_free(m);
+            return NULL;
+        }
+        for (uint32_t i = 0; i < m->total_segments; ++i) {
+            m->segments[i].bytes = manifest_file_size(dir, "chunk-stream0-%05u.m4s", m->segments[i].index, &exists);
+        }
+    } else {
+        /* No segment_info.json: count the files once, duration from the DB. */
+        db_video_t video;
+        if (db && db_get_video_by_id(db, video_id, &video) == SQLITE_OK) {
+            m->total_duration = video.duration;
+        }
+        for (uint32_t i = 0; i < MANIFEST_MAX_SEGMENTS; ++i) {
+            manifest_file_size(dir, "chunk-stream0-%05u.m4s", i, &exists);
+            if (!exists) {
+                break;
+            }
+            m->total_segments++;
+        }
+    }
+    if (manifest_render(m) != 0) {
+        manifest_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+int manifest_index_init(manifest_index_t *idx, const char *base_dir) {
+    if (!idx || !base_dir || strlen(base_dir) >= sizeof(idx->base_dir)) {
+        return -1;
+    }
+    memset(idx, 0, sizeof(*idx));
+    snprintf(idx->base_dir, sizeof(idx->base_dir), "%s", base_dir);
+    pthread_mutex_init(&idx->lock, NULL);
+    return 0;
+}
+
+/* No manifest may still be referenced. */
+void manifest_index_destroy(manifest_index_t *idx) {
+    if (!idx) {
+        return;
+    }
+    for (unsigned i = 0; i < MANIFEST_BUCKETS; ++i) {
+        manifest_node_t *n = idx->buckets[i];
+        while (n) {
+            manifest_node_t *next = n->next;
+            manifest_release_locked(n->manifest);
+            free(n);
+            n = next;
+        }
+    }
+    pthread_mutex_destroy(&idx->lock);
+    memset(idx, 0, sizeof(*idx));
+}
+
+int manifest_index_get(manifest_index_t *idx, int video_id, db_context_t *db, manifest_t **out) {
+    if (!idx || !out) {
+        return -1;
+    }
+    unsigned bucket = (unsigned)video_id % MANIFEST_BUCKETS;
+    pthread_mutex_lock(&idx->lock);
+    for (manifest_node_t *n = idx->buckets[bucket]; n; n = n->next) {
+        if (n->video_id == video_id) {
+            idx->stats.hits++;
+            n->manifest->refs++;
+            *out = n->manifest;
+            pthread_mutex_unlock(&idx->lock);
+            return 0;
+        }
+    }
+    uint64_t generation = idx->generation;
+    pthread_mutex_unlock(&idx->lock);
+
+    manifest_t *m = manifest_load(idx->base_dir, video_id, db);
+
+    pthread_mutex_lock(&idx->lock);
+    if (!m) {
+        idx->stats.load_failures++;
+        pthread_mutex_unlock(&idx->lock);
+        return -1;
+    }
+    idx->stats.loads++;
+    m->owner = idx;
+    m->refs = 1;
+    /* Another thread may have loaded it meanwhile; an invalidation in
+     * between means these files may already be stale, so they are served
+     * once but not kept. */
+    manifest_node_t *found = NULL;
+    for (manifest_node_t *n = idx->buckets[bucket]; n; n = n->next) {
+        if (n->video_id == video_id) {
+            found = n;
+            break;
+        }
+    }
+    if (found) {
+        manifest_release_locked(m);
+        m = found->manifest;
+        m->refs++;
+    } else if (generation == idx->generation) {
+        manifest_node_t *node = malloc(sizeof(*node));
+        if (node) {
+            node->video_id = video_id;
+            node->manifest = m;
+            node->next = idx->buckets[bucket];
+            idx->buckets[bucket] = node;
+            m->refs++;
+            idx->stats.entries++;
+        }
+    }
+    *out = m;
+    pthread_mutex_unlock(&idx->lock);
+    return 0;
+}
+
+void manifest_release(manifest_t *m) {
+    if (!m) {
+        return;
+    }
+    manifest_index_t *idx = m->owner;
+    pthread_mutex_lock(&idx->lock);
+    manifest_release_locked(m);
+    pthread_mutex_unlock(&idx->lock);
+}
+
+void manifest_index_invalidate(manifest_index_t *idx, int video_id) {
+    if (!idx) {
+        return;
+    }
+    pthread_mutex_lock(&idx->lock);
+    idx->generation++;
+    manifest_node_t **pp = &idx->buckets[(unsigned)video_id % MANIFEST_BUCKETS];
+    while (*pp) {
+        manifest_node_t *n = *pp;
+        if (n->video_id == video_id) {
+            *pp = n->next;
+            manifest_release_locked(n->manifest);
+            free(n);
+            idx->stats.invalidations++;
+            idx->stats.entries--;
+        } else {
+            pp = &n->next;
+        }
+    }
+    pthread_mutex_unlock(&idx->lock);
+}
+
+void manifest_index_get_stats(manifest_index_t *idx, manifest_stats_t *out) {
+    if (!idx || !out) {
+        return;
+    }
+    pthread_mutex_lock(&idx->lock);
+    *out = idx->stats;
+    pthread_mutex_unlock(&idx->lock);
+}
@@ -0,0 +1,79 @@
+#ifndef SERVER_MANIFEST_H
+#define SERVER_MANIFEST_H
+
+#include "db/database.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-video index of a segmented video: segment count, timings, byte sizes,
+ * codec and init segment size, read once from <base>/<id>/segment_info.json
+ * and the segment files, with the ws_init reply rendered at load time. Kept
+ * until the video is invalidated (upload, delete, re-segment), so playback
+ * starts without touching the filesystem. */
+#define MANIFEST_BUCKETS      256
+#define MANIFEST_MAX_SEGMENTS 100000
+#define MANIFEST_INFO_MAX     (4 * 1024 * 1024) /* segment_info.json */
+
+struct manifest_index;
+struct manifest_node;
+
+typedef struct {
+    uint32_t index;
+    double start;
+    double end;
+    double duration;
+    uint64_t bytes;
+} manifest_segment_t;
+
+typedef struct manifest {
+    struct manifest_index *owner;
+    int refs; /* under the index lock */
+    int video_id;
+    int has_info;          /* segment_info.json was there; else counted files */
+    double total_duration; /* from the DB when there is no segment_info.json */
+    uint32_t total_segments;
+    char video_codec[32];
+    char codec_string[64];
+    uint64_t init_size;
+    manifest_segment_t *segments; /* total_segments of them */
+    char *ws_init;                /* {"type":"ws_init","status":"ok",...} */
+    size_t ws_init_len;
+} manifest_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t loads;
+    uint64_t load_failures;
+    uint64_t invalidations;
+    uint64_t entries;
+} manifest_stats_t;
+
+typedef struct manifest_index {
+    pthread_mutex_t lock;
+    char base_dir[256];
+    uint64_t generation; /* bumped by every invalidation */
+    struct manifest_node *buckets[MANIFEST_BUCKETS];
+    manifest_stats_t stats;
+} manifest_index_t;
+
+int manifest_index_init(manifest_index_t *idx, const char *base_dir);
+void manifest_index_destroy(manifest_index_t *idx);
+/* 0 with a referenced manifest, -1 when the video has no init segment. db
+ * (optional) supplies the duration when segment_info.json is missing. */
+int manifest_index_get(manifest_index_t *idx, int video_id, db_context_t *db, manifest_t **out);
+void manifest_release(manifest_t *m);
+/* The next lookup reloads video_id; loads already running are discarded. */
+void manifest_index_invalidate(manifest_index_t *idx, int video_id);
+void manifest_index_get_stats(manifest_index_t *idx, manifest_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_MANIFEST_H
@@ -1,7 +1,10 @@
+#define _GNU_SOURCE /* sendmmsg */
 #include "server/quic.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,8 +14,16 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "server/quic_capture.h"
+#include "server/quic_cc.h"
+#include "server/quic_crypto.h"
+#include "server/quic_dispatch.h"
+#include "server/quic_fec.h"
+#include "server/quic_retry.h"
 #include "server/quic_stream.h"
 
+_Static_assert(QUIC_FEC_PACKET_PAYLOAD == QUIC_MAX_PAYLOAD, "repair packets must fit QUIC_MAX_PAYLOAD");
+
 static uint64_t host_to_be64(uint64_t value) {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
     return ((uint64_t)htonl((uint32_t)(value >> 32)) | ((uint64_t)htonl((uint32_t)(value & 0xFFFFFFFF)) << 32));
@@ -29,6 +40,12 @@ static uint64_t be64_to_host(uint64_t value) {
 #endif
 }
 
+uint64_t quic_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
 static quic_connection_entry_t *quic_engine_find_entry_locked(quic_engine_t *engine, uint64_t connection_id);
 static int quic_engine_add_connection_locked(quic_engine_t *engine, uint64_t connection_id, const struct sockaddr_in *addr);
 static void quic_engine_cleanup_connections_locked(quic_engine_t *engine, time_t now);
@@ -36,10 +53,24 @@ static int quic_engine_process_packet(quic_engine_t *engine,
                                       const quic_packet_t *packet,
                                       const struct sockaddr_in *addr,
                                       int *handshake_needed,
+                                      int *resumed,
+                                      int *issue_ticket,
                                       quic_connection_state_t *state_changed,
                                       struct sockaddr_in *state_addr);
-static void quic_engine_send_handshake(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id);
+static void quic_engine_send_handshake(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id, int resumed);
+static int quic_engine_redeem_ticket_locked(quic_engine_t *engine, const uint8_t *ticket, const struct sockaddr_in *addr, time_t now);
+static int quic_engine_screen_initial(quic_engine_t *engine, quic_packet_t *packet, const struct sockaddr_in *addr);
+static void quic_engine_issue_ticket(quic_engine_t *engine, uint64_t connection_id, const struct sockaddr_in *addr);
+static void quic_engine_emit_early_data(quic_engine_t *engine,
+                                        uint64_t connection_id,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        const struct sockaddr_in *addr);
 static void quic_engine_send_close(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id);
+static void quic_engine_start_path_probe_locked(quic_engine_t *engine, quic_connection_entry_t *entry, const struct sockaddr_in *addr);
+static void quic_engine_send_path_challenge_locked(quic_engine_t *engine, quic_connection_entry_t *entry);
+static void quic_engine_check_path_probe_locked(quic_engine_t *engine, quic_connection_entry_t *entry, uint64_t now_us);
+static int quic_engine_handle_path_packet(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr);
 static void *quic_engine_loop(void *arg);
 static void quic_engine_emit_state(quic_engine_t *engine,
                                    uint64_t connection_id,
@@ -51,13 +82,58 @@ static void quic_engine_emit_stream_data(quic_engine_t *engine,
                                          uint32_t offset,
                                          const uint8_t *data,
                                          size_t len);
+static int quic_engine_send_limited(quic_engine_t *engine,
+                                    const quic_packet_t *packet,
+                                    const struct sockaddr_in *addr,
+                                    const quic_send_limit_t *limit);
 static void quic_engine_track_pending(quic_engine_t *engine,
                                       const quic_packet_t *packet,
                                       const uint8_t *buffer,
-                                      size_t len);
-static void quic_engine_ack_pending(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number);
+                                      size_t len,
+                                      const quic_send_limit_t *limit);
+static uint64_t quic_engine_ack_pending(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number, uint8_t ack_flags);
+static void quic_engine_send_skip_locked(quic_engine_t *engine,
+                                         quic_connection_entry_t *entry,
+                                         uint32_t stream_id,
+                                         uint32_t offset,
+                                         uint32_t length);
+static void quic_engine_deliver_stream(quic_engine_t *engine,
+                                       quic_connection_entry_t *entry,
+                                       uint64_t connection_id,
+                                       uint32_t stream_id,
+                                       uint8_t *scratch,
+                                       size_t scratch_len);
 static void quic_engine_retransmit_pending(quic_engine_t *engine);
 static void quic_engine_clear_pending_for_connection(quic_engine_t *engine, uint64_t connection_id);
+static uint64_t quic_engine_ack_datagram_locked(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number);
+static void quic_engine_on_ack_ecn_locked(quic_engine_t *engine, uint64_t connection_id, const uint8_t *counts, uint64_t sent_us);
+static int quic_engine_send_ack(quic_engine_t *engine, quic_packet_t *ack, const struct sockaddr_in *addr);
+static void quic_engine_report_rate_locked(quic_engine_t *engine, uint64_t connection_id);
+static void quic_engine_detect_datagram_loss_locked(quic_engine_t *engine, quic_connection_entry_t *entry, uint64_t now_us);
+static void quic_engine_emit_datagram(quic_engine_t *engine, uint64_t connection_id, const uint8_t *data, size_t len);
+static void quic_engine_emit_packet(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr);
+static int quic_engine_ensure_fec(quic_engine_t *engine, quic_connection_entry_t *entry);
+static void quic_engine_on_fec_recovered(void *user_data,
+                                         uint32_t stream_id,
+                                         uint32_t packet_number,
+                                         uint32_t offset,
+                                         const uint8_t *data,
+                                         uint32_t len);
+
+static int quic_engine_seal_locked(quic_engine_t *engine, uint8_t *buffer, size_t len, size_t cap, size_t *out_len);
+static int quic_engine_open_locked(quic_engine_t *engine, uint8_t *buffer, size_t len, size_t *out_len);
+static void quic_engine_track_pending_locked(quic_engine_t *engine,
+                                             const quic_packet_t *packet,
+                                             const uint8_t *buffer,
+                                             size_t len,
+                                             const quic_send_limit_t *limit);
+
+typedef struct {
+    quic_engine_t *engine;
+    quic_connection_entry_t *entry;
+    uint64_t connection_id;
+    const struct sockaddr_in *addr;
+} quic_fec_recover_ctx_t;
 
 static quic_connection_entry_t *quic_engine_find_entry_locked(quic_engine_t *engine, uint64_t connection_id) {
     for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
@@ -68,6 +144,38 @@ static quic_connection_entry_t *quic_engine_find_entry_locked(quic_engine_t *eng
     return NULL;
 }
 
+/* The nonce only has to be unguessable and distinct, so it comes from the
+ * retry key rather than a read of /dev/urandom under the engine lock. */
+static uint64_t quic_engine_mint_routable_id_locked(quic_engine_t *engine, uint64_t connection_id, int slot) {
+    uint8_t msg[8 + 8 + 4];
+    uint64_t cid_be = host_to_be64(connection_id);
+    uint64_t now_be = host_to_be64(quic_now_us());
+    uint32_t slot_be = htonl((uint32_t)slot);
+    memcpy(msg, &cid_be, sizeof(cid_be));
+    memcpy(msg + 8, &now_be, sizeof(now_be));
+    memcpy(msg + 16, &slot_be, sizeof(slot_be));
+    uint8_t mac[QUIC_SHA256_SIZE];
+    quic_retry_hmac_sha256(engine->retry_key, sizeof(engine->retry_key), msg, sizeof(msg), mac);
+    uint64_t nonce = 0;
+    memcpy(&nonce, mac, sizeof(nonce));
+    return quic_lb_cid_encode(engine->lb_server_id, nonce);
+}
+
+/* Id the connection was opened with, for a packet that may carry its routable alias. */
+static uint64_t quic_engine_canonical_id_locked(quic_engine_t *engine, uint64_t connection_id) {
+    uint8_t server_id = 0;
+    if (engine->lb_server_id == 0 || quic_lb_cid_server_id(connection_id, &server_id) != 0 ||
+        server_id != engine->lb_server_id) {
+        return connection_id;
+    }
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        if (engine->connections[i].in_use && engine->connections[i].routable_id == connection_id) {
+            return engine->connections[i].connection_id;
+        }
+    }
+    return connection_id;
+}
+
 static int quic_engine_add_connection_locked(quic_engine_t *engine, uint64_t connection_id, const struct sockaddr_in *addr) {
     for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
         if (!engine->connections[i].in_use) {
@@ -77,6 +185,20 @@ static int quic_engine_add_connection_locked(quic_engine_t *engine, uint64_t con
             engine->connections[i].last_seen = time(NULL);
             engine->connections[i].state = QUIC_CONN_STATE_CONNECTING;
             quic_stream_manager_init(&engine->connections[i].stream_mgr);
+            quic_cc_init(&engine->connections[i].cc);
+            engine->connections[i].next_datagram_pn = 0;
+            engine->connections[i].next_skip_pn = 0;
+            engine->connections[i].largest_acked_datagram = 0;
+            engine->connections[i].datagrams_acked_any = 0;
+            memset(engine->connections[i].datagrams, 0, sizeof(engine->connections[i].datagrams));
+            engine->connections[i].fec = NULL;
+            memset(&engine->connections[i].probe, 0, sizeof(engine->connections[i].probe));
+            memset(&engine->connections[i].ecn_received, 0, sizeof(engine->connections[i].ecn_received));
+            memset(&engine->connections[i].ecn_reported, 0, sizeof(engine->connections[i].ecn_reported));
+            quic_rate_init(&engine->connections[i].rate);
+            engine->connections[i].rate_reported_us = 0;
+            engine->connections[i].routable_id =
+                engine->lb_server_id ? quic_engine_mint_routable_id_locked(engine, connection_id, i) : 0;
             return 0;
         }
     }
@@ -87,6 +209,8 @@ static int quic_engine_process_packet(quic_engine_t *engine,
                                       const quic_packet_t *packet,
                                       const struct sockaddr_in *addr,
                                       int *handshake_needed,
+                                      int *resumed,
+                                      int *issue_ticket,
                                       quic_connection_state_t *state_changed,
                                       struct sockaddr_in *state_addr) {
     if (!engine || !packet || !addr) {
@@ -105,6 +229,7 @@ static int quic_engine_process_packet(quic_engine_t *engine,
             return -1;
         }
         if (quic_engine_add_connection_locked(engine, packet->connection_id, addr) != 0) {
+            engine->metrics.initials_rejected++;
             pthread_mutex_unlock(&engine->lock);
             return -1;
         }
@@ -113,17 +238,45 @@ static int quic_engine_process_packet(quic_engine_t *engine,
         if (handshake_needed) {
             *handshake_needed = 1;
         }
+        quic_connection_state_t initial_state = QUIC_CONN_STATE_CONNECTING;
+        if (packet->length >= QUIC_TICKET_SIZE) {
+            if (quic_engine_redeem_ticket_locked(engine, packet->payload, addr, now) == 0) {
+                /* The ticket proves this peer finished a handshake from this IP before. */
+                entry->state = QUIC_CONN_STATE_CONNECTED;
+                initial_state = QUIC_CONN_STATE_CONNECTED;
+                engine->metrics.resumptions_accepted++;
+                if (resumed) {
+                    *resumed = 1;
+                }
+                if (issue_ticket) {
+                    *issue_ticket = 1;
+                }
+            } else {
+                engine->metrics.resumptions_rejected++;
+            }
+        }
         if (state_changed && state_addr) {
-            *state_changed = QUIC_CONN_STATE_CONNECTING;
+            *state_changed = initial_state;
             *state_addr = *addr;
         }
     } else {
         if (memcmp(&entry->addr, addr, sizeof(*addr)) != 0) {
-            entry->addr = *addr;
-            engine->metrics.connections_migrated++;
-            if (state_changed && state_addr) {
-                *state_changed = entry->state;
-                *state_addr = *addr;
+            if (entry->addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+                /* NAT rebinding: the same host behind a new port is still the same
+                 * path, so switch now and keep RTT and window instead of slow-starting. */
+                entry->addr = *addr;
+                engine->metrics.connections_migrated++;
+                engine->metrics.nat_rebindings++;
+                if (state_changed && state_addr) {
+                    *state_changed = entry->state;
+                    *state_addr = *addr;
+                }
+            } else if (!entry->probe.active) {
+                /* Anyone can put a new source address on a packet; keep sending
+                 * to the old one until the new one proves it is the peer. A probe
+                 * in flight runs to its answer or timeout, so packets from a second
+                 * address cannot keep replacing the challenge the real peer holds. */
+                quic_engine_start_path_probe_locked(engine, entry, addr);
             }
         }
         entry->last_seen = now;
@@ -133,6 +286,8 @@ static int quic_engine_process_packet(quic_engine_t *engine,
         entry->state = QUIC_CONN_STATE_CLOSED;
         entry->in_use = 0;
         quic_stream_manager_destroy(&entry->stream_mgr);
+        quic_fec_decoder_destroy(entry->fec);
+        entry->fec = NULL;
         quic_engine_clear_pending_for_connection(engine, packet->connection_id);
         engine->metrics.connections_closed++;
         if (state_changed && state_addr) {
@@ -145,6 +300,9 @@ static int quic_engine_process_packet(quic_engine_t *engine,
 
     if (entry->state == QUIC_CONN_STATE_CONNECTING && (packet->flags & QUIC_FLAG_HANDSHAKE)) {
         entry->state = QUIC_CONN_STATE_CONNECTED;
+        if (issue_ticket) {
+            *issue_ticket = 1;
+        }
         if (state_changed && state_addr) {
             *state_changed = QUIC_CONN_STATE_CONNECTED;
             *state_addr = *addr;
@@ -161,19 +319,167 @@ static int quic_engine_process_packet(quic_engine_t *engine,
     return should_deliver ? 0 : -1;
 }
 
-static void quic_engine_send_handshake(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id) {
+static void quic_engine_send_handshake(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id, int resumed) {
+    uint64_t routable_id = 0;
+    pthread_mutex_lock(&engine->lock);
+    const quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (entry) {
+        routable_id = entry->routable_id;
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    uint64_t routable_be = host_to_be64(routable_id);
     quic_packet_t response = {
         .flags = QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK,
         .connection_id = connection_id,
         .packet_number = 1,
         .stream_id = 0,
-        .offset = 0,
-        .length = 0,
-        .payload = NULL,
+        .offset = resumed ? QUIC_RESUME_ACCEPTED : 0,
+        .length = routable_id ? QUIC_LB_ROUTABLE_ID_SIZE : 0,
+        .payload = routable_id ? (const uint8_t *)&routable_be : NULL,
     };
     quic_engine_send(engine, &response, addr);
 }
 
+static int quic_engine_read_random(uint8_t *buf, size_t len) {
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (!f) {
+        return -1;
+    }
+    size_t r = fread(buf, 1, len, f);
+    fclose(f);
+    return r == len ? 0 : -1;
+}
+
+/* A live ticket issued to this IP, or NULL. An expired match is freed on the way. */
+static quic_ticket_t *quic_engine_find_ticket_locked(quic_engine_t *engine, const uint8_t *ticket, const struct sockaddr_in *addr, time_t now) {
+    for (int i = 0; i < QUIC_MAX_TICKETS; ++i) {
+        quic_ticket_t *t = &engine->tickets[i];
+        if (!t->in_use || memcmp(t->id, ticket, QUIC_TICKET_SIZE) != 0) {
+            continue;
+        }
+        if (now >= t->expires) {
+            t->in_use = 0;
+            return NULL;
+        }
+        return t->addr.s_addr == addr->sin_addr.s_addr ? t : NULL;
+    }
+    return NULL;
+}
+
+static int quic_engine_redeem_ticket_locked(quic_engine_t *engine, const uint8_t *ticket, const struct sockaddr_in *addr, time_t now) {
+    quic_ticket_t *t = quic_engine_find_ticket_locked(engine, ticket, addr, now);
+    if (!t) {
+        return -1;
+    }
+    t->in_use = 0;
+    return 0;
+}
+
+/* Runs before any state exists for an INITIAL's connection id. Returns 1 to go
+ * on to quic_engine_process_packet (with a retry token stripped from the
+ * payload), 0 after answering with a Retry, -1 to drop the packet. */
+static int quic_engine_screen_initial(quic_engine_t *engine, quic_packet_t *packet, const struct sockaddr_in *addr) {
+    if (!(packet->flags & QUIC_FLAG_INITIAL)) {
+        return 1;
+    }
+    int has_token = packet->offset == QUIC_RETRY_TOKEN_SIZE && packet->length >= QUIC_RETRY_TOKEN_SIZE;
+    const uint8_t *token = packet->payload;
+    if (has_token) {
+        packet->payload += QUIC_RETRY_TOKEN_SIZE;
+        packet->length -= QUIC_RETRY_TOKEN_SIZE;
+        packet->offset = 0;
+    }
+
+    time_t now = time(NULL);
+    pthread_mutex_lock(&engine->lock);
+    quic_engine_cleanup_connections_locked(engine, now);
+    if (quic_engine_find_entry_locked(engine, packet->connection_id)) {
+        pthread_mutex_unlock(&engine->lock);
+        return 1;
+    }
+    unsigned occupied = 0;
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        occupied += engine->connections[i].in_use ? 1u : 0u;
+    }
+    if (occupied < engine->retry_threshold) {
+        pthread_mutex_unlock(&engine->lock);
+        return 1;
+    }
+    if (has_token) {
+        int valid = quic_retry_token_validate(engine->retry_key, token, QUIC_RETRY_TOKEN_SIZE, addr, packet->connection_id, now) == 0;
+        if (!valid) {
+            /* No second Retry: a spoofer would just get another one to bounce. */
+            engine->metrics.initials_rejected++;
+        }
+        pthread_mutex_unlock(&engine->lock);
+        return valid ? 1 : -1;
+    }
+    /* A live ticket from this IP already proves an earlier handshake there. */
+    if (packet->length >= QUIC_TICKET_SIZE && quic_engine_find_ticket_locked(engine, packet->payload, addr, now)) {
+        pthread_mutex_unlock(&engine->lock);
+        return 1;
+    }
+    engine->metrics.retries_sent++;
+    pthread_mutex_unlock(&engine->lock);
+
+    uint8_t fresh[QUIC_RETRY_TOKEN_SIZE];
+    quic_retry_token_mint(engine->retry_key, addr, packet->connection_id, now, fresh);
+    quic_packet_t retry = {
+        .flags = QUIC_FLAG_RETRY,
+        .connection_id = packet->connection_id,
+        .packet_number = 0,
+        .stream_id = 0,
+        .offset = 0,
+        .length = sizeof(fresh),
+        .payload = fresh,
+    };
+    quic_engine_send(engine, &retry, addr);
+    return 0;
+}
+
+/* Best effort: a lost ticket only means the next session does a full handshake. */
+static void quic_engine_issue_ticket(quic_engine_t *engine, uint64_t connection_id, const struct sockaddr_in *addr) {
+    uint8_t payload[QUIC_TICKET_PAYLOAD];
+    if (quic_engine_read_random(payload, QUIC_TICKET_SIZE) != 0) {
+        return;
+    }
+    uint32_t lifetime = htonl(QUIC_TICKET_LIFETIME);
+    memcpy(payload + QUIC_TICKET_SIZE, &lifetime, sizeof(lifetime));
+
+    time_t now = time(NULL);
+    pthread_mutex_lock(&engine->lock);
+    /* Reuse a free or expired slot, otherwise evict the ticket closest to expiry. */
+    quic_ticket_t *slot = &engine->tickets[0];
+    for (int i = 0; i < QUIC_MAX_TICKETS; ++i) {
+        quic_ticket_t *t = &engine->tickets[i];
+        if (!t->in_use || now >= t->expires) {
+            slot = t;
+            break;
+        }
+        if (t->expires < slot->expires) {
+            slot = t;
+        }
+    }
+    slot->in_use = 1;
+    memcpy(slot->id, payload, QUIC_TICKET_SIZE);
+    slot->addr = addr->sin_addr;
+    slot->expires = now + QUIC_TICKET_LIFETIME;
+    engine->metrics.tickets_issued++;
+    pthread_mutex_unlock(&engine->lock);
+
+    quic_packet_t packet = {
+        .flags = QUIC_FLAG_HANDSHAKE,
+        .connection_id = connection_id,
+        .packet_number = 2,
+        .stream_id = 0,
+        .offset = 0,
+        .length = sizeof(payload),
+        .payload = payload,
+    };
+    quic_engine_send(engine, &packet, addr);
+}
+
 static void quic_engine_send_close(quic_engine_t *engine, const struct sockaddr_in *addr, uint64_t connection_id) {
     quic_packet_t response = {
         .flags = QUIC_FLAG_CLOSE,
@@ -187,6 +493,102 @@ static void quic_engine_send_close(quic_engine_t *engine, const struct sockaddr_
     quic_engine_send(engine, &response, addr);
 }
 
+/* Keyed like the routable ids: unguessable without the retry key, and no
+ * /dev/urandom read under the engine lock on every probe. */
+static void quic_engine_start_path_probe_locked(quic_engine_t *engine, quic_connection_entry_t *entry, const struct sockaddr_in *addr) {
+    quic_path_probe_t *probe = &entry->probe;
+    uint8_t msg[8 + 4 + 2 + 8];
+    uint64_t cid_be = host_to_be64(entry->connection_id);
+    uint64_t now_be = host_to_be64(quic_now_us());
+    memcpy(msg, &cid_be, sizeof(cid_be));
+    memcpy(msg + 8, &addr->sin_addr.s_addr, 4);
+    memcpy(msg + 12, &addr->sin_port, 2);
+    memcpy(msg + 14, &now_be, sizeof(now_be));
+    uint8_t mac[QUIC_SHA256_SIZE];
+    quic_retry_hmac_sha256(engine->retry_key, sizeof(engine->retry_key), msg, sizeof(msg), mac);
+    memcpy(probe->data, mac, sizeof(probe->data));
+    probe->active = 1;
+    probe->addr = *addr;
+    probe->attempts = 0;
+    quic_engine_send_path_challenge_locked(engine, entry);
+}
+
+static void quic_engine_send_path_challenge_locked(quic_engine_t *engine, quic_connection_entry_t *entry) {
+    quic_path_probe_t *probe = &entry->probe;
+    quic_packet_t challenge = {
+        .flags = QUIC_FLAG_PATH_CHALLENGE,
+        .connection_id = entry->connection_id,
+        .packet_number = 0,
+        .stream_id = 0,
+        .offset = 0,
+        .length = QUIC_PATH_CHALLENGE_SIZE,
+        .payload = probe->data,
+    };
+    probe->sent_us = quic_now_us();
+    probe->attempts++;
+    uint8_t buffer[QUIC_HEADER_SIZE + QUIC_PATH_CHALLENGE_SIZE + QUIC_CRYPTO_OVERHEAD];
+    size_t len = 0;
+    if (quic_packet_serialize(&challenge, buffer, sizeof(buffer), &len) != 0 ||
+        quic_engine_seal_locked(engine, buffer, len, sizeof(buffer), &len) != 0) {
+        return;
+    }
+    ssize_t sent = sendto(engine->sockfd, buffer, len, 0, (const struct sockaddr *)&probe->addr, sizeof(probe->addr));
+    if (sent != (ssize_t)len) {
+        return;
+    }
+    engine->metrics.packets_sent++;
+    engine->metrics.path_challenges_sent++;
+}
+
+static void quic_engine_check_path_probe_locked(quic_engine_t *engine, quic_connection_entry_t *entry, uint64_t now_us) {
+    quic_path_probe_t *probe = &entry->probe;
+    if (!probe->active || now_us - probe->sent_us < QUIC_PATH_PROBE_TIMEOUT_US) {
+        return;
+    }
+    if (probe->attempts >= QUIC_PATH_PROBE_ATTEMPTS) {
+        probe->active = 0;
+        engine->metrics.path_validation_failed++;
+        return;
+    }
+    quic_engine_send_path_challenge_locked(engine, entry);
+}
+
+static int quic_engine_handle_path_packet(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr) {
+    if (packet->length != QUIC_PATH_CHALLENGE_SIZE) {
+        return -1;
+    }
+    if (packet->flags == QUIC_FLAG_PATH_CHALLENGE) {
+        pthread_mutex_lock(&engine->lock);
+        int known = quic_engine_find_entry_locked(engine, packet->connection_id) != NULL;
+        pthread_mutex_unlock(&engine->lock);
+        if (!known) {
+            return -1;
+        }
+        /* Same size as the challenge, so answering a spoofed one amplifies nothing. */
+        quic_packet_t response = *packet;
+        response.flags = QUIC_FLAG_PATH_RESPONSE;
+        return quic_engine_send(engine, &response, addr);
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet->connection_id);
+    if (!entry || !entry->probe.active || memcmp(&entry->probe.addr, addr, sizeof(*addr)) != 0 ||
+        memcmp(entry->probe.data, packet->payload, QUIC_PATH_CHALLENGE_SIZE) != 0) {
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+    entry->addr = *addr;
+    entry->last_seen = time(NULL);
+    entry->probe.active = 0;
+    quic_cc_reset_path(&entry->cc);
+    quic_rate_reset_path(&entry->rate);
+    engine->metrics.connections_migrated++;
+    quic_connection_state_t state = entry->state;
+    pthread_mutex_unlock(&engine->lock);
+    quic_engine_emit_state(engine, packet->connection_id, state, addr);
+    return 0;
+}
+
 int quic_packet_serialize(const quic_packet_t *packet, uint8_t *buffer, size_t buffer_len, size_t *out_len) {
     if (!packet || !buffer) {
         return -1;
@@ -296,6 +698,130 @@ int quic_engine_init(quic_engine_t *engine, uint16_t port, quic_packet_handler h
     struct timeval tv = {.tv_sec = (time_t)engine->recv_timeout_sec, .tv_usec = 0};
     setsockopt(engine->sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
 
+    const char *ecn_spec = getenv(QUIC_ECN_ENV);
+    engine->ecn = !(ecn_spec && (strcmp(ecn_spec, "off") == 0 || strcmp(ecn_spec, "0") == 0));
+    if (engine->ecn) {
+        int tos = QUIC_ECN_ECT0;
+        int on = 1;
+        if (setsockopt(engine->sockfd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) != 0 ||
+            setsockopt(engine->sockfd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) != 0) {
+            fprintf(stderr, "[quic][ecn] cannot set ECT(0) or read TOS, ECN disabled\n");
+            tos = 0;
+            setsockopt(engine->sockfd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+            engine->ecn = 0;
+        }
+    }
+
+    const char *capture_path = getenv(QUIC_CAPTURE_ENV);
+    if (capture_path && capture_path[0] != '\0') {
+        engine->capture = malloc(sizeof(*engine->capture));
+        if (!engine->capture || quic_capture_writer_open(engine->capture, capture_path) != 0) {
+            fprintf(stderr, "[quic][capture] cannot record to %s, capture disabled\n", capture_path);
+            free(engine->capture);
+            engine->capture = NULL;
+        } else {
+            printf("[quic][capture] recording received datagrams to %s\n", capture_path);
+        }
+    }
+
+    const char *fec_spec = getenv(QUIC_FEC_ENV);
+    if (fec_spec) {
+        if (quic_fec_parse_config(fec_spec, &engine->fec_mode, &engine->fec_k, &engine->fec_m) != 0) {
+            fprintf(stderr, "[quic][fec] ignoring invalid %s=%s (want xor:K or rs:K:M)\n", QUIC_FEC_ENV, fec_spec);
+            engine->fec_mode = QUIC_FEC_NONE;
+        } else if (engine->fec_mode != QUIC_FEC_NONE) {
+            printf("[quic][fec] %s k=%u m=%u\n",
+                   engine->fec_mode == QUIC_FEC_XOR ? "xor" : "reed-solomon",
+                   engine->fec_k,
+                   engine->fec_m);
+        }
+    }
+
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    /* Keys are derived from the connection id, so a restarted server must not
+     * reuse sequence numbers a client may already have seen under them. */
+    engine->tx_seq = (uint64_t)wall.tv_sec * 1000000000ULL + (uint64_t)wall.tv_nsec;
+    const char *protection = getenv(QUIC_PROTECTION_ENV);
+    if (protection) {
+        quic_aead_t aead = QUIC_AEAD_NONE;
+        const char *psk = getenv(QUIC_PROTECTION_PSK_ENV);
+        if (quic_crypto_parse_aead(protection, &aead) != 0 ||
+            quic_engine_set_protection(engine, aead, (const uint8_t *)psk, psk ? strlen(psk) : 0) != 0) {
+            fprintf(stderr, "[quic][crypto] cannot enable %s=%s (want aes128gcm or chacha20, build with TLS=1)\n",
+                    QUIC_PROTECTION_ENV,
+                    protection);
+        } else if (aead != QUIC_AEAD_NONE) {
+            printf("[quic][crypto] packet protection %s%s\n", quic_crypto_aead_name(aead), psk ? " with pre-shared key" : "");
+        }
+    }
+
+    const char *lb_spec = getenv(QUIC_LB_SERVER_ID_ENV);
+    if (lb_spec) {
+        char *end = NULL;
+        unsigned long server_id = strtoul(lb_spec, &end, 10);
+        if (end == lb_spec || *end != '\0' || server_id == 0 || server_id > UINT8_MAX) {
+            fprintf(stderr, "[quic][lb] ignoring invalid %s=%s (want 1..255)\n", QUIC_LB_SERVER_ID_ENV, lb_spec);
+        } else {
+            engine->lb_server_id = (uint8_t)server_id;
+            printf("[quic][lb] issuing routable connection ids for server %lu\n", server_id);
+        }
+    }
+
+    /* Before the dispatch pool so its workers get pinned too. */
+    const char *latency_spec = getenv(QUIC_LOW_LATENCY_ENV);
+    if (latency_spec) {
+        if (quic_latency_parse_config(latency_spec, &engine->latency) != 0) {
+            fprintf(stderr, "[quic][latency] ignoring invalid %s=%s (want CPUS[:SPIN_US])\n", QUIC_LOW_LATENCY_ENV, latency_spec);
+            memset(&engine->latency, 0, sizeof(engine->latency));
+        } else if (engine->latency.enabled) {
+            if (engine->latency.spin_us > 0 && quic_latency_enable_busy_poll(engine->sockfd, engine->latency.spin_us) != 0) {
+                fprintf(stderr, "[quic][latency] SO_BUSY_POLL refused (needs CAP_NET_ADMIN), spinning in user space only\n");
+            }
+            printf("[quic][latency] receive thread on cpu %u, spin %u us before sleeping\n",
+                   quic_latency_cpu_for(&engine->latency, -1),
+                   engine->latency.spin_us);
+        }
+    }
+
+    const char *dispatch_spec = getenv(QUIC_DISPATCH_ENV);
+    if (dispatch_spec) {
+        unsigned workers = 0;
+        size_t depth = 0;
+        if (quic_dispatch_parse_config(dispatch_spec, &workers, &depth) != 0) {
+            fprintf(stderr, "[quic][dispatch] ignoring invalid %s=%s (want WORKERS or WORKERS:DEPTH)\n",
+                    QUIC_DISPATCH_ENV,
+                    dispatch_spec);
+        } else if (workers > 0) {
+            if (quic_engine_set_dispatch(engine, workers, depth) != 0) {
+                fprintf(stderr, "[quic][dispatch] cannot start %u workers, callbacks stay inline\n", workers);
+            } else {
+                printf("[quic][dispatch] callbacks on %u workers, queue depth %zu each\n",
+                       workers,
+                       engine->dispatch->queue_depth);
+            }
+        }
+    }
+
+    engine->retry_threshold = QUIC_RETRY_DEFAULT_THRESHOLD;
+    const char *retry_spec = getenv(QUIC_RETRY_THRESHOLD_ENV);
+    if (retry_spec) {
+        char *end = NULL;
+        unsigned long threshold = strtoul(retry_spec, &end, 10);
+        if (end == retry_spec || *end != '\0') {
+            fprintf(stderr, "[quic][retry] ignoring invalid %s=%s\n", QUIC_RETRY_THRESHOLD_ENV, retry_spec);
+        } else {
+            engine->retry_threshold = threshold > UINT_MAX ? UINT_MAX : (unsigned)threshold;
+        }
+    }
+    if (quic_engine_read_random(engine->retry_key, sizeof(engine->retry_key)) != 0) {
+        /* A guessable key would let anyone mint tokens, so go without retry. */
+        fprintf(stderr, "[quic][retry] no random key available, stateless retry disabled\n");
+        engine->retry_threshold = UINT_MAX;
+    } else if (engine->retry_threshold <= QUIC_MAX_CONNECTIONS) {
+        printf("[quic][retry] stateless retry at %u of %d connection slots\n", engine->retry_threshold, QUIC_MAX_CONNECTIONS);
+    }
+
     engine->running = 1;
     return 0;
 }
@@ -311,6 +837,15 @@ int quic_engine_start(quic_engine_t *engine) {
         perror("pthread_create");
         return -1;
     }
+    pthread_mutex_lock(&engine->lock);
+    engine->thread_started = 1;
+    pthread_mutex_unlock(&engine->lock);
+    if (engine->latency.enabled) {
+        unsigned cpu = quic_latency_cpu_for(&engine->latency, -1);
+        if (quic_latency_pin_thread(engine->thread, cpu) != 0) {
+            fprintf(stderr, "[quic][latency] cannot pin receive thread to cpu %u\n", cpu);
+        }
+    }
 
     return 0;
 }
@@ -336,6 +871,9 @@ void quic_engine_join(quic_engine_t *engine) {
         return;
     }
     pthread_join(engine->thread, NULL);
+    pthread_mutex_lock(&engine->lock);
+    engine->thread_started = 0;
+    pthread_mutex_unlock(&engine->lock);
 }
 
 void quic_engine_destroy(quic_engine_t *engine) {
@@ -343,16 +881,41 @@ void quic_engine_destroy(quic_engine_t *engine) {
         return;
     }
 
+    /* Queued callbacks may still call back into the engine, so they finish first. */
+    quic_dispatch_destroy(engine->dispatch, NULL);
+    engine->dispatch = NULL;
+
     if (engine->sockfd >= 0) {
         close(engine->sockfd);
         engine->sockfd = -1;
     }
 
+    if (engine->capture) {
+        quic_capture_writer_close(engine->capture);
+        free(engine->capture);
+        engine->capture = NULL;
+    }
+
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        quic_fec_decoder_destroy(engine->connections[i].fec);
+        if (engine->connections[i].crypto) {
+            quic_crypto_ctx_free(&engine->connections[i].crypto->tx);
+            quic_crypto_ctx_free(&engine->connections[i].crypto->rx);
+            free(engine->connections[i].crypto);
+        }
+    }
     pthread_mutex_destroy(&engine->lock);
     memset(engine->connections, 0, sizeof(engine->connections));
 }
 
 int quic_engine_send(const quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr) {
+    return quic_engine_send_limited((quic_engine_t *)engine, packet, addr, NULL);
+}
+
+static int quic_engine_send_limited(quic_engine_t *engine,
+                                    const quic_packet_t *packet,
+                                    const struct sockaddr_in *addr,
+                                    const quic_send_limit_t *limit) {
     if (!engine || !packet || !addr) {
         return -1;
     }
@@ -362,15 +925,21 @@ int quic_engine_send(const quic_engine_t *engine, const quic_packet_t *packet, c
     if (quic_packet_serialize(packet, buffer, sizeof(buffer), &len) != 0) {
         return -1;
     }
+    pthread_mutex_lock(&engine->lock);
+    int sealed = quic_engine_seal_locked(engine, buffer, len, sizeof(buffer), &len);
+    pthread_mutex_unlock(&engine->lock);
+    if (sealed != 0) {
+        return -1;
+    }
 
     ssize_t sent = sendto(engine->sockfd, buffer, len, 0, (const struct sockaddr *)addr, sizeof(*addr));
     if (sent < 0 || (size_t)sent != len) {
         return -1;
     }
-    pthread_mutex_lock((pthread_mutex_t *)&engine->lock);
-    ((quic_engine_t *)engine)->metrics.packets_sent++;
-    pthread_mutex_unlock((pthread_mutex_t *)&engine->lock);
-    quic_engine_track_pending((quic_engine_t *)engine, packet, buffer, len);
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.packets_sent++;
+    pthread_mutex_unlock(&engine->lock);
+    quic_engine_track_pending(engine, packet, buffer, len, limit);
 
     return 0;
 }
@@ -395,6 +964,10 @@ int quic_engine_get_connection(quic_engine_t *engine, uint64_t connection_id, st
 }
 
 int quic_engine_send_to_connection(quic_engine_t *engine, const quic_packet_t *packet) {
+    return quic_engine_send_to_connection_limited(engine, packet, NULL);
+}
+
+int quic_engine_send_to_connection_limited(quic_engine_t *engine, const quic_packet_t *packet, const quic_send_limit_t *limit) {
     if (!engine || !packet) {
         return -1;
     }
@@ -404,7 +977,44 @@ int quic_engine_send_to_connection(quic_engine_t *engine, const quic_packet_t *p
         return -1;
     }
 
-    return quic_engine_send(engine, packet, &addr);
+    return quic_engine_send_limited(engine, packet, &addr, limit);
+}
+
+int quic_engine_update_playback(quic_engine_t *engine, uint64_t connection_id, uint32_t stream_id, uint32_t playback_offset) {
+    if (!engine) {
+        return -1;
+    }
+    pthread_mutex_lock(&engine->lock);
+    for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
+        quic_pending_entry_t *p = &engine->pending[i];
+        if (p->in_use && (p->flags & QUIC_FLAG_DATA) && p->connection_id == connection_id &&
+            p->stream_id == stream_id && p->expire_offset != 0 && p->expire_offset <= playback_offset) {
+            p->expired = 1;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return 0;
+}
+
+int quic_engine_cancel_stream(quic_engine_t *engine, uint64_t connection_id, uint32_t stream_id, uint64_t *unacked_out) {
+    if (!engine) {
+        return -1;
+    }
+    uint64_t bytes = 0;
+    pthread_mutex_lock(&engine->lock);
+    for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
+        quic_pending_entry_t *p = &engine->pending[i];
+        if (p->in_use && (p->flags & QUIC_FLAG_DATA) && !p->cancelled && p->connection_id == connection_id &&
+            p->stream_id == stream_id) {
+            p->cancelled = 1;
+            bytes += p->payload_len;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+    if (unacked_out) {
+        *unacked_out = bytes;
+    }
+    return 0;
 }
 
 int quic_engine_close_connection(quic_engine_t *engine, uint64_t connection_id) {
@@ -421,6 +1031,8 @@ int quic_engine_close_connection(quic_engine_t *engine, uint64_t connection_id)
         entry->state = QUIC_CONN_STATE_CLOSED;
         entry->in_use = 0;
         quic_stream_manager_destroy(&entry->stream_mgr);
+        quic_fec_decoder_destroy(entry->fec);
+        entry->fec = NULL;
         engine->metrics.connections_closed++;
         quic_engine_clear_pending_for_connection(engine, connection_id);
         found = 0;
@@ -470,51 +1082,383 @@ void quic_engine_set_stream_data_handler(quic_engine_t *engine, quic_stream_data
     pthread_mutex_unlock(&engine->lock);
 }
 
+/* Pool counters live in the pool; engine->metrics keeps those of replaced pools. */
+static void quic_metrics_add_dispatch(quic_metrics_t *metrics, const quic_dispatch_stats_t *stats) {
+    metrics->callbacks_dispatched += stats->submitted;
+    metrics->callbacks_completed += stats->completed;
+    metrics->dispatch_queue_depth += stats->queue_depth;
+    metrics->dispatch_full_waits += stats->full_waits;
+    metrics->callback_wait_us_total += stats->wait_us_total;
+    metrics->callback_run_us_total += stats->run_us_total;
+    if (stats->queue_peak > metrics->dispatch_queue_peak) {
+        metrics->dispatch_queue_peak = stats->queue_peak;
+    }
+    if (stats->wait_us_max > metrics->callback_wait_us_max) {
+        metrics->callback_wait_us_max = stats->wait_us_max;
+    }
+    if (stats->run_us_max > metrics->callback_run_us_max) {
+        metrics->callback_run_us_max = stats->run_us_max;
+    }
+}
+
 void quic_engine_get_metrics(const quic_engine_t *engine, quic_metrics_t *out_metrics) {
     if (!engine || !out_metrics) {
         return;
     }
     pthread_mutex_lock((pthread_mutex_t *)&engine->lock);
     *out_metrics = engine->metrics;
+    quic_dispatch_t *dispatch = engine->dispatch;
     pthread_mutex_unlock((pthread_mutex_t *)&engine->lock);
+
+    if (dispatch) {
+        quic_dispatch_stats_t stats;
+        quic_dispatch_get_stats(dispatch, &stats);
+        quic_metrics_add_dispatch(out_metrics, &stats);
+    }
 }
 
-void quic_engine_set_recv_timeout(quic_engine_t *engine, uint32_t seconds) {
+void quic_engine_set_datagram_handler(quic_engine_t *engine, quic_datagram_handler handler, void *user_data) {
     if (!engine) {
         return;
     }
     pthread_mutex_lock(&engine->lock);
-    engine->recv_timeout_sec = seconds;
-    int sock = engine->sockfd;
+    engine->datagram_handler = handler;
+    engine->datagram_user_data = user_data;
     pthread_mutex_unlock(&engine->lock);
+}
 
-    if (sock >= 0) {
-        struct timeval tv = {.tv_sec = (time_t)seconds, .tv_usec = 0};
-        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+int quic_engine_set_dispatch(quic_engine_t *engine, unsigned workers, size_t queue_depth) {
+    if (!engine || workers > QUIC_DISPATCH_MAX_WORKERS) {
+        return -1;
+    }
+    /* The receive thread and callbacks may hold the old pool outside the lock. */
+    pthread_mutex_lock(&engine->lock);
+    int started = engine->thread_started;
+    pthread_mutex_unlock(&engine->lock);
+    if (started) {
+        fprintf(stderr, "[quic][dispatch] cannot replace the worker pool while the engine runs\n");
+        return -1;
+    }
+    quic_dispatch_t *pool = NULL;
+    if (workers > 0) {
+        pool = quic_dispatch_create(workers, queue_depth);
+        if (!pool) {
+            return -1;
+        }
+        for (unsigned i = 0; engine->latency.enabled && i < pool->worker_count; ++i) {
+            unsigned cpu = quic_latency_cpu_for(&engine->latency, (int)i);
+            if (quic_latency_pin_thread(pool->workers[i].thread, cpu) != 0) {
+                fprintf(stderr, "[quic][latency] cannot pin dispatch worker %u to cpu %u\n", i, cpu);
+            }
+        }
+    }
+    pthread_mutex_lock(&engine->lock);
+    quic_dispatch_t *old = engine->dispatch;
+    engine->dispatch = pool;
+    pthread_mutex_unlock(&engine->lock);
+    if (old) {
+        quic_dispatch_stats_t stats;
+        quic_dispatch_destroy(old, &stats);
+        pthread_mutex_lock(&engine->lock);
+        quic_metrics_add_dispatch(&engine->metrics, &stats);
+        pthread_mutex_unlock(&engine->lock);
     }
+    return 0;
 }
 
-static void quic_engine_cleanup_connections_locked(quic_engine_t *engine, time_t now) {
-    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
-        if (engine->connections[i].in_use &&
-            (now - engine->connections[i].last_seen) > QUIC_CONNECTION_TIMEOUT) {
-            engine->connections[i].in_use = 0;
-            engine->connections[i].state = QUIC_CONN_STATE_CLOSED;
-            quic_stream_manager_destroy(&engine->connections[i].stream_mgr);
-            engine->metrics.connections_closed++;
-            quic_engine_clear_pending_for_connection(engine, engine->connections[i].connection_id);
-        }
+void quic_engine_set_early_data_handler(quic_engine_t *engine, quic_early_data_handler handler, void *user_data) {
+    if (!engine) {
+        return;
     }
+    pthread_mutex_lock(&engine->lock);
+    engine->early_data_handler = handler;
+    engine->early_data_user_data = user_data;
+    pthread_mutex_unlock(&engine->lock);
 }
 
-static void *quic_engine_loop(void *arg) {
-    quic_engine_t *engine = (quic_engine_t *)arg;
-    uint8_t buffer[QUIC_MAX_PACKET_SIZE];
+void quic_engine_set_lb_server_id(quic_engine_t *engine, uint8_t server_id) {
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock(&engine->lock);
+    engine->lb_server_id = server_id;
+    pthread_mutex_unlock(&engine->lock);
+}
 
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        ssize_t received = recvfrom(engine->sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&client_addr, &addr_len);
+void quic_engine_set_retry_threshold(quic_engine_t *engine, unsigned occupied_slots) {
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock(&engine->lock);
+    engine->retry_threshold = occupied_slots;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+int quic_engine_send_datagram(quic_engine_t *engine, uint64_t connection_id, const uint8_t *data, size_t len) {
+    if (!engine || (!data && len > 0)) {
+        return -1;
+    }
+
+    size_t wire_len = QUIC_HEADER_SIZE + len;
+    pthread_mutex_lock(&engine->lock);
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (!entry || entry->state != QUIC_CONN_STATE_CONNECTED) {
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+    /* Read under the lock: a sender that got it first may have stamped a later time. */
+    uint64_t now_us = quic_now_us();
+    quic_engine_detect_datagram_loss_locked(engine, entry, now_us);
+
+    int slot = -1;
+    for (int i = 0; i < QUIC_MAX_DATAGRAMS_IN_FLIGHT; ++i) {
+        if (!entry->datagrams[i].in_use) {
+            slot = i;
+            break;
+        }
+    }
+    if (len > QUIC_MAX_PAYLOAD || slot < 0 || !quic_cc_can_send(&entry->cc, wire_len)) {
+        engine->metrics.datagrams_dropped++;
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+
+    quic_packet_t packet = {
+        .flags = QUIC_FLAG_DATAGRAM,
+        .connection_id = connection_id,
+        .packet_number = entry->next_datagram_pn++,
+        .stream_id = 0,
+        .offset = 0,
+        .length = (uint32_t)len,
+        .payload = data,
+    };
+    struct sockaddr_in addr = entry->addr;
+    entry->datagrams[slot].in_use = 1;
+    entry->datagrams[slot].packet_number = packet.packet_number;
+    entry->datagrams[slot].len = (uint32_t)wire_len;
+    entry->datagrams[slot].sent_us = now_us;
+    quic_rate_on_sent(&entry->rate, entry->cc.bytes_in_flight, now_us, &entry->datagrams[slot].rate);
+    quic_cc_on_sent(&entry->cc, wire_len);
+    engine->metrics.datagrams_sent++;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (quic_engine_send(engine, &packet, &addr) != 0) {
+        pthread_mutex_lock(&engine->lock);
+        entry = quic_engine_find_entry_locked(engine, connection_id);
+        if (entry && entry->datagrams[slot].in_use && entry->datagrams[slot].packet_number == packet.packet_number) {
+            entry->datagrams[slot].in_use = 0;
+            quic_cc_on_discarded(&entry->cc, wire_len);
+        }
+        engine->metrics.datagrams_sent--;
+        engine->metrics.datagrams_dropped++;
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+    return 0;
+}
+
+int quic_engine_get_congestion(quic_engine_t *engine, uint64_t connection_id, quic_cc_t *out_cc) {
+    if (!engine || !out_cc) {
+        return -1;
+    }
+    int rc = -1;
+    pthread_mutex_lock(&engine->lock);
+    const quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (entry) {
+        *out_cc = entry->cc;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return rc;
+}
+
+int quic_engine_get_delivery_rate(quic_engine_t *engine, uint64_t connection_id, quic_delivery_rate_t *out_rate) {
+    if (!engine || !out_rate) {
+        return -1;
+    }
+    int rc = -1;
+    pthread_mutex_lock(&engine->lock);
+    const quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (entry) {
+        out_rate->bandwidth_bps = quic_rate_bandwidth_bps(&entry->rate, quic_now_us());
+        out_rate->latest_bps = entry->rate.latest_bps;
+        out_rate->samples = entry->rate.samples;
+        out_rate->delivered_bytes = entry->rate.delivered;
+        out_rate->min_rtt_us = entry->cc.min_rtt_us;
+        out_rate->srtt_us = entry->cc.srtt_us;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return rc;
+}
+
+int quic_engine_set_fec(quic_engine_t *engine, quic_fec_mode_t mode, unsigned k, unsigned m) {
+    if (!engine || (mode != QUIC_FEC_NONE && !quic_fec_params_valid(mode, k, m))) {
+        return -1;
+    }
+    pthread_mutex_lock(&engine->lock);
+    engine->fec_mode = mode;
+    engine->fec_k = mode == QUIC_FEC_NONE ? 0 : k;
+    engine->fec_m = mode == QUIC_FEC_NONE ? 0 : m;
+    pthread_mutex_unlock(&engine->lock);
+    return 0;
+}
+
+void quic_engine_get_fec(const quic_engine_t *engine, quic_fec_mode_t *mode, unsigned *k, unsigned *m) {
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock((pthread_mutex_t *)&engine->lock);
+    if (mode) {
+        *mode = engine->fec_mode;
+    }
+    if (k) {
+        *k = engine->fec_k;
+    }
+    if (m) {
+        *m = engine->fec_m;
+    }
+    pthread_mutex_unlock((pthread_mutex_t *)&engine->lock);
+}
+
+int quic_engine_send_fec_repairs(quic_engine_t *engine, uint64_t connection_id, quic_fec_encoder_t *enc) {
+    if (!engine || !enc) {
+        return -1;
+    }
+    int repairs = quic_fec_encoder_finish(enc);
+    if (repairs <= 0) {
+        quic_fec_encoder_reset(enc);
+        return repairs;
+    }
+
+    uint8_t payload[QUIC_MAX_PAYLOAD];
+    int sent = 0;
+    for (int j = 0; j < repairs; ++j) {
+        size_t len = 0;
+        if (quic_fec_encoder_repair_payload(enc, (unsigned)j, payload, sizeof(payload), &len) != 0) {
+            break;
+        }
+        quic_packet_t packet = {
+            .flags = QUIC_FLAG_REPAIR,
+            .connection_id = connection_id,
+            .packet_number = enc->first_pn,
+            .stream_id = enc->stream_id,
+            .offset = 0,
+            .length = (uint32_t)len,
+            .payload = payload,
+        };
+        if (quic_engine_send_to_connection(engine, &packet) != 0) {
+            break;
+        }
+        sent++;
+    }
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.fec_repairs_sent += (uint64_t)sent;
+    pthread_mutex_unlock(&engine->lock);
+    quic_fec_encoder_reset(enc);
+    return sent;
+}
+
+void quic_engine_set_recv_timeout(quic_engine_t *engine, uint32_t seconds) {
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock(&engine->lock);
+    engine->recv_timeout_sec = seconds;
+    int sock = engine->sockfd;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (sock >= 0) {
+        struct timeval tv = {.tv_sec = (time_t)seconds, .tv_usec = 0};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    }
+}
+
+static void quic_engine_cleanup_connections_locked(quic_engine_t *engine, time_t now) {
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        if (engine->connections[i].in_use &&
+            (now - engine->connections[i].last_seen) > QUIC_CONNECTION_TIMEOUT) {
+            engine->connections[i].in_use = 0;
+            engine->connections[i].state = QUIC_CONN_STATE_CLOSED;
+            quic_stream_manager_destroy(&engine->connections[i].stream_mgr);
+            quic_fec_decoder_destroy(engine->connections[i].fec);
+            engine->connections[i].fec = NULL;
+            engine->metrics.connections_closed++;
+            quic_engine_clear_pending_for_connection(engine, engine->connections[i].connection_id);
+        }
+    }
+}
+
+static uint8_t quic_engine_ecn_from_msg(struct msghdr *msg) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS && cmsg->cmsg_len >= CMSG_LEN(1)) {
+            return *(const uint8_t *)CMSG_DATA(cmsg) & QUIC_ECN_MASK;
+        }
+    }
+    return QUIC_ECN_NOT_ECT;
+}
+
+#define QUIC_BUSY_POLL_PUBLISH_EVERY 256
+
+static void quic_engine_publish_busy_poll(quic_engine_t *engine, uint64_t *hits, uint64_t *sleeps) {
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.busy_poll_hits += *hits;
+    engine->metrics.busy_poll_sleeps += *sleeps;
+    pthread_mutex_unlock(&engine->lock);
+    *hits = 0;
+    *sleeps = 0;
+}
+
+/* In low-latency mode, poll without blocking for spin_us first so a datagram
+ * arriving shortly after the last one skips the sleep/wakeup round trip. The
+ * counters are published before sleeping, which keeps the lock off the hot path. */
+static ssize_t quic_engine_recvmsg(quic_engine_t *engine, struct msghdr *msg, uint64_t *hits, uint64_t *sleeps) {
+    uint32_t spin_us = engine->latency.enabled ? engine->latency.spin_us : 0;
+    if (spin_us > 0) {
+        socklen_t namelen = msg->msg_namelen;
+        size_t controllen = msg->msg_controllen;
+        uint64_t deadline = quic_now_us() + spin_us;
+        do {
+            msg->msg_namelen = namelen;
+            msg->msg_controllen = controllen;
+            ssize_t received = recvmsg(engine->sockfd, msg, MSG_DONTWAIT);
+            if (received >= 0) {
+                if (++*hits >= QUIC_BUSY_POLL_PUBLISH_EVERY) {
+                    quic_engine_publish_busy_poll(engine, hits, sleeps);
+                }
+                return received;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return received;
+            }
+        } while (quic_now_us() < deadline);
+        msg->msg_namelen = namelen;
+        msg->msg_controllen = controllen;
+        ++*sleeps;
+        quic_engine_publish_busy_poll(engine, hits, sleeps);
+    }
+    return recvmsg(engine->sockfd, msg, 0);
+}
+
+static void *quic_engine_loop(void *arg) {
+    quic_engine_t *engine = (quic_engine_t *)arg;
+    uint8_t buffer[QUIC_MAX_PACKET_SIZE];
+    uint64_t spin_hits = 0;
+    uint64_t spin_sleeps = 0;
+
+    while (1) {
+        struct sockaddr_in client_addr;
+        uint8_t control[CMSG_SPACE(sizeof(int))];
+        struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer)};
+        struct msghdr msg = {
+            .msg_name = &client_addr,
+            .msg_namelen = sizeof(client_addr),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        ssize_t received = quic_engine_recvmsg(engine, &msg, &spin_hits, &spin_sleeps);
         if (received < 0) {
             pthread_mutex_lock(&engine->lock);
             int running = engine->running;
@@ -526,89 +1470,398 @@ static void *quic_engine_loop(void *arg) {
                 continue;
             }
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                pthread_mutex_lock(&engine->lock);
-                quic_engine_cleanup_connections_locked(engine, time(NULL));
-                quic_engine_retransmit_pending(engine);
-                pthread_mutex_unlock(&engine->lock);
+                quic_engine_tick(engine);
                 continue;
             }
-            perror("recvfrom");
+            perror("recvmsg");
             continue;
         }
-        pthread_mutex_lock(&engine->lock);
-        engine->metrics.packets_received++;
-        pthread_mutex_unlock(&engine->lock);
 
-        quic_packet_t packet;
-        if (quic_packet_deserialize(&packet, buffer, (size_t)received) != 0) {
-            continue;
+        if (engine->capture) {
+            quic_capture_write(engine->capture, quic_now_us(), &client_addr, buffer, (size_t)received);
         }
 
-        if (packet.flags & QUIC_FLAG_ACK) {
-            pthread_mutex_lock(&engine->lock);
-            quic_engine_ack_pending(engine, packet.connection_id, packet.packet_number);
-            pthread_mutex_unlock(&engine->lock);
-        }
+        quic_engine_process_datagram_ecn(engine, buffer, (size_t)received, &client_addr, quic_engine_ecn_from_msg(&msg));
+    }
 
-        int handshake_needed = 0;
-        quic_connection_state_t state_changed = QUIC_CONN_STATE_IDLE;
-        struct sockaddr_in state_addr;
-        if (quic_engine_process_packet(engine, &packet, &client_addr, &handshake_needed, &state_changed, &state_addr) != 0) {
-            continue;
+    return NULL;
+}
+
+void quic_engine_tick(quic_engine_t *engine) {
+    if (!engine) {
+        return;
+    }
+    pthread_mutex_lock(&engine->lock);
+    quic_engine_cleanup_connections_locked(engine, time(NULL));
+    quic_engine_retransmit_pending(engine);
+    uint64_t now_us = quic_now_us();
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        if (engine->connections[i].in_use) {
+            quic_engine_detect_datagram_loss_locked(engine, &engine->connections[i], now_us);
+            quic_engine_check_path_probe_locked(engine, &engine->connections[i], now_us);
         }
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+
+int quic_engine_process_datagram(quic_engine_t *engine,
+                                 const uint8_t *buffer,
+                                 size_t len,
+                                 const struct sockaddr_in *client_addr) {
+    return quic_engine_process_datagram_ecn(engine, buffer, len, client_addr, QUIC_ECN_NOT_ECT);
+}
 
-        if (state_changed != QUIC_CONN_STATE_IDLE) {
-            quic_engine_emit_state(engine, packet.connection_id, state_changed, &state_addr);
+int quic_engine_process_datagram_ecn(quic_engine_t *engine,
+                                     const uint8_t *buffer,
+                                     size_t len,
+                                     const struct sockaddr_in *client_addr,
+                                     uint8_t ecn) {
+    if (!engine || !buffer || !client_addr) {
+        return -1;
+    }
+
+    uint8_t plain[QUIC_MAX_PACKET_SIZE];
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.packets_received++;
+    if (engine->protection != QUIC_AEAD_NONE) {
+        if (len > sizeof(plain)) {
+            pthread_mutex_unlock(&engine->lock);
+            return -1;
         }
+        memcpy(plain, buffer, len);
+        if (quic_engine_open_locked(engine, plain, len, &len) != 0) {
+            engine->metrics.packets_rejected_auth++;
+            pthread_mutex_unlock(&engine->lock);
+            return -1;
+        }
+        buffer = plain;
+    }
+    pthread_mutex_unlock(&engine->lock);
 
-        if (handshake_needed) {
-            quic_engine_send_handshake(engine, &client_addr, packet.connection_id);
+    quic_packet_t packet;
+    if (quic_packet_deserialize(&packet, buffer, len) != 0) {
+        return -1;
+    }
+    if (engine->lb_server_id != 0) {
+        pthread_mutex_lock(&engine->lock);
+        packet.connection_id = quic_engine_canonical_id_locked(engine, packet.connection_id);
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    if (packet.flags == QUIC_FLAG_PATH_CHALLENGE || packet.flags == QUIC_FLAG_PATH_RESPONSE) {
+        return quic_engine_handle_path_packet(engine, &packet, client_addr);
+    }
+
+    if (packet.flags & QUIC_FLAG_ACK) {
+        pthread_mutex_lock(&engine->lock);
+        uint64_t sent_us = 0;
+        if (packet.flags & QUIC_FLAG_DATAGRAM) {
+            sent_us = quic_engine_ack_datagram_locked(engine, packet.connection_id, packet.packet_number);
+        } else {
+            sent_us = quic_engine_ack_pending(engine, packet.connection_id, packet.packet_number, packet.flags);
+        }
+        if (packet.length == QUIC_ACK_ECN_SIZE && !(packet.flags & (QUIC_FLAG_INITIAL | QUIC_FLAG_HANDSHAKE))) {
+            quic_engine_on_ack_ecn_locked(engine, packet.connection_id, packet.payload, sent_us);
         }
+        quic_engine_report_rate_locked(engine, packet.connection_id);
+        pthread_mutex_unlock(&engine->lock);
+    }
 
-        if ((packet.flags & QUIC_FLAG_DATA) && engine->stream_handler) {
-            pthread_mutex_lock(&engine->lock);
-            quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet.connection_id);
-            pthread_mutex_unlock(&engine->lock);
-            if (entry) {
-                uint8_t assembled[QUIC_MAX_PAYLOAD];
-                size_t assembled_len = 0;
-                uint32_t out_offset = 0;
-                if (quic_stream_on_data(&entry->stream_mgr,
-                                        packet.stream_id,
-                                        packet.offset,
-                                        packet.payload,
-                                        packet.length,
-                                        assembled,
-                                        sizeof(assembled),
-                                        &out_offset,
-                                        &assembled_len) == 0 &&
-                    assembled_len > 0) {
-                    quic_engine_emit_stream_data(engine,
-                                                 packet.connection_id,
-                                                 packet.stream_id,
-                                                 out_offset,
-                                                 assembled,
-                                                 assembled_len);
-                }
+    if (quic_engine_screen_initial(engine, &packet, client_addr) != 1) {
+        return -1;
+    }
+
+    int handshake_needed = 0;
+    int resumed = 0;
+    int issue_ticket = 0;
+    quic_connection_state_t state_changed = QUIC_CONN_STATE_IDLE;
+    struct sockaddr_in state_addr;
+    if (quic_engine_process_packet(engine,
+                                   &packet,
+                                   client_addr,
+                                   &handshake_needed,
+                                   &resumed,
+                                   &issue_ticket,
+                                   &state_changed,
+                                   &state_addr) != 0) {
+        return -1;
+    }
+
+    if (ecn != QUIC_ECN_NOT_ECT) {
+        pthread_mutex_lock(&engine->lock);
+        quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet.connection_id);
+        if (entry) {
+            if (ecn == QUIC_ECN_CE) {
+                entry->ecn_received.ce++;
+                engine->metrics.ecn_ce_received++;
+            } else if (ecn == QUIC_ECN_ECT0) {
+                entry->ecn_received.ect0++;
+            } else {
+                entry->ecn_received.ect1++;
             }
-            quic_packet_t ack = {
-                .flags = QUIC_FLAG_ACK,
-                .connection_id = packet.connection_id,
-                .packet_number = packet.packet_number,
-                .stream_id = packet.stream_id,
-                .offset = packet.offset,
-                .length = 0,
-                .payload = NULL,
-            };
-            quic_engine_send(engine, &ack, &client_addr);
         }
+        pthread_mutex_unlock(&engine->lock);
+    }
+
+    if (state_changed != QUIC_CONN_STATE_IDLE) {
+        quic_engine_emit_state(engine, packet.connection_id, state_changed, &state_addr);
+    }
+
+    if (handshake_needed) {
+        quic_engine_send_handshake(engine, client_addr, packet.connection_id, resumed);
+    }
+    if (issue_ticket) {
+        quic_engine_issue_ticket(engine, packet.connection_id, client_addr);
+    }
+    if (resumed && packet.length > QUIC_TICKET_SIZE) {
+        pthread_mutex_lock(&engine->lock);
+        engine->metrics.early_data_bytes += packet.length - QUIC_TICKET_SIZE;
+        pthread_mutex_unlock(&engine->lock);
+        quic_engine_emit_early_data(engine,
+                                    packet.connection_id,
+                                    packet.payload + QUIC_TICKET_SIZE,
+                                    packet.length - QUIC_TICKET_SIZE,
+                                    client_addr);
+    }
 
-        if (engine->handler) {
-            engine->handler(&packet, &client_addr, engine->user_data);
+    if ((packet.flags & QUIC_FLAG_DATAGRAM) && !(packet.flags & QUIC_FLAG_ACK)) {
+        /* Datagrams skip reassembly and retransmission; the ACK only feeds the peer's congestion control. */
+        pthread_mutex_lock(&engine->lock);
+        engine->metrics.datagrams_received++;
+        pthread_mutex_unlock(&engine->lock);
+        quic_engine_emit_datagram(engine, packet.connection_id, packet.payload, packet.length);
+        quic_packet_t ack = {
+            .flags = QUIC_FLAG_ACK | QUIC_FLAG_DATAGRAM,
+            .connection_id = packet.connection_id,
+            .packet_number = packet.packet_number,
+            .stream_id = 0,
+            .offset = 0,
+            .length = 0,
+            .payload = NULL,
+        };
+        quic_engine_send_ack(engine, &ack, client_addr);
+    } else if ((packet.flags & QUIC_FLAG_SKIP) && !(packet.flags & QUIC_FLAG_ACK)) {
+        uint32_t gap = 0;
+        if (packet.length >= QUIC_SKIP_PAYLOAD_SIZE) {
+            memcpy(&gap, packet.payload, sizeof(gap));
+            gap = ntohl(gap);
+        }
+        pthread_mutex_lock(&engine->lock);
+        quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet.connection_id);
+        engine->metrics.skips_received++;
+        pthread_mutex_unlock(&engine->lock);
+        if (entry && gap > 0 && quic_stream_skip(&entry->stream_mgr, packet.stream_id, packet.offset, gap) == 0 &&
+            engine->stream_handler) {
+            uint8_t assembled[QUIC_MAX_PAYLOAD];
+            quic_engine_deliver_stream(engine, entry, packet.connection_id, packet.stream_id, assembled, sizeof(assembled));
+        }
+        quic_packet_t ack = {
+            .flags = QUIC_FLAG_ACK | QUIC_FLAG_SKIP,
+            .connection_id = packet.connection_id,
+            .packet_number = packet.packet_number,
+            .stream_id = packet.stream_id,
+            .offset = packet.offset,
+            .length = 0,
+            .payload = NULL,
+        };
+        quic_engine_send_ack(engine, &ack, client_addr);
+    } else if ((packet.flags & QUIC_FLAG_REPAIR) && !(packet.flags & (QUIC_FLAG_DATA | QUIC_FLAG_ACK)) &&
+               engine->stream_handler) {
+        pthread_mutex_lock(&engine->lock);
+        quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet.connection_id);
+        engine->metrics.fec_repairs_received++;
+        pthread_mutex_unlock(&engine->lock);
+        if (entry && quic_engine_ensure_fec(engine, entry) == 0) {
+            quic_fec_recover_ctx_t rctx = {engine, entry, packet.connection_id, client_addr};
+            quic_fec_decoder_on_repair(entry->fec,
+                                       packet.stream_id,
+                                       packet.payload,
+                                       packet.length,
+                                       quic_engine_on_fec_recovered,
+                                       &rctx);
+        }
+    } else if ((packet.flags & QUIC_FLAG_DATA) && engine->stream_handler) {
+        pthread_mutex_lock(&engine->lock);
+        quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet.connection_id);
+        pthread_mutex_unlock(&engine->lock);
+        if (entry) {
+            uint8_t assembled[QUIC_MAX_PAYLOAD];
+            size_t assembled_len = 0;
+            uint32_t out_offset = 0;
+            if (quic_stream_on_data(&entry->stream_mgr,
+                                    packet.stream_id,
+                                    packet.offset,
+                                    packet.payload,
+                                    packet.length,
+                                    assembled,
+                                    sizeof(assembled),
+                                    &out_offset,
+                                    &assembled_len) == 0 &&
+                assembled_len > 0) {
+                quic_engine_emit_stream_data(engine,
+                                             packet.connection_id,
+                                             packet.stream_id,
+                                             out_offset,
+                                             assembled,
+                                             assembled_len);
+                /* More may be ready: data beyond a skipped gap or beyond one buffer's worth. */
+                quic_engine_deliver_stream(engine, entry, packet.connection_id, packet.stream_id, assembled, sizeof(assembled));
+            }
+            if ((packet.flags & QUIC_FLAG_REPAIR) && quic_engine_ensure_fec(engine, entry) == 0) {
+                quic_fec_recover_ctx_t rctx = {engine, entry, packet.connection_id, client_addr};
+                quic_fec_decoder_on_source(entry->fec,
+                                           packet.stream_id,
+                                           packet.packet_number,
+                                           packet.offset,
+                                           packet.payload,
+                                           packet.length,
+                                           quic_engine_on_fec_recovered,
+                                           &rctx);
+            }
         }
+        quic_packet_t ack = {
+            .flags = QUIC_FLAG_ACK,
+            .connection_id = packet.connection_id,
+            .packet_number = packet.packet_number,
+            .stream_id = packet.stream_id,
+            .offset = packet.offset,
+            .length = 0,
+            .payload = NULL,
+        };
+        quic_engine_send_ack(engine, &ack, client_addr);
     }
 
-    return NULL;
+    quic_engine_emit_packet(engine, &packet, client_addr);
+    return 0;
+}
+
+typedef enum {
+    QUIC_CALLBACK_PACKET,
+    QUIC_CALLBACK_STATE,
+    QUIC_CALLBACK_STREAM_DATA,
+    QUIC_CALLBACK_EARLY_DATA,
+    QUIC_CALLBACK_DATAGRAM,
+} quic_callback_kind_t;
+
+/* One deferred callback with its own copy of everything the receive thread
+ * would have passed by pointer; freed after it runs. */
+typedef struct {
+    quic_callback_kind_t kind;
+    union {
+        quic_packet_handler packet;
+        quic_state_handler state;
+        quic_stream_data_handler stream;
+        quic_early_data_handler early;
+        quic_datagram_handler datagram;
+    } handler;
+    void *user_data;
+    uint64_t connection_id;
+    quic_packet_t packet;
+    quic_connection_state_t state;
+    uint32_t stream_id;
+    uint32_t offset;
+    int has_addr;
+    struct sockaddr_in addr;
+    size_t len;
+    uint8_t data[];
+} quic_callback_t;
+
+static quic_callback_t *quic_callback_new(quic_callback_kind_t kind,
+                                          uint64_t connection_id,
+                                          void *user_data,
+                                          const uint8_t *data,
+                                          size_t len,
+                                          const struct sockaddr_in *addr) {
+    quic_callback_t *cb = malloc(sizeof(*cb) + len);
+    if (!cb) {
+        return NULL;
+    }
+    memset(cb, 0, sizeof(*cb));
+    cb->kind = kind;
+    cb->user_data = user_data;
+    cb->connection_id = connection_id;
+    if (addr) {
+        cb->has_addr = 1;
+        cb->addr = *addr;
+    }
+    if (len > 0) {
+        memcpy(cb->data, data, len);
+    }
+    cb->len = len;
+    return cb;
+}
+
+static void quic_callback_run(void *arg) {
+    quic_callback_t *cb = (quic_callback_t *)arg;
+    const struct sockaddr_in *addr = cb->has_addr ? &cb->addr : NULL;
+    switch (cb->kind) {
+    case QUIC_CALLBACK_PACKET:
+        cb->packet.payload = cb->len > 0 ? cb->data : NULL;
+        cb->handler.packet(&cb->packet, addr, cb->user_data);
+        break;
+    case QUIC_CALLBACK_STATE:
+        cb->handler.state(cb->connection_id, cb->state, addr, cb->user_data);
+        break;
+    case QUIC_CALLBACK_STREAM_DATA:
+        cb->handler.stream(cb->connection_id, cb->stream_id, cb->offset, cb->data, cb->len, cb->user_data);
+        break;
+    case QUIC_CALLBACK_EARLY_DATA:
+        cb->handler.early(cb->connection_id, cb->data, cb->len, addr, cb->user_data);
+        break;
+    case QUIC_CALLBACK_DATAGRAM:
+        cb->handler.datagram(cb->connection_id, cb->data, cb->len, cb->user_data);
+        break;
+    }
+    free(cb);
+}
+
+/* Queues onto the connection's worker; a pool that is shutting down runs it here instead. */
+static void quic_engine_dispatch_callback(quic_dispatch_t *dispatch, quic_callback_t *cb) {
+    if (quic_dispatch_submit(dispatch, cb->connection_id, quic_callback_run, cb) != 0) {
+        quic_callback_run(cb);
+    }
+}
+
+static void quic_engine_record_inline_callback(quic_engine_t *engine, uint64_t start_us) {
+    uint64_t run_us = quic_now_us() - start_us;
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.callbacks_completed++;
+    engine->metrics.callback_run_us_total += run_us;
+    if (run_us > engine->metrics.callback_run_us_max) {
+        engine->metrics.callback_run_us_max = run_us;
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+
+static void quic_engine_emit_packet(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr) {
+    quic_packet_handler handler = NULL;
+    void *user_data = NULL;
+    quic_dispatch_t *dispatch = NULL;
+    pthread_mutex_lock(&engine->lock);
+    handler = engine->handler;
+    user_data = engine->user_data;
+    dispatch = engine->dispatch;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (!handler) {
+        return;
+    }
+    quic_callback_t *cb = dispatch ? quic_callback_new(QUIC_CALLBACK_PACKET,
+                                                       packet->connection_id,
+                                                       user_data,
+                                                       packet->payload,
+                                                       packet->length,
+                                                       addr)
+                                   : NULL;
+    if (cb) {
+        cb->handler.packet = handler;
+        cb->packet = *packet;
+        quic_engine_dispatch_callback(dispatch, cb);
+        return;
+    }
+    uint64_t start_us = quic_now_us();
+    handler(packet, addr, user_data);
+    quic_engine_record_inline_callback(engine, start_us);
 }
 
 static void quic_engine_emit_state(quic_engine_t *engine,
@@ -617,14 +1870,26 @@ static void quic_engine_emit_state(quic_engine_t *engine,
                                    const struct sockaddr_in *addr) {
     quic_state_handler handler = NULL;
     void *user_data = NULL;
+    quic_dispatch_t *dispatch = NULL;
     pthread_mutex_lock(&engine->lock);
     handler = engine->state_handler;
     user_data = engine->state_user_data;
+    dispatch = engine->dispatch;
     pthread_mutex_unlock(&engine->lock);
 
-    if (handler) {
-        handler(connection_id, state, addr, user_data);
+    if (!handler) {
+        return;
+    }
+    quic_callback_t *cb = dispatch ? quic_callback_new(QUIC_CALLBACK_STATE, connection_id, user_data, NULL, 0, addr) : NULL;
+    if (cb) {
+        cb->handler.state = handler;
+        cb->state = state;
+        quic_engine_dispatch_callback(dispatch, cb);
+        return;
     }
+    uint64_t start_us = quic_now_us();
+    handler(connection_id, state, addr, user_data);
+    quic_engine_record_inline_callback(engine, start_us);
 }
 
 static void quic_engine_emit_stream_data(quic_engine_t *engine,
@@ -635,55 +1900,370 @@ static void quic_engine_emit_stream_data(quic_engine_t *engine,
                                          size_t len) {
     quic_stream_data_handler handler = NULL;
     void *user_data = NULL;
+    quic_dispatch_t *dispatch = NULL;
     pthread_mutex_lock(&engine->lock);
     handler = engine->stream_handler;
     user_data = engine->stream_user_data;
+    dispatch = engine->dispatch;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (!handler) {
+        return;
+    }
+    quic_callback_t *cb =
+        dispatch ? quic_callback_new(QUIC_CALLBACK_STREAM_DATA, connection_id, user_data, data, len, NULL) : NULL;
+    if (cb) {
+        cb->handler.stream = handler;
+        cb->stream_id = stream_id;
+        cb->offset = offset;
+        quic_engine_dispatch_callback(dispatch, cb);
+        return;
+    }
+    uint64_t start_us = quic_now_us();
+    handler(connection_id, stream_id, offset, data, len, user_data);
+    quic_engine_record_inline_callback(engine, start_us);
+}
+
+static void quic_engine_emit_early_data(quic_engine_t *engine,
+                                        uint64_t connection_id,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        const struct sockaddr_in *addr) {
+    quic_early_data_handler handler = NULL;
+    void *user_data = NULL;
+    quic_dispatch_t *dispatch = NULL;
+    pthread_mutex_lock(&engine->lock);
+    handler = engine->early_data_handler;
+    user_data = engine->early_data_user_data;
+    dispatch = engine->dispatch;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (!handler) {
+        return;
+    }
+    quic_callback_t *cb =
+        dispatch ? quic_callback_new(QUIC_CALLBACK_EARLY_DATA, connection_id, user_data, data, len, addr) : NULL;
+    if (cb) {
+        cb->handler.early = handler;
+        quic_engine_dispatch_callback(dispatch, cb);
+        return;
+    }
+    uint64_t start_us = quic_now_us();
+    handler(connection_id, data, len, addr, user_data);
+    quic_engine_record_inline_callback(engine, start_us);
+}
+
+static void quic_engine_emit_datagram(quic_engine_t *engine, uint64_t connection_id, const uint8_t *data, size_t len) {
+    quic_datagram_handler handler = NULL;
+    void *user_data = NULL;
+    quic_dispatch_t *dispatch = NULL;
+    pthread_mutex_lock(&engine->lock);
+    handler = engine->datagram_handler;
+    user_data = engine->datagram_user_data;
+    dispatch = engine->dispatch;
+    pthread_mutex_unlock(&engine->lock);
+
+    if (!handler) {
+        return;
+    }
+    quic_callback_t *cb =
+        dispatch ? quic_callback_new(QUIC_CALLBACK_DATAGRAM, connection_id, user_data, data, len, NULL) : NULL;
+    if (cb) {
+        cb->handler.datagram = handler;
+        quic_engine_dispatch_callback(dispatch, cb);
+        return;
+    }
+    uint64_t start_us = quic_now_us();
+    handler(connection_id, data, len, user_data);
+    quic_engine_record_inline_callback(engine, start_us);
+}
+
+static int quic_engine_ensure_fec(quic_engine_t *engine, quic_connection_entry_t *entry) {
+    if (entry->fec) {
+        return 0;
+    }
+    quic_fec_decoder_t *dec = quic_fec_decoder_create();
+    if (!dec) {
+        return -1;
+    }
+    pthread_mutex_lock(&engine->lock);
+    entry->fec = dec;
+    pthread_mutex_unlock(&engine->lock);
+    return 0;
+}
+
+/* A rebuilt DATA packet goes through reassembly like a received one and is
+ * acknowledged, so the sender drops it from its retransmission queue. */
+static void quic_engine_on_fec_recovered(void *user_data,
+                                         uint32_t stream_id,
+                                         uint32_t packet_number,
+                                         uint32_t offset,
+                                         const uint8_t *data,
+                                         uint32_t len) {
+    quic_fec_recover_ctx_t *rctx = (quic_fec_recover_ctx_t *)user_data;
+    quic_engine_t *engine = rctx->engine;
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.fec_recovered++;
+    pthread_mutex_unlock(&engine->lock);
+
+    uint8_t assembled[QUIC_MAX_PAYLOAD];
+    size_t assembled_len = 0;
+    uint32_t out_offset = 0;
+    if (quic_stream_on_data(&rctx->entry->stream_mgr,
+                            stream_id,
+                            offset,
+                            data,
+                            len,
+                            assembled,
+                            sizeof(assembled),
+                            &out_offset,
+                            &assembled_len) == 0 &&
+        assembled_len > 0) {
+        quic_engine_emit_stream_data(engine, rctx->connection_id, stream_id, out_offset, assembled, assembled_len);
+        quic_engine_deliver_stream(engine, rctx->entry, rctx->connection_id, stream_id, assembled, sizeof(assembled));
+    }
+    quic_packet_t ack = {
+        .flags = QUIC_FLAG_ACK,
+        .connection_id = rctx->connection_id,
+        .packet_number = packet_number,
+        .stream_id = stream_id,
+        .offset = offset,
+        .length = 0,
+        .payload = NULL,
+    };
+    quic_engine_send_ack(engine, &ack, rctx->addr);
+}
+
+static uint64_t quic_engine_ack_datagram_locked(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number) {
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (!entry) {
+        return 0;
+    }
+    for (int i = 0; i < QUIC_MAX_DATAGRAMS_IN_FLIGHT; ++i) {
+        quic_datagram_sent_t *sent = &entry->datagrams[i];
+        if (sent->in_use && sent->packet_number == packet_number) {
+            uint64_t now_us = quic_now_us();
+            quic_cc_on_acked(&entry->cc, sent->len, sent->sent_us, now_us - sent->sent_us);
+            quic_rate_on_acked(&entry->rate, &sent->rate, sent->len, now_us, entry->cc.min_rtt_us);
+            sent->in_use = 0;
+            engine->metrics.datagrams_acked++;
+            if (!entry->datagrams_acked_any || packet_number > entry->largest_acked_datagram) {
+                entry->largest_acked_datagram = packet_number;
+                entry->datagrams_acked_any = 1;
+            }
+            quic_engine_detect_datagram_loss_locked(engine, entry, now_us);
+            return sent->sent_us;
+        }
+    }
+    return 0;
+}
+
+static void quic_engine_on_ack_ecn_locked(quic_engine_t *engine, uint64_t connection_id, const uint8_t *counts, uint64_t sent_us) {
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (!entry) {
+        return;
+    }
+    uint32_t values[3];
+    memcpy(values, counts, sizeof(values));
+    quic_ecn_counts_t reported = {ntohl(values[0]), ntohl(values[1]), ntohl(values[2])};
+    /* Counts are cumulative; a reordered ACK reports less and says nothing new. */
+    if (reported.ect0 > entry->ecn_reported.ect0) {
+        entry->ecn_reported.ect0 = reported.ect0;
+    }
+    if (reported.ect1 > entry->ecn_reported.ect1) {
+        entry->ecn_reported.ect1 = reported.ect1;
+    }
+    if (reported.ce <= entry->ecn_reported.ce) {
+        return;
+    }
+    engine->metrics.ecn_ce_reported += reported.ce - entry->ecn_reported.ce;
+    entry->ecn_reported.ce = reported.ce;
+    uint64_t now_us = quic_now_us();
+    /* A duplicate ACK has no send time; treat the mark as news. */
+    if (quic_cc_on_ecn_ce(&entry->cc, sent_us ? sent_us : now_us, now_us)) {
+        engine->metrics.ecn_congestion_events++;
+    }
+}
+
+static void quic_engine_report_rate_locked(quic_engine_t *engine, uint64_t connection_id) {
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (!entry || entry->state != QUIC_CONN_STATE_CONNECTED) {
+        return;
+    }
+    uint64_t now_us = quic_now_us();
+    if (entry->rate_reported_us != 0 && now_us - entry->rate_reported_us < QUIC_RATE_REPORT_INTERVAL_US) {
+        return;
+    }
+    uint64_t bps = quic_rate_bandwidth_bps(&entry->rate, now_us);
+    if (bps == 0) {
+        return;
+    }
+    entry->rate_reported_us = now_us;
+
+    uint8_t payload[QUIC_RATE_REPORT_SIZE];
+    uint64_t bps_be = host_to_be64(bps);
+    uint32_t min_rtt_be = htonl(entry->cc.min_rtt_us > UINT32_MAX ? UINT32_MAX : (uint32_t)entry->cc.min_rtt_us);
+    uint32_t srtt_be = htonl(entry->cc.srtt_us > UINT32_MAX ? UINT32_MAX : (uint32_t)entry->cc.srtt_us);
+    memcpy(payload, &bps_be, sizeof(bps_be));
+    memcpy(payload + 8, &min_rtt_be, sizeof(min_rtt_be));
+    memcpy(payload + 12, &srtt_be, sizeof(srtt_be));
+    quic_packet_t report = {
+        .flags = QUIC_FLAG_RATE,
+        .connection_id = connection_id,
+        .packet_number = 0,
+        .stream_id = 0,
+        .offset = 0,
+        .length = sizeof(payload),
+        .payload = payload,
+    };
+    uint8_t buffer[QUIC_HEADER_SIZE + QUIC_RATE_REPORT_SIZE + QUIC_CRYPTO_OVERHEAD];
+    size_t len = 0;
+    if (quic_packet_serialize(&report, buffer, sizeof(buffer), &len) != 0 ||
+        quic_engine_seal_locked(engine, buffer, len, sizeof(buffer), &len) != 0) {
+        return;
+    }
+    ssize_t sent = sendto(engine->sockfd, buffer, len, 0, (const struct sockaddr *)&entry->addr, sizeof(entry->addr));
+    if (sent == (ssize_t)len) {
+        engine->metrics.packets_sent++;
+        engine->metrics.rate_reports_sent++;
+    }
+}
+
+static int quic_engine_send_ack(quic_engine_t *engine, quic_packet_t *ack, const struct sockaddr_in *addr) {
+    uint32_t counts[3];
+    pthread_mutex_lock(&engine->lock);
+    const quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, ack->connection_id);
+    /* Peers that never saw a marked packet get the plain ACK, as before ECN. */
+    if (entry && (entry->ecn_received.ect0 || entry->ecn_received.ect1 || entry->ecn_received.ce)) {
+        counts[0] = htonl(entry->ecn_received.ect0);
+        counts[1] = htonl(entry->ecn_received.ect1);
+        counts[2] = htonl(entry->ecn_received.ce);
+        ack->length = QUIC_ACK_ECN_SIZE;
+        ack->payload = (const uint8_t *)counts;
+    }
     pthread_mutex_unlock(&engine->lock);
+    return quic_engine_send(engine, ack, addr);
+}
 
-    if (handler) {
-        handler(connection_id, stream_id, offset, data, len, user_data);
+static void quic_engine_detect_datagram_loss_locked(quic_engine_t *engine, quic_connection_entry_t *entry, uint64_t now_us) {
+    uint64_t threshold = QUIC_DATAGRAM_MAX_LOSS_US;
+    if (entry->cc.srtt_us > 0) {
+        threshold = entry->cc.srtt_us + 4 * entry->cc.rttvar_us;
+        if (threshold < QUIC_DATAGRAM_MIN_LOSS_US) {
+            threshold = QUIC_DATAGRAM_MIN_LOSS_US;
+        } else if (threshold > QUIC_DATAGRAM_MAX_LOSS_US) {
+            threshold = QUIC_DATAGRAM_MAX_LOSS_US;
+        }
+    }
+    for (int i = 0; i < QUIC_MAX_DATAGRAMS_IN_FLIGHT; ++i) {
+        quic_datagram_sent_t *sent = &entry->datagrams[i];
+        if (!sent->in_use) {
+            continue;
+        }
+        int reordered = entry->datagrams_acked_any &&
+                        sent->packet_number + QUIC_DATAGRAM_REORDER_THRESHOLD <= entry->largest_acked_datagram;
+        if (reordered || (now_us > sent->sent_us && now_us - sent->sent_us > threshold)) {
+            quic_cc_on_lost(&entry->cc, sent->len, sent->sent_us, now_us);
+            sent->in_use = 0;
+            engine->metrics.datagrams_lost++;
+        }
+    }
+}
+
+static void quic_engine_deliver_stream(quic_engine_t *engine,
+                                       quic_connection_entry_t *entry,
+                                       uint64_t connection_id,
+                                       uint32_t stream_id,
+                                       uint8_t *scratch,
+                                       size_t scratch_len) {
+    for (;;) {
+        uint32_t out_offset = 0;
+        size_t out_len = 0;
+        if (quic_stream_drain(&entry->stream_mgr, stream_id, scratch, scratch_len, &out_offset, &out_len) != 0 ||
+            out_len == 0) {
+            return;
+        }
+        quic_engine_emit_stream_data(engine, connection_id, stream_id, out_offset, scratch, out_len);
     }
 }
 
 static void quic_engine_track_pending(quic_engine_t *engine,
                                       const quic_packet_t *packet,
                                       const uint8_t *buffer,
-                                      size_t len) {
+                                      size_t len,
+                                      const quic_send_limit_t *limit) {
     if (!engine || !packet || !buffer || len == 0) {
         return;
     }
-    if (!(packet->flags & QUIC_FLAG_DATA)) {
+    pthread_mutex_lock(&engine->lock);
+    quic_engine_track_pending_locked(engine, packet, buffer, len, limit);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+static void quic_engine_track_pending_locked(quic_engine_t *engine,
+                                             const quic_packet_t *packet,
+                                             const uint8_t *buffer,
+                                             size_t len,
+                                             const quic_send_limit_t *limit) {
+    if (!(packet->flags & QUIC_FLAG_DATA) || (packet->flags & QUIC_FLAG_DATAGRAM)) {
         return;
     }
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, packet->connection_id);
     for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
         if (!engine->pending[i].in_use) {
             engine->pending[i].in_use = 1;
+            engine->pending[i].flags = QUIC_FLAG_DATA;
             engine->pending[i].connection_id = packet->connection_id;
             engine->pending[i].packet_number = packet->packet_number;
+            engine->pending[i].stream_id = packet->stream_id;
+            engine->pending[i].stream_offset = packet->offset;
+            engine->pending[i].payload_len = packet->length;
+            engine->pending[i].deadline_us = limit ? limit->deadline_us : 0;
+            engine->pending[i].expire_offset = limit ? limit->expire_offset : 0;
+            engine->pending[i].expired = 0;
+            engine->pending[i].cancelled = 0;
             engine->pending[i].len = len;
             if (len > sizeof(engine->pending[i].buffer)) {
                 engine->pending[i].len = sizeof(engine->pending[i].buffer);
             }
             memcpy(engine->pending[i].buffer, buffer, engine->pending[i].len);
             engine->pending[i].last_sent = time(NULL);
+            engine->pending[i].sent_us = quic_now_us();
             engine->pending[i].retries = 0;
-            return;
+            /* Stream data is not gated by cwnd (the pending table bounds it) but it
+             * occupies the window, so datagrams back off while streams are busy. */
+            if (entry) {
+                quic_rate_on_sent(&entry->rate, entry->cc.bytes_in_flight, engine->pending[i].sent_us, &engine->pending[i].rate);
+                quic_cc_on_sent(&entry->cc, engine->pending[i].len);
+            }
+            break;
         }
     }
 }
 
-static void quic_engine_ack_pending(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number) {
+static uint64_t quic_engine_ack_pending(quic_engine_t *engine, uint64_t connection_id, uint32_t packet_number, uint8_t ack_flags) {
     if (!engine) {
-        return;
+        return 0;
     }
+    uint8_t kind = (ack_flags & QUIC_FLAG_SKIP) ? QUIC_FLAG_SKIP : QUIC_FLAG_DATA;
     for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
         if (engine->pending[i].in_use &&
+            engine->pending[i].flags == kind &&
             engine->pending[i].connection_id == connection_id &&
             engine->pending[i].packet_number == packet_number) {
             engine->pending[i].in_use = 0;
-            return;
+            quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+            if (entry && kind == QUIC_FLAG_DATA) {
+                /* Karn: an ACK after a retransmission cannot tell which copy arrived. */
+                uint64_t now_us = quic_now_us();
+                uint64_t rtt_us = engine->pending[i].retries == 0 ? now_us - engine->pending[i].sent_us : 0;
+                quic_cc_on_acked(&entry->cc, engine->pending[i].len, engine->pending[i].sent_us, rtt_us);
+                quic_rate_on_acked(&entry->rate, &engine->pending[i].rate, engine->pending[i].len, now_us, entry->cc.min_rtt_us);
+            }
+            return engine->pending[i].sent_us;
         }
     }
+    return 0;
 }
 
 static void quic_engine_retransmit_pending(quic_engine_t *engine) {
@@ -698,18 +2278,32 @@ static void quic_engine_retransmit_pending(quic_engine_t *engine) {
         if ((now - engine->pending[i].last_sent) < QUIC_RETRANS_TIMEOUT) {
             continue;
         }
-        struct sockaddr_in addr;
-        int found = 0;
-        for (int j = 0; j < QUIC_MAX_CONNECTIONS; ++j) {
-            if (engine->connections[j].in_use &&
-                engine->connections[j].connection_id == engine->pending[i].connection_id) {
-                addr = engine->connections[j].addr;
-                found = 1;
-                break;
-            }
+        quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, engine->pending[i].connection_id);
+        if (!entry) {
+            engine->pending[i].in_use = 0;
+            continue;
+        }
+        struct sockaddr_in addr = entry->addr;
+        uint64_t now_us = quic_now_us();
+        int is_data = engine->pending[i].flags == QUIC_FLAG_DATA;
+        if (is_data) {
+            quic_cc_on_lost(&entry->cc, engine->pending[i].len, engine->pending[i].sent_us, now_us);
         }
-        if (!found) {
+        if (is_data && (engine->pending[i].expired || engine->pending[i].cancelled ||
+                        (engine->pending[i].deadline_us != 0 && now_us >= engine->pending[i].deadline_us))) {
             engine->pending[i].in_use = 0;
+            if (engine->pending[i].cancelled) {
+                engine->metrics.packets_cancelled++;
+                engine->metrics.bytes_cancelled += engine->pending[i].payload_len;
+            } else {
+                engine->metrics.packets_expired++;
+                engine->metrics.bytes_expired += engine->pending[i].payload_len;
+            }
+            quic_engine_send_skip_locked(engine,
+                                         entry,
+                                         engine->pending[i].stream_id,
+                                         engine->pending[i].stream_offset,
+                                         engine->pending[i].payload_len);
             continue;
         }
 
@@ -721,10 +2315,14 @@ static void quic_engine_retransmit_pending(quic_engine_t *engine) {
                               sizeof(addr));
         if (sent == (ssize_t)engine->pending[i].len) {
             engine->pending[i].last_sent = now;
+            engine->pending[i].sent_us = now_us;
             engine->pending[i].retries++;
             engine->metrics.packets_sent++;
             if (engine->pending[i].retries >= QUIC_MAX_RETRIES) {
                 engine->pending[i].in_use = 0;
+            } else if (is_data) {
+                quic_rate_on_sent(&entry->rate, entry->cc.bytes_in_flight, now_us, &engine->pending[i].rate);
+                quic_cc_on_sent(&entry->cc, engine->pending[i].len);
             }
         } else {
             engine->pending[i].in_use = 0;
@@ -732,6 +2330,54 @@ static void quic_engine_retransmit_pending(quic_engine_t *engine) {
     }
 }
 
+static void quic_engine_send_skip_locked(quic_engine_t *engine,
+                                         quic_connection_entry_t *entry,
+                                         uint32_t stream_id,
+                                         uint32_t offset,
+                                         uint32_t length) {
+    uint32_t gap_be = htonl(length);
+    quic_packet_t skip = {
+        .flags = QUIC_FLAG_SKIP,
+        .connection_id = entry->connection_id,
+        .packet_number = entry->next_skip_pn++,
+        .stream_id = stream_id,
+        .offset = offset,
+        .length = QUIC_SKIP_PAYLOAD_SIZE,
+        .payload = (const uint8_t *)&gap_be,
+    };
+    uint8_t buffer[QUIC_HEADER_SIZE + QUIC_SKIP_PAYLOAD_SIZE + QUIC_CRYPTO_OVERHEAD];
+    size_t len = 0;
+    if (quic_packet_serialize(&skip, buffer, sizeof(buffer), &len) != 0 ||
+        quic_engine_seal_locked(engine, buffer, len, sizeof(buffer), &len) != 0) {
+        return;
+    }
+    ssize_t sent = sendto(engine->sockfd, buffer, len, 0, (const struct sockaddr *)&entry->addr, sizeof(entry->addr));
+    if (sent != (ssize_t)len) {
+        return;
+    }
+    engine->metrics.packets_sent++;
+    engine->metrics.skips_sent++;
+
+    /* The receiver stalls on the gap until it hears about it, so the skip itself is reliable. */
+    for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
+        quic_pending_entry_t *p = &engine->pending[i];
+        if (!p->in_use) {
+            memset(p, 0, offsetof(quic_pending_entry_t, buffer));
+            p->in_use = 1;
+            p->flags = QUIC_FLAG_SKIP;
+            p->connection_id = entry->connection_id;
+            p->packet_number = skip.packet_number;
+            p->stream_id = stream_id;
+            p->stream_offset = offset;
+            p->len = len;
+            memcpy(p->buffer, buffer, len);
+            p->last_sent = time(NULL);
+            p->sent_us = quic_now_us();
+            return;
+        }
+    }
+}
+
 static void quic_engine_clear_pending_for_connection(quic_engine_t *engine, uint64_t connection_id) {
     if (!engine) {
         return;
@@ -742,3 +2388,229 @@ static void quic_engine_clear_pending_for_connection(quic_engine_t *engine, uint
         }
     }
 }
+
+int quic_engine_set_protection(quic_engine_t *engine, quic_aead_t aead, const uint8_t *psk, size_t psk_len) {
+    if (!engine || (!psk && psk_len > 0)) {
+        return -1;
+    }
+    if (aead != QUIC_AEAD_NONE && !quic_crypto_available()) {
+        return -1;
+    }
+    pthread_mutex_lock(&engine->lock);
+    if (psk_len > sizeof(engine->protection_psk)) {
+        pthread_mutex_unlock(&engine->lock);
+        return -1;
+    }
+    engine->protection = aead;
+    if (psk_len > 0) {
+        memcpy(engine->protection_psk, psk, psk_len);
+    }
+    engine->protection_psk_len = psk_len;
+    /* Force every slot to re-derive under the new settings. */
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        if (engine->connections[i].crypto) {
+            engine->connections[i].crypto->aead = QUIC_AEAD_NONE;
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return 0;
+}
+
+static int quic_engine_keys_locked(quic_engine_t *engine,
+                                   uint64_t connection_id,
+                                   quic_crypto_direction_t direction,
+                                   quic_crypto_ctx_t *ctx) {
+    quic_crypto_keys_t keys;
+    const uint8_t *psk = engine->protection_psk_len > 0 ? engine->protection_psk : NULL;
+    int rc = -1;
+    if (quic_crypto_derive_keys(engine->protection, connection_id, direction, psk, engine->protection_psk_len, &keys) == 0) {
+        rc = quic_crypto_ctx_init(ctx, &keys, direction == QUIC_CRYPTO_SERVER);
+    }
+    memset(&keys, 0, sizeof(keys));
+    return rc;
+}
+
+static quic_connection_crypto_t *quic_engine_crypto_locked(quic_engine_t *engine, uint64_t connection_id) {
+    quic_connection_entry_t *entry = quic_engine_find_entry_locked(engine, connection_id);
+    if (!entry) {
+        return NULL;
+    }
+    if (!entry->crypto) {
+        entry->crypto = calloc(1, sizeof(*entry->crypto));
+        if (!entry->crypto) {
+            return NULL;
+        }
+    }
+    quic_connection_crypto_t *crypto = entry->crypto;
+    if (crypto->aead == engine->protection && crypto->connection_id == connection_id) {
+        return crypto;
+    }
+    quic_crypto_ctx_free(&crypto->tx);
+    quic_crypto_ctx_free(&crypto->rx);
+    crypto->aead = QUIC_AEAD_NONE;
+    if (quic_engine_keys_locked(engine, connection_id, QUIC_CRYPTO_SERVER, &crypto->tx) != 0 ||
+        quic_engine_keys_locked(engine, connection_id, QUIC_CRYPTO_CLIENT, &crypto->rx) != 0) {
+        quic_crypto_ctx_free(&crypto->tx);
+        quic_crypto_ctx_free(&crypto->rx);
+        return NULL;
+    }
+    crypto->aead = engine->protection;
+    crypto->connection_id = connection_id;
+    return crypto;
+}
+
+static uint64_t quic_engine_peek_connection_id(const uint8_t *buffer) {
+    uint64_t conn_be;
+    memcpy(&conn_be, buffer + 1, sizeof(conn_be));
+    return be64_to_host(conn_be);
+}
+
+static int quic_engine_seal_locked(quic_engine_t *engine, uint8_t *buffer, size_t len, size_t cap, size_t *out_len) {
+    if (engine->protection == QUIC_AEAD_NONE) {
+        *out_len = len;
+        return 0;
+    }
+    if (len < QUIC_HEADER_SIZE || cap < len + QUIC_CRYPTO_OVERHEAD) {
+        return -1;
+    }
+    uint64_t connection_id = quic_engine_peek_connection_id(buffer);
+    quic_connection_crypto_t *crypto = quic_engine_crypto_locked(engine, connection_id);
+    if (crypto) {
+        return quic_crypto_seal(&crypto->tx, buffer, len - QUIC_HEADER_SIZE, engine->tx_seq++, out_len);
+    }
+    /* No connection (yet or any more): the CLOSE after teardown, or a reply to an unknown peer. */
+    quic_crypto_ctx_t ctx;
+    if (quic_engine_keys_locked(engine, connection_id, QUIC_CRYPTO_SERVER, &ctx) != 0) {
+        return -1;
+    }
+    int rc = quic_crypto_seal(&ctx, buffer, len - QUIC_HEADER_SIZE, engine->tx_seq++, out_len);
+    quic_crypto_ctx_free(&ctx);
+    return rc;
+}
+
+static int quic_engine_open_locked(quic_engine_t *engine, uint8_t *buffer, size_t len, size_t *out_len) {
+    if (len < QUIC_HEADER_SIZE) {
+        return -1;
+    }
+    /* Keys always come from the id the connection was opened with. */
+    uint64_t connection_id = quic_engine_canonical_id_locked(engine, quic_engine_peek_connection_id(buffer));
+    quic_connection_crypto_t *crypto = quic_engine_crypto_locked(engine, connection_id);
+    if (crypto) {
+        return quic_crypto_open(&crypto->rx, buffer, len, out_len);
+    }
+    quic_crypto_ctx_t ctx;
+    if (quic_engine_keys_locked(engine, connection_id, QUIC_CRYPTO_CLIENT, &ctx) != 0) {
+        return -1;
+    }
+    int rc = quic_crypto_open(&ctx, buffer, len, out_len);
+    quic_crypto_ctx_free(&ctx);
+    return rc;
+}
+
+int quic_send_batch_init(quic_send_batch_t *batch) {
+    if (!batch) {
+        return -1;
+    }
+    memset(batch, 0, sizeof(*batch));
+    batch->buffers = malloc((size_t)QUIC_SEND_BATCH_MAX * QUIC_MAX_PACKET_SIZE);
+    return batch->buffers ? 0 : -1;
+}
+
+void quic_send_batch_destroy(quic_send_batch_t *batch) {
+    if (!batch) {
+        return;
+    }
+    free(batch->buffers);
+    memset(batch, 0, sizeof(*batch));
+}
+
+int quic_engine_batch_add(quic_engine_t *engine, quic_send_batch_t *batch, const quic_packet_t *packet, const quic_send_limit_t *limit) {
+    if (!engine || !batch || !batch->buffers || !packet) {
+        return -1;
+    }
+    if (batch->count > 0 && (batch->count == QUIC_SEND_BATCH_MAX || batch->connection_id != packet->connection_id)) {
+        if (quic_engine_batch_flush(engine, batch) != 0) {
+            return -1;
+        }
+    }
+    size_t i = batch->count;
+    uint8_t *buffer = batch->buffers + i * QUIC_MAX_PACKET_SIZE;
+    if (quic_packet_serialize(packet, buffer, QUIC_MAX_PACKET_SIZE, &batch->lens[i]) != 0) {
+        return -1;
+    }
+    batch->packets[i] = *packet;
+    batch->packets[i].payload = NULL;
+    if (limit) {
+        batch->limits[i] = *limit;
+    } else {
+        memset(&batch->limits[i], 0, sizeof(batch->limits[i]));
+    }
+    batch->connection_id = packet->connection_id;
+    batch->count++;
+    return 0;
+}
+
+int quic_engine_batch_flush(quic_engine_t *engine, quic_send_batch_t *batch) {
+    if (!engine || !batch) {
+        return -1;
+    }
+    size_t count = batch->count;
+    if (count == 0) {
+        return 0;
+    }
+    batch->count = 0;
+
+    struct sockaddr_in addr;
+    if (quic_engine_get_connection(engine, batch->connection_id, &addr) != 0) {
+        return -1;
+    }
+
+    /* Seal the whole batch under one lock acquisition, then one syscall. */
+    struct mmsghdr msgs[QUIC_SEND_BATCH_MAX];
+    struct iovec iov[QUIC_SEND_BATCH_MAX];
+    memset(msgs, 0, sizeof(msgs));
+    pthread_mutex_lock(&engine->lock);
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t *buffer = batch->buffers + i * QUIC_MAX_PACKET_SIZE;
+        if (quic_engine_seal_locked(engine, buffer, batch->lens[i], QUIC_MAX_PACKET_SIZE, &batch->lens[i]) != 0) {
+            pthread_mutex_unlock(&engine->lock);
+            return -1;
+        }
+        iov[i].iov_base = buffer;
+        iov[i].iov_len = batch->lens[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addr;
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr);
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    size_t sent = 0;
+    uint64_t calls = 0;
+    while (sent < count) {
+        int rc = sendmmsg(engine->sockfd, msgs + sent, (unsigned int)(count - sent), 0);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        calls++;
+        sent += (size_t)rc;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+    engine->metrics.packets_sent += sent;
+    engine->metrics.send_batches += calls;
+    for (size_t i = 0; i < sent; ++i) {
+        const quic_send_limit_t *limit = &batch->limits[i];
+        int limited = limit->deadline_us != 0 || limit->expire_offset != 0;
+        quic_engine_track_pending_locked(engine,
+                                         &batch->packets[i],
+                                         batch->buffers + i * QUIC_MAX_PACKET_SIZE,
+                                         batch->lens[i],
+                                         limited ? limit : NULL);
+    }
+    pthread_mutex_unlock(&engine->lock);
+    return sent == count ? 0 : -1;
+}
@@ -7,6 +7,15 @@
 #include <stdint.h>
 #include <time.h>
 
+#include "server/quic_capture.h"
+#include "server/quic_cc.h"
+#include "server/quic_crypto.h"
+#include "server/quic_dispatch.h"
+#include "server/quic_fec.h"
+#include "server/quic_latency.h"
+#include "server/quic_lb.h"
+#include "server/quic_rate.h"
+#include "server/quic_retry.h"
 #include "server/quic_stream.h"
 
 #ifdef __cplusplus
@@ -15,18 +24,116 @@ extern "C" {
 
 #define QUIC_MAX_PAYLOAD        (16 * 1024)
 #define QUIC_HEADER_SIZE        25
-#define QUIC_MAX_PACKET_SIZE    (QUIC_HEADER_SIZE + QUIC_MAX_PAYLOAD)
+/* Room for the AEAD tag and sequence number when packet protection is on. */
+#define QUIC_MAX_PACKET_SIZE    (QUIC_HEADER_SIZE + QUIC_MAX_PAYLOAD + QUIC_CRYPTO_OVERHEAD)
 #define QUIC_MAX_CONNECTIONS    32
 #define QUIC_CONNECTION_TIMEOUT 30
 #define QUIC_MAX_PENDING        64
 #define QUIC_RETRANS_TIMEOUT    1
 #define QUIC_MAX_RETRIES        3
+#define QUIC_MAX_DATAGRAMS_IN_FLIGHT 32
+#define QUIC_SEND_BATCH_MAX     32 /* packets per sendmmsg flush */
+/* Datagram loss: 3 packets behind the largest ACK, or unacknowledged for
+ * srtt + 4*rttvar clamped to [MIN, MAX] (MAX alone before the first RTT sample). */
+#define QUIC_DATAGRAM_REORDER_THRESHOLD 3
+#define QUIC_DATAGRAM_MIN_LOSS_US       25000
+#define QUIC_DATAGRAM_MAX_LOSS_US       500000
 
 #define QUIC_FLAG_INITIAL   0x01
 #define QUIC_FLAG_HANDSHAKE 0x02
 #define QUIC_FLAG_DATA      0x04
 #define QUIC_FLAG_ACK       0x08
 #define QUIC_FLAG_CLOSE     0x10
+/* Unreliable datagram (RFC 9221 style): never retransmitted or reassembled.
+ * Together with QUIC_FLAG_ACK it acknowledges the datagram packet number. */
+#define QUIC_FLAG_DATAGRAM  0x20
+/* Sender abandoned stream data: offset = gap start, 4-byte payload = gap length (BE).
+ * Retransmitted like DATA; acknowledged with ACK|SKIP in its own packet number space. */
+#define QUIC_FLAG_SKIP      0x40
+#define QUIC_SKIP_PAYLOAD_SIZE 4
+/* With QUIC_FLAG_DATA: source packet of an FEC group, handled like DATA but also
+ * remembered by the receiver's decoder. Alone: repair symbol (quic_fec.h format),
+ * never acknowledged or retransmitted. */
+#define QUIC_FLAG_REPAIR    0x80
+
+/* Resumption: once a connection is CONNECTED the server sends a HANDSHAKE
+ * packet without ACK whose payload is a ticket (QUIC_TICKET_SIZE bytes) plus
+ * its lifetime in seconds (4 bytes BE). An INITIAL on a new connection id whose
+ * payload starts with an unused ticket issued to the same IP skips the
+ * handshake: the connection is CONNECTED at once and the rest of the payload is
+ * handed to the early data handler. The HANDSHAKE|ACK reply carries offset =
+ * QUIC_RESUME_ACCEPTED in that case. Tickets are single use, which also stops
+ * replayed early data. */
+#define QUIC_TICKET_SIZE        16
+#define QUIC_TICKET_PAYLOAD     (QUIC_TICKET_SIZE + 4)
+#define QUIC_MAX_TICKETS        64
+#define QUIC_TICKET_LIFETIME    600
+#define QUIC_RESUME_ACCEPTED    1
+
+/* Stateless retry: server -> client only, payload is a QUIC_RETRY_TOKEN_SIZE
+ * token. Sent instead of a connection slot while at least retry_threshold
+ * slots are taken and the INITIAL proves nothing about its source address.
+ * The client repeats its INITIAL with offset = QUIC_RETRY_TOKEN_SIZE and the
+ * token in front of the payload (any ticket and early data follow it). */
+#define QUIC_FLAG_RETRY         (QUIC_FLAG_INITIAL | QUIC_FLAG_ACK)
+#define QUIC_RETRY_DEFAULT_THRESHOLD (QUIC_MAX_CONNECTIONS * 3 / 4)
+
+/* Path validation (RFC 9000 §8.2): a PATH_CHALLENGE carries
+ * QUIC_PATH_CHALLENGE_SIZE unguessable bytes that the peer echoes in a
+ * PATH_RESPONSE from the address under test. Either side may challenge.
+ * When a connection shows up from a new IP the server keeps sending to the
+ * old address until the new one answers; a new port on the same IP is taken
+ * as NAT rebinding and used at once. One address is probed at a time, and
+ * packets from other new addresses are ignored until that probe succeeds or
+ * gives up. */
+#define QUIC_FLAG_PATH_CHALLENGE (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_DATAGRAM)
+#define QUIC_FLAG_PATH_RESPONSE  (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_DATAGRAM | QUIC_FLAG_ACK)
+#define QUIC_PATH_CHALLENGE_SIZE 8
+#define QUIC_PATH_PROBE_ATTEMPTS 3
+#define QUIC_PATH_PROBE_TIMEOUT_US 1000000
+
+/* ECN (RFC 9000 §13.4): every datagram leaves with ECT(0) and the TOS byte of
+ * each received one is read back. An ACK may carry QUIC_ACK_ECN_SIZE bytes of
+ * payload: the cumulative ECT(0), ECT(1) and CE counts (u32 BE each) the sender
+ * of the ACK has received on the connection. A rise in the CE count is handled
+ * like a loss by the congestion controller, without anything being resent.
+ * QUIC_ECN=off leaves the socket unmarked. */
+#define QUIC_ECN_NOT_ECT 0x00
+#define QUIC_ECN_ECT1    0x01
+#define QUIC_ECN_ECT0    0x02
+#define QUIC_ECN_CE      0x03
+#define QUIC_ECN_MASK    0x03
+#define QUIC_ACK_ECN_SIZE 12
+#define QUIC_ECN_ENV     "QUIC_ECN"
+
+/* Delivery-rate report: server -> client, at most every
+ * QUIC_RATE_REPORT_INTERVAL_US while ACKs keep producing samples, so a player
+ * can pick a bitrate from what the path actually delivered. Payload
+ * (QUIC_RATE_REPORT_SIZE): u64 bandwidth in bit/s, u32 min RTT and u32
+ * smoothed RTT in microseconds, all BE. Never acknowledged or retransmitted. */
+#define QUIC_FLAG_RATE               (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_SKIP)
+#define QUIC_RATE_REPORT_SIZE        16
+#define QUIC_RATE_REPORT_INTERVAL_US 500000
+
+/* Application callbacks (packet, state, stream data, early data, datagram) run
+ * inline on the receive thread unless QUIC_DISPATCH=WORKERS[:DEPTH] or
+ * quic_engine_set_dispatch hands them to a worker pool. Callbacks of one
+ * connection still run one at a time and in order; different connections run
+ * concurrently, so handlers must be thread-safe in that mode. */
+#define QUIC_DISPATCH_ENV "QUIC_DISPATCH"
+
+/* QUIC_LOW_LATENCY=CPUS[:SPIN_US] (quic_latency.h) pins the receive thread and
+ * dispatch workers, sets SO_BUSY_POLL and spins before each blocking receive.
+ * The embedding process should call quic_latency_exclude_current_thread after
+ * quic_engine_start so its other threads stay off those CPUs. */
+#define QUIC_LOW_LATENCY_ENV "QUIC_LOW_LATENCY"
+
+/* Load balancing: with QUIC_LB_SERVER_ID=1..255 (quic_lb.h) every new connection
+ * also gets a routable id naming this server, sent as the 8-byte BE payload of
+ * HANDSHAKE|ACK. Clients put it in the header of everything they send from then
+ * on, so tools/quic_lb can route by it from any address; the server maps it back
+ * to the id the connection was opened with and keeps sending under that one. */
+#define QUIC_LB_ROUTABLE_ID_SIZE 8
 
 typedef enum {
     QUIC_CONN_STATE_IDLE = 0,
@@ -57,15 +164,106 @@ typedef void (*quic_state_handler)(uint64_t connection_id,
                                    quic_connection_state_t state,
                                    const struct sockaddr_in *addr,
                                    void *user_data);
+typedef void (*quic_datagram_handler)(uint64_t connection_id,
+                                      const uint8_t *data,
+                                      size_t len,
+                                      void *user_data);
+/* Early data from a resumed INITIAL; runs after the HANDSHAKE reply went out,
+ * so DATA sent from it follows the handshake. */
+typedef void (*quic_early_data_handler)(uint64_t connection_id,
+                                        const uint8_t *data,
+                                        size_t len,
+                                        const struct sockaddr_in *addr,
+                                        void *user_data);
 
 typedef struct {
     uint64_t packets_received;
     uint64_t packets_sent;
     uint64_t connections_opened;
     uint64_t connections_closed;
-    uint64_t connections_migrated;
+    uint64_t connections_migrated; /* peer address switched: validated new IP or NAT rebinding */
+    uint64_t nat_rebindings;       /* port-only changes, switched without validation or slow start */
+    uint64_t path_challenges_sent;
+    uint64_t path_validation_failed; /* new IP never answered; the connection stayed on the old path */
+    uint64_t datagrams_sent;
+    uint64_t datagrams_received;
+    uint64_t datagrams_acked;
+    uint64_t datagrams_lost;
+    uint64_t datagrams_dropped; /* refused at send time: congestion window full or too large */
+    uint64_t packets_expired;   /* DATA dropped at retransmit time: deadline passed or played past */
+    uint64_t bytes_expired;     /* payload bytes of those retransmissions, i.e. bandwidth saved */
+    uint64_t packets_cancelled; /* DATA of a cancelled stream skipped at retransmit time */
+    uint64_t bytes_cancelled;   /* payload bytes of those retransmissions, not in bytes_expired */
+    uint64_t skips_sent;
+    uint64_t skips_received;
+    uint64_t fec_repairs_sent;
+    uint64_t fec_repairs_received;
+    uint64_t fec_recovered; /* DATA packets rebuilt from repairs instead of waiting for retransmission */
+    uint64_t packets_rejected_auth; /* failed AEAD verification, dropped before parsing */
+    uint64_t send_batches;          /* sendmmsg calls made by quic_engine_batch_flush */
+    uint64_t tickets_issued;
+    uint64_t resumptions_accepted;
+    uint64_t resumptions_rejected; /* INITIAL carried an unknown, used, expired or foreign ticket */
+    uint64_t early_data_bytes;
+    uint64_t retries_sent;
+    uint64_t initials_rejected; /* bad or expired retry token, or no free connection slot */
+    uint64_t ecn_ce_received;   /* packets that arrived CE-marked */
+    uint64_t ecn_ce_reported;   /* CE marks peers reported in their ACKs */
+    uint64_t ecn_congestion_events; /* window reductions caused by those reports */
+    uint64_t rate_reports_sent;
+    uint64_t callbacks_dispatched;   /* handed to the worker pool */
+    uint64_t callbacks_completed;    /* inline or pooled */
+    uint64_t dispatch_queue_depth;   /* pooled callbacks waiting or running now */
+    uint64_t dispatch_queue_peak;
+    uint64_t dispatch_full_waits;    /* receive thread blocked on a full worker queue */
+    uint64_t callback_wait_us_total; /* queued to started; 0 inline */
+    uint64_t callback_wait_us_max;
+    uint64_t callback_run_us_total;
+    uint64_t callback_run_us_max;
+    uint64_t busy_poll_hits;   /* datagrams picked up while spinning */
+    uint64_t busy_poll_sleeps; /* spins that ran out and fell back to a blocking receive */
 } quic_metrics_t;
 
+typedef struct {
+    uint32_t ect0;
+    uint32_t ect1;
+    uint32_t ce;
+} quic_ecn_counts_t;
+
+/* Partial reliability for one DATA packet. Both limits are only checked when a
+ * retransmission is due, so an expiring packet never costs more than its first send. */
+typedef struct {
+    uint64_t deadline_us;   /* quic_now_us() clock; 0 = no deadline */
+    uint32_t expire_offset; /* useless once playback reaches this stream offset; 0 = never */
+} quic_send_limit_t;
+
+typedef struct {
+    int in_use;
+    uint32_t packet_number;
+    uint32_t len;
+    uint64_t sent_us;
+    quic_rate_packet_t rate;
+} quic_datagram_sent_t;
+
+/* Keyed cipher contexts for one connection slot. Owned by the slot rather than
+ * the connection and only re-keyed when the slot changes hands, so a sender
+ * racing a close never touches freed memory. Guarded by the engine lock. */
+typedef struct {
+    uint64_t connection_id;
+    quic_aead_t aead;
+    quic_crypto_ctx_t tx; /* server -> client */
+    quic_crypto_ctx_t rx; /* client -> server */
+} quic_connection_crypto_t;
+
+/* A new peer IP being validated; nothing but challenges goes there meanwhile. */
+typedef struct {
+    int active;
+    struct sockaddr_in addr;
+    uint8_t data[QUIC_PATH_CHALLENGE_SIZE];
+    uint64_t sent_us;
+    int attempts;
+} quic_path_probe_t;
+
 typedef struct {
     uint64_t connection_id;
     struct sockaddr_in addr;
@@ -73,16 +271,56 @@ typedef struct {
     quic_connection_state_t state;
     int in_use;
     quic_stream_manager_t stream_mgr;
+    quic_cc_t cc;
+    uint32_t next_datagram_pn;
+    uint32_t next_skip_pn;
+    uint32_t largest_acked_datagram; /* valid when datagrams_acked_any */
+    int datagrams_acked_any;
+    quic_datagram_sent_t datagrams[QUIC_MAX_DATAGRAMS_IN_FLIGHT];
+    quic_fec_decoder_t *fec; /* created on the first REPAIR-flagged packet; engine thread only */
+    quic_connection_crypto_t *crypto;
+    quic_path_probe_t probe;
+    quic_ecn_counts_t ecn_received; /* what we echo in our ACKs */
+    quic_ecn_counts_t ecn_reported; /* highest counts the peer echoed back */
+    quic_rate_t rate;
+    uint64_t rate_reported_us; /* last QUIC_FLAG_RATE report; 0 = none yet */
+    uint64_t routable_id;      /* alias carrying lb_server_id; 0 when not load balanced */
 } quic_connection_entry_t;
 
+typedef struct {
+    uint64_t bandwidth_bps; /* windowed max delivery rate; 0 until the first sample */
+    uint64_t latest_bps;    /* most recent sample */
+    uint64_t samples;
+    uint64_t delivered_bytes;
+    uint64_t min_rtt_us;
+    uint64_t srtt_us;
+} quic_delivery_rate_t;
+
 typedef struct {
     int in_use;
+    uint8_t id[QUIC_TICKET_SIZE];
+    struct in_addr addr; /* port may change across sessions (NAT), the IP may not */
+    time_t expires;
+} quic_ticket_t;
+
+typedef struct {
+    int in_use;
+    uint8_t flags; /* QUIC_FLAG_DATA or QUIC_FLAG_SKIP */
     uint64_t connection_id;
     uint32_t packet_number;
+    uint32_t stream_id;
+    uint32_t stream_offset;
+    uint32_t payload_len;
+    uint64_t deadline_us;
+    uint32_t expire_offset;
+    int expired;   /* playback moved past expire_offset */
+    int cancelled; /* quic_engine_cancel_stream: skipped like expired, counted apart */
     size_t len;
     uint8_t buffer[QUIC_MAX_PACKET_SIZE];
     time_t last_sent;
+    uint64_t sent_us;
     int retries;
+    quic_rate_packet_t rate; /* DATA only */
 } quic_pending_entry_t;
 
 typedef struct quic_engine {
@@ -91,18 +329,49 @@ typedef struct quic_engine {
     pthread_t thread;
     pthread_mutex_t lock;
     int running;
+    int thread_started; /* from quic_engine_start until quic_engine_join */
     quic_packet_handler handler;
     void *user_data;
     quic_stream_data_handler stream_handler;
     void *stream_user_data;
     quic_state_handler state_handler;
     void *state_user_data;
+    quic_datagram_handler datagram_handler;
+    void *datagram_user_data;
+    quic_early_data_handler early_data_handler;
+    void *early_data_user_data;
     uint32_t recv_timeout_sec;
     quic_metrics_t metrics;
+    quic_capture_writer_t *capture; /* set when QUIC_CAPTURE_PATH is defined; engine thread only */
+    quic_fec_mode_t fec_mode;       /* sender-side default, from QUIC_FEC or quic_engine_set_fec */
+    unsigned fec_k;
+    unsigned fec_m;
+    quic_aead_t protection;         /* QUIC_AEAD_NONE sends cleartext */
+    uint64_t tx_seq;                /* AEAD sequence shared by every connection; seeded from the wall clock */
+    uint8_t protection_psk[64];
+    size_t protection_psk_len;
+    unsigned retry_threshold; /* occupied slots; 0 retries every new INITIAL */
+    uint8_t retry_key[QUIC_RETRY_KEY_SIZE];
+    int ecn; /* outgoing datagrams are ECT(0) and received TOS bytes are read */
+    quic_dispatch_t *dispatch; /* NULL runs callbacks inline */
+    quic_latency_config_t latency; /* set by quic_engine_init, read without the lock */
+    uint8_t lb_server_id;      /* 0 = no routable ids issued */
     quic_connection_entry_t connections[QUIC_MAX_CONNECTIONS];
     quic_pending_entry_t pending[QUIC_MAX_PENDING];
+    quic_ticket_t tickets[QUIC_MAX_TICKETS];
 } quic_engine_t;
 
+/* Packets for one connection serialized (and sealed) together and handed to the
+ * kernel with a single sendmmsg. Payloads are copied on add. */
+typedef struct {
+    uint64_t connection_id;
+    size_t count;
+    size_t lens[QUIC_SEND_BATCH_MAX];
+    quic_packet_t packets[QUIC_SEND_BATCH_MAX]; /* header fields only, for retransmission tracking */
+    quic_send_limit_t limits[QUIC_SEND_BATCH_MAX];
+    uint8_t *buffers; /* QUIC_SEND_BATCH_MAX * QUIC_MAX_PACKET_SIZE */
+} quic_send_batch_t;
+
 int quic_packet_serialize(const quic_packet_t *packet, uint8_t *buffer, size_t buffer_len, size_t *out_len);
 int quic_packet_deserialize(quic_packet_t *packet, const uint8_t *buffer, size_t buffer_len);
 
@@ -113,6 +382,16 @@ void quic_engine_join(quic_engine_t *engine);
 void quic_engine_destroy(quic_engine_t *engine);
 int quic_engine_send(const quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *addr);
 int quic_engine_send_to_connection(quic_engine_t *engine, const quic_packet_t *packet);
+int quic_engine_send_to_connection_limited(quic_engine_t *engine, const quic_packet_t *packet, const quic_send_limit_t *limit);
+/* Receiver's playhead on a stream; unacknowledged DATA with expire_offset at or
+ * below it is skipped instead of retransmitted. */
+int quic_engine_update_playback(quic_engine_t *engine, uint64_t connection_id, uint32_t stream_id, uint32_t playback_offset);
+/* Seek or stop: unacknowledged DATA on the stream is skipped instead of
+ * retransmitted. unacked_out (optional) gets its payload bytes; most of it is
+ * on the wire and will just be acknowledged, so what is actually saved shows
+ * up later in packets_cancelled/bytes_cancelled. */
+int quic_engine_cancel_stream(quic_engine_t *engine, uint64_t connection_id, uint32_t stream_id, uint64_t *unacked_out);
+uint64_t quic_now_us(void);
 int quic_engine_get_connection(quic_engine_t *engine, uint64_t connection_id, struct sockaddr_in *addr_out);
 int quic_engine_close_connection(quic_engine_t *engine, uint64_t connection_id);
 int quic_engine_get_connection_state(const quic_engine_t *engine, uint64_t connection_id, quic_connection_state_t *out_state);
@@ -120,6 +399,51 @@ void quic_engine_set_state_handler(quic_engine_t *engine, quic_state_handler han
 void quic_engine_set_recv_timeout(quic_engine_t *engine, uint32_t seconds);
 void quic_engine_set_stream_data_handler(quic_engine_t *engine, quic_stream_data_handler handler, void *user_data);
 void quic_engine_get_metrics(const quic_engine_t *engine, quic_metrics_t *out_metrics);
+void quic_engine_set_datagram_handler(quic_engine_t *engine, quic_datagram_handler handler, void *user_data);
+void quic_engine_set_early_data_handler(quic_engine_t *engine, quic_early_data_handler handler, void *user_data);
+/* workers = 0 goes back to inline callbacks; queue_depth = 0 uses the default.
+ * Call before quic_engine_start or after quic_engine_join (-1 in between): a
+ * pool being replaced is drained first. */
+int quic_engine_set_dispatch(quic_engine_t *engine, unsigned workers, size_t queue_depth);
+/* Values above QUIC_MAX_CONNECTIONS turn stateless retry off. */
+void quic_engine_set_retry_threshold(quic_engine_t *engine, unsigned occupied_slots);
+/* Server id embedded in routable ids of connections opened from now on; 0 stops issuing them. */
+void quic_engine_set_lb_server_id(quic_engine_t *engine, uint8_t server_id);
+/* Sends one unreliable datagram on a connected connection. Fails (and counts
+ * datagrams_dropped) when the congestion window has no room rather than queueing. */
+int quic_engine_send_datagram(quic_engine_t *engine, uint64_t connection_id, const uint8_t *data, size_t len);
+int quic_engine_get_congestion(quic_engine_t *engine, uint64_t connection_id, quic_cc_t *out_cc);
+int quic_engine_get_delivery_rate(quic_engine_t *engine, uint64_t connection_id, quic_delivery_rate_t *out_rate);
+/* FEC parameters senders should use; QUIC_FEC_NONE disables. Receiving needs no setup. */
+int quic_engine_set_fec(quic_engine_t *engine, quic_fec_mode_t mode, unsigned k, unsigned m);
+void quic_engine_get_fec(const quic_engine_t *engine, quic_fec_mode_t *mode, unsigned *k, unsigned *m);
+/* Finishes the encoder's current group, sends its repair packets and resets it.
+ * Returns the number of repairs sent. */
+int quic_engine_send_fec_repairs(quic_engine_t *engine, uint64_t connection_id, quic_fec_encoder_t *enc);
+/* Switches AEAD packet protection on every packet in both directions; fails
+ * when built without ENABLE_TLS. A NULL psk uses the RFC 9001 Initial salt. */
+int quic_engine_set_protection(quic_engine_t *engine, quic_aead_t aead, const uint8_t *psk, size_t psk_len);
+int quic_send_batch_init(quic_send_batch_t *batch);
+void quic_send_batch_destroy(quic_send_batch_t *batch);
+/* Queues a packet; flushes first when the batch is full or for another connection. */
+int quic_engine_batch_add(quic_engine_t *engine, quic_send_batch_t *batch, const quic_packet_t *packet, const quic_send_limit_t *limit);
+/* Seals and sends everything queued; -1 if the connection is gone or the kernel refused part of it. */
+int quic_engine_batch_flush(quic_engine_t *engine, quic_send_batch_t *batch);
+/* Receive path for one datagram; the engine thread calls this after recvmsg and
+ * offline tools (capture replay) may call it directly on a stopped engine. */
+int quic_engine_process_datagram(quic_engine_t *engine,
+                                 const uint8_t *buffer,
+                                 size_t len,
+                                 const struct sockaddr_in *client_addr);
+/* Same, with the ECN codepoint (QUIC_ECN_*) from the datagram's IP header. */
+int quic_engine_process_datagram_ecn(quic_engine_t *engine,
+                                     const uint8_t *buffer,
+                                     size_t len,
+                                     const struct sockaddr_in *client_addr,
+                                     uint8_t ecn);
+/* Periodic work: idle cleanup, retransmission, datagram loss detection and
+ * path probes. The engine thread runs it whenever recvfrom times out. */
+void quic_engine_tick(quic_engine_t *engine);
 
 #ifdef __cplusplus
 }
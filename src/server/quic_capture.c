@@ -0,0 +1,151 @@
+#include "server/quic_capture.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void put_be16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint16_t get_be16(const uint8_t *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+int quic_capture_writer_open(quic_capture_writer_t *writer, const char *path) {
+    if (!writer || !path) {
+        return -1;
+    }
+    memset(writer, 0, sizeof(*writer));
+    writer->fp = fopen(path, "wb");
+    if (!writer->fp) {
+        perror("[quic][capture] fopen");
+        return -1;
+    }
+    uint8_t header[QUIC_CAPTURE_HEADER_SIZE];
+    memcpy(header, QUIC_CAPTURE_MAGIC, 8);
+    put_be16(header + 8, QUIC_CAPTURE_VERSION);
+    put_be16(header + 10, 0);
+    put_be32(header + 12, (uint32_t)time(NULL));
+    if (fwrite(header, 1, sizeof(header), writer->fp) != sizeof(header)) {
+        fclose(writer->fp);
+        writer->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int quic_capture_write(quic_capture_writer_t *writer,
+                       uint64_t now_us,
+                       const struct sockaddr_in *addr,
+                       const uint8_t *data,
+                       size_t len) {
+    if (!writer || !writer->fp || !addr || !data || len > UINT16_MAX) {
+        return -1;
+    }
+    uint64_t delta = writer->records == 0 || now_us < writer->last_us ? 0 : now_us - writer->last_us;
+    if (delta > UINT32_MAX) {
+        delta = UINT32_MAX; /* idle gaps beyond ~71 minutes are clamped */
+    }
+    writer->last_us = now_us;
+
+    uint8_t rec[QUIC_CAPTURE_RECORD_SIZE];
+    put_be32(rec, (uint32_t)delta);
+    memcpy(rec + 4, &addr->sin_addr.s_addr, 4);
+    memcpy(rec + 8, &addr->sin_port, 2);
+    put_be16(rec + 10, (uint16_t)len);
+    if (fwrite(rec, 1, sizeof(rec), writer->fp) != sizeof(rec) || fwrite(data, 1, len, writer->fp) != len) {
+        return -1;
+    }
+    writer->records++;
+    writer->bytes += len;
+    return 0;
+}
+
+void quic_capture_writer_close(quic_capture_writer_t *writer) {
+    if (!writer || !writer->fp) {
+        return;
+    }
+    fclose(writer->fp);
+    writer->fp = NULL;
+}
+
+int quic_capture_reader_open(quic_capture_reader_t *reader, const char *path) {
+    if (!reader || !path) {
+        return -1;
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->fp = fopen(path, "rb");
+    if (!reader->fp) {
+        return -1;
+    }
+    uint8_t header[QUIC_CAPTURE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), reader->fp) != sizeof(header) ||
+        memcmp(header, QUIC_CAPTURE_MAGIC, 8) != 0 ||
+        get_be16(header + 8) != QUIC_CAPTURE_VERSION) {
+        fclose(reader->fp);
+        reader->fp = NULL;
+        return -1;
+    }
+    reader->start_wall_sec = get_be32(header + 12);
+    return 0;
+}
+
+int quic_capture_read(quic_capture_reader_t *reader, quic_capture_record_t *record, uint8_t *buf, size_t buf_size) {
+    if (!reader || !reader->fp || !record || !buf) {
+        return -1;
+    }
+    uint8_t rec[QUIC_CAPTURE_RECORD_SIZE];
+    size_t n = fread(rec, 1, sizeof(rec), reader->fp);
+    if (n == 0 && feof(reader->fp)) {
+        return 0;
+    }
+    if (n != sizeof(rec)) {
+        return -1;
+    }
+    size_t len = get_be16(rec + 10);
+    if (len > buf_size || fread(buf, 1, len, reader->fp) != len) {
+        return -1;
+    }
+    reader->elapsed_us += get_be32(rec);
+    memset(record, 0, sizeof(*record));
+    record->timestamp_us = reader->elapsed_us;
+    record->addr.sin_family = AF_INET;
+    memcpy(&record->addr.sin_addr.s_addr, rec + 4, 4);
+    memcpy(&record->addr.sin_port, rec + 8, 2);
+    record->len = len;
+    return 1;
+}
+
+int quic_capture_rewind(quic_capture_reader_t *reader) {
+    if (!reader || !reader->fp) {
+        return -1;
+    }
+    if (fseek(reader->fp, QUIC_CAPTURE_HEADER_SIZE, SEEK_SET) != 0) {
+        return -1;
+    }
+    clearerr(reader->fp);
+    reader->elapsed_us = 0;
+    return 0;
+}
+
+void quic_capture_reader_close(quic_capture_reader_t *reader) {
+    if (!reader || !reader->fp) {
+        return;
+    }
+    fclose(reader->fp);
+    reader->fp = NULL;
+}
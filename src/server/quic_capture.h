@@ -0,0 +1,59 @@
+#ifndef SERVER_QUIC_CAPTURE_H
+#define SERVER_QUIC_CAPTURE_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Compact datagram capture: a 16-byte file header followed by records of
+ * [u32 delta_us][u32 ipv4][u16 port][u16 len][len bytes], all big-endian
+ * except the address fields which are stored as they appear on the wire. */
+#define QUIC_CAPTURE_MAGIC       "OQUICCAP"
+#define QUIC_CAPTURE_VERSION     1
+#define QUIC_CAPTURE_HEADER_SIZE 16
+#define QUIC_CAPTURE_RECORD_SIZE 12
+#define QUIC_CAPTURE_ENV         "QUIC_CAPTURE_PATH"
+
+typedef struct {
+    FILE *fp;
+    uint64_t last_us;
+    uint64_t records;
+    uint64_t bytes;
+} quic_capture_writer_t;
+
+typedef struct {
+    FILE *fp;
+    uint32_t start_wall_sec;
+    uint64_t elapsed_us; /* running sum of deltas */
+} quic_capture_reader_t;
+
+typedef struct {
+    uint64_t timestamp_us; /* offset from the first record */
+    struct sockaddr_in addr;
+    size_t len;
+} quic_capture_record_t;
+
+int quic_capture_writer_open(quic_capture_writer_t *writer, const char *path);
+int quic_capture_write(quic_capture_writer_t *writer,
+                       uint64_t now_us,
+                       const struct sockaddr_in *addr,
+                       const uint8_t *data,
+                       size_t len);
+void quic_capture_writer_close(quic_capture_writer_t *writer);
+
+int quic_capture_reader_open(quic_capture_reader_t *reader, const char *path);
+/* Returns 1 when a record was read, 0 at end of file, -1 on a corrupt file. */
+int quic_capture_read(quic_capture_reader_t *reader, quic_capture_record_t *record, uint8_t *buf, size_t buf_size);
+int quic_capture_rewind(quic_capture_reader_t *reader);
+void quic_capture_reader_close(quic_capture_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_CAPTURE_H
@@ -0,0 +1,113 @@
+#include "server/quic_cc.h"
+
+#include <string.h>
+
+void quic_cc_init(quic_cc_t *cc) {
+    if (!cc) {
+        return;
+    }
+    memset(cc, 0, sizeof(*cc));
+    cc->cwnd = QUIC_CC_INITIAL_WINDOW;
+    cc->ssthresh = UINT64_MAX;
+}
+
+void quic_cc_reset_path(quic_cc_t *cc) {
+    if (!cc) {
+        return;
+    }
+    uint64_t in_flight = cc->bytes_in_flight;
+    uint64_t events = cc->congestion_events;
+    quic_cc_init(cc);
+    cc->bytes_in_flight = in_flight;
+    cc->congestion_events = events;
+}
+
+int quic_cc_can_send(const quic_cc_t *cc, size_t bytes) {
+    if (!cc) {
+        return 0;
+    }
+    return cc->bytes_in_flight + bytes <= cc->cwnd;
+}
+
+void quic_cc_on_sent(quic_cc_t *cc, size_t bytes) {
+    if (!cc) {
+        return;
+    }
+    cc->bytes_in_flight += bytes;
+}
+
+static void quic_cc_remove_in_flight(quic_cc_t *cc, size_t bytes) {
+    cc->bytes_in_flight = cc->bytes_in_flight > bytes ? cc->bytes_in_flight - bytes : 0;
+}
+
+static void quic_cc_update_rtt(quic_cc_t *cc, uint64_t rtt_us) {
+    if (cc->min_rtt_us == 0 || rtt_us < cc->min_rtt_us) {
+        cc->min_rtt_us = rtt_us;
+    }
+    if (cc->srtt_us == 0) {
+        cc->srtt_us = rtt_us;
+        cc->rttvar_us = rtt_us / 2;
+        return;
+    }
+    uint64_t diff = cc->srtt_us > rtt_us ? cc->srtt_us - rtt_us : rtt_us - cc->srtt_us;
+    cc->rttvar_us = (3 * cc->rttvar_us + diff) / 4;
+    cc->srtt_us = (7 * cc->srtt_us + rtt_us) / 8;
+}
+
+void quic_cc_on_acked(quic_cc_t *cc, size_t bytes, uint64_t sent_us, uint64_t rtt_us) {
+    if (!cc) {
+        return;
+    }
+    quic_cc_remove_in_flight(cc, bytes);
+    if (rtt_us > 0) {
+        quic_cc_update_rtt(cc, rtt_us);
+    }
+    /* No growth for packets sent before the current recovery period started. */
+    if (cc->recovery_start_us != 0 && sent_us <= cc->recovery_start_us) {
+        return;
+    }
+    if (cc->cwnd < cc->ssthresh) {
+        cc->cwnd += bytes;
+    } else {
+        cc->cwnd += (uint64_t)QUIC_CC_MAX_DATAGRAM * bytes / cc->cwnd;
+    }
+    if (cc->cwnd > QUIC_CC_MAX_WINDOW) {
+        cc->cwnd = QUIC_CC_MAX_WINDOW;
+    }
+}
+
+static int quic_cc_congestion_event(quic_cc_t *cc, uint64_t sent_us, uint64_t now_us) {
+    if (cc->recovery_start_us != 0 && sent_us <= cc->recovery_start_us) {
+        return 0;
+    }
+    cc->recovery_start_us = now_us;
+    cc->ssthresh = cc->cwnd / 2;
+    if (cc->ssthresh < QUIC_CC_MIN_WINDOW) {
+        cc->ssthresh = QUIC_CC_MIN_WINDOW;
+    }
+    cc->cwnd = cc->ssthresh;
+    cc->congestion_events++;
+    return 1;
+}
+
+void quic_cc_on_lost(quic_cc_t *cc, size_t bytes, uint64_t sent_us, uint64_t now_us) {
+    if (!cc) {
+        return;
+    }
+    quic_cc_remove_in_flight(cc, bytes);
+    quic_cc_congestion_event(cc, sent_us, now_us);
+}
+
+int quic_cc_on_ecn_ce(quic_cc_t *cc, uint64_t sent_us, uint64_t now_us) {
+    if (!cc) {
+        return 0;
+    }
+    return quic_cc_congestion_event(cc, sent_us, now_us);
+}
+
+void quic_cc_on_discarded(quic_cc_t *cc, size_t bytes) {
+    if (!cc) {
+        return;
+    }
+    quic_cc_remove_in_flight(cc, bytes);
+}
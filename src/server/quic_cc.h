@@ -0,0 +1,50 @@
+#ifndef SERVER_QUIC_CC_H
+#define SERVER_QUIC_CC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* NewReno-style window per connection (RFC 9002 §7), counted in bytes on the wire. */
+#define QUIC_CC_MAX_DATAGRAM   1200
+#define QUIC_CC_INITIAL_WINDOW (10 * QUIC_CC_MAX_DATAGRAM)
+#define QUIC_CC_MIN_WINDOW     (2 * QUIC_CC_MAX_DATAGRAM)
+/* Our DATA packets can carry up to 16KB, so the cap has to leave room for several of them. */
+#define QUIC_CC_MAX_WINDOW     (4 * 1024 * 1024)
+
+typedef struct {
+    uint64_t cwnd;
+    uint64_t ssthresh;
+    uint64_t bytes_in_flight;
+    uint64_t recovery_start_us; /* losses of packets sent before this are one event */
+    uint64_t srtt_us;
+    uint64_t rttvar_us;
+    uint64_t min_rtt_us;
+    uint64_t congestion_events;
+} quic_cc_t;
+
+void quic_cc_init(quic_cc_t *cc);
+/* New network path: forget RTT and window (RFC 9002 §9.4) but keep
+ * bytes_in_flight, which still drains as old-path packets are acked or lost. */
+void quic_cc_reset_path(quic_cc_t *cc);
+/* 1 if `bytes` more may be put in flight without exceeding cwnd. */
+int quic_cc_can_send(const quic_cc_t *cc, size_t bytes);
+void quic_cc_on_sent(quic_cc_t *cc, size_t bytes);
+/* rtt_us is 0 when the sample is ambiguous (e.g. an ACK for a retransmitted packet). */
+void quic_cc_on_acked(quic_cc_t *cc, size_t bytes, uint64_t sent_us, uint64_t rtt_us);
+/* Packet declared lost: leaves flight and, once per recovery period, halves the window. */
+void quic_cc_on_lost(quic_cc_t *cc, size_t bytes, uint64_t sent_us, uint64_t now_us);
+/* ECN-CE reported for a packet sent at sent_us: same window reduction as a
+ * loss, but nothing leaves flight. Returns 1 if the window was reduced. */
+int quic_cc_on_ecn_ce(quic_cc_t *cc, uint64_t sent_us, uint64_t now_us);
+/* Bytes that leave flight without a signal about the path (connection closed, entry evicted). */
+void quic_cc_on_discarded(quic_cc_t *cc, size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_CC_H
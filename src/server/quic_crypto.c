@@ -0,0 +1,373 @@
+#include "server/quic_crypto.h"
+
+#include <string.h>
+
+#ifdef ENABLE_TLS
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#endif
+
+int quic_crypto_parse_aead(const char *name, quic_aead_t *out) {
+    if (!name || !out) {
+        return -1;
+    }
+    if (name[0] == '\0' || strcmp(name, "off") == 0) {
+        *out = QUIC_AEAD_NONE;
+    } else if (strcmp(name, "aes128gcm") == 0 || strcmp(name, "aes-128-gcm") == 0) {
+        *out = QUIC_AEAD_AES_128_GCM;
+    } else if (strcmp(name, "chacha20") == 0 || strcmp(name, "chacha20-poly1305") == 0) {
+        *out = QUIC_AEAD_CHACHA20_POLY1305;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *quic_crypto_aead_name(quic_aead_t aead) {
+    switch (aead) {
+    case QUIC_AEAD_AES_128_GCM:
+        return "aes128gcm";
+    case QUIC_AEAD_CHACHA20_POLY1305:
+        return "chacha20";
+    default:
+        return "off";
+    }
+}
+
+#ifdef ENABLE_TLS
+
+/* RFC 9001 section 5.2, QUIC version 1. */
+static const uint8_t quic_v1_initial_salt[20] = {0x38, 0x76, 0x2c, 0xf7, 0xf5, 0x59, 0x34, 0xb3, 0x4d, 0x17,
+                                                 0x9a, 0xe6, 0xa4, 0xc8, 0x0c, 0xad, 0xcc, 0xbb, 0x7f, 0x0a};
+
+static void put_be64(uint8_t *p, uint64_t v) {
+    for (int i = 7; i >= 0; --i) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static uint64_t get_be64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static uint32_t get_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+int quic_crypto_available(void) {
+    return 1;
+}
+
+static int hkdf(int mode,
+                const uint8_t *salt,
+                size_t salt_len,
+                const uint8_t *key,
+                size_t key_len,
+                const uint8_t *info,
+                size_t info_len,
+                uint8_t *out,
+                size_t out_len) {
+    EVP_KDF *kdf = EVP_KDF_fetch(NULL, "HKDF", NULL);
+    if (!kdf) {
+        return -1;
+    }
+    EVP_KDF_CTX *kctx = EVP_KDF_CTX_new(kdf);
+    EVP_KDF_free(kdf);
+    if (!kctx) {
+        return -1;
+    }
+    OSSL_PARAM params[6];
+    size_t n = 0;
+    params[n++] = OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, (char *)"SHA256", 0);
+    params[n++] = OSSL_PARAM_construct_int(OSSL_KDF_PARAM_MODE, &mode);
+    params[n++] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, (void *)key, key_len);
+    if (salt) {
+        params[n++] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, (void *)salt, salt_len);
+    }
+    if (info) {
+        params[n++] = OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, (void *)info, info_len);
+    }
+    params[n] = OSSL_PARAM_construct_end();
+    int rc = EVP_KDF_derive(kctx, out, out_len, params) > 0 ? 0 : -1;
+    EVP_KDF_CTX_free(kctx);
+    return rc;
+}
+
+/* TLS 1.3 HKDF-Expand-Label with an empty context. */
+static int expand_label(const uint8_t *secret, const char *label, uint8_t *out, size_t out_len) {
+    uint8_t info[64];
+    size_t label_len = strlen(label);
+    if (label_len + 10 > sizeof(info)) {
+        return -1;
+    }
+    size_t n = 0;
+    info[n++] = (uint8_t)(out_len >> 8);
+    info[n++] = (uint8_t)out_len;
+    info[n++] = (uint8_t)(6 + label_len);
+    memcpy(info + n, "tls13 ", 6);
+    n += 6;
+    memcpy(info + n, label, label_len);
+    n += label_len;
+    info[n++] = 0;
+    return hkdf(EVP_KDF_HKDF_MODE_EXPAND_ONLY, NULL, 0, secret, 32, info, n, out, out_len);
+}
+
+int quic_crypto_initial_secret(uint64_t connection_id, const uint8_t *psk, size_t psk_len, uint8_t out[32]) {
+    if (!out || (!psk && psk_len > 0)) {
+        return -1;
+    }
+    uint8_t cid[8];
+    put_be64(cid, connection_id);
+    if (!psk || psk_len == 0) {
+        psk = quic_v1_initial_salt;
+        psk_len = sizeof(quic_v1_initial_salt);
+    }
+    return hkdf(EVP_KDF_HKDF_MODE_EXTRACT_ONLY, psk, psk_len, cid, sizeof(cid), NULL, 0, out, 32);
+}
+
+int quic_crypto_derive_keys(quic_aead_t aead,
+                            uint64_t connection_id,
+                            quic_crypto_direction_t direction,
+                            const uint8_t *psk,
+                            size_t psk_len,
+                            quic_crypto_keys_t *out) {
+    if (!out || (aead != QUIC_AEAD_AES_128_GCM && aead != QUIC_AEAD_CHACHA20_POLY1305)) {
+        return -1;
+    }
+    uint8_t initial[32];
+    uint8_t secret[32];
+    if (quic_crypto_initial_secret(connection_id, psk, psk_len, initial) != 0 ||
+        expand_label(initial, direction == QUIC_CRYPTO_CLIENT ? "client in" : "server in", secret, sizeof(secret)) != 0) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->aead = aead;
+    out->key_len = aead == QUIC_AEAD_AES_128_GCM ? 16 : 32;
+    out->hp_len = out->key_len;
+    if (expand_label(secret, "quic key", out->key, out->key_len) != 0 ||
+        expand_label(secret, "quic iv", out->iv, sizeof(out->iv)) != 0 ||
+        expand_label(secret, "quic hp", out->hp, out->hp_len) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int quic_crypto_ctx_init(quic_crypto_ctx_t *ctx, const quic_crypto_keys_t *keys, int encrypt) {
+    if (!ctx || !keys) {
+        return -1;
+    }
+    memset(ctx, 0, sizeof(*ctx));
+    const EVP_CIPHER *aead_cipher = NULL;
+    const EVP_CIPHER *hp_cipher = NULL;
+    if (keys->aead == QUIC_AEAD_AES_128_GCM) {
+        aead_cipher = EVP_aes_128_gcm();
+        hp_cipher = EVP_aes_128_ecb();
+    } else if (keys->aead == QUIC_AEAD_CHACHA20_POLY1305) {
+        aead_cipher = EVP_chacha20_poly1305();
+        hp_cipher = EVP_chacha20();
+    } else {
+        return -1;
+    }
+    EVP_CIPHER_CTX *aead_ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX *hp_ctx = EVP_CIPHER_CTX_new();
+    int ok = aead_ctx && hp_ctx;
+    if (ok) {
+        ok = encrypt ? EVP_EncryptInit_ex(aead_ctx, aead_cipher, NULL, keys->key, NULL) == 1
+                     : EVP_DecryptInit_ex(aead_ctx, aead_cipher, NULL, keys->key, NULL) == 1;
+    }
+    /* Header protection always runs the cipher forward to produce the mask. */
+    ok = ok && EVP_EncryptInit_ex(hp_ctx, hp_cipher, NULL, keys->hp, NULL) == 1;
+    if (ok && keys->aead == QUIC_AEAD_AES_128_GCM) {
+        ok = EVP_CIPHER_CTX_set_padding(hp_ctx, 0) == 1;
+    }
+    if (!ok) {
+        EVP_CIPHER_CTX_free(aead_ctx);
+        EVP_CIPHER_CTX_free(hp_ctx);
+        return -1;
+    }
+    ctx->aead = keys->aead;
+    memcpy(ctx->iv, keys->iv, sizeof(ctx->iv));
+    ctx->aead_ctx = aead_ctx;
+    ctx->hp_ctx = hp_ctx;
+    ctx->encrypt = encrypt;
+    return 0;
+}
+
+void quic_crypto_ctx_free(quic_crypto_ctx_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+    EVP_CIPHER_CTX_free((EVP_CIPHER_CTX *)ctx->aead_ctx);
+    EVP_CIPHER_CTX_free((EVP_CIPHER_CTX *)ctx->hp_ctx);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+static int header_mask(quic_crypto_ctx_t *ctx, const uint8_t *sample, uint8_t mask[QUIC_CRYPTO_SAMPLE_SIZE]) {
+    EVP_CIPHER_CTX *hp = (EVP_CIPHER_CTX *)ctx->hp_ctx;
+    int outl = 0;
+    if (ctx->aead == QUIC_AEAD_AES_128_GCM) {
+        return EVP_EncryptUpdate(hp, mask, &outl, sample, QUIC_CRYPTO_SAMPLE_SIZE) == 1 ? 0 : -1;
+    }
+    /* ChaCha20: the sample is the 4-byte counter plus 12-byte nonce, exactly OpenSSL's 16-byte IV. */
+    static const uint8_t zeros[QUIC_CRYPTO_SAMPLE_SIZE];
+    if (EVP_EncryptInit_ex(hp, NULL, NULL, NULL, sample) != 1) {
+        return -1;
+    }
+    return EVP_EncryptUpdate(hp, mask, &outl, zeros, QUIC_CRYPTO_SAMPLE_SIZE) == 1 ? 0 : -1;
+}
+
+static void make_nonce(const quic_crypto_ctx_t *ctx, uint64_t seq, uint8_t nonce[12]) {
+    memcpy(nonce, ctx->iv, 12);
+    for (int i = 0; i < 8; ++i) {
+        nonce[11 - i] ^= (uint8_t)(seq >> (8 * i));
+    }
+}
+
+int quic_crypto_seal(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t payload_len, uint64_t seq, size_t *out_len) {
+    if (!ctx || !ctx->aead_ctx || !ctx->encrypt || !packet || payload_len > INT32_MAX) {
+        return -1;
+    }
+    EVP_CIPHER_CTX *c = (EVP_CIPHER_CTX *)ctx->aead_ctx;
+    uint8_t *payload = packet + QUIC_CRYPTO_HEADER_SIZE;
+    uint8_t *tag = payload + payload_len;
+    uint8_t *seq_bytes = tag + QUIC_CRYPTO_TAG_SIZE;
+    uint8_t nonce[12];
+    int outl = 0;
+    put_be64(seq_bytes, seq);
+    make_nonce(ctx, seq, nonce);
+    if (EVP_EncryptInit_ex(c, NULL, NULL, NULL, nonce) != 1 ||
+        EVP_EncryptUpdate(c, NULL, &outl, packet, QUIC_CRYPTO_HEADER_SIZE) != 1 ||
+        EVP_EncryptUpdate(c, NULL, &outl, seq_bytes, QUIC_CRYPTO_SEQ_SIZE) != 1) {
+        return -1;
+    }
+    if (payload_len > 0 && EVP_EncryptUpdate(c, payload, &outl, payload, (int)payload_len) != 1) {
+        return -1;
+    }
+    if (EVP_EncryptFinal_ex(c, payload + payload_len, &outl) != 1 ||
+        EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_AEAD_GET_TAG, QUIC_CRYPTO_TAG_SIZE, tag) != 1) {
+        return -1;
+    }
+
+    uint8_t mask[QUIC_CRYPTO_SAMPLE_SIZE];
+    if (header_mask(ctx, payload, mask) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < QUIC_CRYPTO_HP_LEN; ++i) {
+        packet[QUIC_CRYPTO_HP_OFFSET + i] ^= mask[i];
+    }
+    if (out_len) {
+        *out_len = QUIC_CRYPTO_HEADER_SIZE + payload_len + QUIC_CRYPTO_OVERHEAD;
+    }
+    return 0;
+}
+
+int quic_crypto_open(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t len, size_t *out_len) {
+    if (!ctx || !ctx->aead_ctx || ctx->encrypt || !packet || len < QUIC_CRYPTO_HEADER_SIZE + QUIC_CRYPTO_OVERHEAD) {
+        return -1;
+    }
+    size_t payload_len = get_be32(packet + 21);
+    if (payload_len > len - QUIC_CRYPTO_HEADER_SIZE - QUIC_CRYPTO_OVERHEAD) {
+        return -1;
+    }
+    uint8_t *payload = packet + QUIC_CRYPTO_HEADER_SIZE;
+    uint8_t *tag = payload + payload_len;
+    const uint8_t *seq_bytes = tag + QUIC_CRYPTO_TAG_SIZE;
+
+    uint8_t mask[QUIC_CRYPTO_SAMPLE_SIZE];
+    if (header_mask(ctx, payload, mask) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < QUIC_CRYPTO_HP_LEN; ++i) {
+        packet[QUIC_CRYPTO_HP_OFFSET + i] ^= mask[i];
+    }
+
+    EVP_CIPHER_CTX *c = (EVP_CIPHER_CTX *)ctx->aead_ctx;
+    uint8_t nonce[12];
+    int outl = 0;
+    make_nonce(ctx, get_be64(seq_bytes), nonce);
+    if (EVP_DecryptInit_ex(c, NULL, NULL, NULL, nonce) != 1 ||
+        EVP_DecryptUpdate(c, NULL, &outl, packet, QUIC_CRYPTO_HEADER_SIZE) != 1 ||
+        EVP_DecryptUpdate(c, NULL, &outl, seq_bytes, QUIC_CRYPTO_SEQ_SIZE) != 1) {
+        return -1;
+    }
+    if (payload_len > 0 && EVP_DecryptUpdate(c, payload, &outl, payload, (int)payload_len) != 1) {
+        return -1;
+    }
+    if (EVP_CIPHER_CTX_ctrl(c, EVP_CTRL_AEAD_SET_TAG, QUIC_CRYPTO_TAG_SIZE, tag) != 1 ||
+        EVP_DecryptFinal_ex(c, payload + payload_len, &outl) != 1) {
+        return -1;
+    }
+    if (out_len) {
+        *out_len = QUIC_CRYPTO_HEADER_SIZE + payload_len;
+    }
+    return 0;
+}
+
+#else /* !ENABLE_TLS */
+
+int quic_crypto_available(void) {
+    return 0;
+}
+
+int quic_crypto_initial_secret(uint64_t connection_id, const uint8_t *psk, size_t psk_len, uint8_t out[32]) {
+    (void)connection_id;
+    (void)psk;
+    (void)psk_len;
+    (void)out;
+    return -1;
+}
+
+int quic_crypto_derive_keys(quic_aead_t aead,
+                            uint64_t connection_id,
+                            quic_crypto_direction_t direction,
+                            const uint8_t *psk,
+                            size_t psk_len,
+                            quic_crypto_keys_t *out) {
+    (void)aead;
+    (void)connection_id;
+    (void)direction;
+    (void)psk;
+    (void)psk_len;
+    (void)out;
+    return -1;
+}
+
+int quic_crypto_ctx_init(quic_crypto_ctx_t *ctx, const quic_crypto_keys_t *keys, int encrypt) {
+    (void)keys;
+    (void)encrypt;
+    if (ctx) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+    return -1;
+}
+
+void quic_crypto_ctx_free(quic_crypto_ctx_t *ctx) {
+    if (ctx) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+}
+
+int quic_crypto_seal(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t payload_len, uint64_t seq, size_t *out_len) {
+    (void)ctx;
+    (void)packet;
+    (void)payload_len;
+    (void)seq;
+    (void)out_len;
+    return -1;
+}
+
+int quic_crypto_open(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t len, size_t *out_len) {
+    (void)ctx;
+    (void)packet;
+    (void)len;
+    (void)out_len;
+    return -1;
+}
+
+#endif
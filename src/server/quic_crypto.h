@@ -0,0 +1,93 @@
+#ifndef SERVER_QUIC_CRYPTO_H
+#define SERVER_QUIC_CRYPTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* AEAD packet protection for the 25-byte QUIC header format (RFC 9001 style).
+ *
+ * Protected packet: [header][ciphertext (header.length bytes)][tag 16][seq 8].
+ * The nonce is iv XOR seq and the AAD is the unprotected header plus seq, so
+ * seq has to be unique per key; the engine uses one monotonic counter for all
+ * packets. Header protection masks packet number, stream id and offset with a
+ * mask computed from a 16-byte ciphertext sample; flags, connection id and
+ * length stay in the clear for routing and framing.
+ *
+ * Keys come from HKDF over the connection id (RFC 9001 Initial keys), salted
+ * with an optional pre-shared secret. Without the secret this authenticates
+ * packets but only obfuscates them against anyone who knows the salt.
+ *
+ * Requires ENABLE_TLS (OpenSSL); without it every call fails with -1. */
+#define QUIC_CRYPTO_TAG_SIZE    16
+#define QUIC_CRYPTO_SEQ_SIZE    8
+#define QUIC_CRYPTO_OVERHEAD    (QUIC_CRYPTO_TAG_SIZE + QUIC_CRYPTO_SEQ_SIZE)
+#define QUIC_CRYPTO_SAMPLE_SIZE 16
+#define QUIC_CRYPTO_HP_OFFSET   9  /* packet number, stream id, offset */
+#define QUIC_CRYPTO_HP_LEN      12
+#define QUIC_CRYPTO_HEADER_SIZE 25
+/* "aes128gcm", "chacha20" or "off"; read by quic_engine_init. */
+#define QUIC_PROTECTION_ENV     "QUIC_PROTECTION"
+#define QUIC_PROTECTION_PSK_ENV "QUIC_PROTECTION_PSK"
+
+typedef enum {
+    QUIC_AEAD_NONE = 0,
+    QUIC_AEAD_AES_128_GCM,
+    QUIC_AEAD_CHACHA20_POLY1305
+} quic_aead_t;
+
+typedef enum {
+    QUIC_CRYPTO_CLIENT = 0, /* keys protecting client -> server packets */
+    QUIC_CRYPTO_SERVER
+} quic_crypto_direction_t;
+
+typedef struct {
+    quic_aead_t aead;
+    uint8_t key[32];
+    size_t key_len;
+    uint8_t iv[12];
+    uint8_t hp[32];
+    size_t hp_len;
+} quic_crypto_keys_t;
+
+/* One direction with the cipher contexts keyed once, so sealing a packet only
+ * resets the nonce instead of re-running the AES/ChaCha key schedule. */
+typedef struct {
+    quic_aead_t aead;
+    uint8_t iv[12];
+    void *aead_ctx; /* EVP_CIPHER_CTX */
+    void *hp_ctx;   /* EVP_CIPHER_CTX */
+    int encrypt;
+} quic_crypto_ctx_t;
+
+int quic_crypto_available(void);
+int quic_crypto_parse_aead(const char *name, quic_aead_t *out);
+const char *quic_crypto_aead_name(quic_aead_t aead);
+
+/* HKDF-Extract over the connection id; psk == NULL uses the RFC 9001 v1 salt. */
+int quic_crypto_initial_secret(uint64_t connection_id, const uint8_t *psk, size_t psk_len, uint8_t out[32]);
+int quic_crypto_derive_keys(quic_aead_t aead,
+                            uint64_t connection_id,
+                            quic_crypto_direction_t direction,
+                            const uint8_t *psk,
+                            size_t psk_len,
+                            quic_crypto_keys_t *out);
+
+int quic_crypto_ctx_init(quic_crypto_ctx_t *ctx, const quic_crypto_keys_t *keys, int encrypt);
+void quic_crypto_ctx_free(quic_crypto_ctx_t *ctx);
+
+/* packet holds header + payload_len plaintext bytes and must have room for
+ * QUIC_CRYPTO_OVERHEAD more. Encrypts in place; *out_len is the wire size. */
+int quic_crypto_seal(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t payload_len, uint64_t seq, size_t *out_len);
+/* Verifies and decrypts in place, leaving header + plaintext at the start of
+ * packet. Fails on a short packet or a bad tag. */
+int quic_crypto_open(quic_crypto_ctx_t *ctx, uint8_t *packet, size_t len, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_CRYPTO_H
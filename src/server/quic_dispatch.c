@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+#include "server/quic_dispatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t dispatch_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* Connection ids from clients need not be random, so mix before picking a worker. */
+static unsigned dispatch_worker_index(const quic_dispatch_t *pool, uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned)(key % pool->worker_count);
+}
+
+static void dispatch_record_done(quic_dispatch_t *pool, uint64_t wait_us, uint64_t run_us) {
+    pthread_mutex_lock(&pool->stats_lock);
+    pool->stats.completed++;
+    pool->stats.queue_depth--;
+    pool->stats.wait_us_total += wait_us;
+    pool->stats.run_us_total += run_us;
+    if (wait_us > pool->stats.wait_us_max) {
+        pool->stats.wait_us_max = wait_us;
+    }
+    if (run_us > pool->stats.run_us_max) {
+        pool->stats.run_us_max = run_us;
+    }
+    pthread_mutex_unlock(&pool->stats_lock);
+}
+
+static void *dispatch_worker_main(void *arg) {
+    quic_dispatch_worker_t *worker = (quic_dispatch_worker_t *)arg;
+    quic_dispatch_t *pool = worker->pool;
+    for (;;) {
+        pthread_mutex_lock(&worker->lock);
+        while (worker->count == 0 && !worker->stopping) {
+            pthread_cond_wait(&worker->not_empty, &worker->lock);
+        }
+        if (worker->count == 0) {
+            pthread_mutex_unlock(&worker->lock);
+            break;
+        }
+        quic_dispatch_task_t task = worker->ring[worker->head];
+        worker->head = (worker->head + 1) % pool->queue_depth;
+        worker->count--;
+        pthread_cond_signal(&worker->not_full);
+        pthread_mutex_unlock(&worker->lock);
+
+        uint64_t start_us = dispatch_now_us();
+        task.fn(task.arg);
+        uint64_t end_us = dispatch_now_us();
+        dispatch_record_done(pool, start_us - task.queued_us, end_us - start_us);
+    }
+    return NULL;
+}
+
+quic_dispatch_t *quic_dispatch_create(unsigned workers, size_t queue_depth) {
+    if (workers == 0 || workers > QUIC_DISPATCH_MAX_WORKERS) {
+        return NULL;
+    }
+    quic_dispatch_t *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->queue_depth = queue_depth > 0 ? queue_depth : QUIC_DISPATCH_DEFAULT_DEPTH;
+    pthread_mutex_init(&pool->stats_lock, NULL);
+    for (unsigned i = 0; i < workers; ++i) {
+        quic_dispatch_worker_t *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->ring = calloc(pool->queue_depth, sizeof(*worker->ring));
+        if (!worker->ring) {
+            quic_dispatch_destroy(pool, NULL);
+            return NULL;
+        }
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->not_empty, NULL);
+        pthread_cond_init(&worker->not_full, NULL);
+        if (pthread_create(&worker->thread, NULL, dispatch_worker_main, worker) != 0) {
+            pthread_cond_destroy(&worker->not_full);
+            pthread_cond_destroy(&worker->not_empty);
+            pthread_mutex_destroy(&worker->lock);
+            free(worker->ring);
+            worker->ring = NULL;
+            quic_dispatch_destroy(pool, NULL);
+            return NULL;
+        }
+        pool->worker_count = i + 1;
+    }
+    return pool;
+}
+
+void quic_dispatch_destroy(quic_dispatch_t *pool, quic_dispatch_stats_t *final_stats) {
+    if (!pool) {
+        return;
+    }
+    for (unsigned i = 0; i < pool->worker_count; ++i) {
+        quic_dispatch_worker_t *worker = &pool->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stopping = 1;
+        pthread_cond_broadcast(&worker->not_empty);
+        pthread_cond_broadcast(&worker->not_full);
+        pthread_mutex_unlock(&worker->lock);
+    }
+    for (unsigned i = 0; i < pool->worker_count; ++i) {
+        quic_dispatch_worker_t *worker = &pool->workers[i];
+        pthread_join(worker->thread, NULL);
+        pthread_cond_destroy(&worker->not_full);
+        pthread_cond_destroy(&worker->not_empty);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker->ring);
+    }
+    if (final_stats) {
+        *final_stats = pool->stats;
+    }
+    pthread_mutex_destroy(&pool->stats_lock);
+    free(pool);
+}
+
+int quic_dispatch_submit(quic_dispatch_t *pool, uint64_t key, quic_dispatch_fn fn, void *arg) {
+    if (!pool || !fn) {
+        return -1;
+    }
+    quic_dispatch_worker_t *worker = &pool->workers[dispatch_worker_index(pool, key)];
+    int waited = 0;
+    pthread_mutex_lock(&worker->lock);
+    while (worker->count == pool->queue_depth && !worker->stopping) {
+        waited = 1;
+        pthread_cond_wait(&worker->not_full, &worker->lock);
+    }
+    if (worker->stopping) {
+        pthread_mutex_unlock(&worker->lock);
+        return -1;
+    }
+    size_t tail = (worker->head + worker->count) % pool->queue_depth;
+    worker->ring[tail].fn = fn;
+    worker->ring[tail].arg = arg;
+    worker->ring[tail].queued_us = dispatch_now_us();
+    worker->count++;
+    /* Counted before the worker can see the task, so depth never goes below zero. */
+    pthread_mutex_lock(&pool->stats_lock);
+    pool->stats.submitted++;
+    pool->stats.queue_depth++;
+    if (pool->stats.queue_depth > pool->stats.queue_peak) {
+        pool->stats.queue_peak = pool->stats.queue_depth;
+    }
+    if (waited) {
+        pool->stats.full_waits++;
+    }
+    pthread_mutex_unlock(&pool->stats_lock);
+    pthread_cond_signal(&worker->not_empty);
+    pthread_mutex_unlock(&worker->lock);
+    return 0;
+}
+
+void quic_dispatch_get_stats(quic_dispatch_t *pool, quic_dispatch_stats_t *out_stats) {
+    if (!pool || !out_stats) {
+        return;
+    }
+    pthread_mutex_lock(&pool->stats_lock);
+    *out_stats = pool->stats;
+    pthread_mutex_unlock(&pool->stats_lock);
+}
+
+int quic_dispatch_parse_config(const char *spec, unsigned *workers, size_t *queue_depth) {
+    if (!spec || !workers || !queue_depth) {
+        return -1;
+    }
+    if (spec[0] == '\0' || strcmp(spec, "off") == 0) {
+        *workers = 0;
+        *queue_depth = 0;
+        return 0;
+    }
+    char *end = NULL;
+    unsigned long parsed_workers = strtoul(spec, &end, 10);
+    unsigned long parsed_depth = 0;
+    if (end == spec || parsed_workers > QUIC_DISPATCH_MAX_WORKERS) {
+        return -1;
+    }
+    if (*end == ':') {
+        const char *p = end + 1;
+        parsed_depth = strtoul(p, &end, 10);
+        if (end == p || parsed_depth == 0) {
+            return -1;
+        }
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *workers = (unsigned)parsed_workers;
+    *queue_depth = (size_t)parsed_depth;
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef SERVER_QUIC_DISPATCH_H
+#define SERVER_QUIC_DISPATCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bounded worker pool for application callbacks. Every task carries a key (the
+ * connection id) and all tasks with the same key go to the same worker, so they
+ * run one at a time and in submission order. Each worker has its own ring of
+ * queue_depth slots; submitting to a full ring blocks the caller, which is the
+ * receive thread, instead of dropping data that was already acknowledged. */
+#define QUIC_DISPATCH_MAX_WORKERS    64
+#define QUIC_DISPATCH_DEFAULT_DEPTH  1024
+
+typedef void (*quic_dispatch_fn)(void *arg);
+
+typedef struct {
+    quic_dispatch_fn fn;
+    void *arg;
+    uint64_t queued_us;
+} quic_dispatch_task_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    quic_dispatch_task_t *ring;
+    size_t head;
+    size_t count;
+    int stopping;
+    struct quic_dispatch *pool;
+} quic_dispatch_worker_t;
+
+typedef struct {
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t queue_depth; /* tasks waiting or running right now, all workers */
+    uint64_t queue_peak;
+    uint64_t full_waits;  /* submissions that had to wait for a free slot */
+    uint64_t wait_us_total; /* submit to start */
+    uint64_t wait_us_max;
+    uint64_t run_us_total;
+    uint64_t run_us_max;
+} quic_dispatch_stats_t;
+
+typedef struct quic_dispatch {
+    unsigned worker_count;
+    size_t queue_depth;
+    quic_dispatch_worker_t workers[QUIC_DISPATCH_MAX_WORKERS];
+    pthread_mutex_t stats_lock;
+    quic_dispatch_stats_t stats;
+} quic_dispatch_t;
+
+/* workers in [1, QUIC_DISPATCH_MAX_WORKERS]; queue_depth 0 uses the default. */
+quic_dispatch_t *quic_dispatch_create(unsigned workers, size_t queue_depth);
+/* Runs everything already queued, then stops and frees the pool. final_stats,
+ * when not NULL, receives the counters as they stood after the last task. */
+void quic_dispatch_destroy(quic_dispatch_t *pool, quic_dispatch_stats_t *final_stats);
+/* On success fn owns arg; -1 (pool shutting down) leaves it with the caller. */
+int quic_dispatch_submit(quic_dispatch_t *pool, uint64_t key, quic_dispatch_fn fn, void *arg);
+void quic_dispatch_get_stats(quic_dispatch_t *pool, quic_dispatch_stats_t *out_stats);
+/* "WORKERS" or "WORKERS:DEPTH"; WORKERS 0 means callbacks stay inline. */
+int quic_dispatch_parse_config(const char *spec, unsigned *workers, size_t *queue_depth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_DISPATCH_H
@@ -0,0 +1,733 @@
+#include "server/quic_fec.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUIC_FEC_HAVE_X86 1
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define QUIC_FEC_HAVE_NEON 1
+#endif
+
+/* GF(2^8) with the polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11D), generator 2. */
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+/* Products split by nibble so one 16-entry shuffle does 16/32 multiplies at once. */
+static uint8_t gf_nib_lo[256][16];
+static uint8_t gf_nib_hi[256][16];
+static pthread_once_t gf_once = PTHREAD_ONCE_INIT;
+
+typedef void (*mul_add_fn)(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len);
+static mul_add_fn mul_add_impl;
+static quic_fec_kernel_t active_kernel = QUIC_FEC_KERNEL_SCALAR;
+
+static void mul_add_scalar(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len) {
+    const uint8_t *lo = gf_nib_lo[coef];
+    const uint8_t *hi = gf_nib_hi[coef];
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] ^= (uint8_t)(lo[src[i] & 0x0F] ^ hi[src[i] >> 4]);
+    }
+}
+
+#ifdef QUIC_FEC_HAVE_X86
+__attribute__((target("ssse3"))) static void mul_add_ssse3(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len) {
+    const __m128i tlo = _mm_loadu_si128((const __m128i *)gf_nib_lo[coef]);
+    const __m128i thi = _mm_loadu_si128((const __m128i *)gf_nib_hi[coef]);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_and_si128(s, mask);
+        __m128i hi = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(tlo, lo), _mm_shuffle_epi8(thi, hi));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, p));
+    }
+    mul_add_scalar(dst + i, src + i, coef, len - i);
+}
+
+__attribute__((target("avx2"))) static void mul_add_avx2(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len) {
+    const __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_nib_lo[coef]));
+    const __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_nib_hi[coef]));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_and_si256(s, mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(tlo, lo), _mm256_shuffle_epi8(thi, hi));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, p));
+    }
+    mul_add_scalar(dst + i, src + i, coef, len - i);
+}
+#endif
+
+#ifdef QUIC_FEC_HAVE_NEON
+static void mul_add_neon(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len) {
+    const uint8x16_t tlo = vld1q_u8(gf_nib_lo[coef]);
+    const uint8x16_t thi = vld1q_u8(gf_nib_hi[coef]);
+    const uint8x16_t mask = vdupq_n_u8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t s = vld1q_u8(src + i);
+        uint8x16_t p = veorq_u8(vqtbl1q_u8(tlo, vandq_u8(s, mask)), vqtbl1q_u8(thi, vshrq_n_u8(s, 4)));
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), p));
+    }
+    mul_add_scalar(dst + i, src + i, coef, len - i);
+}
+#endif
+
+static int kernel_supported(quic_fec_kernel_t kernel) {
+    switch (kernel) {
+    case QUIC_FEC_KERNEL_SCALAR:
+        return 1;
+#ifdef QUIC_FEC_HAVE_X86
+    case QUIC_FEC_KERNEL_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case QUIC_FEC_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef QUIC_FEC_HAVE_NEON
+    case QUIC_FEC_KERNEL_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static void install_kernel(quic_fec_kernel_t kernel) {
+    active_kernel = kernel;
+    switch (kernel) {
+#ifdef QUIC_FEC_HAVE_X86
+    case QUIC_FEC_KERNEL_SSSE3:
+        mul_add_impl = mul_add_ssse3;
+        return;
+    case QUIC_FEC_KERNEL_AVX2:
+        mul_add_impl = mul_add_avx2;
+        return;
+#endif
+#ifdef QUIC_FEC_HAVE_NEON
+    case QUIC_FEC_KERNEL_NEON:
+        mul_add_impl = mul_add_neon;
+        return;
+#endif
+    default:
+        active_kernel = QUIC_FEC_KERNEL_SCALAR;
+        mul_add_impl = mul_add_scalar;
+        return;
+    }
+}
+
+static quic_fec_kernel_t best_kernel(void) {
+    const quic_fec_kernel_t order[] = {QUIC_FEC_KERNEL_AVX2, QUIC_FEC_KERNEL_SSSE3, QUIC_FEC_KERNEL_NEON};
+    for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); ++i) {
+        if (kernel_supported(order[i])) {
+            return order[i];
+        }
+    }
+    return QUIC_FEC_KERNEL_SCALAR;
+}
+
+static void gf_init(void) {
+    unsigned x = 1;
+    for (int i = 0; i < 255; ++i) {
+        gf_exp[i] = (uint8_t)x;
+        gf_log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= 0x11D;
+        }
+    }
+    for (int i = 255; i < 512; ++i) {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+    for (int c = 0; c < 256; ++c) {
+        for (int n = 0; n < 16; ++n) {
+            gf_nib_lo[c][n] = quic_fec_gf_mul((uint8_t)c, (uint8_t)n);
+            gf_nib_hi[c][n] = quic_fec_gf_mul((uint8_t)c, (uint8_t)(n << 4));
+        }
+    }
+#ifdef QUIC_FEC_HAVE_X86
+    __builtin_cpu_init();
+#endif
+    install_kernel(best_kernel());
+}
+
+static void gf_ensure_init(void) {
+    pthread_once(&gf_once, gf_init);
+}
+
+int quic_fec_set_kernel(quic_fec_kernel_t kernel) {
+    gf_ensure_init();
+    if (kernel == QUIC_FEC_KERNEL_AUTO) {
+        kernel = best_kernel();
+    }
+    if (!kernel_supported(kernel)) {
+        return -1;
+    }
+    install_kernel(kernel);
+    return 0;
+}
+
+const char *quic_fec_kernel_name(void) {
+    gf_ensure_init();
+    switch (active_kernel) {
+    case QUIC_FEC_KERNEL_SSSE3:
+        return "ssse3";
+    case QUIC_FEC_KERNEL_AVX2:
+        return "avx2";
+    case QUIC_FEC_KERNEL_NEON:
+        return "neon";
+    default:
+        return "scalar";
+    }
+}
+
+uint8_t quic_fec_gf_mul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + gf_log[b]];
+}
+
+uint8_t quic_fec_gf_inv(uint8_t a) {
+    gf_ensure_init();
+    if (a == 0) {
+        return 0;
+    }
+    return gf_exp[255 - gf_log[a]];
+}
+
+void quic_fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len) {
+    if (coef == 0 || len == 0) {
+        return;
+    }
+    gf_ensure_init();
+    if (coef == 1) {
+        for (size_t i = 0; i < len; ++i) {
+            dst[i] ^= src[i];
+        }
+        return;
+    }
+    mul_add_impl(dst, src, coef, len);
+}
+
+/* Cauchy matrix rows x_j = k + j, columns y_i = i: every square submatrix is
+ * invertible, which is what makes any k of k + m symbols sufficient. */
+static uint8_t fec_coef(quic_fec_mode_t mode, unsigned k, unsigned j, unsigned i) {
+    if (mode == QUIC_FEC_XOR) {
+        return 1;
+    }
+    return quic_fec_gf_inv((uint8_t)((k + j) ^ i));
+}
+
+int quic_fec_params_valid(quic_fec_mode_t mode, unsigned k, unsigned m) {
+    if (k == 0 || k > QUIC_FEC_MAX_K || m == 0 || m > QUIC_FEC_MAX_M) {
+        return 0;
+    }
+    if (mode == QUIC_FEC_XOR) {
+        return m == 1;
+    }
+    return mode == QUIC_FEC_REED_SOLOMON;
+}
+
+int quic_fec_parse_config(const char *spec, quic_fec_mode_t *mode, unsigned *k, unsigned *m) {
+    if (!spec || !mode || !k || !m) {
+        return -1;
+    }
+    if (spec[0] == '\0' || strcmp(spec, "off") == 0) {
+        *mode = QUIC_FEC_NONE;
+        *k = 0;
+        *m = 0;
+        return 0;
+    }
+    quic_fec_mode_t parsed_mode;
+    const char *p;
+    if (strncmp(spec, "xor:", 4) == 0) {
+        parsed_mode = QUIC_FEC_XOR;
+        p = spec + 4;
+    } else if (strncmp(spec, "rs:", 3) == 0) {
+        parsed_mode = QUIC_FEC_REED_SOLOMON;
+        p = spec + 3;
+    } else {
+        return -1;
+    }
+    char *end = NULL;
+    unsigned long parsed_k = strtoul(p, &end, 10);
+    unsigned long parsed_m = 1;
+    if (end == p) {
+        return -1;
+    }
+    if (parsed_mode == QUIC_FEC_REED_SOLOMON) {
+        if (*end != ':') {
+            return -1;
+        }
+        p = end + 1;
+        parsed_m = strtoul(p, &end, 10);
+        if (end == p) {
+            return -1;
+        }
+    }
+    if (*end != '\0' || parsed_k > QUIC_FEC_MAX_K || parsed_m > QUIC_FEC_MAX_M ||
+        !quic_fec_params_valid(parsed_mode, (unsigned)parsed_k, (unsigned)parsed_m)) {
+        return -1;
+    }
+    *mode = parsed_mode;
+    *k = (unsigned)parsed_k;
+    *m = (unsigned)parsed_m;
+    return 0;
+}
+
+int quic_fec_encode(quic_fec_mode_t mode,
+                    unsigned k,
+                    unsigned m,
+                    const uint8_t *const *src,
+                    uint8_t *const *repair,
+                    size_t len) {
+    if (!src || !repair || !quic_fec_params_valid(mode, k, m)) {
+        return -1;
+    }
+    gf_ensure_init();
+    for (unsigned j = 0; j < m; ++j) {
+        memset(repair[j], 0, len);
+        for (unsigned i = 0; i < k; ++i) {
+            quic_fec_mul_add(repair[j], src[i], fec_coef(mode, k, j, i), len);
+        }
+    }
+    return 0;
+}
+
+/* Gauss-Jordan inverse of an n x n matrix in place; -1 if singular. */
+static int gf_invert(uint8_t a[QUIC_FEC_MAX_M][QUIC_FEC_MAX_M], uint8_t out[QUIC_FEC_MAX_M][QUIC_FEC_MAX_M], unsigned n) {
+    for (unsigned r = 0; r < n; ++r) {
+        for (unsigned c = 0; c < n; ++c) {
+            out[r][c] = (uint8_t)(r == c);
+        }
+    }
+    for (unsigned col = 0; col < n; ++col) {
+        unsigned pivot = col;
+        while (pivot < n && a[pivot][col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            return -1;
+        }
+        if (pivot != col) {
+            for (unsigned c = 0; c < n; ++c) {
+                uint8_t t = a[col][c];
+                a[col][c] = a[pivot][c];
+                a[pivot][c] = t;
+                t = out[col][c];
+                out[col][c] = out[pivot][c];
+                out[pivot][c] = t;
+            }
+        }
+        uint8_t inv = quic_fec_gf_inv(a[col][col]);
+        for (unsigned c = 0; c < n; ++c) {
+            a[col][c] = quic_fec_gf_mul(a[col][c], inv);
+            out[col][c] = quic_fec_gf_mul(out[col][c], inv);
+        }
+        for (unsigned r = 0; r < n; ++r) {
+            uint8_t f = a[r][col];
+            if (r == col || f == 0) {
+                continue;
+            }
+            for (unsigned c = 0; c < n; ++c) {
+                a[r][c] ^= quic_fec_gf_mul(f, a[col][c]);
+                out[r][c] ^= quic_fec_gf_mul(f, out[col][c]);
+            }
+        }
+    }
+    return 0;
+}
+
+int quic_fec_decode(quic_fec_mode_t mode,
+                    unsigned k,
+                    unsigned m,
+                    uint8_t *const *src,
+                    const uint8_t *src_present,
+                    const uint8_t *const *repair,
+                    const uint8_t *repair_present,
+                    size_t len) {
+    if (!src || !src_present || !repair || !repair_present || !quic_fec_params_valid(mode, k, m)) {
+        return -1;
+    }
+    gf_ensure_init();
+
+    unsigned missing[QUIC_FEC_MAX_K];
+    unsigned e = 0;
+    for (unsigned i = 0; i < k; ++i) {
+        if (!src_present[i]) {
+            missing[e++] = i;
+        }
+    }
+    if (e == 0) {
+        return 0;
+    }
+    unsigned rows[QUIC_FEC_MAX_M];
+    unsigned r = 0;
+    for (unsigned j = 0; j < m && r < e; ++j) {
+        if (repair_present[j]) {
+            rows[r++] = j;
+        }
+    }
+    if (r < e) {
+        return -1;
+    }
+
+    uint8_t a[QUIC_FEC_MAX_M][QUIC_FEC_MAX_M];
+    uint8_t inv[QUIC_FEC_MAX_M][QUIC_FEC_MAX_M];
+    for (unsigned c = 0; c < e; ++c) {
+        for (unsigned d = 0; d < e; ++d) {
+            a[c][d] = fec_coef(mode, k, rows[c], missing[d]);
+        }
+    }
+    if (gf_invert(a, inv, e) != 0) {
+        return -1;
+    }
+
+    /* Syndromes: each chosen repair minus the contribution of the sources we have. */
+    uint8_t *syndromes = malloc((size_t)e * len);
+    if (!syndromes) {
+        return -1;
+    }
+    for (unsigned c = 0; c < e; ++c) {
+        uint8_t *s = syndromes + (size_t)c * len;
+        memcpy(s, repair[rows[c]], len);
+        for (unsigned i = 0; i < k; ++i) {
+            if (src_present[i]) {
+                quic_fec_mul_add(s, src[i], fec_coef(mode, k, rows[c], i), len);
+            }
+        }
+    }
+    for (unsigned d = 0; d < e; ++d) {
+        memset(src[missing[d]], 0, len);
+        for (unsigned c = 0; c < e; ++c) {
+            quic_fec_mul_add(src[missing[d]], syndromes + (size_t)c * len, inv[d][c], len);
+        }
+    }
+    free(syndromes);
+    return 0;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+int quic_fec_encoder_init(quic_fec_encoder_t *enc, quic_fec_mode_t mode, unsigned k, unsigned m) {
+    if (!enc || !quic_fec_params_valid(mode, k, m)) {
+        return -1;
+    }
+    memset(enc, 0, sizeof(*enc));
+    enc->mode = mode;
+    enc->k = k;
+    enc->m = m;
+    enc->symbols = malloc((size_t)k * QUIC_FEC_MAX_SYMBOL);
+    enc->repairs = malloc((size_t)m * QUIC_FEC_MAX_SYMBOL);
+    if (!enc->symbols || !enc->repairs) {
+        quic_fec_encoder_destroy(enc);
+        return -1;
+    }
+    return 0;
+}
+
+void quic_fec_encoder_destroy(quic_fec_encoder_t *enc) {
+    if (!enc) {
+        return;
+    }
+    free(enc->symbols);
+    free(enc->repairs);
+    memset(enc, 0, sizeof(*enc));
+}
+
+int quic_fec_encoder_add(quic_fec_encoder_t *enc,
+                         uint32_t stream_id,
+                         uint32_t packet_number,
+                         uint32_t offset,
+                         const uint8_t *payload,
+                         size_t len) {
+    if (!enc || !enc->symbols || (!payload && len > 0) || len > QUIC_FEC_MAX_SOURCE_PAYLOAD) {
+        return -1;
+    }
+    if (enc->count > 0 &&
+        (enc->count >= enc->k || stream_id != enc->stream_id || packet_number != enc->first_pn + enc->count)) {
+        return -1;
+    }
+    if (enc->count == 0) {
+        enc->stream_id = stream_id;
+        enc->first_pn = packet_number;
+        enc->symbol_len = 0;
+    }
+    uint8_t *sym = enc->symbols + (size_t)enc->count * QUIC_FEC_MAX_SYMBOL;
+    size_t sym_len = QUIC_FEC_META_SIZE + len;
+    put_u32(sym, offset);
+    put_u32(sym + 4, (uint32_t)len);
+    if (len > 0) {
+        memcpy(sym + QUIC_FEC_META_SIZE, payload, len);
+    }
+    /* Pad now so a later, longer symbol does not leave stale bytes behind this one. */
+    memset(sym + sym_len, 0, QUIC_FEC_MAX_SYMBOL - sym_len);
+    if (sym_len > enc->symbol_len) {
+        enc->symbol_len = sym_len;
+    }
+    enc->count++;
+    return enc->count == enc->k ? 1 : 0;
+}
+
+int quic_fec_encoder_finish(quic_fec_encoder_t *enc) {
+    if (!enc || enc->count == 0) {
+        return 0;
+    }
+    const uint8_t *src[QUIC_FEC_MAX_K];
+    uint8_t *rep[QUIC_FEC_MAX_M];
+    for (unsigned i = 0; i < enc->count; ++i) {
+        src[i] = enc->symbols + (size_t)i * QUIC_FEC_MAX_SYMBOL;
+    }
+    for (unsigned j = 0; j < enc->m; ++j) {
+        rep[j] = enc->repairs + (size_t)j * QUIC_FEC_MAX_SYMBOL;
+    }
+    if (quic_fec_encode(enc->mode, enc->count, enc->m, src, rep, enc->symbol_len) != 0) {
+        return -1;
+    }
+    return (int)enc->m;
+}
+
+int quic_fec_encoder_repair_payload(const quic_fec_encoder_t *enc,
+                                    unsigned index,
+                                    uint8_t *out,
+                                    size_t out_size,
+                                    size_t *out_len) {
+    if (!enc || !out || index >= enc->m || enc->count == 0) {
+        return -1;
+    }
+    size_t total = QUIC_FEC_REPAIR_HEADER_SIZE + enc->symbol_len;
+    if (out_size < total) {
+        return -1;
+    }
+    put_u32(out, enc->first_pn);
+    out[4] = (uint8_t)enc->count;
+    out[5] = (uint8_t)enc->m;
+    out[6] = (uint8_t)index;
+    out[7] = (uint8_t)enc->mode;
+    put_u32(out + 8, (uint32_t)enc->symbol_len);
+    memcpy(out + QUIC_FEC_REPAIR_HEADER_SIZE, enc->repairs + (size_t)index * QUIC_FEC_MAX_SYMBOL, enc->symbol_len);
+    if (out_len) {
+        *out_len = total;
+    }
+    return 0;
+}
+
+void quic_fec_encoder_reset(quic_fec_encoder_t *enc) {
+    if (!enc) {
+        return;
+    }
+    enc->count = 0;
+    enc->symbol_len = 0;
+}
+
+quic_fec_decoder_t *quic_fec_decoder_create(void) {
+    return calloc(1, sizeof(quic_fec_decoder_t));
+}
+
+static void release_group(quic_fec_group_t *group) {
+    for (unsigned j = 0; j < QUIC_FEC_MAX_M; ++j) {
+        free(group->repairs[j]);
+    }
+    memset(group, 0, sizeof(*group));
+}
+
+void quic_fec_decoder_destroy(quic_fec_decoder_t *dec) {
+    if (!dec) {
+        return;
+    }
+    for (int i = 0; i < QUIC_FEC_WINDOW; ++i) {
+        free(dec->window[i].symbol);
+    }
+    for (int g = 0; g < QUIC_FEC_MAX_GROUPS; ++g) {
+        release_group(&dec->groups[g]);
+    }
+    free(dec);
+}
+
+static quic_fec_source_slot_t *find_source(quic_fec_decoder_t *dec, uint32_t stream_id, uint32_t pn) {
+    quic_fec_source_slot_t *slot = &dec->window[pn % QUIC_FEC_WINDOW];
+    if (slot->in_use && slot->packet_number == pn && slot->stream_id == stream_id) {
+        return slot;
+    }
+    return NULL;
+}
+
+static int try_recover(quic_fec_decoder_t *dec, quic_fec_group_t *group, quic_fec_recover_fn cb, void *user_data) {
+    uint8_t *src[QUIC_FEC_MAX_K];
+    uint8_t present[QUIC_FEC_MAX_K];
+    unsigned missing = 0;
+    for (unsigned i = 0; i < group->k; ++i) {
+        quic_fec_source_slot_t *slot = find_source(dec, group->stream_id, group->first_pn + i);
+        if (slot && slot->symbol_len > group->symbol_len) {
+            release_group(group); /* sender and receiver disagree about this group */
+            return -1;
+        }
+        present[i] = slot != NULL;
+        src[i] = slot ? slot->symbol : NULL;
+        missing += slot ? 0 : 1;
+    }
+    if (missing == 0) {
+        release_group(group);
+        return 0;
+    }
+    unsigned repairs = 0;
+    for (unsigned j = 0; j < group->m; ++j) {
+        repairs += group->repair_present[j];
+    }
+    if (repairs < missing) {
+        return 0;
+    }
+
+    uint8_t *scratch = malloc((size_t)missing * group->symbol_len);
+    if (!scratch) {
+        return -1;
+    }
+    unsigned next = 0;
+    for (unsigned i = 0; i < group->k; ++i) {
+        if (present[i]) {
+            quic_fec_source_slot_t *slot = find_source(dec, group->stream_id, group->first_pn + i);
+            memset(slot->symbol + slot->symbol_len, 0, group->symbol_len - slot->symbol_len);
+        } else {
+            src[i] = scratch + (size_t)(next++) * group->symbol_len;
+        }
+    }
+    const uint8_t *rep[QUIC_FEC_MAX_M];
+    for (unsigned j = 0; j < group->m; ++j) {
+        rep[j] = group->repairs[j];
+    }
+
+    int recovered = 0;
+    if (quic_fec_decode(group->mode, group->k, group->m, src, present, rep, group->repair_present, group->symbol_len) == 0) {
+        for (unsigned i = 0; i < group->k; ++i) {
+            if (present[i]) {
+                continue;
+            }
+            uint32_t offset = get_u32(src[i]);
+            uint32_t len = get_u32(src[i] + 4);
+            if ((size_t)len + QUIC_FEC_META_SIZE > group->symbol_len) {
+                continue;
+            }
+            recovered++;
+            dec->recovered++;
+            if (cb) {
+                cb(user_data, group->stream_id, group->first_pn + i, offset, src[i] + QUIC_FEC_META_SIZE, len);
+            }
+        }
+    }
+    free(scratch);
+    release_group(group);
+    return recovered;
+}
+
+int quic_fec_decoder_on_source(quic_fec_decoder_t *dec,
+                               uint32_t stream_id,
+                               uint32_t packet_number,
+                               uint32_t offset,
+                               const uint8_t *payload,
+                               size_t len,
+                               quic_fec_recover_fn cb,
+                               void *user_data) {
+    if (!dec || (!payload && len > 0) || len > QUIC_FEC_MAX_SOURCE_PAYLOAD) {
+        return -1;
+    }
+    quic_fec_source_slot_t *slot = &dec->window[packet_number % QUIC_FEC_WINDOW];
+    if (!slot->symbol) {
+        slot->symbol = malloc(QUIC_FEC_MAX_SYMBOL);
+        if (!slot->symbol) {
+            return -1;
+        }
+    }
+    put_u32(slot->symbol, offset);
+    put_u32(slot->symbol + 4, (uint32_t)len);
+    if (len > 0) {
+        memcpy(slot->symbol + QUIC_FEC_META_SIZE, payload, len);
+    }
+    slot->symbol_len = (uint32_t)(QUIC_FEC_META_SIZE + len);
+    slot->packet_number = packet_number;
+    slot->stream_id = stream_id;
+    slot->in_use = 1;
+
+    int total = 0;
+    for (int g = 0; g < QUIC_FEC_MAX_GROUPS; ++g) {
+        quic_fec_group_t *group = &dec->groups[g];
+        if (group->in_use && group->stream_id == stream_id && packet_number - group->first_pn < group->k) {
+            int rc = try_recover(dec, group, cb, user_data);
+            total += rc > 0 ? rc : 0;
+        }
+    }
+    return total;
+}
+
+int quic_fec_decoder_on_repair(quic_fec_decoder_t *dec,
+                               uint32_t stream_id,
+                               const uint8_t *payload,
+                               size_t len,
+                               quic_fec_recover_fn cb,
+                               void *user_data) {
+    if (!dec || !payload || len < QUIC_FEC_REPAIR_HEADER_SIZE) {
+        return -1;
+    }
+    uint32_t first_pn = get_u32(payload);
+    unsigned k = payload[4];
+    unsigned m = payload[5];
+    unsigned index = payload[6];
+    quic_fec_mode_t mode = (quic_fec_mode_t)payload[7];
+    uint32_t symbol_len = get_u32(payload + 8);
+    if (!quic_fec_params_valid(mode, k, m) || index >= m || symbol_len < QUIC_FEC_META_SIZE ||
+        symbol_len > QUIC_FEC_MAX_SYMBOL || len < QUIC_FEC_REPAIR_HEADER_SIZE + (size_t)symbol_len) {
+        return -1;
+    }
+
+    quic_fec_group_t *group = NULL;
+    for (int g = 0; g < QUIC_FEC_MAX_GROUPS; ++g) {
+        quic_fec_group_t *cand = &dec->groups[g];
+        if (cand->in_use && cand->stream_id == stream_id && cand->first_pn == first_pn) {
+            if (cand->k != k || cand->m != m || cand->mode != mode || cand->symbol_len != symbol_len) {
+                return -1;
+            }
+            group = cand;
+            break;
+        }
+    }
+    if (!group) {
+        /* Oldest group gives way; its repairs are useless once the sender moved this far on. */
+        group = &dec->groups[dec->next_group];
+        dec->next_group = (dec->next_group + 1) % QUIC_FEC_MAX_GROUPS;
+        release_group(group);
+        group->in_use = 1;
+        group->mode = mode;
+        group->stream_id = stream_id;
+        group->first_pn = first_pn;
+        group->k = k;
+        group->m = m;
+        group->symbol_len = symbol_len;
+    }
+    if (group->repair_present[index]) {
+        return 0;
+    }
+    group->repairs[index] = malloc(symbol_len);
+    if (!group->repairs[index]) {
+        return -1;
+    }
+    memcpy(group->repairs[index], payload + QUIC_FEC_REPAIR_HEADER_SIZE, symbol_len);
+    group->repair_present[index] = 1;
+    return try_recover(dec, group, cb, user_data);
+}
@@ -0,0 +1,163 @@
+#ifndef SERVER_QUIC_FEC_H
+#define SERVER_QUIC_FEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Forward error correction over groups of consecutive DATA packets.
+ *
+ * A source symbol is [u32 offset][u32 length][payload] zero-padded to the
+ * longest symbol in the group, so a recovered symbol carries everything the
+ * receiver needs to feed stream reassembly. Repair payload on the wire:
+ * [u32 first_pn][u8 k][u8 m][u8 index][u8 mode][u32 symbol_len][symbol]. */
+#define QUIC_FEC_MAX_K              32
+#define QUIC_FEC_MAX_M              8
+#define QUIC_FEC_META_SIZE          8
+#define QUIC_FEC_REPAIR_HEADER_SIZE 12
+/* Must equal QUIC_MAX_PAYLOAD (checked in quic.c); a repair symbol has to fit one packet. */
+#define QUIC_FEC_PACKET_PAYLOAD     (16 * 1024)
+#define QUIC_FEC_MAX_SYMBOL         (QUIC_FEC_PACKET_PAYLOAD - QUIC_FEC_REPAIR_HEADER_SIZE)
+#define QUIC_FEC_MAX_SOURCE_PAYLOAD (QUIC_FEC_MAX_SYMBOL - QUIC_FEC_META_SIZE)
+#define QUIC_FEC_WINDOW             32 /* source packets remembered per connection */
+#define QUIC_FEC_MAX_GROUPS         4  /* groups with repairs waiting on sources */
+/* "xor:K" or "rs:K:M"; read by quic_engine_init. */
+#define QUIC_FEC_ENV                "QUIC_FEC"
+
+typedef enum {
+    QUIC_FEC_NONE = 0,
+    QUIC_FEC_XOR,         /* one parity packet per group (m = 1) */
+    QUIC_FEC_REED_SOLOMON /* Cauchy RS over GF(2^8): any k of k + m packets recover the group */
+} quic_fec_mode_t;
+
+typedef enum {
+    QUIC_FEC_KERNEL_AUTO = 0,
+    QUIC_FEC_KERNEL_SCALAR,
+    QUIC_FEC_KERNEL_SSSE3,
+    QUIC_FEC_KERNEL_AVX2,
+    QUIC_FEC_KERNEL_NEON
+} quic_fec_kernel_t;
+
+/* Selects the GF multiply-accumulate kernel for the whole process; -1 if the CPU lacks it. */
+int quic_fec_set_kernel(quic_fec_kernel_t kernel);
+const char *quic_fec_kernel_name(void);
+
+int quic_fec_params_valid(quic_fec_mode_t mode, unsigned k, unsigned m);
+/* Parses a QUIC_FEC_ENV value. "off" or "" yields QUIC_FEC_NONE. */
+int quic_fec_parse_config(const char *spec, quic_fec_mode_t *mode, unsigned *k, unsigned *m);
+
+uint8_t quic_fec_gf_mul(uint8_t a, uint8_t b);
+uint8_t quic_fec_gf_inv(uint8_t a);
+/* dst ^= coef * src over GF(2^8), byte-wise. */
+void quic_fec_mul_add(uint8_t *dst, const uint8_t *src, uint8_t coef, size_t len);
+
+/* Block coding on equal-length symbols. repair[j] is overwritten. */
+int quic_fec_encode(quic_fec_mode_t mode,
+                    unsigned k,
+                    unsigned m,
+                    const uint8_t *const *src,
+                    uint8_t *const *repair,
+                    size_t len);
+/* Rebuilds every src[i] with src_present[i] == 0 in place from the present
+ * sources and repairs. Fails when fewer than k symbols are present. */
+int quic_fec_decode(quic_fec_mode_t mode,
+                    unsigned k,
+                    unsigned m,
+                    uint8_t *const *src,
+                    const uint8_t *src_present,
+                    const uint8_t *const *repair,
+                    const uint8_t *repair_present,
+                    size_t len);
+
+typedef struct {
+    quic_fec_mode_t mode;
+    unsigned k;
+    unsigned m;
+    uint32_t stream_id;
+    uint32_t first_pn;
+    unsigned count;
+    size_t symbol_len;
+    uint8_t *symbols; /* k * QUIC_FEC_MAX_SYMBOL */
+    uint8_t *repairs; /* m * QUIC_FEC_MAX_SYMBOL */
+} quic_fec_encoder_t;
+
+int quic_fec_encoder_init(quic_fec_encoder_t *enc, quic_fec_mode_t mode, unsigned k, unsigned m);
+void quic_fec_encoder_destroy(quic_fec_encoder_t *enc);
+/* Adds the next source packet. Packet numbers within a group must be
+ * consecutive on one stream; returns 1 once the group is full, -1 if the
+ * packet does not continue the current group (finish it first). */
+int quic_fec_encoder_add(quic_fec_encoder_t *enc,
+                         uint32_t stream_id,
+                         uint32_t packet_number,
+                         uint32_t offset,
+                         const uint8_t *payload,
+                         size_t len);
+/* Computes repairs for the current, possibly partial, group; returns how many to send. */
+int quic_fec_encoder_finish(quic_fec_encoder_t *enc);
+int quic_fec_encoder_repair_payload(const quic_fec_encoder_t *enc,
+                                    unsigned index,
+                                    uint8_t *out,
+                                    size_t out_size,
+                                    size_t *out_len);
+void quic_fec_encoder_reset(quic_fec_encoder_t *enc);
+
+typedef void (*quic_fec_recover_fn)(void *user_data,
+                                    uint32_t stream_id,
+                                    uint32_t packet_number,
+                                    uint32_t offset,
+                                    const uint8_t *data,
+                                    uint32_t len);
+
+typedef struct {
+    int in_use;
+    uint32_t stream_id;
+    uint32_t packet_number;
+    uint32_t symbol_len; /* meta + payload */
+    uint8_t *symbol;     /* QUIC_FEC_MAX_SYMBOL bytes, allocated on first use */
+} quic_fec_source_slot_t;
+
+typedef struct {
+    int in_use;
+    quic_fec_mode_t mode;
+    uint32_t stream_id;
+    uint32_t first_pn;
+    unsigned k;
+    unsigned m;
+    uint32_t symbol_len;
+    uint8_t repair_present[QUIC_FEC_MAX_M];
+    uint8_t *repairs[QUIC_FEC_MAX_M];
+} quic_fec_group_t;
+
+typedef struct {
+    quic_fec_source_slot_t window[QUIC_FEC_WINDOW];
+    quic_fec_group_t groups[QUIC_FEC_MAX_GROUPS];
+    unsigned next_group;
+    uint64_t recovered;
+} quic_fec_decoder_t;
+
+quic_fec_decoder_t *quic_fec_decoder_create(void);
+void quic_fec_decoder_destroy(quic_fec_decoder_t *dec);
+/* Both return the number of packets recovered through `cb`, or -1 on malformed input. */
+int quic_fec_decoder_on_source(quic_fec_decoder_t *dec,
+                               uint32_t stream_id,
+                               uint32_t packet_number,
+                               uint32_t offset,
+                               const uint8_t *payload,
+                               size_t len,
+                               quic_fec_recover_fn cb,
+                               void *user_data);
+int quic_fec_decoder_on_repair(quic_fec_decoder_t *dec,
+                               uint32_t stream_id,
+                               const uint8_t *payload,
+                               size_t len,
+                               quic_fec_recover_fn cb,
+                               void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_FEC_H
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE /* CPU_SET, pthread_setaffinity_np */
+#include "server/quic_latency.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+static int quic_latency_add_cpu(quic_latency_config_t *cfg, unsigned long cpu) {
+    if (cpu >= CPU_SETSIZE || cfg->cpu_count == QUIC_LATENCY_MAX_CPUS) {
+        return -1;
+    }
+    for (unsigned i = 0; i < cfg->cpu_count; ++i) {
+        if (cfg->cpus[i] == cpu) {
+            return 0;
+        }
+    }
+    cfg->cpus[cfg->cpu_count++] = (unsigned)cpu;
+    return 0;
+}
+
+int quic_latency_parse_config(const char *spec, quic_latency_config_t *out) {
+    if (!spec || !out) {
+        return -1;
+    }
+    quic_latency_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.spin_us = QUIC_LATENCY_DEFAULT_SPIN_US;
+    if (spec[0] == '\0' || strcmp(spec, "off") == 0) {
+        *out = cfg;
+        return 0;
+    }
+    const char *p = spec;
+    for (;;) {
+        char *end = NULL;
+        unsigned long first = strtoul(p, &end, 10);
+        if (end == p) {
+            return -1;
+        }
+        unsigned long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtoul(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        }
+        for (unsigned long cpu = first; cpu <= last; ++cpu) {
+            if (quic_latency_add_cpu(&cfg, cpu) != 0) {
+                return -1;
+            }
+        }
+        p = end;
+        if (*p != ',') {
+            break;
+        }
+        ++p;
+    }
+    if (*p == ':') {
+        const char *spin = p + 1;
+        char *end = NULL;
+        unsigned long spin_us = strtoul(spin, &end, 10);
+        if (end == spin || spin_us > 1000000) {
+            return -1;
+        }
+        cfg.spin_us = (uint32_t)spin_us;
+        p = end;
+    }
+    if (*p != '\0') {
+        return -1;
+    }
+    cfg.enabled = 1;
+    *out = cfg;
+    return 0;
+}
+
+unsigned quic_latency_cpu_for(const quic_latency_config_t *cfg, int worker) {
+    if (worker < 0 || cfg->cpu_count < 2) {
+        return cfg->cpus[0];
+    }
+    return cfg->cpus[1 + (unsigned)worker % (cfg->cpu_count - 1)];
+}
+
+int quic_latency_pin_thread(pthread_t thread, unsigned cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int quic_latency_exclude_current_thread(const quic_latency_config_t *cfg) {
+    if (!cfg || !cfg->enabled) {
+        return 0;
+    }
+    cpu_set_t set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        return -1;
+    }
+    for (unsigned i = 0; i < cfg->cpu_count; ++i) {
+        CPU_CLR(cfg->cpus[i], &set);
+    }
+    if (CPU_COUNT(&set) == 0) {
+        return -1;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+int quic_latency_enable_busy_poll(int fd, uint32_t spin_us) {
+    int value = (int)spin_us;
+    return setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) == 0 ? 0 : -1;
+}
@@ -0,0 +1,43 @@
+#ifndef SERVER_QUIC_LATENCY_H
+#define SERVER_QUIC_LATENCY_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Low-latency mode for the network threads, configured as "CPUS[:SPIN_US]"
+ * where CPUS is a list like "2,3" or "2-5". The receive thread is pinned to the
+ * first CPU and dispatch workers to the others in turn (all to the first when
+ * only one is given). The socket gets SO_BUSY_POLL=SPIN_US, and the receive
+ * loop polls it without blocking for SPIN_US before it goes to sleep in
+ * recvmsg, trading a busy core for the wakeup latency of an idle one. */
+#define QUIC_LATENCY_MAX_CPUS        64
+#define QUIC_LATENCY_DEFAULT_SPIN_US 50
+
+typedef struct {
+    int enabled;
+    unsigned cpus[QUIC_LATENCY_MAX_CPUS];
+    unsigned cpu_count;
+    uint32_t spin_us;
+} quic_latency_config_t;
+
+/* "off" or "" leaves the mode disabled. -1 on a malformed spec or a CPU past CPU_SETSIZE. */
+int quic_latency_parse_config(const char *spec, quic_latency_config_t *out);
+/* CPU for the receive thread (worker -1) or dispatch worker n. */
+unsigned quic_latency_cpu_for(const quic_latency_config_t *cfg, int worker);
+int quic_latency_pin_thread(pthread_t thread, unsigned cpu);
+/* Drops the configured CPUs from the calling thread's mask so threads it creates
+ * later (HTTP, WebSocket) leave them to the network threads. Keeps the mask as
+ * is, and returns -1, when that would leave no CPU at all. */
+int quic_latency_exclude_current_thread(const quic_latency_config_t *cfg);
+/* SO_BUSY_POLL needs CAP_NET_ADMIN to go above the sysctl default; -1 if refused. */
+int quic_latency_enable_busy_poll(int fd, uint32_t spin_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_LATENCY_H
@@ -0,0 +1,50 @@
+#include "server/quic_lb.h"
+
+uint64_t quic_lb_cid_encode(uint8_t server_id, uint64_t nonce) {
+    uint64_t cid = ((uint64_t)QUIC_LB_CONFIG_ID << 62) | ((uint64_t)server_id << 48);
+    cid |= (nonce & 0x3FULL) << 56;
+    cid |= (nonce >> 6) & 0xFFFFFFFFFFFFULL;
+    return cid;
+}
+
+int quic_lb_cid_server_id(uint64_t connection_id, uint8_t *server_id) {
+    uint8_t id = (uint8_t)(connection_id >> 48);
+    if ((connection_id >> 62) != QUIC_LB_CONFIG_ID || id == 0) {
+        return -1;
+    }
+    if (server_id) {
+        *server_id = id;
+    }
+    return 0;
+}
+
+/* Lamping & Veach, "A Fast, Minimal Memory, Consistent Hash Algorithm". The key
+ * is mixed first because client-chosen ids often differ only in their low bits. */
+static unsigned quic_lb_jump_hash(uint64_t key, unsigned buckets) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    int64_t b = -1;
+    int64_t j = 0;
+    while (j < (int64_t)buckets) {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (int64_t)((double)(b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+    }
+    return (unsigned)b;
+}
+
+int quic_lb_route(const uint8_t *server_ids, unsigned count, uint64_t connection_id) {
+    if (!server_ids || count == 0) {
+        return -1;
+    }
+    uint8_t id = 0;
+    if (quic_lb_cid_server_id(connection_id, &id) == 0) {
+        for (unsigned i = 0; i < count; ++i) {
+            if (server_ids[i] == id) {
+                return (int)i;
+            }
+        }
+    }
+    return (int)quic_lb_jump_hash(connection_id, count);
+}
@@ -0,0 +1,37 @@
+#ifndef SERVER_QUIC_LB_H
+#define SERVER_QUIC_LB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Routable connection ids, after the plaintext algorithm of QUIC-LB
+ * (draft-ietf-quic-load-balancers). Most significant byte first:
+ *   byte 0  bits 7-6 config id (QUIC_LB_CONFIG_ID), bits 5-0 random
+ *   byte 1  server id, 1..255
+ *   byte 2+ random nonce
+ * A server behind tools/quic_lb hands every new connection such an id (see
+ * QUIC_LB_SERVER_ID_ENV in quic.h), so any load balancer that knows the server
+ * ids can route a datagram from its connection id alone, whatever address it
+ * comes from. Ids with other config bits, such as the one a client opens a
+ * connection with, are placed by a consistent hash of the whole id instead. */
+#define QUIC_LB_CONFIG_ID      0x1
+#define QUIC_LB_MAX_BACKENDS   64
+#define QUIC_LB_SERVER_ID_ENV  "QUIC_LB_SERVER_ID"
+
+uint64_t quic_lb_cid_encode(uint8_t server_id, uint64_t nonce);
+/* 0 and the embedded server id for a routable id, -1 otherwise. */
+int quic_lb_cid_server_id(uint64_t connection_id, uint8_t *server_id);
+/* Backend index in [0, count): the backend whose id the connection id names,
+ * else a jump consistent hash, so adding a backend moves few unroutable ids.
+ * -1 when count is 0. */
+int quic_lb_route(const uint8_t *server_ids, unsigned count, uint64_t connection_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_LB_H
@@ -0,0 +1,79 @@
+#include "server/quic_rate.h"
+
+#include <string.h>
+
+#define QUIC_RATE_BUCKET_US (QUIC_RATE_WINDOW_US / QUIC_RATE_BUCKETS)
+
+void quic_rate_init(quic_rate_t *rate) {
+    if (!rate) {
+        return;
+    }
+    memset(rate, 0, sizeof(*rate));
+}
+
+void quic_rate_reset_path(quic_rate_t *rate) {
+    if (!rate) {
+        return;
+    }
+    rate->latest_bps = 0;
+    memset(rate->bucket_bps, 0, sizeof(rate->bucket_bps));
+    memset(rate->bucket_start_us, 0, sizeof(rate->bucket_start_us));
+}
+
+void quic_rate_on_sent(quic_rate_t *rate, uint64_t in_flight, uint64_t now_us, quic_rate_packet_t *out) {
+    if (!rate || !out) {
+        return;
+    }
+    /* Leaving idle: the time spent with nothing to send is not part of any interval. */
+    if (in_flight == 0) {
+        rate->first_sent_us = now_us;
+        rate->delivered_us = now_us;
+    }
+    out->delivered = rate->delivered;
+    out->delivered_us = rate->delivered_us;
+    out->first_sent_us = rate->first_sent_us;
+    out->sent_us = now_us;
+}
+
+int quic_rate_on_acked(quic_rate_t *rate, const quic_rate_packet_t *packet, size_t bytes, uint64_t now_us, uint64_t min_rtt_us) {
+    if (!rate || !packet) {
+        return 0;
+    }
+    rate->delivered += bytes;
+    rate->delivered_us = now_us;
+    rate->first_sent_us = packet->sent_us;
+
+    uint64_t send_elapsed = packet->sent_us - packet->first_sent_us;
+    uint64_t ack_elapsed = now_us - packet->delivered_us;
+    uint64_t interval = send_elapsed > ack_elapsed ? send_elapsed : ack_elapsed;
+    if (interval == 0 || (min_rtt_us > 0 && interval < min_rtt_us)) {
+        return 0;
+    }
+    uint64_t bps = (rate->delivered - packet->delivered) * 8ULL * 1000000ULL / interval;
+    rate->latest_bps = bps;
+    rate->samples++;
+
+    size_t slot = (size_t)((now_us / QUIC_RATE_BUCKET_US) % QUIC_RATE_BUCKETS);
+    uint64_t start = now_us - now_us % QUIC_RATE_BUCKET_US;
+    if (rate->bucket_start_us[slot] != start) {
+        rate->bucket_start_us[slot] = start;
+        rate->bucket_bps[slot] = 0;
+    }
+    if (bps > rate->bucket_bps[slot]) {
+        rate->bucket_bps[slot] = bps;
+    }
+    return 1;
+}
+
+uint64_t quic_rate_bandwidth_bps(const quic_rate_t *rate, uint64_t now_us) {
+    if (!rate) {
+        return 0;
+    }
+    uint64_t best = 0;
+    for (size_t i = 0; i < QUIC_RATE_BUCKETS; ++i) {
+        if (rate->bucket_bps[i] > best && now_us - rate->bucket_start_us[i] < QUIC_RATE_WINDOW_US) {
+            best = rate->bucket_bps[i];
+        }
+    }
+    return best;
+}
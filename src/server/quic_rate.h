@@ -0,0 +1,54 @@
+#ifndef SERVER_QUIC_RATE_H
+#define SERVER_QUIC_RATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Delivery-rate estimation in the style of BBR (draft-cheng-iccrg-delivery-rate-
+ * estimation): each packet remembers how much had been delivered when it left,
+ * and its ACK turns the bytes delivered since then, over the longer of the send
+ * and ACK intervals, into one sample. The estimate is the largest sample of the
+ * last QUIC_RATE_WINDOW_US, so ACK compression and idle gaps between chunks do
+ * not drag it down. */
+#define QUIC_RATE_WINDOW_US (2 * 1000000ULL)
+#define QUIC_RATE_BUCKETS   10 /* the window's max filter keeps one max per slice */
+
+/* Connection state when a packet was sent; stored next to the packet. */
+typedef struct {
+    uint64_t delivered;
+    uint64_t delivered_us;
+    uint64_t first_sent_us;
+    uint64_t sent_us;
+} quic_rate_packet_t;
+
+typedef struct {
+    uint64_t delivered;     /* bytes acknowledged so far */
+    uint64_t delivered_us;  /* when the last of them was acknowledged */
+    uint64_t first_sent_us; /* send time of the packet that opened the current interval */
+    uint64_t latest_bps;
+    uint64_t samples;
+    uint64_t bucket_bps[QUIC_RATE_BUCKETS];
+    uint64_t bucket_start_us[QUIC_RATE_BUCKETS];
+} quic_rate_t;
+
+void quic_rate_init(quic_rate_t *rate);
+/* New network path: drop the old path's samples, keep the delivered counters
+ * that packets still in flight refer to. */
+void quic_rate_reset_path(quic_rate_t *rate);
+/* Snapshot for a packet leaving now; in_flight is what was outstanding before it. */
+void quic_rate_on_sent(quic_rate_t *rate, uint64_t in_flight, uint64_t now_us, quic_rate_packet_t *out);
+/* Returns 1 when the ACK produced a sample. Intervals shorter than min_rtt_us
+ * (0 = unknown) would overstate the rate and are not sampled. */
+int quic_rate_on_acked(quic_rate_t *rate, const quic_rate_packet_t *packet, size_t bytes, uint64_t now_us, uint64_t min_rtt_us);
+/* Bits per second; 0 until the window holds a sample. */
+uint64_t quic_rate_bandwidth_bps(const quic_rate_t *rate, uint64_t now_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_RATE_H
@@ -0,0 +1,203 @@
+#include "server/quic_retry.h"
+
+#include <string.h>
+
+/* FIPS 180-4 SHA-256; only ever fed short messages, so no streaming API. */
+typedef struct {
+    uint32_t state[8];
+    uint64_t total;
+    uint8_t block[64];
+    size_t used;
+} sha256_ctx_t;
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t rotr32(uint32_t x, unsigned n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256_compress(uint32_t state[8], const uint8_t block[64]) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) |
+               ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + sha256_k[i] + w[i];
+        uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void sha256_init(sha256_ctx_t *ctx) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->total = 0;
+    ctx->used = 0;
+}
+
+static void sha256_update(sha256_ctx_t *ctx, const uint8_t *data, size_t len) {
+    ctx->total += len;
+    while (len > 0) {
+        size_t take = sizeof(ctx->block) - ctx->used;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(ctx->block + ctx->used, data, take);
+        ctx->used += take;
+        data += take;
+        len -= take;
+        if (ctx->used == sizeof(ctx->block)) {
+            sha256_compress(ctx->state, ctx->block);
+            ctx->used = 0;
+        }
+    }
+}
+
+static void sha256_final(sha256_ctx_t *ctx, uint8_t out[QUIC_SHA256_SIZE]) {
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->used != 56) {
+        sha256_update(ctx, &pad, 1);
+    }
+    uint8_t len_be[8];
+    for (int i = 0; i < 8; ++i) {
+        len_be[i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    sha256_update(ctx, len_be, sizeof(len_be));
+    for (int i = 0; i < 8; ++i) {
+        out[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        out[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        out[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        out[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+void quic_retry_hmac_sha256(const uint8_t *key,
+                            size_t key_len,
+                            const uint8_t *msg,
+                            size_t msg_len,
+                            uint8_t out[QUIC_SHA256_SIZE]) {
+    uint8_t block[64];
+    memset(block, 0, sizeof(block));
+    sha256_ctx_t ctx;
+    if (key_len > sizeof(block)) {
+        sha256_init(&ctx);
+        sha256_update(&ctx, key, key_len);
+        sha256_final(&ctx, block);
+    } else if (key_len > 0) {
+        memcpy(block, key, key_len);
+    }
+
+    uint8_t pad[64];
+    for (size_t i = 0; i < sizeof(pad); ++i) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    uint8_t inner[QUIC_SHA256_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, pad, sizeof(pad));
+    sha256_update(&ctx, msg, msg_len);
+    sha256_final(&ctx, inner);
+
+    for (size_t i = 0; i < sizeof(pad); ++i) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    sha256_init(&ctx);
+    sha256_update(&ctx, pad, sizeof(pad));
+    sha256_update(&ctx, inner, sizeof(inner));
+    sha256_final(&ctx, out);
+}
+
+static void quic_retry_tag(const uint8_t key[QUIC_RETRY_KEY_SIZE],
+                           const struct sockaddr_in *addr,
+                           uint64_t connection_id,
+                           const uint8_t issued_be[4],
+                           uint8_t out[QUIC_SHA256_SIZE]) {
+    /* Address fields as they appear on the wire, so no byte swapping is needed. */
+    uint8_t msg[4 + 2 + 8 + 4];
+    memcpy(msg, &addr->sin_addr.s_addr, 4);
+    memcpy(msg + 4, &addr->sin_port, 2);
+    for (int i = 0; i < 8; ++i) {
+        msg[6 + i] = (uint8_t)(connection_id >> (56 - 8 * i));
+    }
+    memcpy(msg + 14, issued_be, 4);
+    quic_retry_hmac_sha256(key, QUIC_RETRY_KEY_SIZE, msg, sizeof(msg), out);
+}
+
+void quic_retry_token_mint(const uint8_t key[QUIC_RETRY_KEY_SIZE],
+                           const struct sockaddr_in *addr,
+                           uint64_t connection_id,
+                           time_t now,
+                           uint8_t out[QUIC_RETRY_TOKEN_SIZE]) {
+    uint32_t issued = (uint32_t)now;
+    out[0] = (uint8_t)(issued >> 24);
+    out[1] = (uint8_t)(issued >> 16);
+    out[2] = (uint8_t)(issued >> 8);
+    out[3] = (uint8_t)issued;
+    uint8_t tag[QUIC_SHA256_SIZE];
+    quic_retry_tag(key, addr, connection_id, out, tag);
+    memcpy(out + 4, tag, QUIC_RETRY_TAG_SIZE);
+}
+
+int quic_retry_token_validate(const uint8_t key[QUIC_RETRY_KEY_SIZE],
+                              const uint8_t *token,
+                              size_t token_len,
+                              const struct sockaddr_in *addr,
+                              uint64_t connection_id,
+                              time_t now) {
+    if (!key || !token || !addr || token_len != QUIC_RETRY_TOKEN_SIZE) {
+        return -1;
+    }
+    uint32_t issued = ((uint32_t)token[0] << 24) | ((uint32_t)token[1] << 16) | ((uint32_t)token[2] << 8) | token[3];
+    /* Unsigned distance: a token from the future wraps to a huge age. */
+    if ((uint32_t)now - issued > QUIC_RETRY_TOKEN_LIFETIME) {
+        return -1;
+    }
+    uint8_t tag[QUIC_SHA256_SIZE];
+    quic_retry_tag(key, addr, connection_id, token, tag);
+    /* Constant time, so the tag cannot be guessed byte by byte. */
+    uint8_t diff = 0;
+    for (size_t i = 0; i < QUIC_RETRY_TAG_SIZE; ++i) {
+        diff |= (uint8_t)(tag[i] ^ token[4 + i]);
+    }
+    return diff == 0 ? 0 : -1;
+}
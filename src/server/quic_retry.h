@@ -0,0 +1,51 @@
+#ifndef SERVER_QUIC_RETRY_H
+#define SERVER_QUIC_RETRY_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Stateless retry tokens (RFC 9000 §8.1.2 style): [u32 issue time BE][tag 16],
+ * the tag being HMAC-SHA256(key, ip | port | connection id | issue time)
+ * truncated to 16 bytes. A token only proves the client can receive at the
+ * address it claims, so the server can hand one out without keeping state and
+ * check it without a lookup. SHA-256 is built in so this works without TLS=1. */
+#define QUIC_RETRY_TAG_SIZE       16
+#define QUIC_RETRY_TOKEN_SIZE     (4 + QUIC_RETRY_TAG_SIZE)
+#define QUIC_RETRY_KEY_SIZE       32
+#define QUIC_RETRY_TOKEN_LIFETIME 10 /* seconds; a client echoes it within one RTT */
+#define QUIC_SHA256_SIZE          32
+/* Occupied connection slots at which token-less INITIALs get a Retry instead
+ * of a slot; read by quic_engine_init. */
+#define QUIC_RETRY_THRESHOLD_ENV  "QUIC_RETRY_THRESHOLD"
+
+void quic_retry_hmac_sha256(const uint8_t *key,
+                            size_t key_len,
+                            const uint8_t *msg,
+                            size_t msg_len,
+                            uint8_t out[QUIC_SHA256_SIZE]);
+
+void quic_retry_token_mint(const uint8_t key[QUIC_RETRY_KEY_SIZE],
+                           const struct sockaddr_in *addr,
+                           uint64_t connection_id,
+                           time_t now,
+                           uint8_t out[QUIC_RETRY_TOKEN_SIZE]);
+/* 0 when the token was minted under key for this address and connection id
+ * and is younger than QUIC_RETRY_TOKEN_LIFETIME; -1 otherwise. */
+int quic_retry_token_validate(const uint8_t key[QUIC_RETRY_KEY_SIZE],
+                              const uint8_t *token,
+                              size_t token_len,
+                              const struct sockaddr_in *addr,
+                              uint64_t connection_id,
+                              time_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_QUIC_RETRY_H
@@ -46,12 +46,15 @@ static int insert_segment(quic_stream_state_t *state, uint32_t offset, const uin
     if (!node) {
         return -1;
     }
-    node->data = malloc(length);
-    if (!node->data) {
-        free(node);
-        return -1;
+    node->data = NULL;
+    if (data) {
+        node->data = malloc(length);
+        if (!node->data) {
+            free(node);
+            return -1;
+        }
+        memcpy(node->data, data, length);
     }
-    memcpy(node->data, data, length);
     node->offset = offset;
     node->length = length;
     node->next = NULL;
@@ -65,11 +68,32 @@ static int insert_segment(quic_stream_state_t *state, uint32_t offset, const uin
     return 0;
 }
 
-static void consume_segments(quic_stream_state_t *state, uint8_t *out_buf, size_t out_buf_size, size_t *out_len) {
+static void consume_segments(quic_stream_state_t *state,
+                             uint8_t *out_buf,
+                             size_t out_buf_size,
+                             uint32_t *out_offset,
+                             size_t *out_len) {
     size_t written = 0;
     quic_stream_segment_t *seg = state->segments;
 
-    while (seg && seg->offset <= state->next_offset) {
+    while (seg && seg->offset <= state->next_offset && written < out_buf_size) {
+        if (!seg->data) {
+            /* The output is one contiguous range, so a skip ends this batch. */
+            if (written > 0) {
+                break;
+            }
+            if (seg->offset + seg->length > state->next_offset) {
+                state->next_offset = seg->offset + seg->length;
+            }
+            quic_stream_segment_t *tmp = seg;
+            seg = seg->next;
+            free(tmp);
+            state->segments = seg;
+            continue;
+        }
+        if (written == 0 && out_offset) {
+            *out_offset = state->next_offset;
+        }
         uint32_t start = state->next_offset > seg->offset ? state->next_offset - seg->offset : 0;
         if (start >= seg->length) {
             quic_stream_segment_t *tmp = seg;
@@ -135,7 +159,48 @@ int quic_stream_on_data(quic_stream_manager_t *mgr,
         return -1;
     }
 
-    consume_segments(state, out_buf, out_buf_size, out_len);
+    consume_segments(state, out_buf, out_buf_size, out_offset, out_len);
+    return 0;
+}
+
+int quic_stream_skip(quic_stream_manager_t *mgr, uint32_t stream_id, uint32_t offset, uint32_t length) {
+    if (!mgr || length == 0) {
+        return -1;
+    }
+
+    quic_stream_state_t *state = find_or_create_stream(mgr, stream_id);
+    if (!state) {
+        return -1;
+    }
+    if (offset + length <= state->next_offset) {
+        return 0; /* already delivered; the skip raced a late retransmission */
+    }
+    return insert_segment(state, offset, NULL, length);
+}
+
+int quic_stream_drain(quic_stream_manager_t *mgr,
+                      uint32_t stream_id,
+                      uint8_t *out_buf,
+                      size_t out_buf_size,
+                      uint32_t *out_offset,
+                      size_t *out_len) {
+    if (!mgr || !out_buf || out_buf_size == 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < QUIC_STREAM_MAX_STREAMS; ++i) {
+        quic_stream_state_t *state = &mgr->streams[i];
+        if (state->in_use && state->stream_id == stream_id) {
+            if (out_offset) {
+                *out_offset = state->next_offset;
+            }
+            consume_segments(state, out_buf, out_buf_size, out_offset, out_len);
+            return 0;
+        }
+    }
+    if (out_len) {
+        *out_len = 0;
+    }
     return 0;
 }
 
@@ -13,7 +13,7 @@ extern "C" {
 typedef struct quic_stream_segment {
     uint32_t offset;
     uint32_t length;
-    uint8_t *data;
+    uint8_t *data; /* NULL marks a range the sender abandoned (skip) */
     struct quic_stream_segment *next;
 } quic_stream_segment_t;
 
@@ -41,6 +41,16 @@ int quic_stream_on_data(quic_stream_manager_t *mgr,
                         size_t out_buf_size,
                         uint32_t *out_offset,
                         size_t *out_len);
+/* Sender gave up on [offset, offset + length): reassembly moves past it
+ * instead of waiting. Call quic_stream_drain afterwards for data it unblocked. */
+int quic_stream_skip(quic_stream_manager_t *mgr, uint32_t stream_id, uint32_t offset, uint32_t length);
+/* Emits the next contiguous run of buffered data; *out_len is 0 when nothing is ready. */
+int quic_stream_drain(quic_stream_manager_t *mgr,
+                      uint32_t stream_id,
+                      uint8_t *out_buf,
+                      size_t out_buf_size,
+                      uint32_t *out_offset,
+                      size_t *out_len);
 
 #ifdef __cplusplus
 }
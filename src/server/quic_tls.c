@@ -1,12 +1,14 @@
 #include "server/quic_tls.h"
 
+#include "server/quic_crypto.h"
+
 #include <stdint.h>
 #include <string.h>
 
 /* Placeholder QUIC <-> TLS bridge.
- * This stub prepares deterministic secrets to allow early wiring of CRYPTO handling
- * without pulling OpenSSL during initial development. Replace with real OpenSSL 3.2
- * integration (SSL_CTX/SSL objects + BIO handoff) when TLS is wired. */
+ * The initial secret is the real RFC 9001 HKDF output when built with TLS=1
+ * (quic_crypto.c); handshake and application secrets are still synthesized
+ * until SSL_CTX/SSL objects + BIO handoff are wired. */
 
 int quic_tls_context_init(quic_tls_context_t *ctx, const char *cert_path, const char *key_path) {
     if (!ctx) {
@@ -27,7 +29,10 @@ int quic_tls_session_init(quic_tls_session_t *session, quic_tls_context_t *ctx,
     }
     memset(session, 0, sizeof(*session));
     session->connection_id = connection_id;
-    /* For now, synthesize fixed-length pseudo-secrets; replace with HKDF output. */
+    if (quic_crypto_initial_secret(connection_id, NULL, 0, session->keys.initial_secret) == 0) {
+        return 0;
+    }
+    /* Built without OpenSSL: fixed-length pseudo-secret. */
     for (size_t i = 0; i < sizeof(session->keys.initial_secret); ++i) {
         session->keys.initial_secret[i] = (uint8_t)(connection_id + i);
     }
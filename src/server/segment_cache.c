@@ -0,0 +1,339 @@
+#define _GNU_SOURCE /* pread */
+#include "server/segment_cache.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct segment_entry {
+    int video_id;
+    int index;
+    segment_buf_t *buf; /* the entry's own reference; NULL until loaded */
+    int loading;
+    int result;         /* of the load, as segment_cache_get returns it */
+    int pins;           /* threads running or waiting for the load */
+    int linked;         /* findable in the table */
+    struct segment_entry *hnext;
+    struct segment_entry *prev; /* LRU, linked ready entries only */
+    struct segment_entry *next;
+} segment_entry_t;
+
+static unsigned segment_cache_bucket(int video_id, int index) {
+    uint32_t h = (uint32_t)video_id * 2654435761u ^ (uint32_t)(index + 1) * 40503u;
+    h ^= h >> 15;
+    return h % SEGMENT_CACHE_BUCKETS;
+}
+
+static void segment_buf_release_locked(segment_buf_t *buf) {
+    if (--buf->refs == 0) {
+        free(buf);
+    }
+}
+
+static void segment_lru_remove(segment_cache_t *cache, segment_entry_t *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        cache->lru_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        cache->lru_tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+static void segment_lru_push_front(segment_cache_t *cache, segment_entry_t *e) {
+    e->prev = NULL;
+    e->next = cache->lru_head;
+    if (cache->lru_head) {
+        cache->lru_head->prev = e;
+    } else {
+        cache->lru_tail = e;
+    }
+    cache->lru_head = e;
+}
+
+static void segment_entry_free_locked(segment_entry_t *e) {
+    if (e->buf) {
+        segment_buf_release_locked(e->buf);
+    }
+    free(e);
+}
+
+/* Takes e out of the table (and the LRU when ready); freed now unless a
+ * thread still holds a pin, in which case the last one frees it. */
+static void segment_entry_unlink_locked(segment_cache_t *cache, segment_entry_t *e) {
+    segment_entry_t **pp = &cache->buckets[segment_cache_bucket(e->video_id, e->index)];
+    while (*pp && *pp != e) {
+        pp = &(*pp)->hnext;
+    }
+    if (*pp) {
+        *pp = e->hnext;
+    }
+    e->hnext = NULL;
+    e->linked = 0;
+    if (!e->loading && e->result == 0 && e->buf) {
+        segment_lru_remove(cache, e);
+        cache->stats.bytes -= e->buf->frame_len;
+        cache->stats.entries--;
+    }
+    if (e->pins == 0) {
+        segment_entry_free_locked(e);
+    }
+}
+
+static void segment_cache_evict_locked(segment_cache_t *cache) {
+    while (cache->stats.bytes > cache->capacity && cache->lru_tail) {
+        segment_entry_unlink_locked(cache, cache->lru_tail);
+        cache->stats.evictions++;
+    }
+}
+
+/* Runs without the lock. 1 = too large to cache. */
+static int segment_cache_load(const segment_cache_t *cache, int video_id, int index, const char *path, segment_buf_t **out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    if (len > cache->capacity / SEGMENT_CACHE_MAX_SHARE) {
+        close(fd);
+        return 1;
+    }
+    segment_buf_t *buf = malloc(sizeof(*buf) + SEGMENT_CACHE_HEADROOM + len);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    uint8_t *data = buf->storage + SEGMENT_CACHE_HEADROOM;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(fd, data + got, len - got, (off_t)got);
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+    if (got != len) {
+        free(buf);
+        return -1;
+    }
+    size_t head = cache->frame ? cache->frame(video_id, index, len, buf->storage, cache->frame_arg) : 0;
+    if (head > SEGMENT_CACHE_HEADROOM) {
+        free(buf);
+        return -1;
+    }
+    buf->cache = NULL;
+    buf->refs = 1;
+    buf->data = data;
+    buf->len = len;
+    buf->frame = data - head;
+    buf->frame_len = head + len;
+    *out = buf;
+    return 0;
+}
+
+int segment_cache_init(segment_cache_t *cache, size_t capacity) {
+    if (!cache) {
+        return -1;
+    }
+    memset(cache, 0, sizeof(*cache));
+    cache->capacity = capacity;
+    cache->stats.capacity = capacity;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->loaded, NULL);
+    return 0;
+}
+
+int segment_cache_init_from_env(segment_cache_t *cache) {
+    size_t mb = SEGMENT_CACHE_DEFAULT_MB;
+    const char *spec = getenv(SEGMENT_CACHE_ENV);
+    if (spec && spec[0] != '\0') {
+        char *end = NULL;
+        unsigned long parsed = strtoul(spec, &end, 10);
+        if (end == spec || *end != '\0' || parsed > SEGMENT_CACHE_MAX_MB || parsed > SIZE_MAX / (1024 * 1024)) {
+            fprintf(stderr, "[cache] ignoring invalid %s=%s\n", SEGMENT_CACHE_ENV, spec);
+        } else {
+            mb = parsed;
+        }
+    }
+    return segment_cache_init(cache, mb * 1024 * 1024);
+}
+
+void segment_cache_set_framer(segment_cache_t *cache, segment_frame_fn frame, void *arg) {
+    if (cache) {
+        cache->frame = frame;
+        cache->frame_arg = arg;
+    }
+}
+
+/* No buffer may still be referenced. */
+void segment_cache_destroy(segment_cache_t *cache) {
+    if (!cache) {
+        return;
+    }
+    for (unsigned i = 0; i < SEGMENT_CACHE_BUCKETS; ++i) {
+        segment_entry_t *e = cache->buckets[i];
+        while (e) {
+            segment_entry_t *next = e->hnext;
+            segment_entry_free_locked(e);
+            e = next;
+        }
+    }
+    pthread_cond_destroy(&cache->loaded);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
+
+int segment_cache_get(segment_cache_t *cache, int video_id, int index, const char *path, segment_buf_t **out) {
+    if (!cache || !path || !out) {
+        return -1;
+    }
+    if (cache->capacity == 0) {
+        return 1;
+    }
+    pthread_mutex_lock(&cache->lock);
+    unsigned bucket = segment_cache_bucket(video_id, index);
+    segment_entry_t *e = cache->buckets[bucket];
+    while (e && (e->video_id != video_id || e->index != index)) {
+        e = e->hnext;
+    }
+    if (e && !e->loading) {
+        cache->stats.hits++;
+        segment_lru_remove(cache, e);
+        segment_lru_push_front(cache, e);
+        e->buf->refs++;
+        *out = e->buf;
+        pthread_mutex_unlock(&cache->lock);
+        return 0;
+    }
+    cache->stats.misses++;
+
+    if (e) {
+        /* Someone is already reading this segment. */
+        cache->stats.coalesced++;
+        e->pins++;
+        while (e->loading) {
+            pthread_cond_wait(&cache->loaded, &cache->lock);
+        }
+        int rc = e->result;
+        if (rc == 0) {
+            e->buf->refs++;
+            *out = e->buf;
+        }
+        if (--e->pins == 0 && !e->linked) {
+            segment_entry_free_locked(e);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        return rc;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (!e) {
+        pthread_mutex_unlock(&cache->lock);
+        return -1;
+    }
+    e->video_id = video_id;
+    e->index = index;
+    e->loading = 1;
+    e->pins = 1;
+    e->linked = 1;
+    e->hnext = cache->buckets[bucket];
+    cache->buckets[bucket] = e;
+    pthread_mutex_unlock(&cache->lock);
+
+    segment_buf_t *buf = NULL;
+    int rc = segment_cache_load(cache, video_id, index, path, &buf);
+
+    pthread_mutex_lock(&cache->lock);
+    e->loading = 0;
+    e->result = rc;
+    if (rc == 0) {
+        cache->stats.loads++;
+        buf->cache = cache;
+        buf->refs = 2; /* entry + caller */
+        e->buf = buf;
+        *out = buf;
+        if (e->linked) {
+            segment_lru_push_front(cache, e);
+            cache->stats.bytes += buf->frame_len;
+            cache->stats.entries++;
+            segment_cache_evict_locked(cache);
+        }
+    } else {
+        if (rc < 0) {
+            cache->stats.load_failures++;
+        } else {
+            cache->stats.bypassed++;
+        }
+        /* Not kept: the next request tries the disk again. */
+        if (e->linked) {
+            segment_entry_unlink_locked(cache, e);
+        }
+    }
+    pthread_cond_broadcast(&cache->loaded);
+    if (--e->pins == 0 && !e->linked) {
+        segment_entry_free_locked(e);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return rc;
+}
+
+void segment_buf_ref(segment_buf_t *buf) {
+    if (!buf) {
+        return;
+    }
+    pthread_mutex_lock(&buf->cache->lock);
+    buf->refs++;
+    pthread_mutex_unlock(&buf->cache->lock);
+}
+
+void segment_buf_release(segment_buf_t *buf) {
+    if (!buf) {
+        return;
+    }
+    segment_cache_t *cache = buf->cache;
+    pthread_mutex_lock(&cache->lock);
+    segment_buf_release_locked(buf);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void segment_cache_invalidate_video(segment_cache_t *cache, int video_id) {
+    if (!cache) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    for (unsigned i = 0; i < SEGMENT_CACHE_BUCKETS; ++i) {
+        segment_entry_t *e = cache->buckets[i];
+        while (e) {
+            segment_entry_t *next = e->hnext;
+            if (e->video_id == video_id) {
+                segment_entry_unlink_locked(cache, e);
+                cache->stats.invalidations++;
+            }
+            e = next;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void segment_cache_get_stats(segment_cache_t *cache, segment_cache_stats_t *out) {
+    if (!cache || !out) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    *out = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
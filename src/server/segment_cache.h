@@ -0,0 +1,95 @@
+#ifndef SERVER_SEGMENT_CACHE_H
+#define SERVER_SEGMENT_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Process-wide cache of DASH segment files keyed by (video_id, index). Entries
+ * are immutable refcounted buffers, so a connection can keep sending one after
+ * it was evicted or invalidated. Concurrent misses on the same key wait for a
+ * single disk read. Ready entries are evicted least recently used first once
+ * their total passes the capacity; buffers still referenced by senders live on
+ * until released. SEGMENT_CACHE_MB sets the capacity, 0 turns the cache off. */
+#define SEGMENT_CACHE_ENV         "SEGMENT_CACHE_MB"
+#define SEGMENT_CACHE_DEFAULT_MB  256
+#define SEGMENT_CACHE_MAX_MB      (64 * 1024)
+#define SEGMENT_CACHE_BUCKETS     4096
+#define SEGMENT_CACHE_INIT_INDEX  (-1) /* init-stream0.m4s */
+#define SEGMENT_CACHE_MAX_SHARE   8    /* larger files than capacity / this are not cached */
+#define SEGMENT_CACHE_HEADROOM    18   /* room in front of the payload for a frame prefix */
+
+struct segment_cache;
+struct segment_entry;
+
+/* Writes the prefix that goes in front of a segment of payload_len bytes into
+ * the end of head and returns its length (at most SEGMENT_CACHE_HEADROOM). Runs
+ * once per load, so a cached segment is already laid out as it goes out. arg is
+ * what segment_cache_set_framer was given. */
+typedef size_t (*segment_frame_fn)(int video_id,
+                                   int index,
+                                   size_t payload_len,
+                                   uint8_t head[SEGMENT_CACHE_HEADROOM],
+                                   void *arg);
+
+typedef struct segment_buf {
+    struct segment_cache *cache;
+    int refs; /* under the cache lock */
+    const uint8_t *data; /* the file's contents */
+    size_t len;
+    const uint8_t *frame; /* prefix + data, contiguous */
+    size_t frame_len;
+    uint8_t storage[];
+} segment_buf_t;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;      /* lookups that had to load or wait for a load */
+    uint64_t coalesced;   /* misses that waited for another thread's load */
+    uint64_t loads;
+    uint64_t load_failures;
+    uint64_t bypassed;    /* too large to cache, served from the file */
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t bytes;       /* held by cached entries, prefixes included */
+    uint64_t entries;
+    uint64_t capacity;
+} segment_cache_stats_t;
+
+typedef struct segment_cache {
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+    size_t capacity;
+    segment_frame_fn frame; /* NULL: frame is the bare payload */
+    void *frame_arg;
+    struct segment_entry *buckets[SEGMENT_CACHE_BUCKETS];
+    struct segment_entry *lru_head; /* most recently used */
+    struct segment_entry *lru_tail;
+    segment_cache_stats_t stats;
+} segment_cache_t;
+
+/* capacity 0 disables caching; lookups then return 1. */
+int segment_cache_init(segment_cache_t *cache, size_t capacity);
+/* Capacity from SEGMENT_CACHE_MB, or the default. */
+int segment_cache_init_from_env(segment_cache_t *cache);
+void segment_cache_destroy(segment_cache_t *cache);
+/* Set before the first lookup. */
+void segment_cache_set_framer(segment_cache_t *cache, segment_frame_fn frame, void *arg);
+/* 0 with a referenced buffer of path's contents, 1 when the caller should send
+ * the file itself (cache off or file too large), -1 when it cannot be read. */
+int segment_cache_get(segment_cache_t *cache, int video_id, int index, const char *path, segment_buf_t **out);
+void segment_buf_ref(segment_buf_t *buf);
+void segment_buf_release(segment_buf_t *buf);
+/* Drops every entry of video_id; loads in flight are not kept. */
+void segment_cache_invalidate_video(segment_cache_t *cache, int video_id);
+void segment_cache_get_stats(segment_cache_t *cache, segment_cache_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERVER_SEGMENT_CACHE_H
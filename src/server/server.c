@@ -1,8 +1,11 @@
+#define _GNU_SOURCE /* accept4, EPOLLEXCLUSIVE, pthread_condattr_setclock, MSG_MORE */
 #include "server/server.h"
+#include "server/quic_dispatch.h"
 #include "server/websocket.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #ifdef ENABLE_TLS
 #include <openssl/err.h>
@@ -12,20 +15,104 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
-#define SERVER_BACKLOG 8
+#define SERVER_BACKLOG      1024
+#define SERVER_EPOLL_BATCH  128
+#define SERVER_READ_CHUNK   16384
+#define SERVER_FILE_CHUNK   16384 /* one TLS record; files are copied through this, never loaded whole */
+#define SERVER_OUTBUF_KEEP  (64 * 1024) /* bigger output buffers are freed once drained */
+#define SERVER_FD_HEADROOM  64          /* files, DB, QUIC socket next to the clients */
 
+/* A file or a borrowed buffer sent without copying it into the output buffer. */
 typedef struct {
-    server_ctx_t *ctx;
-    int client_fd;
-    struct sockaddr_in addr;
-} client_task_t;
+    int file_fd; /* -1 for a buffer */
+    const uint8_t *data;
+    server_release_fn release;
+    void *owner;
+    uint64_t off;
+    uint64_t end;
+    /* Framed: lead then [off, end) as frames of at most fragment bytes. */
+    server_frame_fn frame;
+    size_t fragment;
+    int started;
+    uint8_t lead[SERVER_LEAD_MAX];
+    size_t lead_off;
+    size_t lead_len;
+    uint8_t head[SERVER_FRAME_HEAD_MAX];
+    size_t head_off;
+    size_t head_len;
+    uint64_t frame_left; /* payload bytes left in the current frame */
+    int cut;             /* cancelled: an empty final frame still closes the message */
+    int prebuilt;        /* the first frame came with the body */
+} server_body_t;
+
+struct server_conn {
+    server_ctx_t *server;
+    server_io_thread_t *io;
+    uint64_t id;
+    int fd;
+    SSL *ssl; /* optional */
+    pthread_mutex_t lock;
+    pthread_cond_t drained;
+    int refs;           /* I/O thread list + a scheduled worker */
+    int tls_pending;    /* SSL_accept not finished */
+    int tls_want_write; /* SSL_read needs the socket writable */
+    int ktls_send;      /* the kernel encrypts our records; files can use SSL_sendfile */
+    int detached;       /* a worker drives the socket in blocking mode */
+    int scheduled;
+    int dirty;          /* input arrived while scheduled */
+    int paused;         /* input buffer full, EPOLLIN off */
+    int closing;        /* close once output is flushed */
+    int wake_on_drain;  /* rerun the handler when the body is on the wire */
+    int wake_pending;   /* ...and it was, with no worker scheduled */
+    int shut;           /* shutdown() done */
+    int closed;
+    uint32_t events;
+    uint8_t *in;
+    size_t in_len;
+    size_t in_cap;
+    uint8_t *out;
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    int has_body;       /* body goes out after out */
+    server_body_t body;
+    uint8_t *tail;      /* written while the body is queued */
+    size_t tail_len;
+    size_t tail_cap;
+    uint8_t *urgent;    /* control messages waiting for a frame boundary */
+    size_t urgent_len;
+    size_t urgent_cap;
+    uint64_t bytes_sent;
+    uint64_t sendfile_bytes;
+    uint64_t last_active_ms;
+    websocket_session_t session;
+    server_conn_t *prev;
+    server_conn_t *next;
+    server_conn_t *reap_next;
+};
 
-static void *client_worker(void *arg);
-static void *accept_loop(void *arg);
+struct server_io_thread {
+    server_ctx_t *server;
+    pthread_t thread;
+    int started;
+    int epfd;
+    int wake_fd;
+    pthread_mutex_t lock; /* conns; taken after server->lock */
+    server_conn_t *conns;
+};
+
+static void *server_io_main(void *arg);
 
 static void server_close_socket(int *fd) {
     if (*fd >= 0) {
@@ -35,6 +122,62 @@ static void server_close_socket(int *fd) {
     }
 }
 
+static uint64_t server_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static int server_set_nonblocking(int fd, int nonblocking) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    flags = nonblocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+    return fcntl(fd, F_SETFL, flags);
+}
+
+/* Each client needs a descriptor; the usual soft limit of 1024 would cap viewers long before max_clients. */
+static void server_raise_fd_limit(int max_clients) {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) != 0) {
+        return;
+    }
+    rlim_t needed = (rlim_t)max_clients + SERVER_FD_HEADROOM;
+    if (lim.rlim_cur >= needed) {
+        return;
+    }
+    lim.rlim_cur = lim.rlim_max == RLIM_INFINITY || lim.rlim_max >= needed ? needed : lim.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur < needed) {
+        fprintf(stderr, "[server] RLIMIT_NOFILE is %lu, below max_clients %d\n", (unsigned long)lim.rlim_cur, max_clients);
+    }
+}
+
+int server_parse_thread_config(const char *spec, unsigned *io_threads, unsigned *workers) {
+    if (!spec || !io_threads || !workers) {
+        return -1;
+    }
+    char *end = NULL;
+    unsigned long parsed_io = strtoul(spec, &end, 10);
+    unsigned long parsed_workers = SERVER_DEFAULT_WORKERS;
+    if (end == spec || parsed_io == 0 || parsed_io > SERVER_MAX_IO_THREADS) {
+        return -1;
+    }
+    if (*end == ':') {
+        const char *p = end + 1;
+        parsed_workers = strtoul(p, &end, 10);
+        if (end == p || parsed_workers == 0 || parsed_workers > QUIC_DISPATCH_MAX_WORKERS) {
+            return -1;
+        }
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *io_threads = (unsigned)parsed_io;
+    *workers = (unsigned)parsed_workers;
+    return 0;
+}
+
 int server_init(server_ctx_t *ctx, const char *bind_ip, uint16_t port, int max_clients) {
     if (!ctx || !bind_ip || max_clients <= 0) {
         return -1;
@@ -46,11 +189,37 @@ int server_init(server_ctx_t *ctx, const char *bind_ip, uint16_t port, int max_c
     ctx->port = port;
     strncpy(ctx->bind_ip, bind_ip, sizeof(ctx->bind_ip) - 1);
     pthread_mutex_init(&ctx->lock, NULL);
-    pthread_cond_init(&ctx->clients_cv, NULL);
     ctx->ws_context = NULL;
     ctx->ssl_ctx = NULL;
+    const char *sendfile_spec = getenv(SERVER_SENDFILE_ENV);
+    ctx->use_sendfile = !(sendfile_spec && strcmp(sendfile_spec, "0") == 0);
+    ctx->outbuf_high = SERVER_OUTBUF_HIGH;
+    const char *outbuf_spec = getenv(SERVER_OUTBUF_ENV);
+    if (outbuf_spec && outbuf_spec[0] != '\0') {
+        char *end = NULL;
+        unsigned long kb = strtoul(outbuf_spec, &end, 10);
+        if (*end != '\0' || kb * 1024 < SERVER_OUTBUF_MIN || kb > 1024 * 1024) {
+            fprintf(stderr, "[server] ignoring invalid %s=%s\n", SERVER_OUTBUF_ENV, outbuf_spec);
+        } else {
+            ctx->outbuf_high = (size_t)kb * 1024;
+        }
+    }
+    ctx->io_thread_count = SERVER_DEFAULT_IO_THREADS;
+    ctx->worker_count = SERVER_DEFAULT_WORKERS;
+
+    const char *threads_spec = getenv(SERVER_THREADS_ENV);
+    if (threads_spec && threads_spec[0] != '\0') {
+        if (server_parse_thread_config(threads_spec, &ctx->io_thread_count, &ctx->worker_count) != 0) {
+            fprintf(stderr, "[server] ignoring invalid %s=%s\n", SERVER_THREADS_ENV, threads_spec);
+            ctx->io_thread_count = SERVER_DEFAULT_IO_THREADS;
+            ctx->worker_count = SERVER_DEFAULT_WORKERS;
+        } else {
+            printf("[server] %u I/O threads, %u workers\n", ctx->io_thread_count, ctx->worker_count);
+        }
+    }
+    server_raise_fd_limit(max_clients);
 
-    ctx->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    ctx->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (ctx->listen_fd < 0) {
         perror("socket");
         return -1;
@@ -126,6 +295,16 @@ int server_enable_tls(server_ctx_t *ctx, const char *cert_path, const char *key_
         ctx->ssl_ctx = NULL;
         return -1;
     }
+    /* Writes from the output buffer may be partial and resume after it grew or moved. */
+    SSL_CTX_set_mode(ctx->ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+    /* OpenSSL switches a connection to kernel TLS after the handshake when the
+     * kernel has the tls module and the cipher is supported; others stay in userspace. */
+    const char *ktls_spec = getenv(SERVER_KTLS_ENV);
+    if (!(ktls_spec && strcmp(ktls_spec, "0") == 0)) {
+        SSL_CTX_set_options(ctx->ssl_ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
     return 0;
 #else
     (void)cert_path;
@@ -134,187 +313,1297 @@ int server_enable_tls(server_ctx_t *ctx, const char *cert_path, const char *key_
 #endif
 }
 
-int server_start(server_ctx_t *ctx) {
-    if (!ctx || ctx->listen_fd < 0) {
+int server_set_threads(server_ctx_t *ctx, unsigned io_threads, unsigned workers) {
+    if (!ctx || ctx->io_threads || io_threads == 0 || io_threads > SERVER_MAX_IO_THREADS || workers == 0 ||
+        workers > QUIC_DISPATCH_MAX_WORKERS) {
         return -1;
     }
+    ctx->io_thread_count = io_threads;
+    ctx->worker_count = workers;
+    return 0;
+}
 
-    int rc = pthread_create(&ctx->accept_thread, NULL, accept_loop, ctx);
-    if (rc != 0) {
-        errno = rc;
-        perror("pthread_create");
-        return -1;
+/* ---- connections ---- */
+
+static void server_body_drop(server_body_t *body) {
+    if (body->file_fd >= 0) {
+        close(body->file_fd);
+    } else if (body->release) {
+        body->release(body->owner);
     }
+    memset(body, 0, sizeof(*body));
+    body->file_fd = -1;
+}
 
+static void server_conn_drop_body(server_conn_t *conn) {
+    if (conn->has_body) {
+        server_body_drop(&conn->body);
+        conn->has_body = 0;
+    }
+}
+
+static void server_conn_free(server_conn_t *conn) {
+#ifdef ENABLE_TLS
+    if (conn->ssl) {
+        SSL_free(conn->ssl);
+    }
+#endif
+    if (conn->fd >= 0) {
+        close(conn->fd);
+    }
+    server_conn_drop_body(conn);
+    free(conn->in);
+    free(conn->out);
+    free(conn->tail);
+    free(conn->urgent);
+    pthread_cond_destroy(&conn->drained);
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+static void server_conn_unref(server_conn_t *conn) {
+    pthread_mutex_lock(&conn->lock);
+    int last = --conn->refs == 0;
+    pthread_mutex_unlock(&conn->lock);
+    if (last) {
+        server_conn_free(conn);
+    }
+}
+
+static server_conn_t *server_conn_create(server_ctx_t *ctx, int fd) {
+    server_conn_t *conn = calloc(1, sizeof(*conn));
+    if (!conn) {
+        return NULL;
+    }
+    conn->server = ctx;
+    conn->fd = fd;
+    conn->body.file_fd = -1;
+    conn->refs = 1;
+    conn->last_active_ms = server_now_ms();
+    pthread_mutex_init(&conn->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&conn->drained, &attr);
+    pthread_condattr_destroy(&attr);
+#ifdef ENABLE_TLS
+    if (ctx->ssl_ctx) {
+        conn->ssl = SSL_new(ctx->ssl_ctx);
+        if (!conn->ssl) {
+            conn->fd = -1;
+            server_conn_free(conn);
+            return NULL;
+        }
+        SSL_set_fd(conn->ssl, fd);
+        SSL_set_accept_state(conn->ssl);
+        conn->tls_pending = 1;
+    }
+#endif
+    return conn;
+}
+
+static int server_buf_append(uint8_t **buf, size_t *len, size_t *cap, const void *data, size_t n) {
+    if (*len + n > *cap) {
+        size_t new_cap = *cap ? *cap : 4096;
+        while (new_cap < *len + n) {
+            new_cap *= 2;
+        }
+        uint8_t *grown = realloc(*buf, new_cap);
+        if (!grown) {
+            return -1;
+        }
+        *buf = grown;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
     return 0;
 }
 
-void server_request_stop(server_ctx_t *ctx) {
-    if (!ctx) {
+static uint64_t server_body_left(const server_body_t *body) {
+    return (body->end - body->off) + (body->lead_len - body->lead_off) + (body->head_len - body->head_off) +
+           (uint64_t)body->cut;
+}
+
+/* Bytes copied into the connection; what the output cap applies to. */
+static size_t server_conn_buffered_locked(const server_conn_t *conn) {
+    return conn->out_len - conn->out_off + conn->tail_len + conn->urgent_len;
+}
+
+/* Bytes queued but not yet handed to the socket. */
+static uint64_t server_conn_pending_locked(const server_conn_t *conn) {
+    uint64_t pending = server_conn_buffered_locked(conn);
+    if (conn->has_body) {
+        pending += server_body_left(&conn->body);
+    }
+    return pending;
+}
+
+static void server_conn_update_events_locked(server_conn_t *conn) {
+    if (conn->closed || conn->detached || conn->shut) {
         return;
     }
+    uint32_t want = 0;
+    if (!conn->paused && !conn->closing) {
+        want |= EPOLLIN;
+    }
+    /* A wakeup noticed off the I/O thread is delivered by the next EPOLLOUT. */
+    if (server_conn_pending_locked(conn) > 0 || conn->tls_want_write || conn->wake_pending) {
+        want |= EPOLLOUT;
+    }
+    if (want != conn->events) {
+        struct epoll_event ev = {.events = want, .data.ptr = conn};
+        if (epoll_ctl(conn->io->epfd, EPOLL_CTL_MOD, conn->fd, &ev) == 0) {
+            conn->events = want;
+        }
+    }
+}
 
-    pthread_mutex_lock(&ctx->lock);
-    ctx->running = 0;
-    pthread_mutex_unlock(&ctx->lock);
-    server_close_socket(&ctx->listen_fd);
+/* The I/O thread sees the hangup and closes; close_notify only when no worker uses the SSL. */
+static void server_conn_shutdown_locked(server_conn_t *conn, int notify) {
+    if (conn->shut) {
+        return;
+    }
+#ifdef ENABLE_TLS
+    if (notify && conn->ssl && !conn->tls_pending) {
+        SSL_shutdown(conn->ssl);
+    }
+#else
+    (void)notify;
+#endif
+    shutdown(conn->fd, SHUT_RDWR);
+    conn->shut = 1;
 }
 
-void server_join(server_ctx_t *ctx) {
-    if (!ctx) {
+/* Bytes the socket took from a buffer or file, 0 when it would block, -1 on error. */
+static ssize_t server_conn_send_locked(server_conn_t *conn, const uint8_t *data, size_t len, int more) {
+#ifdef ENABLE_TLS
+    if (conn->ssl) {
+        (void)more;
+        int r = SSL_write(conn->ssl, data, (int)len);
+        if (r <= 0) {
+            int err = SSL_get_error(conn->ssl, r);
+            return err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ ? 0 : -1;
+        }
+        return r;
+    }
+#endif
+    for (;;) {
+        ssize_t n = send(conn->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT | (more ? MSG_MORE : 0));
+        if (n >= 0) {
+            return n;
+        }
+        if (errno != EINTR) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+    }
+}
+
+/* Plaintext goes out through sendfile and kTLS through SSL_sendfile; userspace
+ * TLS, or a file sendfile refuses, is read one chunk at a time into a stack
+ * buffer. A partial write rereads the same range, which also keeps the
+ * SSL_write retry identical. At most limit bytes (the rest of a frame). */
+static ssize_t server_conn_send_file_locked(server_conn_t *conn, uint64_t limit) {
+    uint64_t left = conn->body.end - conn->body.off;
+    if (left > limit) {
+        left = limit;
+    }
+#if defined(ENABLE_TLS) && defined(SSL_OP_ENABLE_KTLS)
+    if (conn->ssl && conn->ktls_send && conn->server->use_sendfile) {
+        size_t len = left > (1U << 30) ? (size_t)1U << 30 : (size_t)left;
+        ossl_ssize_t n = SSL_sendfile(conn->ssl, conn->body.file_fd, (off_t)conn->body.off, len, 0);
+        if (n > 0) {
+            conn->sendfile_bytes += (uint64_t)n;
+            return (ssize_t)n;
+        }
+        int err = SSL_get_error(conn->ssl, (int)n);
+        if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+            return 0;
+        }
+        return -1;
+    }
+#endif
+    if (!conn->ssl && conn->server->use_sendfile) {
+        size_t len = left > (1U << 30) ? (size_t)1U << 30 : (size_t)left;
+        off_t off = (off_t)conn->body.off;
+        for (;;) {
+            ssize_t n = sendfile(conn->fd, conn->body.file_fd, &off, len);
+            if (n > 0) {
+                conn->sendfile_bytes += (uint64_t)n;
+                return n;
+            }
+            if (n == 0) {
+                return -1; /* file shrank under us */
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            if (errno != EINTR) {
+                break;
+            }
+        }
+        if (errno != EINVAL && errno != ENOSYS) {
+            return -1;
+        }
+    }
+    uint8_t chunk[SERVER_FILE_CHUNK];
+    size_t len = left > sizeof(chunk) ? sizeof(chunk) : (size_t)left;
+    ssize_t got = pread(conn->body.file_fd, chunk, len, (off_t)conn->body.off);
+    if (got != (ssize_t)len) {
+        return -1;
+    }
+    return server_conn_send_locked(conn, chunk, len, 0);
+}
+
+/* 1 once every urgent byte is out, 0 when the socket is full, -1 on error. */
+static int server_conn_flush_urgent_locked(server_conn_t *conn) {
+    size_t done = 0;
+    while (done < conn->urgent_len) {
+        ssize_t n = server_conn_send_locked(conn, conn->urgent + done, conn->urgent_len - done, 1);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t)n;
+        conn->bytes_sent += (uint64_t)n;
+    }
+    if (done > 0) {
+        memmove(conn->urgent, conn->urgent + done, conn->urgent_len - done);
+        conn->urgent_len -= done;
+    }
+    return conn->urgent_len == 0;
+}
+
+/* Next piece of the body: the frame header, the lead, then file or buffer
+ * bytes, never past the end of the current frame. Between two frames the
+ * urgent bytes go first. Bytes sent, 0 when the socket is full, -1 on error. */
+static ssize_t server_conn_send_body_locked(server_conn_t *conn) {
+    server_body_t *body = &conn->body;
+    if (body->frame && body->head_off == body->head_len && body->frame_left == 0) {
+        int urgent = server_conn_flush_urgent_locked(conn);
+        if (urgent <= 0) {
+            return urgent;
+        }
+        uint64_t left = (body->lead_len - body->lead_off) + (body->end - body->off);
+        uint64_t len = left < body->fragment ? left : body->fragment;
+        body->head_len = body->frame(!body->started, len == left, len, body->head);
+        body->head_off = 0;
+        body->cut = 0;
+        body->frame_left = len;
+        body->started = 1;
+    }
+    if (body->head_off < body->head_len) {
+        ssize_t n = server_conn_send_locked(conn, body->head + body->head_off, body->head_len - body->head_off, 1);
+        if (n > 0) {
+            body->head_off += (size_t)n;
+        }
+        return n;
+    }
+    uint64_t limit = body->frame ? body->frame_left : UINT64_MAX;
+    ssize_t n = 0;
+    if (body->lead_off < body->lead_len) {
+        size_t len = body->lead_len - body->lead_off;
+        if (len > limit) {
+            len = (size_t)limit;
+        }
+        n = server_conn_send_locked(conn, body->lead + body->lead_off, len, 1);
+        if (n > 0) {
+            body->lead_off += (size_t)n;
+        }
+    } else {
+        if (body->file_fd >= 0) {
+            n = server_conn_send_file_locked(conn, limit);
+        } else {
+            uint64_t len = body->end - body->off;
+            if (len > limit) {
+                len = limit;
+            }
+            n = server_conn_send_locked(conn, body->data + body->off, len > (1U << 30) ? (size_t)1U << 30 : (size_t)len, 0);
+        }
+        if (n > 0) {
+            body->off += (uint64_t)n;
+        }
+    }
+    if (n > 0 && body->frame) {
+        body->frame_left -= (uint64_t)n;
+    }
+    return n;
+}
+
+/* 0 when the socket took everything it could, -1 on a write error. */
+static int server_conn_flush_locked(server_conn_t *conn) {
+    uint64_t before = conn->bytes_sent;
+    for (;;) {
+        while (conn->out_off < conn->out_len) {
+            size_t len = conn->out_len - conn->out_off;
+            if (len > (1U << 30)) {
+                len = 1U << 30;
+            }
+            /* With a file next, the prefix and the file's first bytes share segments. */
+            ssize_t n = server_conn_send_locked(conn, conn->out + conn->out_off, len, conn->has_body);
+            if (n < 0) {
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            conn->out_off += (size_t)n;
+            conn->bytes_sent += (uint64_t)n;
+        }
+        if (conn->out_off < conn->out_len) {
+            break;
+        }
+        conn->out_off = 0;
+        conn->out_len = 0;
+        if (!conn->has_body) {
+            break;
+        }
+        while (server_body_left(&conn->body) > 0) {
+            ssize_t n = server_conn_send_body_locked(conn);
+            if (n < 0) {
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            conn->bytes_sent += (uint64_t)n;
+        }
+        if (server_body_left(&conn->body) > 0) {
+            break;
+        }
+        server_conn_drop_body(conn);
+        if (conn->wake_on_drain) {
+            conn->wake_on_drain = 0;
+            if (conn->scheduled) {
+                conn->dirty = 1;
+            } else {
+                conn->wake_pending = 1;
+            }
+        }
+        /* Control messages still waiting, then what was written behind the file. */
+        if (conn->urgent_len > 0) {
+            if (server_buf_append(&conn->urgent, &conn->urgent_len, &conn->urgent_cap, conn->tail, conn->tail_len) != 0) {
+                return -1;
+            }
+            uint8_t *tail = conn->tail;
+            size_t tail_cap = conn->tail_cap;
+            conn->tail = conn->urgent;
+            conn->tail_len = conn->urgent_len;
+            conn->tail_cap = conn->urgent_cap;
+            conn->urgent = tail;
+            conn->urgent_len = 0;
+            conn->urgent_cap = tail_cap;
+        }
+        uint8_t *spare = conn->out;
+        size_t spare_cap = conn->out_cap;
+        conn->out = conn->tail;
+        conn->out_len = conn->tail_len;
+        conn->out_cap = conn->tail_cap;
+        conn->tail = spare;
+        conn->tail_len = 0;
+        conn->tail_cap = spare_cap;
+    }
+    if (conn->out_len == 0 && conn->out_cap > SERVER_OUTBUF_KEEP) {
+        free(conn->out);
+        conn->out = NULL;
+        conn->out_cap = 0;
+    }
+    if (conn->tail_len == 0 && conn->tail_cap > SERVER_OUTBUF_KEEP) {
+        free(conn->tail);
+        conn->tail = NULL;
+        conn->tail_cap = 0;
+    }
+    if (conn->urgent_len == 0 && conn->urgent_cap > SERVER_OUTBUF_KEEP) {
+        free(conn->urgent);
+        conn->urgent = NULL;
+        conn->urgent_cap = 0;
+    }
+    if (conn->bytes_sent != before || server_conn_pending_locked(conn) == 0) {
+        conn->last_active_ms = server_now_ms();
+        pthread_cond_broadcast(&conn->drained);
+    }
+    return 0;
+}
+
+/* 1 when input was appended, 0 when none was ready, -1 on EOF or error. */
+static int server_conn_read_locked(server_conn_t *conn) {
+    uint8_t chunk[SERVER_READ_CHUNK];
+    int got = 0;
+    while (conn->in_len < SERVER_INBUF_MAX) {
+        size_t room = SERVER_INBUF_MAX - conn->in_len;
+        if (room > sizeof(chunk)) {
+            room = sizeof(chunk);
+        }
+        ssize_t n = 0;
+#ifdef ENABLE_TLS
+        if (conn->ssl) {
+            int r = SSL_read(conn->ssl, chunk, (int)room);
+            if (r <= 0) {
+                int err = SSL_get_error(conn->ssl, r);
+                if (err == SSL_ERROR_WANT_READ) {
+                    break;
+                }
+                if (err == SSL_ERROR_WANT_WRITE) {
+                    conn->tls_want_write = 1;
+                    break;
+                }
+                return -1;
+            }
+            n = r;
+        } else
+#endif
+        {
+            n = recv(conn->fd, chunk, room, MSG_DONTWAIT);
+            if (n == 0) {
+                return -1;
+            }
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                return -1;
+            }
+        }
+        if (server_buf_append(&conn->in, &conn->in_len, &conn->in_cap, chunk, (size_t)n) != 0) {
+            return -1;
+        }
+        got = 1;
+    }
+    if (conn->in_len >= SERVER_INBUF_MAX) {
+        conn->paused = 1;
+    }
+    if (got) {
+        conn->last_active_ms = server_now_ms();
+    }
+    return got;
+}
+
+#ifdef ENABLE_TLS
+static int server_conn_tls_accept_locked(server_conn_t *conn) {
+    int r = SSL_do_handshake(conn->ssl);
+    if (r == 1) {
+        conn->tls_pending = 0;
+        conn->tls_want_write = 0;
+        conn->ktls_send = BIO_get_ktls_send(SSL_get_wbio(conn->ssl)) ? 1 : 0;
+        return 0;
+    }
+    int err = SSL_get_error(conn->ssl, r);
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        conn->tls_want_write = err == SSL_ERROR_WANT_WRITE;
+        return 0;
+    }
+    // SSL 핸드셰이크 실패 (평문 HTTP 요청이 HTTPS 포트로 온 경우 등)
+    fprintf(stderr, "[TLS] SSL_accept failed for client (possibly plain HTTP on HTTPS port)\n");
+    return -1;
+}
+#endif
+
+/* I/O thread only; the list lock must not be held. Drops the list's reference. */
+static void server_conn_close(server_conn_t *conn) {
+    server_io_thread_t *io = conn->io;
+    server_ctx_t *ctx = conn->server;
+    pthread_mutex_lock(&conn->lock);
+    if (conn->closed) {
+        pthread_mutex_unlock(&conn->lock);
         return;
     }
+    conn->closed = 1;
+    int was_detached = conn->detached;
+    server_conn_shutdown_locked(conn, !was_detached);
+    pthread_cond_broadcast(&conn->drained);
+    pthread_mutex_unlock(&conn->lock);
+    if (!was_detached) {
+        epoll_ctl(io->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
 
-    pthread_join(ctx->accept_thread, NULL);
+    pthread_mutex_lock(&io->lock);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        io->conns = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    conn->prev = conn->next = NULL;
+    pthread_mutex_unlock(&io->lock);
 
+    pthread_mutex_lock(&conn->lock);
+    uint64_t bytes_sent = conn->bytes_sent;
+    uint64_t sendfile_bytes = conn->sendfile_bytes;
+    int ktls_send = conn->ktls_send;
+    pthread_mutex_unlock(&conn->lock);
     pthread_mutex_lock(&ctx->lock);
-    while (ctx->client_count > 0) {
-        pthread_cond_wait(&ctx->clients_cv, &ctx->lock);
+    if (ctx->client_count > 0) {
+        ctx->client_count--;
     }
+    ctx->stats.bytes_sent += bytes_sent;
+    ctx->stats.sendfile_bytes += sendfile_bytes;
+    ctx->stats.ktls_connections += (uint64_t)ktls_send;
     pthread_mutex_unlock(&ctx->lock);
+    server_conn_unref(conn);
 }
 
-void server_destroy(server_ctx_t *ctx) {
-    if (!ctx) {
-        return;
+static void server_conn_run(void *arg);
+
+static void server_conn_schedule(server_conn_t *conn) {
+    if (quic_dispatch_submit(conn->server->workers, conn->id, server_conn_run, conn) != 0) {
+        pthread_mutex_lock(&conn->lock);
+        conn->scheduled = 0;
+        pthread_mutex_unlock(&conn->lock);
+        server_conn_unref(conn);
+    }
+}
+
+/* Worker task: hands new input to the protocol until none is left. */
+static void server_conn_run(void *arg) {
+    server_conn_t *conn = (server_conn_t *)arg;
+    websocket_context_t *ws = conn->server->ws_context;
+    for (;;) {
+        pthread_mutex_lock(&conn->lock);
+        conn->dirty = 0;
+        if (conn->closed || conn->closing) {
+            conn->scheduled = 0;
+            pthread_mutex_unlock(&conn->lock);
+            break;
+        }
+        pthread_mutex_unlock(&conn->lock);
+
+        int rc = websocket_process_input(conn, &conn->session, ws);
+
+        pthread_mutex_lock(&conn->lock);
+        if (conn->detached) {
+            /* Back under epoll only to be noticed and closed by the I/O thread. */
+            conn->detached = 0;
+            conn->closing = 1;
+            if (!conn->closed) {
+                server_conn_shutdown_locked(conn, 1);
+                server_set_nonblocking(conn->fd, 1);
+                struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+                if (epoll_ctl(conn->io->epfd, EPOLL_CTL_ADD, conn->fd, &ev) == 0) {
+                    conn->events = EPOLLIN;
+                }
+            }
+        } else if (rc != 0) {
+            conn->closing = 1;
+            if (server_conn_pending_locked(conn) == 0) {
+                server_conn_shutdown_locked(conn, 1);
+            }
+            server_conn_update_events_locked(conn);
+        } else if (conn->paused && conn->in_len < SERVER_INBUF_MAX && !conn->closed) {
+            /* Read here too: TLS may hold decrypted bytes that epoll will never report. */
+            conn->paused = 0;
+            int got = server_conn_read_locked(conn);
+            if (got < 0) {
+                conn->closing = 1;
+                server_conn_shutdown_locked(conn, 0);
+            } else if (got > 0) {
+                conn->dirty = 1;
+            }
+            server_conn_update_events_locked(conn);
+        }
+        int again = conn->dirty && !conn->closing && !conn->closed;
+        if (!again) {
+            conn->scheduled = 0;
+        }
+        pthread_mutex_unlock(&conn->lock);
+        if (!again) {
+            break;
+        }
     }
+    server_conn_unref(conn);
+}
 
-    server_close_socket(&ctx->listen_fd);
-    pthread_mutex_destroy(&ctx->lock);
-    pthread_cond_destroy(&ctx->clients_cv);
+size_t server_conn_buffered(server_conn_t *conn) {
+    pthread_mutex_lock(&conn->lock);
+    size_t len = conn->in_len;
+    pthread_mutex_unlock(&conn->lock);
+    return len;
+}
+
+size_t server_conn_peek(server_conn_t *conn, void *buf, size_t len) {
+    pthread_mutex_lock(&conn->lock);
+    if (len > conn->in_len) {
+        len = conn->in_len;
+    }
+    if (len > 0) {
+        memcpy(buf, conn->in, len);
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return len;
+}
+
+void server_conn_consume(server_conn_t *conn, size_t len) {
+    pthread_mutex_lock(&conn->lock);
+    if (len >= conn->in_len) {
+        conn->in_len = 0;
+        free(conn->in);
+        conn->in = NULL;
+        conn->in_cap = 0;
+    } else {
+        memmove(conn->in, conn->in + len, conn->in_len - len);
+        conn->in_len -= len;
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/* Waits while more than outbuf_high is buffered (or, for a body, while one is queued).
+ * -1 once the connection is gone or nothing drained for SERVER_WRITE_TIMEOUT_MS. */
+static int server_conn_wait_room_locked(server_conn_t *conn, int for_body) {
+    struct timespec deadline;
+    uint64_t last_sent = conn->bytes_sent;
+    int armed = 0;
+    while (!conn->closed && !conn->shut &&
+           (server_conn_buffered_locked(conn) > conn->server->outbuf_high || (for_body && conn->has_body))) {
+        if (!armed || conn->bytes_sent != last_sent) {
+            /* A slow reader that keeps draining is not stalled. */
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += SERVER_WRITE_TIMEOUT_MS / 1000;
+            deadline.tv_nsec += (long)(SERVER_WRITE_TIMEOUT_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            last_sent = conn->bytes_sent;
+            armed = 1;
+        }
+        if (pthread_cond_timedwait(&conn->drained, &conn->lock, &deadline) == ETIMEDOUT && conn->bytes_sent == last_sent) {
+            return -1;
+        }
+    }
+    return conn->closed || conn->shut || conn->detached ? -1 : 0;
+}
+
+/* Appends behind whatever is queued: the output buffer, or the tail while a body is. */
+static int server_conn_queue_locked(server_conn_t *conn, const void *buf, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (conn->has_body) {
+        return server_buf_append(&conn->tail, &conn->tail_len, &conn->tail_cap, buf, len);
+    }
+    if (conn->out_off > 0) {
+        memmove(conn->out, conn->out + conn->out_off, conn->out_len - conn->out_off);
+        conn->out_len -= conn->out_off;
+        conn->out_off = 0;
+    }
+    return server_buf_append(&conn->out, &conn->out_len, &conn->out_cap, buf, len);
+}
+
+/* Flushes after queueing; on failure the connection goes, since a
+ * half-written frame would corrupt the stream. */
+static int server_conn_finish_write_locked(server_conn_t *conn, int rc) {
+    if (rc == 0 && !conn->tls_pending) {
+        rc = server_conn_flush_locked(conn);
+    }
+    if (rc != 0) {
+        conn->closing = 1;
+        server_conn_shutdown_locked(conn, 0);
+    } else {
+        server_conn_update_events_locked(conn);
+    }
+    return rc;
+}
+
+int server_conn_write(server_conn_t *conn, const void *buf, size_t len) {
+    if (!conn || (!buf && len > 0)) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&conn->lock);
+    int rc = server_conn_wait_room_locked(conn, 0);
+    if (rc == 0) {
+        rc = server_conn_queue_locked(conn, buf, len);
+    }
+    rc = server_conn_finish_write_locked(conn, rc);
+    pthread_mutex_unlock(&conn->lock);
+    return rc;
+}
+
+int server_conn_writev(server_conn_t *conn, const struct iovec *iov, int iovcnt) {
+    if (!conn || (!iov && iovcnt > 0) || iovcnt < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&conn->lock);
+    int rc = server_conn_wait_room_locked(conn, 0);
+    for (int i = 0; rc == 0 && i < iovcnt; ++i) {
+        rc = server_conn_queue_locked(conn, iov[i].iov_base, iov[i].iov_len);
+    }
+    rc = server_conn_finish_write_locked(conn, rc);
+    pthread_mutex_unlock(&conn->lock);
+    return rc;
+}
+
+int server_conn_write_urgent(server_conn_t *conn, const void *buf, size_t len) {
+    if (!conn || (!buf && len > 0)) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&conn->lock);
+    int rc = server_conn_wait_room_locked(conn, 0);
+    if (rc == 0) {
+        rc = conn->has_body ? server_buf_append(&conn->urgent, &conn->urgent_len, &conn->urgent_cap, buf, len)
+                            : server_conn_queue_locked(conn, buf, len);
+    }
+    rc = server_conn_finish_write_locked(conn, rc);
+    pthread_mutex_unlock(&conn->lock);
+    return rc;
+}
+
+/* Queues prefix, then body; on failure the body is dropped, which closes the
+ * file or releases the buffer. */
+static int server_conn_queue_body(server_conn_t *conn, const void *prefix, size_t prefix_len, server_body_t *body) {
+    pthread_mutex_lock(&conn->lock);
+    int rc = server_conn_wait_room_locked(conn, 1);
+    if (rc == 0) {
+        rc = server_conn_queue_locked(conn, prefix, prefix_len);
+    }
+    if (rc == 0 && server_body_left(body) > 0) {
+        conn->body = *body;
+        conn->has_body = 1;
+    } else {
+        server_body_drop(body);
+    }
+    rc = server_conn_finish_write_locked(conn, rc);
+    pthread_mutex_unlock(&conn->lock);
+    return rc;
+}
+
+int server_conn_send_file(server_conn_t *conn, const void *prefix, size_t prefix_len, int file_fd, uint64_t offset, size_t len) {
+    if (!conn || file_fd < 0 || (!prefix && prefix_len > 0)) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        return -1;
+    }
+    server_body_t body = {.file_fd = file_fd, .off = offset, .end = offset + len};
+    return server_conn_queue_body(conn, prefix, prefix_len, &body);
+}
+
+int server_conn_send_buffer(server_conn_t *conn,
+                            const void *prefix,
+                            size_t prefix_len,
+                            const uint8_t *data,
+                            size_t len,
+                            server_release_fn release,
+                            void *owner) {
+    if (!conn || (!data && len > 0) || (!prefix && prefix_len > 0)) {
+        if (release) {
+            release(owner);
+        }
+        return -1;
+    }
+    server_body_t body = {.file_fd = -1, .data = data, .release = release, .owner = owner, .end = len};
+    return server_conn_queue_body(conn, prefix, prefix_len, &body);
+}
+
+static int server_body_set_framing(server_body_t *body, const server_framing_t *framing) {
+    if (!framing || framing->fragment == 0 || !framing->frame || framing->lead_len > SERVER_LEAD_MAX ||
+        (!framing->lead && framing->lead_len > 0) ||
+        (framing->first_frame > 0 && (framing->lead_len > 0 || framing->first_frame > body->end - body->off))) {
+        return -1;
+    }
+    if (framing->first_frame > 0) {
+        /* Goes out as is; continuation frames follow. */
+        body->started = 1;
+        body->prebuilt = 1;
+        body->frame_left = framing->first_frame;
+    }
+    body->frame = framing->frame;
+    body->fragment = framing->fragment;
+    if (framing->lead_len > 0) {
+        memcpy(body->lead, framing->lead, framing->lead_len);
+    }
+    body->lead_len = framing->lead_len;
+    return 0;
+}
+
+int server_conn_send_file_framed(server_conn_t *conn,
+                                 const server_framing_t *framing,
+                                 int file_fd,
+                                 uint64_t offset,
+                                 size_t len) {
+    server_body_t body = {.file_fd = file_fd, .off = offset, .end = offset + len};
+    if (!conn || file_fd < 0 || server_body_set_framing(&body, framing) != 0) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        return -1;
+    }
+    return server_conn_queue_body(conn, NULL, 0, &body);
+}
+
+int server_conn_send_buffer_framed(server_conn_t *conn,
+                                   const server_framing_t *framing,
+                                   const uint8_t *data,
+                                   size_t len,
+                                   server_release_fn release,
+                                   void *owner) {
+    server_body_t body = {.file_fd = -1, .data = data, .release = release, .owner = owner, .end = len};
+    if (!conn || (!data && len > 0) || server_body_set_framing(&body, framing) != 0) {
+        if (release) {
+            release(owner);
+        }
+        return -1;
+    }
+    return server_conn_queue_body(conn, NULL, 0, &body);
+}
+
+uint64_t server_conn_cancel_body(server_conn_t *conn) {
+    if (!conn) {
+        return 0;
+    }
+    pthread_mutex_lock(&conn->lock);
+    server_body_t *body = &conn->body;
+    uint64_t saved = 0;
+    if (conn->has_body && body->frame && !conn->closed && !conn->shut) {
+        uint64_t lead_left = body->lead_len - body->lead_off;
+        uint64_t payload_left = lead_left + (body->end - body->off);
+        if (!body->started || (body->prebuilt && body->off == 0)) {
+            /* Nothing of the message is out yet: drop all of it. */
+            saved = payload_left;
+            body->lead_off = body->lead_len;
+            body->off = body->end;
+        } else if (payload_left > body->frame_left) {
+            /* Finish the frame on the wire, then close the message empty. */
+            saved = payload_left - body->frame_left;
+            if (body->frame_left <= lead_left) {
+                body->lead_len = body->lead_off + (size_t)body->frame_left;
+                body->end = body->off;
+            } else {
+                body->end = body->off + (body->frame_left - lead_left);
+            }
+            body->cut = 1;
+        }
+        if (saved > 0) {
+            server_conn_finish_write_locked(conn, 0);
+        }
+    }
+    pthread_mutex_unlock(&conn->lock);
+    return saved;
+}
+
+int server_conn_wake_on_drain(server_conn_t *conn) {
+    if (!conn) {
+        return 0;
+    }
+    pthread_mutex_lock(&conn->lock);
+    int busy = conn->has_body && !conn->closed && !conn->shut;
+    conn->wake_on_drain = busy;
+    pthread_mutex_unlock(&conn->lock);
+    return busy;
+}
+
+int server_conn_detach(server_conn_t *conn, int *fd, SSL **ssl) {
+    if (!conn || !fd || !ssl) {
+        return -1;
+    }
+    pthread_mutex_lock(&conn->lock);
+    if (conn->closed || conn->shut || conn->detached) {
+        pthread_mutex_unlock(&conn->lock);
+        return -1;
+    }
+    conn->detached = 1;
+    epoll_ctl(conn->io->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    conn->events = 0;
+    server_set_nonblocking(conn->fd, 0);
+    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 #ifdef ENABLE_TLS
-    if (ctx->ssl_ctx) {
-        SSL_CTX_free(ctx->ssl_ctx);
-        ctx->ssl_ctx = NULL;
+    if (conn->ssl) {
+        SSL_clear_mode(conn->ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
     }
 #endif
-    memset(ctx, 0, sizeof(*ctx));
+    int rc = server_conn_flush_locked(conn);
+    *fd = conn->fd;
+    *ssl = conn->ssl;
+    pthread_mutex_unlock(&conn->lock);
+    return rc;
 }
 
-void server_set_websocket_context(server_ctx_t *ctx, websocket_context_t *ws_ctx) {
-    if (!ctx) {
+/* ---- I/O threads ---- */
+
+static void server_io_handle(server_conn_t *conn, uint32_t events) {
+    int do_close = 0;
+    int schedule = 0;
+    pthread_mutex_lock(&conn->lock);
+    if (conn->closed || conn->detached) {
+        pthread_mutex_unlock(&conn->lock);
         return;
     }
-    ctx->ws_context = ws_ctx;
-}
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        do_close = 1;
+    }
+#ifdef ENABLE_TLS
+    if (!do_close && conn->tls_pending) {
+        if (server_conn_tls_accept_locked(conn) != 0) {
+            do_close = 1;
+        } else if (!conn->tls_pending) {
+            events |= EPOLLIN | EPOLLOUT;
+        }
+    }
+#endif
+    if (!do_close && !conn->tls_pending && (events & EPOLLOUT)) {
+        if (conn->tls_want_write) {
+            conn->tls_want_write = 0;
+            events |= EPOLLIN;
+        }
+        if (server_conn_flush_locked(conn) != 0) {
+            do_close = 1;
+        } else if (conn->closing && server_conn_pending_locked(conn) == 0) {
+            do_close = 1;
+        }
+    }
+    if (!do_close && conn->wake_pending) {
+        conn->wake_pending = 0;
+        if (!conn->closing && !conn->scheduled) {
+            conn->scheduled = 1;
+            conn->refs++;
+            schedule = 1;
+        }
+    }
+    if (!do_close && !conn->tls_pending && (events & EPOLLIN) && !conn->closing && !conn->paused) {
+        int got = server_conn_read_locked(conn);
+        if (got < 0) {
+            do_close = 1;
+        } else if (got > 0) {
+            if (conn->scheduled) {
+                conn->dirty = 1;
+            } else if (!schedule) {
+                conn->scheduled = 1;
+                conn->refs++;
+                schedule = 1;
+            }
+        }
+    }
+    if (!do_close) {
+        server_conn_update_events_locked(conn);
+    }
+    pthread_mutex_unlock(&conn->lock);
 
-static void *accept_loop(void *arg) {
-    server_ctx_t *ctx = (server_ctx_t *)arg;
+    if (schedule) {
+        server_conn_schedule(conn);
+    }
+    if (do_close) {
+        server_conn_close(conn);
+    }
+}
 
-    while (1) {
+static void server_io_accept(server_io_thread_t *io) {
+    server_ctx_t *ctx = io->server;
+    for (;;) {
         struct sockaddr_in client_addr;
         socklen_t addr_len = sizeof(client_addr);
-        int client_fd = accept(ctx->listen_fd, (struct sockaddr *)&client_addr, &addr_len);
+        int client_fd =
+            accept4(ctx->listen_fd, (struct sockaddr *)&client_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (client_fd < 0) {
-            pthread_mutex_lock(&ctx->lock);
-            int should_continue = ctx->running;
-            pthread_mutex_unlock(&ctx->lock);
-            if (!should_continue) {
-                break;
-            }
             if (errno == EINTR) {
                 continue;
             }
-            perror("accept");
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept");
+            }
+            return;
+        }
+
+        server_conn_t *conn = server_conn_create(ctx, client_fd);
+        if (!conn) {
+            close(client_fd);
             continue;
         }
 
+        /* Registered under both locks so a draining I/O thread never misses a late arrival. */
         pthread_mutex_lock(&ctx->lock);
-        int can_accept = ctx->client_count < ctx->max_clients;
-        if (can_accept) {
+        int accepted = ctx->running && ctx->client_count < ctx->max_clients;
+        if (accepted) {
+            server_io_thread_t *target = &ctx->io_threads[ctx->next_io++ % ctx->io_thread_count];
+            conn->io = target;
+            conn->id = ++ctx->next_conn_id;
+            conn->events = EPOLLIN;
+            pthread_mutex_lock(&target->lock);
+            conn->next = target->conns;
+            if (target->conns) {
+                target->conns->prev = conn;
+            }
+            target->conns = conn;
+            struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+            if (epoll_ctl(target->epfd, EPOLL_CTL_ADD, client_fd, &ev) != 0) {
+                target->conns = conn->next;
+                if (target->conns) {
+                    target->conns->prev = NULL;
+                }
+                accepted = 0;
+            }
+            pthread_mutex_unlock(&target->lock);
+        }
+        if (accepted) {
             ctx->client_count++;
+            ctx->stats.accepted++;
+            if ((uint64_t)ctx->client_count > ctx->stats.open_peak) {
+                ctx->stats.open_peak = (uint64_t)ctx->client_count;
+            }
+        } else {
+            ctx->stats.rejected_busy++;
         }
         pthread_mutex_unlock(&ctx->lock);
 
-        if (!can_accept) {
+        if (!accepted) {
             const char *msg = "Server busy, try again later\n";
-            send(client_fd, msg, strlen(msg), MSG_NOSIGNAL);
-            close(client_fd);
-            continue;
+            send(client_fd, msg, strlen(msg), MSG_NOSIGNAL | MSG_DONTWAIT);
+            server_conn_free(conn);
         }
+    }
+}
 
-        client_task_t *task = malloc(sizeof(*task));
-        if (!task) {
-            close(client_fd);
-            pthread_mutex_lock(&ctx->lock);
-            ctx->client_count--;
-            pthread_mutex_unlock(&ctx->lock);
-            continue;
+/* Closes timed-out connections, or while draining everything that is done.
+ * Returns 1 once the thread has no connections left after a stop. */
+static int server_io_sweep(server_io_thread_t *io, uint64_t now, int draining, int force) {
+    server_conn_t *reap = NULL;
+    uint64_t timeouts = 0;
+    pthread_mutex_lock(&io->lock);
+    for (server_conn_t *conn = io->conns; conn; conn = conn->next) {
+        pthread_mutex_lock(&conn->lock);
+        int close_it = force;
+        if (!close_it && !conn->detached && !conn->scheduled) {
+            if (draining) {
+                close_it = server_conn_pending_locked(conn) == 0;
+            } else {
+                uint64_t limit = conn->tls_pending || !conn->session.upgraded ? SERVER_HANDSHAKE_TIMEOUT_MS
+                                                                               : SERVER_IDLE_TIMEOUT_MS;
+                /* Workers stamp last_active_ms too and may be ahead of now. */
+                close_it = now > conn->last_active_ms && now - conn->last_active_ms >= limit;
+                timeouts += (uint64_t)close_it;
+            }
+        }
+        pthread_mutex_unlock(&conn->lock);
+        if (close_it) {
+            conn->reap_next = reap;
+            reap = conn;
         }
+    }
+    pthread_mutex_unlock(&io->lock);
 
-        task->ctx = ctx;
-        task->client_fd = client_fd;
-        task->addr = client_addr;
+    while (reap) {
+        server_conn_t *next = reap->reap_next;
+        server_conn_close(reap);
+        reap = next;
+    }
+    if (timeouts > 0) {
+        pthread_mutex_lock(&io->server->lock);
+        io->server->stats.closed_timeout += timeouts;
+        pthread_mutex_unlock(&io->server->lock);
+    }
+    if (!draining) {
+        return 0;
+    }
+    pthread_mutex_lock(&io->server->lock);
+    pthread_mutex_lock(&io->lock);
+    int empty = io->server->running == 0 && io->conns == NULL;
+    pthread_mutex_unlock(&io->lock);
+    pthread_mutex_unlock(&io->server->lock);
+    return empty;
+}
 
-        pthread_t thread_id;
-        int rc = pthread_create(&thread_id, NULL, client_worker, task);
-        if (rc != 0) {
-            errno = rc;
-            perror("pthread_create");
-            close(client_fd);
-            free(task);
+static void *server_io_main(void *arg) {
+    server_io_thread_t *io = (server_io_thread_t *)arg;
+    server_ctx_t *ctx = io->server;
+    struct epoll_event events[SERVER_EPOLL_BATCH];
+    uint64_t last_sweep = server_now_ms();
+    uint64_t drain_deadline = 0;
+    int draining = 0;
+
+    for (;;) {
+        int n = epoll_wait(io->epfd, events, SERVER_EPOLL_BATCH, draining ? 50 : 1000);
+        if (n < 0 && errno != EINTR) {
+            perror("epoll_wait");
+        }
+        for (int i = 0; i < n; ++i) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == NULL) {
+                server_io_accept(io);
+            } else if (ptr == io) {
+                uint64_t value = 0;
+                ssize_t r = read(io->wake_fd, &value, sizeof(value));
+                (void)r;
+            } else {
+                server_io_handle((server_conn_t *)ptr, events[i].events);
+            }
+        }
+
+        uint64_t now = server_now_ms();
+        if (!draining) {
             pthread_mutex_lock(&ctx->lock);
-            ctx->client_count--;
+            draining = !ctx->running;
             pthread_mutex_unlock(&ctx->lock);
-            continue;
+            if (draining) {
+                epoll_ctl(io->epfd, EPOLL_CTL_DEL, ctx->listen_fd, NULL);
+                drain_deadline = now + SERVER_DRAIN_TIMEOUT_MS;
+            }
+        }
+        if (draining) {
+            if (server_io_sweep(io, now, 1, now >= drain_deadline)) {
+                break;
+            }
+        } else if (now - last_sweep >= 1000) {
+            server_io_sweep(io, now, 0, 0);
+            last_sweep = now;
         }
-
-        pthread_detach(thread_id);
     }
-
     return NULL;
 }
 
-static void *client_worker(void *arg) {
-    client_task_t *task = (client_task_t *)arg;
-    server_ctx_t *ctx = task->ctx;
-    int client_fd = task->client_fd;
-    SSL *ssl = NULL;
-#ifdef ENABLE_TLS
-    if (ctx->ssl_ctx) {
-        ssl = SSL_new(ctx->ssl_ctx);
-        if (!ssl) {
-            close(client_fd);
-            free(task);
-            goto done;
-        }
-        SSL_set_fd(ssl, client_fd);
-        if (SSL_accept(ssl) != 1) {
-            // SSL 핸드셰이크 실패 (평문 HTTP 요청이 HTTPS 포트로 온 경우 등)
-            // 에러를 stderr에 출력하지 않고 조용히 처리 (정상적인 거부 케이스)
-            int ssl_err = SSL_get_error(ssl, -1);
-            if (ssl_err != SSL_ERROR_WANT_READ && ssl_err != SSL_ERROR_WANT_WRITE) {
-                // 실제 에러인 경우에만 로그 출력
-                fprintf(stderr, "[TLS] SSL_accept failed for client (possibly plain HTTP on HTTPS port)\n");
+static void server_io_thread_destroy(server_io_thread_t *io) {
+    if (io->epfd >= 0) {
+        close(io->epfd);
+        io->epfd = -1;
+    }
+    if (io->wake_fd >= 0) {
+        close(io->wake_fd);
+        io->wake_fd = -1;
+    }
+    pthread_mutex_destroy(&io->lock);
+}
+
+int server_start(server_ctx_t *ctx) {
+    if (!ctx || ctx->listen_fd < 0 || ctx->io_threads) {
+        return -1;
+    }
+
+    /* Each connection has at most one task queued, and each 0-RTT request spends a
+     * resumption ticket, so a ring this deep does not make an I/O thread wait. */
+    ctx->workers = quic_dispatch_create(ctx->worker_count, (size_t)ctx->max_clients + QUIC_MAX_TICKETS);
+    ctx->io_threads = calloc(ctx->io_thread_count, sizeof(*ctx->io_threads));
+    if (!ctx->workers || !ctx->io_threads) {
+        fputs("[server] cannot allocate worker pool\n", stderr);
+        quic_dispatch_destroy(ctx->workers, NULL);
+        ctx->workers = NULL;
+        free(ctx->io_threads);
+        ctx->io_threads = NULL;
+        return -1;
+    }
+
+    for (unsigned i = 0; i < ctx->io_thread_count; ++i) {
+        server_io_thread_t *io = &ctx->io_threads[i];
+        io->server = ctx;
+        io->epfd = -1;
+        io->wake_fd = -1;
+        pthread_mutex_init(&io->lock, NULL);
+    }
+    for (unsigned i = 0; i < ctx->io_thread_count; ++i) {
+        server_io_thread_t *io = &ctx->io_threads[i];
+        io->epfd = epoll_create1(EPOLL_CLOEXEC);
+        io->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event wake = {.events = EPOLLIN, .data.ptr = io};
+        struct epoll_event listen_ev = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+        int rc = -1;
+        if (io->epfd >= 0 && io->wake_fd >= 0 && epoll_ctl(io->epfd, EPOLL_CTL_ADD, io->wake_fd, &wake) == 0 &&
+            epoll_ctl(io->epfd, EPOLL_CTL_ADD, ctx->listen_fd, &listen_ev) == 0) {
+            rc = pthread_create(&io->thread, NULL, server_io_main, io);
+        }
+        if (rc != 0) {
+            if (rc > 0) {
+                errno = rc;
             }
-            SSL_free(ssl);
-            ssl = NULL;
-            close(client_fd);
-            free(task);
-            goto done;
+            perror("server_start");
+            server_request_stop(ctx);
+            server_join(ctx);
+            return -1;
         }
+        io->started = 1;
+    }
+    if (ctx->ws_context) {
+        websocket_set_workers(ctx->ws_context, ctx->workers);
     }
-#else
-#endif
-    free(task);
 
-    websocket_handle_client(client_fd, ssl, ctx->ws_context);
+    return 0;
+}
 
-#ifdef ENABLE_TLS
-    if (ssl) {
-        SSL_shutdown(ssl);
-        SSL_free(ssl);
+void server_request_stop(server_ctx_t *ctx) {
+    if (!ctx) {
+        return;
     }
-#endif
+
     pthread_mutex_lock(&ctx->lock);
-    if (ctx->client_count > 0) {
-        ctx->client_count--;
-    }
-    pthread_cond_signal(&ctx->clients_cv);
+    ctx->running = 0;
     pthread_mutex_unlock(&ctx->lock);
+    for (unsigned i = 0; ctx->io_threads && i < ctx->io_thread_count; ++i) {
+        if (ctx->io_threads[i].wake_fd >= 0) {
+            uint64_t one = 1;
+            ssize_t r = write(ctx->io_threads[i].wake_fd, &one, sizeof(one));
+            (void)r;
+        }
+    }
+}
+
+void server_join(server_ctx_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    for (unsigned i = 0; ctx->io_threads && i < ctx->io_thread_count; ++i) {
+        if (ctx->io_threads[i].started) {
+            pthread_join(ctx->io_threads[i].thread, NULL);
+            ctx->io_threads[i].started = 0;
+        }
+    }
+    /* Tasks still queued see their connections closed and return; the last one frees them. */
+    if (ctx->workers) {
+        if (ctx->ws_context) {
+            websocket_set_workers(ctx->ws_context, NULL);
+        }
+        quic_dispatch_destroy(ctx->workers, NULL);
+        ctx->workers = NULL;
+    }
+    if (ctx->io_threads) {
+        for (unsigned i = 0; i < ctx->io_thread_count; ++i) {
+            server_io_thread_destroy(&ctx->io_threads[i]);
+        }
+        free(ctx->io_threads);
+        ctx->io_threads = NULL;
+    }
+    server_close_socket(&ctx->listen_fd);
+}
 
+void server_destroy(server_ctx_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    server_join(ctx);
+    server_close_socket(&ctx->listen_fd);
+    pthread_mutex_destroy(&ctx->lock);
 #ifdef ENABLE_TLS
-done:
+    if (ctx->ssl_ctx) {
+        SSL_CTX_free(ctx->ssl_ctx);
+        ctx->ssl_ctx = NULL;
+    }
 #endif
-    return NULL;
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void server_set_websocket_context(server_ctx_t *ctx, websocket_context_t *ws_ctx) {
+    if (!ctx) {
+        return;
+    }
+    ctx->ws_context = ws_ctx;
+}
+
+void server_get_stats(server_ctx_t *ctx, server_stats_t *out_stats) {
+    if (!ctx || !out_stats) {
+        return;
+    }
+    pthread_mutex_lock(&ctx->lock);
+    *out_stats = ctx->stats;
+    out_stats->open = (uint64_t)ctx->client_count;
+    pthread_mutex_unlock(&ctx->lock);
 }
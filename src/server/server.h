@@ -3,7 +3,9 @@
 
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 
 #ifdef ENABLE_TLS
 #include <openssl/ssl.h>
@@ -18,12 +20,46 @@ extern "C" {
 
 struct websocket_context;
 typedef struct websocket_context websocket_context_t;
+struct quic_dispatch;
+
+/* Event-driven TCP server. A few I/O threads own non-blocking sockets through
+ * epoll: they accept, run the TLS handshake, read into per-connection input
+ * buffers and flush output buffers. Parsing and everything that may block (DB,
+ * bcrypt, file reads, QUIC sends) runs on a worker pool; a connection is on at
+ * most one worker at a time, so its frames are handled in order. Configured by
+ * SERVER_THREADS="IO[:WORKERS]". */
+#define SERVER_THREADS_ENV         "SERVER_THREADS"
+#define SERVER_SENDFILE_ENV        "SERVER_SENDFILE" /* "0" sends files through the copy path */
+#define SERVER_KTLS_ENV            "SERVER_KTLS" /* "0" keeps TLS encryption in userspace */
+#define SERVER_OUTBUF_ENV          "SERVER_OUTBUF_KB" /* per-connection cap on buffered output */
+#define SERVER_DEFAULT_IO_THREADS  2
+#define SERVER_DEFAULT_WORKERS     8
+#define SERVER_MAX_IO_THREADS      16
+#define SERVER_INBUF_MAX           (128 * 1024) /* reading pauses above this */
+#define SERVER_OUTBUF_HIGH         (4 * 1024 * 1024) /* writers wait above this */
+#define SERVER_OUTBUF_MIN          (16 * 1024)
+#define SERVER_HANDSHAKE_TIMEOUT_MS 5000 /* TLS + HTTP request header */
+#define SERVER_IDLE_TIMEOUT_MS     300000 /* open WebSocket with no traffic */
+#define SERVER_WRITE_TIMEOUT_MS    5000 /* writer waiting for a slow reader */
+#define SERVER_DRAIN_TIMEOUT_MS    2000 /* server_join flushing output */
+
+typedef struct server_conn server_conn_t;
+typedef struct server_io_thread server_io_thread_t;
+
+typedef struct {
+    uint64_t accepted;
+    uint64_t rejected_busy;
+    uint64_t closed_timeout;
+    uint64_t open;
+    uint64_t open_peak;
+    uint64_t bytes_sent;     /* counted as connections close */
+    uint64_t sendfile_bytes; /* part of bytes_sent that never left the kernel */
+    uint64_t ktls_connections; /* TLS connections whose records the kernel encrypted */
+} server_stats_t;
 
 typedef struct server_ctx {
     int listen_fd;
-    pthread_t accept_thread;
     pthread_mutex_t lock;
-    pthread_cond_t clients_cv;
     int running;
     int client_count;
     int max_clients;
@@ -31,15 +67,105 @@ typedef struct server_ctx {
     char bind_ip[INET_ADDRSTRLEN];
     websocket_context_t *ws_context;
     SSL_CTX *ssl_ctx;
+    int use_sendfile;
+    size_t outbuf_high; /* SERVER_OUTBUF_KB; bodies are not copied and do not count */
+    unsigned io_thread_count;
+    unsigned worker_count;
+    server_io_thread_t *io_threads;
+    struct quic_dispatch *workers;
+    unsigned next_io;
+    uint64_t next_conn_id;
+    server_stats_t stats;
 } server_ctx_t;
 
+/* max_clients caps open connections; later ones get "Server busy". */
 int server_init(server_ctx_t *ctx, const char *bind_ip, uint16_t port, int max_clients);
 int server_enable_tls(server_ctx_t *ctx, const char *cert_path, const char *key_path);
+/* Overrides SERVER_THREADS; only before server_start. */
+int server_set_threads(server_ctx_t *ctx, unsigned io_threads, unsigned workers);
 int server_start(server_ctx_t *ctx);
 void server_request_stop(server_ctx_t *ctx);
+/* Stops accepting, lets queued work finish and output drain (up to
+ * SERVER_DRAIN_TIMEOUT_MS), then closes what is left. */
 void server_join(server_ctx_t *ctx);
 void server_destroy(server_ctx_t *ctx);
 void server_set_websocket_context(server_ctx_t *ctx, websocket_context_t *ws_ctx);
+void server_get_stats(server_ctx_t *ctx, server_stats_t *out_stats);
+/* "IO" or "IO:WORKERS"; -1 when malformed or out of range. */
+int server_parse_thread_config(const char *spec, unsigned *io_threads, unsigned *workers);
+
+/* Connection API for the protocol code, called from a worker while it owns the
+ * connection. Input is copied out under the connection lock because the I/O
+ * thread keeps appending to it. */
+size_t server_conn_buffered(server_conn_t *conn);
+size_t server_conn_peek(server_conn_t *conn, void *buf, size_t len);
+void server_conn_consume(server_conn_t *conn, size_t len);
+/* Queues len bytes and writes what the socket takes now; the I/O thread sends
+ * the rest. Waits while more than SERVER_OUTBUF_KB (default SERVER_OUTBUF_HIGH)
+ * is buffered; a queued file or buffer body is not counted. -1 once the
+ * connection is closed or the reader stalls past SERVER_WRITE_TIMEOUT_MS. */
+int server_conn_write(server_conn_t *conn, const void *buf, size_t len);
+/* server_conn_write for pieces that go out back to back, as one write. */
+int server_conn_writev(server_conn_t *conn, const struct iovec *iov, int iovcnt);
+/* Queues prefix followed by len bytes of file_fd from offset without reading
+ * the file into memory: plaintext and kTLS sockets get it through sendfile,
+ * userspace TLS through a fixed chunk per SSL_write. Takes ownership of file_fd. Later writes queue
+ * behind the file; a second file (or buffer) waits until the first is on the wire. */
+int server_conn_send_file(server_conn_t *conn, const void *prefix, size_t prefix_len, int file_fd, uint64_t offset, size_t len);
+typedef void (*server_release_fn)(void *owner);
+/* Like server_conn_send_file for a buffer the caller keeps alive until
+ * release(owner) runs, so shared data goes out without a copy into the
+ * connection. release is called exactly once, also on failure. */
+int server_conn_send_buffer(server_conn_t *conn,
+                            const void *prefix,
+                            size_t prefix_len,
+                            const uint8_t *data,
+                            size_t len,
+                            server_release_fn release,
+                            void *owner);
+/* Writes the header of one frame of a framed body: first frame of the message
+ * or a continuation, fin on the last one, len payload bytes. */
+#define SERVER_FRAME_HEAD_MAX 16
+#define SERVER_LEAD_MAX       16
+typedef size_t (*server_frame_fn)(int first, int fin, uint64_t len, uint8_t head[SERVER_FRAME_HEAD_MAX]);
+typedef struct {
+    size_t fragment;      /* payload bytes per frame, > 0 */
+    server_frame_fn frame;
+    const uint8_t *lead;  /* payload bytes before the body, copied */
+    size_t lead_len;      /* up to SERVER_LEAD_MAX */
+    size_t first_frame;   /* not 0: the body opens with its whole first frame,
+                           * header included, this many bytes; no lead then */
+} server_framing_t;
+/* server_conn_send_file/_buffer for a body that goes out as a message split
+ * into frames. Bytes from server_conn_write_urgent go out between two frames;
+ * other writes wait until the whole message is out. */
+int server_conn_send_file_framed(server_conn_t *conn,
+                                 const server_framing_t *framing,
+                                 int file_fd,
+                                 uint64_t offset,
+                                 size_t len);
+int server_conn_send_buffer_framed(server_conn_t *conn,
+                                   const server_framing_t *framing,
+                                   const uint8_t *data,
+                                   size_t len,
+                                   server_release_fn release,
+                                   void *owner);
+/* server_conn_write for small control messages that overtake whatever is
+ * queued behind the body, at its next frame boundary. */
+int server_conn_write_urgent(server_conn_t *conn, const void *buf, size_t len);
+/* Cancels the rest of a framed body: the frame on the wire is finished and
+ * an empty final frame ends the message early (if nothing was sent yet, the
+ * body is dropped). Returns the payload bytes that will not be sent; 0 for
+ * an unframed body, which always goes out whole. */
+uint64_t server_conn_cancel_body(server_conn_t *conn);
+/* 1 while a file or buffer body is still queued; the protocol handler then
+ * runs again (with no new input) once it is on the wire. 0 when a body can
+ * be queued right away. Lets a worker keep a stream going without blocking. */
+int server_conn_wake_on_drain(server_conn_t *conn);
+/* Hands the socket to the caller in blocking mode (5 s timeouts) for
+ * request/response handlers that do their own I/O; buffered input stays
+ * readable with peek. The connection closes when the worker returns. */
+int server_conn_detach(server_conn_t *conn, int *fd, SSL **ssl);
 
 #ifdef __cplusplus
 }
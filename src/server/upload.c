@@ -1,5 +1,7 @@
 #include "server/upload.h"
 
+#include "server/websocket.h"
+
 #include "utils/thumbnail.h"
 
 #include <stdio.h>
@@ -117,7 +119,13 @@ static int write_resp(int fd, SSL *ssl, const char *resp) {
     return (int)write(fd, resp, len);
 }
 
-int handle_upload_request(int fd, SSL *ssl, const char *content_type, const char *body, size_t body_len, db_context_t *db) {
+int handle_upload_request(int fd,
+                          SSL *ssl,
+                          const char *content_type,
+                          const char *body,
+                          size_t body_len,
+                          db_context_t *db,
+                          struct websocket_context *ws) {
     if (!content_type || !body || body_len == 0 || !db) {
         return -1;
     }
@@ -238,6 +246,8 @@ int handle_upload_request(int fd, SSL *ssl, const char *content_type, const char
         return -1;
     }
     db_update_video_segment_path(db, video_id, segment_dir);
+    /* A viewer may have asked while the script was still writing segments. */
+    websocket_invalidate_video(ws, video_id);
 
     char resp[256];
     snprintf(resp,
@@ -8,6 +8,15 @@
 typedef struct ssl_st SSL;
 #endif
 
-int handle_upload_request(int fd, SSL *ssl, const char *content_type, const char *body, size_t body_len, db_context_t *db);
+struct websocket_context;
+
+/* ws (optional) drops what it caches for the new video once it is segmented. */
+int handle_upload_request(int fd,
+                          SSL *ssl,
+                          const char *content_type,
+                          const char *body,
+                          size_t body_len,
+                          db_context_t *db,
+                          struct websocket_context *ws);
 
 #endif // SERVER_UPLOAD_H
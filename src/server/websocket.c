@@ -13,6 +13,7 @@
 #include <arpa/inet.h>
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -30,8 +31,7 @@
 #define VIDEO_BASE_PATH "data/videos"
 
 typedef struct {
-    int fd;
-    SSL *ssl; /* optional */
+    server_conn_t *conn;
 } ws_io_t;
 
 typedef struct {
@@ -55,7 +55,10 @@ typedef enum {
     WS_CMD_STREAM_STOP,
     WS_CMD_WS_INIT,
     WS_CMD_WS_SEGMENT,
-    WS_CMD_LIST_CONTINUE
+    WS_CMD_LIST_CONTINUE,
+    WS_CMD_WS_PUSH,
+    WS_CMD_WS_ACK,
+    WS_CMD_WS_SEGMENTS
 } ws_command_type;
 
 typedef struct {
@@ -71,21 +74,24 @@ typedef struct {
     int position;
     uint32_t seek_offset;
     int segment_index;
+    uint32_t deadline_ms;     /* stream_chunk: 0 = retransmit until ACKed */
+    uint32_t expire_offset;   /* stream_chunk: 0 = never expires by playback */
+    uint32_t playback_offset; /* stream_chunk: viewer's current byte position, 0 = not reported */
+    uint32_t window;          /* ws_push: segments buffered ahead, 0 = stop */
+    uint32_t count;           /* ws_segments: segments from segment_index */
 } ws_command_t;
 
-static int io_read(ws_io_t *io, void *buf, size_t len);
-static int io_write(ws_io_t *io, const void *buf, size_t len);
-static int read_http_request(ws_io_t *io, char *buffer, size_t buf_size, size_t *out_len);
+static int handle_http_request(ws_io_t *io, websocket_session_t *session, websocket_context_t *ctx);
 static int send_http_error(ws_io_t *io, const char *status_line);
 static int perform_handshake(ws_io_t *io, http_request_t *request);
 static int validate_websocket_request(const http_request_t *req);
-static int buffer_contains_clrf(const char *buf, size_t len);
-static int ws_read_frame(ws_io_t *io, ws_frame_t *frame);
+static size_t header_end_offset(const char *buf, size_t len);
+static int ws_take_frame(server_conn_t *conn, ws_frame_t *frame);
 static void ws_free_frame(ws_frame_t *frame);
+static size_t ws_frame_header(uint8_t opcode, uint64_t payload_len, uint8_t header[10]);
 static int ws_send_frame(ws_io_t *io, uint8_t opcode, const uint8_t *payload, size_t payload_len);
 static void sha1_compute(const uint8_t *data, size_t len, uint8_t out[20]);
 static int base64_encode(const uint8_t *data, size_t len, char *out, size_t out_size);
-static int read_exact(ws_io_t *io, void *buf, size_t len);
 static int write_all(ws_io_t *io, const void *buf, size_t len);
 static int header_contains_token(const char *value, const char *token);
 static const char *json_find_value(const char *json, const char *key);
@@ -95,7 +101,11 @@ static int json_extract_uint32_field(const char *json, const char *key, uint32_t
 static int json_extract_int_field(const char *json, const char *key, int *out);
 static int parse_command(const char *text, ws_command_t *cmd);
 static int hex_to_bytes(const char *hex, uint8_t *out, size_t max_len, size_t *out_len);
-static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_frame_t *frame, int user_id);
+static int handle_text_frame(ws_io_t *io,
+                             websocket_context_t *ctx,
+                             const ws_frame_t *frame,
+                             websocket_session_t *session);
+static int ws_push_pump(ws_io_t *io, websocket_context_t *ctx, websocket_push_t *push);
 static int send_json_response(ws_io_t *io, const char *type, const char *status, const char *message);
 static int send_video_chunk(websocket_context_t *ctx,
                             uint64_t connection_id,
@@ -103,45 +113,125 @@ static int send_video_chunk(websocket_context_t *ctx,
                             const char *file_path,
                             uint32_t offset,
                             uint32_t length,
-                            uint32_t *next_packet_number);
-static int send_ws_file(ws_io_t *io, const char *path, const char magic[4], uint32_t index) {
-    FILE *fp = fopen(path, "rb");
-    if (!fp) {
-        return -1;
+                            const quic_send_limit_t *limit);
+static int resolve_video_path(websocket_context_t *ctx, int video_id, char *out, size_t out_size);
+/* The 4-byte magic and big-endian index in front of every segment payload. */
+static void ws_segment_lead(const char magic[4], uint32_t index, uint8_t lead[8]) {
+    memcpy(lead, magic, 4);
+    lead[4] = (uint8_t)((index >> 24) & 0xFF);
+    lead[5] = (uint8_t)((index >> 16) & 0xFF);
+    lead[6] = (uint8_t)((index >> 8) & 0xFF);
+    lead[7] = (uint8_t)(index & 0xFF);
+}
+
+/* Binary frame header followed by the lead. */
+static size_t ws_segment_prefix(uint64_t body_len, const char magic[4], uint32_t index, uint8_t prefix[10 + 8]) {
+    size_t header_len = ws_frame_header(0x2, body_len + 8, prefix);
+    ws_segment_lead(magic, index, prefix + header_len);
+    return header_len + 8;
+}
+
+/* server_frame_fn: one binary message as a first frame and continuations. */
+static size_t ws_fragment_header(int first, int fin, uint64_t len, uint8_t head[SERVER_FRAME_HEAD_MAX]) {
+    size_t head_len = ws_frame_header(first ? 0x2 : 0x0, len, head);
+    if (!fin) {
+        head[0] &= 0x7F;
     }
-    if (fseek(fp, 0, SEEK_END) != 0) {
-        fclose(fp);
+    return head_len;
+}
+
+static server_framing_t ws_segment_framing(size_t fragment, const char magic[4], uint32_t index, uint8_t lead[8]) {
+    ws_segment_lead(magic, index, lead);
+    return (server_framing_t){.fragment = fragment, .frame = ws_fragment_header, .lead = lead, .lead_len = 8};
+}
+
+/* The frame header and magic/index prefix are queued; the file body goes
+ * straight from the page cache (sendfile) or through one fixed chunk (TLS).
+ * Above fragment bytes (when not 0) the message is split into frames. */
+static int send_ws_file(ws_io_t *io, const char *path, const char magic[4], uint32_t index, size_t fragment) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         return -1;
     }
-    long size = ftell(fp);
-    if (size <= 0) {
-        fclose(fp);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
         return -1;
     }
-    rewind(fp);
 
-    size_t total = (size_t)size + 8;
-    uint8_t *buf = malloc(total);
-    if (!buf) {
-        fclose(fp);
-        return -1;
+    if (fragment > 0 && (uint64_t)st.st_size + 8 > fragment) {
+        uint8_t lead[8];
+        server_framing_t framing = ws_segment_framing(fragment, magic, index, lead);
+        return server_conn_send_file_framed(io->conn, &framing, fd, 0, (size_t)st.st_size);
     }
-    memcpy(buf, magic, 4);
-    buf[4] = (uint8_t)((index >> 24) & 0xFF);
-    buf[5] = (uint8_t)((index >> 16) & 0xFF);
-    buf[6] = (uint8_t)((index >> 8) & 0xFF);
-    buf[7] = (uint8_t)(index & 0xFF);
+    uint8_t prefix[10 + 8];
+    size_t prefix_len = ws_segment_prefix((uint64_t)st.st_size, magic, index, prefix);
+    return server_conn_send_file(io->conn, prefix, prefix_len, fd, 0, (size_t)st.st_size);
+}
 
-    size_t n = fread(buf + 8, 1, (size_t)size, fp);
-    fclose(fp);
-    if (n != (size_t)size) {
-        free(buf);
-        return -1;
+/* segment_frame_fn: cached segments carry their binary frame prefix, of the
+ * whole message or, when it is split (see send_ws_segment), of its first
+ * fragment. arg is the websocket_context_t. */
+static size_t ws_frame_segment(int video_id,
+                               int index,
+                               size_t payload_len,
+                               uint8_t head[SEGMENT_CACHE_HEADROOM],
+                               void *arg) {
+    (void)video_id;
+    const websocket_context_t *ctx = (const websocket_context_t *)arg;
+    const char *magic = index == SEGMENT_CACHE_INIT_INDEX ? "INIT" : "SEGM";
+    uint32_t seq = index == SEGMENT_CACHE_INIT_INDEX ? 0 : (uint32_t)index;
+    uint8_t prefix[SERVER_FRAME_HEAD_MAX + 8];
+    size_t prefix_len;
+    if (ctx->fragment_size > 0 && payload_len + 8 > ctx->fragment_size) {
+        size_t header_len = ws_fragment_header(1, 0, ctx->fragment_size, prefix);
+        ws_segment_lead(magic, seq, prefix + header_len);
+        prefix_len = header_len + 8;
+    } else {
+        prefix_len = ws_segment_prefix(payload_len, magic, seq, prefix);
     }
+    memcpy(head + SEGMENT_CACHE_HEADROOM - prefix_len, prefix, prefix_len);
+    return prefix_len;
+}
 
-    int rc = ws_send_frame(io, 0x2, buf, total);
-    free(buf);
-    return rc;
+static void ws_release_segment(void *owner) {
+    segment_buf_release((segment_buf_t *)owner);
+}
+
+/* Serves the segment from the shared cache, where it is stored with its frame
+ * prefix (the first fragment's, for a split message): one pointer and length,
+ * nothing to copy, and only continuation headers to build. The
+ * connection holds a reference to the buffer until it is on the wire. Files
+ * the cache passes on (disabled, too large) go out through send_ws_file. */
+static int send_ws_segment(ws_io_t *io,
+                           websocket_context_t *ctx,
+                           int video_id,
+                           int cache_index,
+                           const char *path,
+                           const char magic[4],
+                           uint32_t index) {
+    if (!ctx) {
+        return send_ws_file(io, path, magic, index, 0);
+    }
+    segment_buf_t *buf = NULL;
+    int rc = segment_cache_get(&ctx->segment_cache, video_id, cache_index, path, &buf);
+    if (rc < 0) {
+        return -1;
+    }
+    if (rc > 0) {
+        return send_ws_file(io, path, magic, index, ctx->fragment_size);
+    }
+    if (ctx->fragment_size > 0 && buf->len + 8 > ctx->fragment_size) {
+        /* Cached with the first fragment's header: that frame goes out as is,
+         * the continuation headers are written as the rest is sent. */
+        server_framing_t framing = {
+            .fragment = ctx->fragment_size,
+            .frame = ws_fragment_header,
+            .first_frame = buf->frame_len - buf->len + ctx->fragment_size - 8,
+        };
+        return server_conn_send_buffer_framed(io->conn, &framing, buf->frame, buf->frame_len, ws_release_segment, buf);
+    }
+    return server_conn_send_buffer(io->conn, NULL, 0, buf->frame, buf->frame_len, ws_release_segment, buf);
 }
 
 void websocket_context_init(websocket_context_t *ctx, quic_engine_t *engine, db_context_t *db) {
@@ -152,27 +242,155 @@ void websocket_context_init(websocket_context_t *ctx, quic_engine_t *engine, db_
     ctx->quic_engine = engine;
     ctx->db = db;
     pthread_mutex_init(&ctx->lock, NULL);
+    pthread_mutex_init(&ctx->workers_lock, NULL);
     ctx->next_packet_number = 1;
     ctx->segment_sent_ok = 0;
     ctx->segment_sent_fail = 0;
+    segment_cache_init_from_env(&ctx->segment_cache);
+    manifest_index_init(&ctx->manifests, "data/segments");
+    ctx->fragment_size = (size_t)WS_DEFAULT_FRAGMENT_KB * 1024;
+    const char *fragment_spec = getenv(WS_FRAGMENT_ENV);
+    if (fragment_spec && fragment_spec[0] != '\0') {
+        char *end = NULL;
+        unsigned long kb = strtoul(fragment_spec, &end, 10);
+        if (*end != '\0' || kb > 64 * 1024) {
+            fprintf(stderr, "[ws] ignoring invalid %s=%s\n", WS_FRAGMENT_ENV, fragment_spec);
+        } else {
+            ctx->fragment_size = (size_t)kb * 1024;
+        }
+    }
+    /* After fragment_size: the framer lays out the first fragment with it. */
+    segment_cache_set_framer(&ctx->segment_cache, ws_frame_segment, ctx);
+}
+
+void websocket_invalidate_video(websocket_context_t *ctx, int video_id) {
+    if (!ctx) {
+        return;
+    }
+    segment_cache_invalidate_video(&ctx->segment_cache, video_id);
+    manifest_index_invalidate(&ctx->manifests, video_id);
 }
 
 void websocket_context_destroy(websocket_context_t *ctx) {
     if (!ctx) {
         return;
     }
+    manifest_index_destroy(&ctx->manifests);
+    segment_cache_destroy(&ctx->segment_cache);
+    pthread_mutex_destroy(&ctx->workers_lock);
     pthread_mutex_destroy(&ctx->lock);
     memset(ctx, 0, sizeof(*ctx));
 }
 
+static int resolve_video_path(websocket_context_t *ctx, int video_id, char *out, size_t out_size) {
+    db_video_t video;
+    if (!ctx->db || db_get_video_by_id(ctx->db, video_id, &video) != SQLITE_OK) {
+        return -1;
+    }
+    int len = video.file_path[0] == '/' ? snprintf(out, out_size, "%s", video.file_path)
+                                        : snprintf(out, out_size, "%s/%s", VIDEO_BASE_PATH, video.file_path);
+    return len > 0 && (size_t)len < out_size ? 0 : -1;
+}
+
+void websocket_set_workers(websocket_context_t *ctx, struct quic_dispatch *workers) {
+    if (!ctx) {
+        return;
+    }
+    pthread_mutex_lock(&ctx->workers_lock);
+    ctx->workers = workers;
+    pthread_mutex_unlock(&ctx->workers_lock);
+}
+
+static uint32_t ws_next_packet_number(websocket_context_t *ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    uint32_t pn = ctx->next_packet_number++;
+    pthread_mutex_unlock(&ctx->lock);
+    return pn;
+}
+
+typedef struct {
+    websocket_context_t *ctx;
+    uint64_t connection_id;
+    int video_id;
+    uint32_t stream_id;
+    uint32_t length;
+    uint32_t init_stream_id;
+} ws_early_request_t;
+
+static void ws_early_request_run(void *arg) {
+    ws_early_request_t *req = (ws_early_request_t *)arg;
+    websocket_context_t *ctx = req->ctx;
+    char full_path[512];
+    if (resolve_video_path(ctx, req->video_id, full_path, sizeof(full_path)) != 0) {
+        fprintf(stderr, "[ws][0rtt] video=%d not found, conn=%llu falls back to stream_chunk\n",
+                req->video_id,
+                (unsigned long long)req->connection_id);
+        free(req);
+        return;
+    }
+    if (req->init_stream_id != 0) {
+        char init_path[512];
+        snprintf(init_path, sizeof(init_path), "data/segments/%d/init-stream0.m4s", req->video_id);
+        if (send_video_chunk(ctx, req->connection_id, req->init_stream_id, init_path, 0, STREAM_MAX_CHUNK, NULL) != 0) {
+            fprintf(stderr, "[ws][0rtt] init segment missing video=%d path=%s\n", req->video_id, init_path);
+        }
+    }
+    if (send_video_chunk(ctx, req->connection_id, req->stream_id, full_path, 0, req->length, NULL) != 0) {
+        fprintf(stderr, "[ws][0rtt] first chunk failed video=%d conn=%llu\n",
+                req->video_id,
+                (unsigned long long)req->connection_id);
+    }
+    free(req);
+}
+
+/* Runs on the QUIC receive thread unless QUIC_DISPATCH is set, so the lookup
+ * and file reads go to the WebSocket workers and this only parses. */
+void websocket_on_quic_early_data(uint64_t connection_id,
+                                  const uint8_t *data,
+                                  size_t len,
+                                  const struct sockaddr_in *addr,
+                                  void *user_data) {
+    (void)addr;
+    websocket_context_t *ctx = (websocket_context_t *)user_data;
+    if (!ctx || !ctx->quic_engine || !data || len < WS_EARLY_REQUEST_SIZE) {
+        return;
+    }
+    uint32_t fields[4];
+    for (int i = 0; i < 4; ++i) {
+        fields[i] = ((uint32_t)data[i * 4] << 24) | ((uint32_t)data[i * 4 + 1] << 16) |
+                    ((uint32_t)data[i * 4 + 2] << 8) | (uint32_t)data[i * 4 + 3];
+    }
+    ws_early_request_t *req = malloc(sizeof(*req));
+    if (!req) {
+        return;
+    }
+    req->ctx = ctx;
+    req->connection_id = connection_id;
+    req->video_id = (int)fields[0];
+    req->stream_id = fields[1];
+    req->length = fields[2];
+    req->init_stream_id = fields[3];
+    if (req->length == 0 || req->length > STREAM_MAX_CHUNK) {
+        req->length = STREAM_MAX_CHUNK;
+    }
+
+    pthread_mutex_lock(&ctx->workers_lock);
+    int queued = ctx->workers && quic_dispatch_submit(ctx->workers, connection_id, ws_early_request_run, req) == 0;
+    pthread_mutex_unlock(&ctx->workers_lock);
+    if (!queued) {
+        fprintf(stderr, "[ws][0rtt] no workers, conn=%llu falls back to stream_chunk\n", (unsigned long long)connection_id);
+        free(req);
+    }
+}
+
 static int send_video_chunk(websocket_context_t *ctx,
                             uint64_t connection_id,
                             uint32_t stream_id,
                             const char *file_path,
                             uint32_t offset,
                             uint32_t length,
-                            uint32_t *next_packet_number) {
-    if (!ctx || !ctx->quic_engine || !file_path || !next_packet_number) {
+                            const quic_send_limit_t *limit) {
+    if (!ctx || !ctx->quic_engine || !file_path) {
         return -1;
     }
 
@@ -197,27 +415,63 @@ static int send_video_chunk(websocket_context_t *ctx,
     uint32_t sent_bytes = 0;
     uint8_t buffer[QUIC_MAX_PAYLOAD];
 
+    /* With FEC on, packets shrink by the symbol metadata so a repair still fits one packet. */
+    quic_fec_mode_t fec_mode = QUIC_FEC_NONE;
+    unsigned fec_k = 0;
+    unsigned fec_m = 0;
+    quic_engine_get_fec(ctx->quic_engine, &fec_mode, &fec_k, &fec_m);
+    quic_fec_encoder_t fec;
+    int use_fec = fec_mode != QUIC_FEC_NONE && quic_fec_encoder_init(&fec, fec_mode, fec_k, fec_m) == 0;
+    size_t max_payload = use_fec ? QUIC_FEC_MAX_SOURCE_PAYLOAD : QUIC_MAX_PAYLOAD;
+    /* Packets go out QUIC_SEND_BATCH_MAX at a time: one seal pass and one sendmmsg per batch. */
+    quic_send_batch_t batch;
+    if (quic_send_batch_init(&batch) != 0) {
+        if (use_fec) {
+            quic_fec_encoder_destroy(&fec);
+        }
+        fclose(fp);
+        return -1;
+    }
+    int rc = 0;
+
     while (remaining > 0 && sent_bytes + offset < (uint32_t)st.st_size) {
         size_t to_read = remaining;
-        if (to_read > QUIC_MAX_PAYLOAD) {
-            to_read = QUIC_MAX_PAYLOAD;
+        if (to_read > max_payload) {
+            to_read = max_payload;
         }
         size_t n = fread(buffer, 1, to_read, fp);
         if (n == 0) {
             break;
         }
         quic_packet_t pkt = {
-            .flags = QUIC_FLAG_DATA,
+            .flags = use_fec ? (QUIC_FLAG_DATA | QUIC_FLAG_REPAIR) : QUIC_FLAG_DATA,
             .connection_id = connection_id,
-            .packet_number = (*next_packet_number)++,
+            .packet_number = ws_next_packet_number(ctx),
             .stream_id = stream_id,
             .offset = offset + sent_bytes,
             .length = (uint32_t)n,
             .payload = buffer,
         };
-        if (quic_engine_send_to_connection(ctx->quic_engine, &pkt) != 0) {
-            fclose(fp);
-            return -1;
+        if (quic_engine_batch_add(ctx->quic_engine, &batch, &pkt, limit) != 0) {
+            rc = -1;
+            break;
+        }
+        if (use_fec) {
+            int added = quic_fec_encoder_add(&fec, stream_id, pkt.packet_number, pkt.offset, buffer, n);
+            if (added < 0) {
+                /* Packet numbers jumped (another chunk interleaved); close the group and start over. */
+                quic_engine_batch_flush(ctx->quic_engine, &batch);
+                quic_engine_send_fec_repairs(ctx->quic_engine, connection_id, &fec);
+                added = quic_fec_encoder_add(&fec, stream_id, pkt.packet_number, pkt.offset, buffer, n);
+            }
+            if (added == 1) {
+                /* Sources first, so the receiver rarely holds a repair it cannot use yet. */
+                if (quic_engine_batch_flush(ctx->quic_engine, &batch) != 0) {
+                    rc = -1;
+                    break;
+                }
+                quic_engine_send_fec_repairs(ctx->quic_engine, connection_id, &fec);
+            }
         }
         sent_bytes += (uint32_t)n;
         if (sent_bytes + offset >= (uint32_t)st.st_size) {
@@ -230,74 +484,46 @@ static int send_video_chunk(websocket_context_t *ctx,
         }
     }
 
+    if (rc == 0 && quic_engine_batch_flush(ctx->quic_engine, &batch) != 0) {
+        rc = -1;
+    }
+    quic_send_batch_destroy(&batch);
+    if (use_fec) {
+        if (rc == 0) {
+            quic_engine_send_fec_repairs(ctx->quic_engine, connection_id, &fec);
+        }
+        quic_fec_encoder_destroy(&fec);
+    }
     fclose(fp);
-    return 0;
+    return rc;
 }
 
-int websocket_handle_client(int client_fd, SSL *ssl, websocket_context_t *ctx) {
-    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
-    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-
-    ws_io_t io = {.fd = client_fd, .ssl = ssl};
-
-    char buffer[WS_MAX_HTTP_BUFFER];
-    size_t received = 0;
-    if (read_http_request(&io, buffer, sizeof(buffer), &received) != 0) {
-        send_http_error(&io, "HTTP/1.1 400 Bad Request\r\n\r\n");
-        close(client_fd);
+int websocket_process_input(server_conn_t *conn, websocket_session_t *session, websocket_context_t *ctx) {
+    if (!conn || !session) {
         return -1;
     }
+    ws_io_t io = {.conn = conn};
 
-    http_request_t request;
-    if (http_parse_request(buffer, received, &request) != 0) {
-        send_http_error(&io, "HTTP/1.1 400 Bad Request\r\n\r\n");
-        close(client_fd);
-        return -1;
-    }
-
-    if (validate_websocket_request(&request) != 0) {
-        const char *sep = strstr(buffer, "\r\n\r\n");
-        size_t header_size = sep ? (size_t)(sep - buffer + 4) : received;
-        size_t already = received > header_size ? received - header_size : 0;
-        if (ctx && ctx->db) {
-            int rc = http_api_handle(client_fd, io.ssl, &request, ctx, buffer + header_size, already);
-            close(client_fd);
+    if (!session->upgraded) {
+        int rc = handle_http_request(&io, session, ctx);
+        if (rc <= 0) {
             return rc;
         }
-        send_http_error(&io, "HTTP/1.1 400 Bad Request\r\n\r\n");
-        close(client_fd);
-        return -1;
-    }
-
-    int current_user_id = 0;
-    /* optional: extend session if provided */
-    if (ctx && ctx->db) {
-        char sid[SESSION_ID_LEN + 1];
-        if (session_extract_from_headers(&request, sid, sizeof(sid)) == 0) {
-            session_validate_and_extend(ctx->db, sid, SESSION_TTL_SECONDS, &current_user_id);
-        }
-    }
-
-    if (perform_handshake(&io, &request) != 0) {
-        send_http_error(&io, "HTTP/1.1 500 Internal Server Error\r\n\r\n");
-        close(client_fd);
-        return -1;
     }
 
-    if (send_json_response(&io, "ready", "ok", "websocket-ready") != 0) {
-        close(client_fd);
-        return -1;
-    }
-
-    while (1) {
+    for (;;) {
         ws_frame_t frame = {0};
-        if (ws_read_frame(&io, &frame) != 0) {
-            break;
+        int rc = ws_take_frame(conn, &frame);
+        if (rc == 0 && session->push.active) {
+            /* Input drained, or woken because the last pushed segment left. */
+            return ws_push_pump(&io, ctx, &session->push);
+        }
+        if (rc <= 0) {
+            return rc;
         }
 
         if (frame.opcode == 0x1) {
-            if (handle_text_frame(&io, ctx, &frame, current_user_id) != 0 && frame.payload) {
+            if (handle_text_frame(&io, ctx, &frame, session) != 0 && frame.payload) {
                 ws_send_frame(&io, 0x1, frame.payload, (size_t)frame.payload_len);
             }
         } else if (frame.opcode == 0x2 || frame.opcode == 0x0) {
@@ -305,49 +531,88 @@ int websocket_handle_client(int client_fd, SSL *ssl, websocket_context_t *ctx) {
         } else if (frame.opcode == 0x8) {
             ws_send_frame(&io, 0x8, frame.payload, (size_t)frame.payload_len);
             ws_free_frame(&frame);
-            break;
+            return -1;
         } else if (frame.opcode == 0x9) {
             ws_send_frame(&io, 0xA, frame.payload, (size_t)frame.payload_len);
         } else {
             ws_send_frame(&io, 0x8, NULL, 0);
             ws_free_frame(&frame);
-            break;
+            return -1;
         }
 
         ws_free_frame(&frame);
     }
-
-    close(client_fd);
-    return 0;
 }
 
-static int read_http_request(ws_io_t *io, char *buffer, size_t buf_size, size_t *out_len) {
-    size_t total = 0;
+/* 1 once upgraded, 0 while the request header is incomplete, -1 when the
+ * connection should close (error sent, or an API request was served). */
+static int handle_http_request(ws_io_t *io, websocket_session_t *session, websocket_context_t *ctx) {
+    char buffer[WS_MAX_HTTP_BUFFER];
+    size_t received = server_conn_peek(io->conn, buffer, sizeof(buffer));
+    size_t header_size = header_end_offset(buffer, received);
+    if (header_size == 0) {
+        if (received < sizeof(buffer)) {
+            return 0;
+        }
+        send_http_error(io, "HTTP/1.1 400 Bad Request\r\n\r\n");
+        return -1;
+    }
+
+    http_request_t request;
+    if (http_parse_request(buffer, received, &request) != 0) {
+        send_http_error(io, "HTTP/1.1 400 Bad Request\r\n\r\n");
+        return -1;
+    }
 
-    while (total < buf_size) {
-        int n = io_read(io, buffer + total, buf_size - total);
-        if (n <= 0) {
+    if (validate_websocket_request(&request) != 0) {
+        if (ctx && ctx->db) {
+            /* API handlers read the body and write the reply themselves, so they get the plain socket. */
+            int fd = -1;
+            SSL *ssl = NULL;
+            if (server_conn_detach(io->conn, &fd, &ssl) != 0) {
+                return -1;
+            }
+            size_t buffered = server_conn_buffered(io->conn);
+            char *raw = buffered > header_size ? malloc(buffered) : NULL;
+            size_t already = 0;
+            if (raw) {
+                buffered = server_conn_peek(io->conn, raw, buffered);
+                already = buffered - header_size;
+            }
+            http_api_handle(fd, ssl, &request, ctx, raw ? raw + header_size : NULL, already);
+            free(raw);
             return -1;
         }
-        total += (size_t)n;
-        if (buffer_contains_clrf(buffer, total)) {
-            if (out_len) {
-                *out_len = total;
-            }
-            return 0;
+        send_http_error(io, "HTTP/1.1 400 Bad Request\r\n\r\n");
+        return -1;
+    }
+    server_conn_consume(io->conn, header_size);
+
+    /* optional: extend session if provided */
+    if (ctx && ctx->db) {
+        char sid[SESSION_ID_LEN + 1];
+        if (session_extract_from_headers(&request, sid, sizeof(sid)) == 0) {
+            session_validate_and_extend(ctx->db, sid, SESSION_TTL_SECONDS, &session->user_id);
         }
     }
 
-    return -1;
-}
+    if (perform_handshake(io, &request) != 0) {
+        send_http_error(io, "HTTP/1.1 500 Internal Server Error\r\n\r\n");
+        return -1;
+    }
 
-static int buffer_contains_clrf(const char *buf, size_t len) {
-    if (len < 4) {
-        return 0;
+    if (send_json_response(io, "ready", "ok", "websocket-ready") != 0) {
+        return -1;
     }
+    session->upgraded = 1;
+    return 1;
+}
+
+/* Length of the request header including the blank line, 0 when incomplete. */
+static size_t header_end_offset(const char *buf, size_t len) {
     for (size_t i = 3; i < len; ++i) {
         if (buf[i - 3] == '\r' && buf[i - 2] == '\n' && buf[i - 1] == '\r' && buf[i] == '\n') {
-            return 1;
+            return i + 1;
         }
     }
     return 0;
@@ -468,31 +733,34 @@ void websocket_apply_mask(uint8_t *data, size_t len, const uint8_t mask[4]) {
     }
 }
 
-static int ws_read_frame(ws_io_t *io, ws_frame_t *frame) {
-    uint8_t header[2];
-    if (read_exact(io, header, sizeof(header)) != 0) {
-        return -1;
+/* 1 with a whole frame taken off the input, 0 while it is incomplete, -1 when malformed. */
+static int ws_take_frame(server_conn_t *conn, ws_frame_t *frame) {
+    uint8_t header[14];
+    size_t avail = server_conn_peek(conn, header, sizeof(header));
+    if (avail < 2) {
+        return 0;
     }
 
     frame->fin = (header[0] & 0x80) != 0;
     frame->opcode = header[0] & 0x0F;
     uint8_t mask_flag = (header[1] & 0x80) != 0;
     uint64_t payload_len = header[1] & 0x7F;
+    size_t header_len = 2;
 
     if (payload_len == 126) {
-        uint8_t extended[2];
-        if (read_exact(io, extended, sizeof(extended)) != 0) {
-            return -1;
+        header_len += 2;
+        if (avail < header_len) {
+            return 0;
         }
-        payload_len = (extended[0] << 8) | extended[1];
+        payload_len = (uint64_t)((header[2] << 8) | header[3]);
     } else if (payload_len == 127) {
-        uint8_t extended[8];
-        if (read_exact(io, extended, sizeof(extended)) != 0) {
-            return -1;
+        header_len += 8;
+        if (avail < header_len) {
+            return 0;
         }
         payload_len = 0;
         for (int i = 0; i < 8; ++i) {
-            payload_len = (payload_len << 8) | extended[i];
+            payload_len = (payload_len << 8) | header[2 + i];
         }
     }
 
@@ -502,29 +770,35 @@ static int ws_read_frame(ws_io_t *io, ws_frame_t *frame) {
 
     uint8_t mask_key[4] = {0};
     if (mask_flag) {
-        if (read_exact(io, mask_key, sizeof(mask_key)) != 0) {
-            return -1;
+        header_len += 4;
+        if (avail < header_len) {
+            return 0;
         }
+        memcpy(mask_key, header + header_len - 4, sizeof(mask_key));
+    }
+
+    size_t total = header_len + (size_t)payload_len;
+    if (server_conn_buffered(conn) < total) {
+        return 0;
     }
 
     frame->payload_len = payload_len;
     frame->payload = NULL;
     if (payload_len > 0) {
-        frame->payload = malloc((size_t)payload_len);
-        if (!frame->payload) {
-            return -1;
-        }
-        if (read_exact(io, frame->payload, (size_t)payload_len) != 0) {
-            free(frame->payload);
-            frame->payload = NULL;
+        uint8_t *raw = malloc(total);
+        if (!raw) {
             return -1;
         }
+        server_conn_peek(conn, raw, total);
+        memmove(raw, raw + header_len, (size_t)payload_len);
+        frame->payload = raw;
         if (mask_flag) {
             websocket_apply_mask(frame->payload, (size_t)payload_len, mask_key);
         }
     }
+    server_conn_consume(conn, total);
 
-    return 0;
+    return 1;
 }
 
 static void ws_free_frame(ws_frame_t *frame) {
@@ -534,90 +808,47 @@ static void ws_free_frame(ws_frame_t *frame) {
     }
 }
 
-static int ws_send_frame(ws_io_t *io, uint8_t opcode, const uint8_t *payload, size_t payload_len) {
-    uint8_t header[10];
-    size_t header_len = 0;
-
+static size_t ws_frame_header(uint8_t opcode, uint64_t payload_len, uint8_t header[10]) {
     header[0] = 0x80 | (opcode & 0x0F);
     if (payload_len <= 125) {
         header[1] = (uint8_t)payload_len;
-        header_len = 2;
-    } else if (payload_len <= 0xFFFF) {
+        return 2;
+    }
+    if (payload_len <= 0xFFFF) {
         header[1] = 126;
         header[2] = (uint8_t)((payload_len >> 8) & 0xFF);
         header[3] = (uint8_t)(payload_len & 0xFF);
-        header_len = 4;
-    } else {
-        header[1] = 127;
-        for (int i = 0; i < 8; ++i) {
-            header[2 + i] = (uint8_t)((payload_len >> (56 - 8 * i)) & 0xFF);
-        }
-        header_len = 10;
-    }
-
-    if (write_all(io, header, header_len) != 0) {
-        return -1;
-    }
-
-    if (payload_len > 0 && write_all(io, payload, payload_len) != 0) {
-        return -1;
-    }
-
-    return 0;
-}
-
-static int io_read(ws_io_t *io, void *buf, size_t len) {
-    if (!io || len == 0) {
-        return -1;
+        return 4;
     }
-#ifdef ENABLE_TLS
-    if (io->ssl) {
-        int n = SSL_read(io->ssl, buf, (int)len);
-        return n <= 0 ? -1 : n;
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i) {
+        header[2 + i] = (uint8_t)((payload_len >> (56 - 8 * i)) & 0xFF);
     }
-#endif
-    ssize_t n = recv(io->fd, buf, len, 0);
-    return n <= 0 ? -1 : (int)n;
+    return 10;
 }
 
-static int io_write(ws_io_t *io, const void *buf, size_t len) {
-    if (!io || len == 0) {
-        return -1;
-    }
-#ifdef ENABLE_TLS
-    if (io->ssl) {
-        int n = SSL_write(io->ssl, buf, (int)len);
-        return n <= 0 ? -1 : n;
-    }
-#endif
-    ssize_t n = send(io->fd, buf, len, MSG_NOSIGNAL);
-    return n <= 0 ? -1 : (int)n;
-}
-
-static int read_exact(ws_io_t *io, void *buf, size_t len) {
-    uint8_t *ptr = buf;
-    size_t total = 0;
-    while (total < len) {
-        int n = io_read(io, ptr + total, len - total);
-        if (n <= 0) {
-            return -1;
+static int ws_send_frame(ws_io_t *io, uint8_t opcode, const uint8_t *payload, size_t payload_len) {
+    if ((opcode == 0x9 || opcode == 0xA) && payload_len <= 125) {
+        /* Ping/pong may sit between the frames of a segment; one piece so
+         * nothing lands inside it. */
+        uint8_t control[2 + 125];
+        size_t header_len = ws_frame_header(opcode, payload_len, control);
+        if (payload_len > 0) {
+            memcpy(control + header_len, payload, payload_len);
         }
-        total += (size_t)n;
+        return server_conn_write_urgent(io->conn, control, header_len + payload_len);
     }
-    return 0;
+    uint8_t header[10];
+    size_t header_len = ws_frame_header(opcode, payload_len, header);
+    struct iovec iov[2] = {
+        {.iov_base = header, .iov_len = header_len},
+        {.iov_base = (void *)payload, .iov_len = payload_len},
+    };
+    return server_conn_writev(io->conn, iov, payload_len > 0 ? 2 : 1);
 }
 
 static int write_all(ws_io_t *io, const void *buf, size_t len) {
-    const uint8_t *ptr = buf;
-    size_t total = 0;
-    while (total < len) {
-        int n = io_write(io, ptr + total, len - total);
-        if (n <= 0) {
-            return -1;
-        }
-        total += (size_t)n;
-    }
-    return 0;
+    return server_conn_write(io->conn, buf, len);
 }
 
 static int send_json_response(ws_io_t *io, const char *type, const char *status, const char *message) {
@@ -859,6 +1090,32 @@ static int parse_command(const char *text, ws_command_t *cmd) {
         if (json_extract_uint32_field(text, "stream_id", &cmd->stream_id) != 0) {
             cmd->stream_id = 1;
         }
+        if (json_extract_uint32_field(text, "deadline_ms", &cmd->deadline_ms) != 0) {
+            cmd->deadline_ms = 0;
+        }
+        if (json_extract_uint32_field(text, "expire_offset", &cmd->expire_offset) != 0) {
+            cmd->expire_offset = 0;
+        }
+        if (json_extract_uint32_field(text, "playback_offset", &cmd->playback_offset) != 0) {
+            cmd->playback_offset = 0;
+        }
+        return 0;
+    }
+
+    if (strcmp(type, "stream_seek") == 0 || strcmp(type, "stream_stop") == 0) {
+        cmd->type = strcmp(type, "stream_seek") == 0 ? WS_CMD_STREAM_SEEK : WS_CMD_STREAM_STOP;
+        if (json_extract_int_field(text, "video_id", &cmd->video_id) != 0) {
+            cmd->video_id = 0;
+        }
+        if (json_extract_int_field(text, "segment", &cmd->segment_index) != 0) {
+            cmd->segment_index = -1;
+        }
+        if (json_extract_uint64_field(text, "connection_id", &cmd->connection_id) != 0) {
+            cmd->connection_id = 0;
+        }
+        if (json_extract_uint32_field(text, "stream_id", &cmd->stream_id) != 0) {
+            cmd->stream_id = 0;
+        }
         return 0;
     }
 
@@ -881,10 +1138,50 @@ static int parse_command(const char *text, ws_command_t *cmd) {
         return 0;
     }
 
+    if (strcmp(type, "ws_push") == 0) {
+        cmd->type = WS_CMD_WS_PUSH;
+        if (json_extract_int_field(text, "video_id", &cmd->video_id) != 0) {
+            return -1;
+        }
+        if (json_extract_int_field(text, "segment", &cmd->segment_index) != 0) {
+            cmd->segment_index = 0;
+        }
+        if (json_extract_uint32_field(text, "window", &cmd->window) != 0) {
+            cmd->window = WS_PUSH_DEFAULT_WINDOW;
+        }
+        return 0;
+    }
+
+    if (strcmp(type, "ws_segments") == 0) {
+        cmd->type = WS_CMD_WS_SEGMENTS;
+        if (json_extract_int_field(text, "video_id", &cmd->video_id) != 0) {
+            return -1;
+        }
+        if (json_extract_int_field(text, "from", &cmd->segment_index) != 0) {
+            return -1;
+        }
+        if (json_extract_uint32_field(text, "count", &cmd->count) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (strcmp(type, "ws_ack") == 0) {
+        cmd->type = WS_CMD_WS_ACK;
+        if (json_extract_int_field(text, "segment", &cmd->segment_index) != 0) {
+            return -1;
+        }
+        return 0;
+    }
+
     return -1;
 }
 
-static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_frame_t *frame, int user_id) {
+static int handle_text_frame(ws_io_t *io,
+                             websocket_context_t *ctx,
+                             const ws_frame_t *frame,
+                             websocket_session_t *session) {
+    int user_id = session->user_id;
     if (!frame->payload || frame->payload_len == 0) {
         return send_json_response(io, "error", "bad_request", "empty-payload");
     }
@@ -939,9 +1236,7 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
             .payload = cmd.payload,
         };
 
-        pthread_mutex_lock(&ctx->lock);
-        packet.packet_number = ctx->next_packet_number++;
-        pthread_mutex_unlock(&ctx->lock);
+        packet.packet_number = ws_next_packet_number(ctx);
 
         if (quic_engine_send_to_connection(ctx->quic_engine, &packet) != 0) {
             return send_json_response(io, "error", "quic_send_failed", "connection-not-found");
@@ -1097,15 +1392,9 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
         if (!ctx || !ctx->db) {
             return send_json_response(io, "error", "unavailable", "db-missing");
         }
-        db_video_t video;
-        if (db_get_video_by_id(ctx->db, cmd.video_id, &video) != SQLITE_OK) {
-            return send_json_response(io, "error", "not_found", "video-not-found");
-        }
         char full_path[512];
-        if (video.file_path[0] == '/') {
-            strncpy(full_path, video.file_path, sizeof(full_path) - 1);
-        } else {
-            snprintf(full_path, sizeof(full_path), "%s/%s", VIDEO_BASE_PATH, video.file_path);
+        if (resolve_video_path(ctx, cmd.video_id, full_path, sizeof(full_path)) != 0) {
+            return send_json_response(io, "error", "not_found", "video-not-found");
         }
         struct stat st;
         if (stat(full_path, &st) != 0) {
@@ -1135,39 +1424,74 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
         if (!ctx || !ctx->db) {
             return send_json_response(io, "error", "unavailable", "db-missing");
         }
-        db_video_t video;
-        if (db_get_video_by_id(ctx->db, cmd.video_id, &video) != SQLITE_OK) {
+        char full_path[512];
+        if (resolve_video_path(ctx, cmd.video_id, full_path, sizeof(full_path)) != 0) {
             return send_json_response(io, "error", "not_found", "video-not-found");
         }
-        char full_path[512];
-        if (video.file_path[0] == '/') {
-            strncpy(full_path, video.file_path, sizeof(full_path) - 1);
-        } else {
-            snprintf(full_path, sizeof(full_path), "%s/%s", VIDEO_BASE_PATH, video.file_path);
-        }
-        uint32_t next_pn;
-        pthread_mutex_lock(&ctx->lock);
-        next_pn = ctx->next_packet_number;
-        pthread_mutex_unlock(&ctx->lock);
-        if (send_video_chunk(ctx,
-                             cmd.connection_id,
-                             cmd.stream_id,
-                             full_path,
-                             cmd.offset,
-                             cmd.length,
-                             &next_pn) != 0) {
+        session->quic_connection_id = cmd.connection_id;
+        session->quic_stream_id = cmd.stream_id;
+        if (cmd.playback_offset > 0) {
+            quic_engine_update_playback(ctx->quic_engine, cmd.connection_id, cmd.stream_id, cmd.playback_offset);
+        }
+        quic_send_limit_t limit = {
+            .deadline_us = cmd.deadline_ms > 0 ? quic_now_us() + (uint64_t)cmd.deadline_ms * 1000ULL : 0,
+            .expire_offset = cmd.expire_offset,
+        };
+        if (send_video_chunk(ctx, cmd.connection_id, cmd.stream_id, full_path, cmd.offset, cmd.length, &limit) != 0) {
             return send_json_response(io, "error", "stream_failed", "chunk-send-failed");
         }
-        pthread_mutex_lock(&ctx->lock);
-        ctx->next_packet_number = next_pn;
-        pthread_mutex_unlock(&ctx->lock);
 
-        char resp[128];
+        /* The player picks its next bitrate from the rate the QUIC path measured. */
+        quic_delivery_rate_t rate = {0};
+        quic_engine_get_delivery_rate(ctx->quic_engine, cmd.connection_id, &rate);
+        char resp[192];
         int len = snprintf(resp,
                            sizeof(resp),
-                           "{\"type\":\"stream_chunk\",\"status\":\"ok\",\"offset\":%u,\"length\":%u}",
+                           "{\"type\":\"stream_chunk\",\"status\":\"ok\",\"offset\":%u,\"length\":%u,"
+                           "\"delivery_rate_bps\":%llu}",
                            cmd.offset,
-                           cmd.length);
+                           cmd.length,
+                           (unsigned long long)rate.bandwidth_bps);
+        if (len <= 0 || len >= (int)sizeof(resp)) {
+            return send_json_response(io, "error", "internal_error", "response-too-large");
+        }
+        return ws_send_frame(io, 0x1, (const uint8_t *)resp, (size_t)len);
+    }
+
+    if (cmd.type == WS_CMD_STREAM_SEEK || cmd.type == WS_CMD_STREAM_STOP) {
+        /* Drops what was queued for the old position: the push, the rest of the
+         * segment on the wire (its message ends early, before this reply) and
+         * every QUIC retransmission of the stream. A stream_chunk already ran
+         * to completion: this frame is only read after it. The QUIC saving is
+         * only known as those packets are acked or skipped, so the reply
+         * counts the segment bytes and gives the QUIC bytes still unacked. */
+        session->push.active = 0;
+        uint64_t ws_bytes = server_conn_cancel_body(io->conn);
+        uint64_t quic_unacked = 0;
+        uint64_t connection_id = cmd.connection_id != 0 ? cmd.connection_id : session->quic_connection_id;
+        uint32_t stream_id = cmd.stream_id;
+        if (stream_id == 0) {
+            stream_id = session->quic_stream_id != 0 ? session->quic_stream_id : 1;
+        }
+        if (ctx && connection_id != 0) {
+            quic_engine_cancel_stream(ctx->quic_engine, connection_id, stream_id, &quic_unacked);
+        }
+        if (ctx) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->cancels++;
+            ctx->cancel_ws_bytes += ws_bytes;
+            pthread_mutex_unlock(&ctx->lock);
+        }
+        char resp[224];
+        int len = snprintf(resp,
+                           sizeof(resp),
+                           "{\"type\":\"%s\",\"status\":\"ok\",\"video_id\":%d,\"segment\":%d,\"bytes_saved\":%llu,"
+                           "\"quic_unacked_cancelled\":%llu}",
+                           cmd.type == WS_CMD_STREAM_SEEK ? "stream_seek" : "stream_stop",
+                           cmd.video_id,
+                           cmd.segment_index,
+                           (unsigned long long)ws_bytes,
+                           (unsigned long long)quic_unacked);
         if (len <= 0 || len >= (int)sizeof(resp)) {
             return send_json_response(io, "error", "internal_error", "response-too-large");
         }
@@ -1175,92 +1499,27 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
     }
 
     if (cmd.type == WS_CMD_WS_INIT) {
+        /* A new init starts a new stream (seek, recovery); ws_push follows. */
+        session->push.active = 0;
         char path[512];
         snprintf(path, sizeof(path), "data/segments/%d/init-stream0.m4s", cmd.video_id);
-        if (send_ws_file(io, path, "INIT", 0) != 0) {
+        manifest_t *manifest = NULL;
+        if (ctx && manifest_index_get(&ctx->manifests, cmd.video_id, ctx->db, &manifest) != 0) {
             fprintf(stderr, "[ws] init segment missing video=%d path=%s\n", cmd.video_id, path);
             return send_json_response(io, "ws_segment", "error", "init-missing");
         }
-        
-        // Try to read segment_info.json first
-        char info_path[512];
-        snprintf(info_path, sizeof(info_path), "data/segments/%d/segment_info.json", cmd.video_id);
-        FILE *fp = fopen(info_path, "r");
-        if (fp) {
-            // Read the entire segment_info.json
-            fseek(fp, 0, SEEK_END);
-            long file_size = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-            
-            if (file_size > 0 && file_size < 1024 * 1024) { // Max 1MB
-                char *file_content = malloc(file_size + 1);
-                if (file_content) {
-                    size_t read_len = fread(file_content, 1, file_size, fp);
-                    fclose(fp);
-                    file_content[read_len] = '\0';
-                    
-                    // Find where JSON content starts (after opening brace and whitespace)
-                    char *content_start = file_content;
-                    while (*content_start && (*content_start == ' ' || *content_start == '\n' || *content_start == '\r' || *content_start == '\t')) {
-                        content_start++;
-                    }
-                    if (*content_start == '{') {
-                        content_start++;
-                        while (*content_start && (*content_start == ' ' || *content_start == '\n' || *content_start == '\r' || *content_start == '\t')) {
-                            content_start++;
-                        }
-                    }
-                    
-                    // Build response with header + content
-                    size_t content_len = strlen(content_start);
-                    size_t resp_size = 64 + content_len;
-                    char *resp = malloc(resp_size);
-                    if (resp) {
-                        int len = snprintf(resp, resp_size, "{\"type\":\"ws_init\",\"status\":\"ok\",%s", content_start);
-                        if (len > 0 && (size_t)len < resp_size) {
-                            int rc = ws_send_frame(io, 0x1, (const uint8_t *)resp, (size_t)len);
-                            free(resp);
-                            free(file_content);
-                            return rc;
-                        }
-                        free(resp);
-                    }
-                    free(file_content);
-                }
-            } else {
-                fclose(fp);
-            }
-        }
-        
-        // Fallback: count segments manually if segment_info.json doesn't exist
-        int duration = 0;
-        int total_segments = 0;
-        if (ctx && ctx->db) {
-            db_video_t video;
-            if (db_get_video_by_id(ctx->db, cmd.video_id, &video) == SQLITE_OK) {
-                duration = video.duration;
-            }
-        }
-        
-        // Count segment files
-        for (int i = 0; i < 1000; i++) {
-            char seg_path[256];
-            snprintf(seg_path, sizeof(seg_path), "data/segments/%d/chunk-stream0-%05d.m4s", cmd.video_id, i);
-            struct stat st;
-            if (stat(seg_path, &st) != 0) {
-                total_segments = i;
-                break;
-            }
+        if (send_ws_segment(io, ctx, cmd.video_id, SEGMENT_CACHE_INIT_INDEX, path, "INIT", 0) != 0) {
+            fprintf(stderr, "[ws] init segment missing video=%d path=%s\n", cmd.video_id, path);
+            manifest_release(manifest);
+            return send_json_response(io, "ws_segment", "error", "init-missing");
         }
-        
-        char resp[256];
-        int len = snprintf(resp, sizeof(resp),
-            "{\"type\":\"ws_init\",\"status\":\"ok\",\"duration\":%d,\"total_segments\":%d}",
-            duration, total_segments);
-        if (len > 0 && len < (int)sizeof(resp)) {
-            return ws_send_frame(io, 0x1, (const uint8_t *)resp, (size_t)len);
+        if (!manifest) {
+            return send_json_response(io, "ws_init", "ok", "init-sent");
         }
-        return send_json_response(io, "ws_init", "ok", "init-sent");
+        /* Rendered when the manifest was loaded. */
+        int rc = ws_send_frame(io, 0x1, (const uint8_t *)manifest->ws_init, manifest->ws_init_len);
+        manifest_release(manifest);
+        return rc;
     }
 
     if (cmd.type == WS_CMD_WS_SEGMENT) {
@@ -1269,7 +1528,7 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
         int retries = 0;
         int send_rc = -1;
         while (retries < 2) {
-            send_rc = send_ws_file(io, path, "SEGM", (uint32_t)cmd.segment_index);
+            send_rc = send_ws_segment(io, ctx, cmd.video_id, cmd.segment_index, path, "SEGM", (uint32_t)cmd.segment_index);
             if (send_rc == 0) {
                 break;
             }
@@ -1300,6 +1559,91 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
         return send_json_response(io, "ws_segment", "ok", "segment-sent");
     }
 
+    if (cmd.type == WS_CMD_WS_PUSH) {
+        websocket_push_t *push = &session->push;
+        push->active = 0;
+        if (cmd.window == 0) {
+            return send_json_response(io, "ws_push", "ok", "stopped");
+        }
+        manifest_t *manifest = NULL;
+        if (!ctx || manifest_index_get(&ctx->manifests, cmd.video_id, ctx->db, &manifest) != 0) {
+            return send_json_response(io, "ws_push", "error", "video-not-found");
+        }
+        uint32_t total = manifest->total_segments;
+        manifest_release(manifest);
+        if (cmd.segment_index < 0 || (uint32_t)cmd.segment_index >= total) {
+            return send_json_response(io, "ws_push", "error", "segment-out-of-range");
+        }
+        uint32_t window = cmd.window > WS_PUSH_MAX_WINDOW ? WS_PUSH_MAX_WINDOW : cmd.window;
+        /* Sent from ws_push_pump once this frame's batch of input is handled. */
+        *push = (websocket_push_t){
+            .active = 1,
+            .video_id = cmd.video_id,
+            .next = (uint32_t)cmd.segment_index,
+            .acked = (uint32_t)cmd.segment_index,
+            .window = window,
+            .total = total,
+        };
+        char resp[160];
+        int len = snprintf(resp,
+                           sizeof(resp),
+                           "{\"type\":\"ws_push\",\"status\":\"ok\",\"segment\":%d,\"window\":%u,\"total_segments\":%u}",
+                           cmd.segment_index,
+                           window,
+                           total);
+        if (len <= 0 || len >= (int)sizeof(resp)) {
+            return send_json_response(io, "error", "internal_error", "response-too-large");
+        }
+        return ws_send_frame(io, 0x1, (const uint8_t *)resp, (size_t)len);
+    }
+
+    if (cmd.type == WS_CMD_WS_SEGMENTS) {
+        /* Replaces a running push: both share the connection's send slot. */
+        websocket_push_t *push = &session->push;
+        push->active = 0;
+        if (cmd.count == 0 || cmd.count > WS_SEGMENTS_MAX_COUNT) {
+            return send_json_response(io, "ws_segments", "error", "bad-count");
+        }
+        manifest_t *manifest = NULL;
+        if (!ctx || manifest_index_get(&ctx->manifests, cmd.video_id, ctx->db, &manifest) != 0) {
+            return send_json_response(io, "ws_segments", "error", "video-not-found");
+        }
+        uint32_t total = manifest->total_segments;
+        manifest_release(manifest);
+        if (cmd.segment_index < 0 || (uint32_t)cmd.segment_index >= total) {
+            return send_json_response(io, "ws_segments", "error", "segment-out-of-range");
+        }
+        uint32_t first = (uint32_t)cmd.segment_index;
+        uint32_t end = total - first < cmd.count ? total : first + cmd.count;
+        *push = (websocket_push_t){
+            .active = 1,
+            .batch = 1,
+            .video_id = cmd.video_id,
+            .first = first,
+            .next = first,
+            .acked = first,
+            .window = end - first,
+            .total = end,
+        };
+        return 0;
+    }
+
+    if (cmd.type == WS_CMD_WS_ACK) {
+        /* No reply: acks arrive once per segment. Acks past what was sent
+         * (stale after a restart) cannot open the window further. */
+        websocket_push_t *push = &session->push;
+        if (cmd.segment_index >= 0) {
+            uint32_t consumed = (uint32_t)cmd.segment_index + 1;
+            if (consumed > push->next) {
+                consumed = push->next;
+            }
+            if (consumed > push->acked) {
+                push->acked = consumed;
+            }
+        }
+        return 0;
+    }
+
     if (cmd.type == WS_CMD_WATCH_GET) {
         if (!ctx || !ctx->db) {
             return send_json_response(io, "error", "unavailable", "db-missing");
@@ -1349,6 +1693,70 @@ static int handle_text_frame(ws_io_t *io, websocket_context_t *ctx, const ws_fra
     return send_json_response(io, "error", "bad_request", "unsupported");
 }
 
+/* ws_segments summary: how much of the range went out, and why it stopped. */
+static int ws_segments_summary(ws_io_t *io, const websocket_push_t *push, const char *status, const char *message) {
+    char payload[192];
+    int len = snprintf(payload,
+                       sizeof(payload),
+                       "{\"type\":\"ws_segments\",\"status\":\"%s\",\"video_id\":%d,\"from\":%u,\"count\":%u,"
+                       "\"message\":\"%s\"}",
+                       status,
+                       push->video_id,
+                       push->first,
+                       push->next - push->first,
+                       message);
+    if (len <= 0 || len >= (int)sizeof(payload)) {
+        return send_json_response(io, "ws_segments", status, message);
+    }
+    return ws_send_frame(io, 0x1, (const uint8_t *)payload, (size_t)len);
+}
+
+/* Queues one pushed segment at a time and asks to be run again once it is on
+ * the wire, so a slow client never parks the worker. 0, or -1 when even the
+ * error could not be sent. */
+static int ws_push_pump(ws_io_t *io, websocket_context_t *ctx, websocket_push_t *push) {
+    while (push->active && push->next < push->total && push->next < push->acked + push->window) {
+        if (server_conn_wake_on_drain(io->conn)) {
+            return 0;
+        }
+        uint32_t index = push->next;
+        char path[512];
+        snprintf(path, sizeof(path), "data/segments/%d/chunk-stream0-%05u.m4s", push->video_id, index);
+        if (send_ws_segment(io, ctx, push->video_id, (int)index, path, "SEGM", index) != 0) {
+            fprintf(stderr, "[ws] push segment missing/fail video=%d seg=%u path=%s\n", push->video_id, index, path);
+            push->active = 0;
+            if (ctx) {
+                pthread_mutex_lock(&ctx->lock);
+                ctx->segment_sent_fail++;
+                pthread_mutex_unlock(&ctx->lock);
+            }
+            if (push->batch) {
+                return ws_segments_summary(io, push, "error", "segment-missing");
+            }
+            char payload[160];
+            int len = snprintf(payload,
+                               sizeof(payload),
+                               "{\"type\":\"ws_segment\",\"status\":\"error\",\"segment\":%u,\"message\":\"segment-missing\"}",
+                               index);
+            return ws_send_frame(io, 0x1, (const uint8_t *)payload, (size_t)len);
+        }
+        push->next++;
+        if (ctx) {
+            pthread_mutex_lock(&ctx->lock);
+            ctx->segment_sent_ok++;
+            pthread_mutex_unlock(&ctx->lock);
+        }
+    }
+    if (push->active && push->next >= push->total) {
+        push->active = 0;
+        if (push->batch) {
+            return ws_segments_summary(io, push, "ok", "segments-sent");
+        }
+        return send_json_response(io, "ws_push", "done", "last-segment-sent");
+    }
+    return 0;
+}
+
 typedef struct {
     uint32_t state[5];
     uint64_t bitlen;
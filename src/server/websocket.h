@@ -1,7 +1,10 @@
 #ifndef SERVER_WEBSOCKET_H
 #define SERVER_WEBSOCKET_H
 
+#include "server/manifest.h"
 #include "server/quic.h"
+#include "server/segment_cache.h"
+#include "server/server.h"
 #include "db/database.h"
 
 #include <pthread.h>
@@ -17,19 +20,82 @@ typedef struct ssl_st SSL;
 extern "C" {
 #endif
 
+/* Binary segment messages larger than this go out as continuation frames, so
+ * pongs are not held behind a whole multi-megabyte segment. "0" sends every
+ * segment as one frame. */
+#define WS_FRAGMENT_ENV        "WS_FRAGMENT_KB"
+#define WS_DEFAULT_FRAGMENT_KB 256
+
 typedef struct websocket_context {
     quic_engine_t *quic_engine;
     db_context_t *db; /* optional */
     pthread_mutex_t lock;
-    uint32_t next_packet_number;
+    uint32_t next_packet_number;   /* taken one packet at a time under lock */
+    pthread_mutex_t workers_lock;
+    struct quic_dispatch *workers; /* server worker pool for 0-RTT requests, NULL when not serving */
     uint64_t segment_sent_ok;
     uint64_t segment_sent_fail;
+    segment_cache_t segment_cache; /* ws_init / ws_segment files */
+    manifest_index_t manifests;    /* ws_init replies */
+    size_t fragment_size;          /* WS_FRAGMENT_KB in bytes, 0 = whole frames */
+    uint64_t cancels;              /* stream_seek and stream_stop */
+    uint64_t cancel_ws_bytes;      /* segment bytes cut before they were sent */
 } websocket_context_t;
 
+/* 0-RTT playback request, the early data of a resumed QUIC INITIAL. Four
+ * big-endian u32: video_id, stream_id, length, init_stream_id. The server sends
+ * bytes [0, length) of the video on stream_id (0 or over 1 MiB = 1 MiB)
+ * and, when init_stream_id is not 0, the DASH init segment on init_stream_id,
+ * with no WebSocket round trip. Later chunks use stream_chunk as usual. The
+ * request is read on a server worker; without one (server not started) it is
+ * dropped and the client falls back to stream_chunk. */
+#define WS_EARLY_REQUEST_SIZE 16
+
 void websocket_context_init(websocket_context_t *ctx, quic_engine_t *engine, db_context_t *db);
 void websocket_context_destroy(websocket_context_t *ctx);
+/* Drops the cached segments and manifest of video_id after its files changed
+ * (delete, upload, re-segment). */
+void websocket_invalidate_video(websocket_context_t *ctx, int video_id);
+/* Set by server_start and cleared by server_join before the pool goes away. */
+void websocket_set_workers(websocket_context_t *ctx, struct quic_dispatch *workers);
+/* quic_early_data_handler; user_data is the websocket_context_t. */
+void websocket_on_quic_early_data(uint64_t connection_id,
+                                  const uint8_t *data,
+                                  size_t len,
+                                  const struct sockaddr_in *addr,
+                                  void *user_data);
+
+/* ws_push: segments [next, acked + window) go out back to back, one at a
+ * time as the previous one reaches the socket; ws_ack moves acked. */
+#define WS_PUSH_DEFAULT_WINDOW 4
+#define WS_PUSH_MAX_WINDOW     16
+/* ws_segments: a fixed range sent the same way, then one JSON summary. */
+#define WS_SEGMENTS_MAX_COUNT 64
+
+typedef struct {
+    int active;
+    int batch; /* ws_segments: no acks, summary instead of done */
+    int video_id;
+    uint32_t first;  /* ws_segments: start of the range */
+    uint32_t next;   /* next segment to send */
+    uint32_t acked;  /* segments below this were consumed by the client */
+    uint32_t window; /* segments the client buffers ahead of acked */
+    uint32_t total;  /* stop here: end of the video, or of the batch */
+} websocket_push_t;
+
+/* Protocol state of one TCP connection, kept by the server next to its buffers. */
+typedef struct {
+    int upgraded; /* HTTP request seen and answered with 101 */
+    int user_id;
+    websocket_push_t push;
+    uint64_t quic_connection_id; /* last stream_chunk; stream_seek/stop default to it */
+    uint32_t quic_stream_id;
+} websocket_session_t;
 
-int websocket_handle_client(int client_fd, SSL *ssl, websocket_context_t *ctx);
+/* Runs on a server worker whenever conn has new input. Handles the HTTP
+ * request (upgrade, or an API call on the detached socket), then every whole
+ * frame; partial input stays buffered. 0 waits for more, -1 closes. */
+int websocket_process_input(server_conn_t *conn, websocket_session_t *session, websocket_context_t *ctx);
 int websocket_calculate_accept_key(const char *client_key, char *out, size_t out_size);
 void websocket_apply_mask(uint8_t *data, size_t len, const uint8_t mask[4]);
 
@@ -0,0 +1,147 @@
+#define _GNU_SOURCE /* mkdtemp */
+
+#include "server/manifest.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char base[] = "/tmp/manifest_test_XXXXXX";
+
+static void write_file(const char *path, const char *data, size_t len) {
+    FILE *fp = fopen(path, "wb");
+    assert(fp);
+    assert(fwrite(data, 1, len, fp) == len);
+    fclose(fp);
+}
+
+static void write_sized(int video_id, const char *name, size_t len) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/%s", base, video_id, name);
+    char *data = calloc(1, len + 1);
+    assert(data);
+    write_file(path, data, len);
+    free(data);
+}
+
+static void make_video_dir(int video_id) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/%d", base, video_id);
+    assert(mkdir(dir, 0755) == 0);
+}
+
+static void write_info(int video_id, const char *json) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%d/segment_info.json", base, video_id);
+    write_file(path, json, strlen(json));
+}
+
+static const char *INFO_JSON =
+    "{\n"
+    "  \"total_duration\": 5.500,\n"
+    "  \"total_segments\": 3,\n"
+    "  \"video_codec\": \"hevc\",\n"
+    "  \"codec_string\": \"hvc1.1.6.L120.90\",\n"
+    "  \"segments\": [\n"
+    "    {\"index\": 0, \"start\": 0.000, \"end\": 2.000, \"duration\": 2.000},\n"
+    "    {\"index\": 1, \"start\": 2.000, \"end\": 4.000, \"duration\": 2.000},\n"
+    "    {\"index\": 2, \"start\": 4.000, \"end\": 5.500, \"duration\": 1.500}\n"
+    "  ]\n"
+    "}\n";
+
+/* segment_info.json과 세그먼트 파일 크기를 한 번 읽어 ws_init 응답까지 만들어 둔다 */
+static void test_load_info(manifest_index_t *idx) {
+    make_video_dir(1);
+    write_sized(1, "init-stream0.m4s", 800);
+    write_sized(1, "chunk-stream0-00000.m4s", 1000);
+    write_sized(1, "chunk-stream0-00001.m4s", 1100);
+    write_sized(1, "chunk-stream0-00002.m4s", 600);
+    write_info(1, INFO_JSON);
+
+    manifest_t *m = NULL;
+    assert(manifest_index_get(idx, 1, NULL, &m) == 0);
+    assert(m->has_info);
+    assert(m->total_segments == 3);
+    assert(m->init_size == 800);
+    assert(strcmp(m->video_codec, "hevc") == 0);
+    assert(strcmp(m->codec_string, "hvc1.1.6.L120.90") == 0);
+    assert(m->total_duration > 5.49 && m->total_duration < 5.51);
+    assert(m->segments[1].index == 1 && m->segments[1].bytes == 1100);
+    assert(m->segments[2].start > 3.99 && m->segments[2].duration > 1.49);
+    assert(strncmp(m->ws_init, "{\"type\":\"ws_init\",\"status\":\"ok\",", 32) == 0);
+    assert(strlen(m->ws_init) == m->ws_init_len);
+    assert(strstr(m->ws_init, "\"total_segments\":3"));
+    assert(strstr(m->ws_init, "\"codec_string\":\"hvc1.1.6.L120.90\""));
+    assert(strstr(m->ws_init, "\"init_size\":800"));
+    assert(strstr(m->ws_init, "{\"index\":2,\"start\":4.000,\"end\":5.500,\"duration\":1.500,\"bytes\":600}]}"));
+
+    /* 파일을 지워도 두 번째 조회는 메모리에서 답한다 */
+    char path[512];
+    snprintf(path, sizeof(path), "%s/1/segment_info.json", base);
+    assert(unlink(path) == 0);
+    manifest_t *again = NULL;
+    assert(manifest_index_get(idx, 1, NULL, &again) == 0);
+    assert(again == m);
+    manifest_release(again);
+    manifest_release(m);
+
+    manifest_stats_t st;
+    manifest_index_get_stats(idx, &st);
+    assert(st.loads == 1 && st.hits == 1 && st.entries == 1);
+}
+
+/* 무효화 뒤에는 바뀐 파일을 다시 읽는다. 들고 있던 manifest는 그대로 쓸 수 있다 */
+static void test_invalidate(manifest_index_t *idx) {
+    manifest_t *old = NULL;
+    assert(manifest_index_get(idx, 1, NULL, &old) == 0);
+    write_sized(1, "chunk-stream0-00003.m4s", 10);
+    manifest_index_invalidate(idx, 1);
+
+    manifest_t *m = NULL;
+    assert(manifest_index_get(idx, 1, NULL, &m) == 0);
+    assert(m != old);
+    assert(!m->has_info); /* segment_info.json은 앞에서 지웠다 */
+    assert(m->total_segments == 4);
+    assert(strcmp(m->ws_init, "{\"type\":\"ws_init\",\"status\":\"ok\",\"duration\":0,\"total_segments\":4,\"init_size\":800}") == 0);
+    assert(old->total_segments == 3);
+    manifest_release(old);
+    manifest_release(m);
+
+    manifest_stats_t st;
+    manifest_index_get_stats(idx, &st);
+    assert(st.invalidations == 1 && st.loads == 2 && st.entries == 1);
+}
+
+/* init 세그먼트가 없으면 실패하고 캐시에 남기지 않는다 */
+static void test_missing(manifest_index_t *idx) {
+    manifest_t *m = NULL;
+    assert(manifest_index_get(idx, 2, NULL, &m) == -1);
+    make_video_dir(2);
+    write_sized(2, "init-stream0.m4s", 10);
+    assert(manifest_index_get(idx, 2, NULL, &m) == 0);
+    assert(m->total_segments == 0);
+    manifest_release(m);
+
+    manifest_stats_t st;
+    manifest_index_get_stats(idx, &st);
+    assert(st.load_failures == 1);
+}
+
+int main(void) {
+    assert(mkdtemp(base) != NULL);
+    manifest_index_t idx;
+    assert(manifest_index_init(&idx, base) == 0);
+    test_load_info(&idx);
+    test_invalidate(&idx);
+    test_missing(&idx);
+    manifest_index_destroy(&idx);
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", base);
+    assert(system(cmd) == 0);
+    printf("manifest_test passed\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include "server/quic_cc.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+int main(void) {
+    quic_cc_t cc;
+    quic_cc_init(&cc);
+    assert(cc.cwnd == QUIC_CC_INITIAL_WINDOW);
+    assert(cc.bytes_in_flight == 0);
+
+    /* 창을 다 채우면 더 보낼 수 없다 */
+    assert(quic_cc_can_send(&cc, QUIC_CC_INITIAL_WINDOW));
+    quic_cc_on_sent(&cc, QUIC_CC_INITIAL_WINDOW);
+    assert(!quic_cc_can_send(&cc, 1));
+
+    /* slow start: ACK된 바이트만큼 증가, RTT 샘플 반영 */
+    quic_cc_on_acked(&cc, 1200, 100, 20000);
+    assert(cc.bytes_in_flight == QUIC_CC_INITIAL_WINDOW - 1200);
+    assert(cc.cwnd == QUIC_CC_INITIAL_WINDOW + 1200);
+    assert(cc.srtt_us == 20000);
+    assert(cc.min_rtt_us == 20000);
+    quic_cc_on_acked(&cc, 1200, 200, 10000);
+    assert(cc.min_rtt_us == 10000);
+    assert(cc.srtt_us < 20000 && cc.srtt_us > 10000);
+
+    /* 손실: 창 절반, 같은 복구 구간의 추가 손실은 무시 */
+    uint64_t before = cc.cwnd;
+    quic_cc_on_lost(&cc, 1200, 300, 1000);
+    assert(cc.cwnd == before / 2);
+    assert(cc.ssthresh == cc.cwnd);
+    assert(cc.congestion_events == 1);
+    quic_cc_on_lost(&cc, 1200, 400, 1100);
+    assert(cc.cwnd == before / 2);
+    assert(cc.congestion_events == 1);
+
+    /* 복구 이전에 보낸 패킷의 ACK는 창을 키우지 않는다 */
+    uint64_t recovered = cc.cwnd;
+    quic_cc_on_acked(&cc, 1200, 500, 0);
+    assert(cc.cwnd == recovered);
+
+    /* 복구 이후 전송분: congestion avoidance (MSS * acked / cwnd) */
+    quic_cc_on_acked(&cc, 1200, 2000, 0);
+    assert(cc.cwnd == recovered + (uint64_t)QUIC_CC_MAX_DATAGRAM * 1200 / recovered);
+
+    /* 연속 손실에도 최소 창 유지 */
+    for (uint64_t t = 3000; t < 30000; t += 1000) {
+        quic_cc_on_lost(&cc, 0, t, t);
+    }
+    assert(cc.cwnd == QUIC_CC_MIN_WINDOW);
+
+    quic_cc_on_discarded(&cc, UINT32_MAX);
+    assert(cc.bytes_in_flight == 0);
+
+    /* ECN-CE: 손실과 같은 창 감소지만 보낸 바이트는 그대로 in-flight */
+    quic_cc_t marked;
+    quic_cc_init(&marked);
+    quic_cc_on_sent(&marked, 4800);
+    assert(quic_cc_on_ecn_ce(&marked, 100, 1000) == 1);
+    assert(marked.cwnd == QUIC_CC_INITIAL_WINDOW / 2 && marked.bytes_in_flight == 4800);
+    assert(quic_cc_on_ecn_ce(&marked, 500, 1100) == 0);
+    assert(marked.congestion_events == 1);
+
+    puts("quic_cc_test passed");
+    return 0;
+}
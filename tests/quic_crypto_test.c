@@ -0,0 +1,253 @@
+#include "server/quic.h"
+#include "server/quic_crypto.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static void from_hex(const char *hex, uint8_t *out, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned v = 0;
+        sscanf(hex + 2 * i, "%2x", &v);
+        out[i] = (uint8_t)v;
+    }
+}
+
+static int hex_equal(const uint8_t *got, const char *hex, size_t len) {
+    uint8_t want[64];
+    from_hex(hex, want, len);
+    return memcmp(got, want, len) == 0;
+}
+
+static size_t build_packet(uint8_t *buf, uint8_t flags, uint64_t cid, uint32_t pn, const uint8_t *payload, uint32_t len) {
+    quic_packet_t packet = {
+        .flags = flags,
+        .connection_id = cid,
+        .packet_number = pn,
+        .stream_id = 3,
+        .offset = 4096,
+        .length = len,
+        .payload = payload,
+    };
+    size_t out = 0;
+    assert(quic_packet_serialize(&packet, buf, QUIC_MAX_PACKET_SIZE, &out) == 0);
+    return out;
+}
+
+static void check_roundtrip(quic_aead_t aead) {
+    const uint64_t cid = 0x1122334455667788ULL;
+    quic_crypto_keys_t client_keys;
+    quic_crypto_keys_t server_keys;
+    assert(quic_crypto_derive_keys(aead, cid, QUIC_CRYPTO_CLIENT, NULL, 0, &client_keys) == 0);
+    assert(quic_crypto_derive_keys(aead, cid, QUIC_CRYPTO_SERVER, NULL, 0, &server_keys) == 0);
+    quic_crypto_ctx_t seal;
+    quic_crypto_ctx_t open;
+    quic_crypto_ctx_t wrong;
+    assert(quic_crypto_ctx_init(&seal, &client_keys, 1) == 0);
+    assert(quic_crypto_ctx_init(&open, &client_keys, 0) == 0);
+    assert(quic_crypto_ctx_init(&wrong, &server_keys, 0) == 0);
+
+    /* 페이로드가 없는 ACK(샘플이 태그에 걸침)부터 최대 크기까지 */
+    static uint8_t payload[QUIC_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(payload); ++i) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    const uint32_t sizes[] = {0, 1, 15, 1200, QUIC_MAX_PAYLOAD};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        uint8_t plain[QUIC_MAX_PACKET_SIZE];
+        uint8_t wire[QUIC_MAX_PACKET_SIZE];
+        size_t plain_len = build_packet(plain, QUIC_FLAG_DATA, cid, 42, payload, sizes[s]);
+        memcpy(wire, plain, plain_len);
+        size_t wire_len = 0;
+        assert(quic_crypto_seal(&seal, wire, sizes[s], 1000 + s, &wire_len) == 0);
+        assert(wire_len == plain_len + QUIC_CRYPTO_OVERHEAD);
+        /* flags/cid/length는 평문, 패킷 번호는 가려진다 */
+        assert(memcmp(wire, plain, 9) == 0);
+        assert(memcmp(wire + 21, plain + 21, 4) == 0);
+        assert(memcmp(wire + 9, plain + 9, 4) != 0);
+        if (sizes[s] >= 16) {
+            assert(memcmp(wire + QUIC_HEADER_SIZE, plain + QUIC_HEADER_SIZE, 16) != 0);
+        }
+
+        uint8_t copy[QUIC_MAX_PACKET_SIZE];
+        memcpy(copy, wire, wire_len);
+        assert(quic_crypto_open(&wrong, copy, wire_len, NULL) == -1);
+
+        memcpy(copy, wire, wire_len);
+        size_t out_len = 0;
+        assert(quic_crypto_open(&open, copy, wire_len, &out_len) == 0);
+        assert(out_len == plain_len);
+        assert(memcmp(copy, plain, plain_len) == 0);
+
+        /* 변조: 암호문, 헤더, 시퀀스, 길이 부족 */
+        memcpy(copy, wire, wire_len);
+        copy[wire_len - QUIC_CRYPTO_SEQ_SIZE - 1] ^= 1;
+        assert(quic_crypto_open(&open, copy, wire_len, NULL) == -1);
+        memcpy(copy, wire, wire_len);
+        copy[0] ^= QUIC_FLAG_ACK;
+        assert(quic_crypto_open(&open, copy, wire_len, NULL) == -1);
+        memcpy(copy, wire, wire_len);
+        copy[wire_len - 1] ^= 1;
+        assert(quic_crypto_open(&open, copy, wire_len, NULL) == -1);
+        memcpy(copy, wire, wire_len);
+        assert(quic_crypto_open(&open, copy, wire_len - 1, NULL) == -1);
+    }
+
+    /* 같은 평문도 시퀀스가 다르면 다른 암호문 */
+    uint8_t a[QUIC_MAX_PACKET_SIZE];
+    uint8_t b[QUIC_MAX_PACKET_SIZE];
+    size_t len = build_packet(a, QUIC_FLAG_DATA, cid, 1, payload, 64);
+    memcpy(b, a, len);
+    assert(quic_crypto_seal(&seal, a, 64, 1, NULL) == 0);
+    assert(quic_crypto_seal(&seal, b, 64, 2, NULL) == 0);
+    assert(memcmp(a + QUIC_HEADER_SIZE, b + QUIC_HEADER_SIZE, 64) != 0);
+
+    /* 사전 공유 키가 다르면 열 수 없다 */
+    quic_crypto_keys_t psk_keys;
+    const uint8_t psk[] = "viewer-secret";
+    assert(quic_crypto_derive_keys(aead, cid, QUIC_CRYPTO_CLIENT, psk, sizeof(psk) - 1, &psk_keys) == 0);
+    assert(memcmp(psk_keys.key, client_keys.key, psk_keys.key_len) != 0);
+
+    quic_crypto_ctx_free(&seal);
+    quic_crypto_ctx_free(&open);
+    quic_crypto_ctx_free(&wrong);
+}
+
+static void check_engine(void) {
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    assert(quic_engine_set_protection(engine, QUIC_AEAD_AES_128_GCM, NULL, 0) == 0);
+
+    int client = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(client >= 0);
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(client, (struct sockaddr *)&client_addr, sizeof(client_addr)) == 0);
+    socklen_t alen = sizeof(client_addr);
+    assert(getsockname(client, (struct sockaddr *)&client_addr, &alen) == 0);
+    struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    const uint64_t cid = 0xC0FFEE;
+    quic_crypto_keys_t keys;
+    quic_crypto_ctx_t client_tx;
+    quic_crypto_ctx_t client_rx;
+    assert(quic_crypto_derive_keys(QUIC_AEAD_AES_128_GCM, cid, QUIC_CRYPTO_CLIENT, NULL, 0, &keys) == 0);
+    assert(quic_crypto_ctx_init(&client_tx, &keys, 1) == 0);
+    assert(quic_crypto_derive_keys(QUIC_AEAD_AES_128_GCM, cid, QUIC_CRYPTO_SERVER, NULL, 0, &keys) == 0);
+    assert(quic_crypto_ctx_init(&client_rx, &keys, 0) == 0);
+
+    /* 평문 INITIAL은 인증 실패로 버려진다 */
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    size_t len = build_packet(buf, QUIC_FLAG_INITIAL, cid, 0, NULL, 0);
+    assert(quic_engine_process_datagram(engine, buf, len, &client_addr) == -1);
+    quic_metrics_t metrics;
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.packets_rejected_auth == 1);
+
+    /* 보호된 INITIAL -> 보호된 HANDSHAKE 응답 */
+    len = build_packet(buf, QUIC_FLAG_INITIAL, cid, 0, NULL, 0);
+    assert(quic_crypto_seal(&client_tx, buf, 0, 1, &len) == 0);
+    assert(quic_engine_process_datagram(engine, buf, len, &client_addr) == 0);
+    ssize_t got = recv(client, buf, sizeof(buf), 0);
+    assert(got == QUIC_HEADER_SIZE + QUIC_CRYPTO_OVERHEAD);
+    size_t plain_len = 0;
+    assert(quic_crypto_open(&client_rx, buf, (size_t)got, &plain_len) == 0);
+    quic_packet_t reply;
+    assert(quic_packet_deserialize(&reply, buf, plain_len) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK));
+    assert(reply.connection_id == cid);
+
+    len = build_packet(buf, QUIC_FLAG_HANDSHAKE, cid, 1, NULL, 0);
+    assert(quic_crypto_seal(&client_tx, buf, 0, 2, &len) == 0);
+    assert(quic_engine_process_datagram(engine, buf, len, &client_addr) == 0);
+    /* 재개 티켓도 보호된 채로 온다 */
+    got = recv(client, buf, sizeof(buf), 0);
+    assert(got == QUIC_HEADER_SIZE + QUIC_TICKET_PAYLOAD + QUIC_CRYPTO_OVERHEAD);
+    assert(quic_crypto_open(&client_rx, buf, (size_t)got, &plain_len) == 0);
+    assert(quic_packet_deserialize(&reply, buf, plain_len) == 0);
+    assert(reply.flags == QUIC_FLAG_HANDSHAKE && reply.length == QUIC_TICKET_PAYLOAD);
+
+    /* 배치 전송: sendmmsg 한 번, 각 패킷은 개별적으로 열린다 */
+    quic_send_batch_t batch;
+    assert(quic_send_batch_init(&batch) == 0);
+    uint8_t payload[1000];
+    memset(payload, 0x42, sizeof(payload));
+    for (uint32_t i = 0; i < 5; ++i) {
+        quic_packet_t pkt = {
+            .flags = QUIC_FLAG_DATA,
+            .connection_id = cid,
+            .packet_number = 10 + i,
+            .stream_id = 1,
+            .offset = i * (uint32_t)sizeof(payload),
+            .length = sizeof(payload),
+            .payload = payload,
+        };
+        assert(quic_engine_batch_add(engine, &batch, &pkt, NULL) == 0);
+    }
+    assert(quic_engine_batch_flush(engine, &batch) == 0);
+    for (uint32_t i = 0; i < 5; ++i) {
+        got = recv(client, buf, sizeof(buf), 0);
+        assert(got == QUIC_HEADER_SIZE + (ssize_t)sizeof(payload) + QUIC_CRYPTO_OVERHEAD);
+        assert(quic_crypto_open(&client_rx, buf, (size_t)got, &plain_len) == 0);
+        assert(quic_packet_deserialize(&reply, buf, plain_len) == 0);
+        assert(reply.packet_number == 10 + i);
+        assert(reply.offset == i * sizeof(payload));
+        assert(memcmp(reply.payload, payload, sizeof(payload)) == 0);
+    }
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.send_batches == 1);
+
+    quic_send_batch_destroy(&batch);
+    quic_crypto_ctx_free(&client_tx);
+    quic_crypto_ctx_free(&client_rx);
+    close(client);
+    quic_engine_stop(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+}
+
+int main(void) {
+    quic_aead_t aead;
+    assert(quic_crypto_parse_aead("aes128gcm", &aead) == 0 && aead == QUIC_AEAD_AES_128_GCM);
+    assert(quic_crypto_parse_aead("chacha20", &aead) == 0 && aead == QUIC_AEAD_CHACHA20_POLY1305);
+    assert(quic_crypto_parse_aead("off", &aead) == 0 && aead == QUIC_AEAD_NONE);
+    assert(quic_crypto_parse_aead("rot13", &aead) == -1);
+
+    if (!quic_crypto_available()) {
+        fprintf(stderr, "built without TLS=1, skipping packet protection test\n");
+        puts("quic_crypto_test passed");
+        return 0;
+    }
+
+    /* RFC 9001 Appendix A.1 Initial 키 */
+    const uint64_t rfc_cid = 0x8394c8f03e515708ULL;
+    uint8_t secret[32];
+    assert(quic_crypto_initial_secret(rfc_cid, NULL, 0, secret) == 0);
+    assert(hex_equal(secret, "7db5df06e7a69e432496adedb00851923595221596ae2ae9fb8115c1e9ed0a44", 32));
+    quic_crypto_keys_t keys;
+    assert(quic_crypto_derive_keys(QUIC_AEAD_AES_128_GCM, rfc_cid, QUIC_CRYPTO_CLIENT, NULL, 0, &keys) == 0);
+    assert(keys.key_len == 16);
+    assert(hex_equal(keys.key, "1f369613dd76d5467730efcbe3b1a22d", 16));
+    assert(hex_equal(keys.iv, "fa044b2f42a3fd3b46fb255c", 12));
+    assert(hex_equal(keys.hp, "9f50449e04a0e810283a1e9933adedd2", 16));
+    assert(quic_crypto_derive_keys(QUIC_AEAD_AES_128_GCM, rfc_cid, QUIC_CRYPTO_SERVER, NULL, 0, &keys) == 0);
+    assert(hex_equal(keys.key, "cf3a5331653c364c88f0f379b6067e37", 16));
+    assert(hex_equal(keys.iv, "0ac1493ca1905853b0bba03e", 12));
+    assert(hex_equal(keys.hp, "c206b8d9b9f0f37644430b490eeaa314", 16));
+
+    check_roundtrip(QUIC_AEAD_AES_128_GCM);
+    check_roundtrip(QUIC_AEAD_CHACHA20_POLY1305);
+    check_engine();
+
+    puts("quic_crypto_test passed");
+    return 0;
+}
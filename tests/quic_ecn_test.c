@@ -0,0 +1,235 @@
+#define _POSIX_C_SOURCE 200809L /* setenv */
+
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static void on_stream_data(uint64_t connection_id,
+                           uint32_t stream_id,
+                           uint32_t offset,
+                           const uint8_t *data,
+                           size_t len,
+                           void *user_data) {
+    (void)connection_id;
+    (void)stream_id;
+    (void)offset;
+    (void)data;
+    (void)len;
+    (void)user_data;
+}
+
+static void send_marked(int fd, const struct sockaddr_in *to, const quic_packet_t *packet, int tos) {
+    assert(setsockopt(fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0);
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    size_t len = 0;
+    assert(quic_packet_serialize(packet, buf, sizeof(buf), &len) == 0);
+    assert(sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)) == (ssize_t)len);
+}
+
+/* Next packet for the client and the ECN bits it arrived with; -1 on timeout. */
+static int recv_marked(int fd, uint8_t *buf, quic_packet_t *packet, uint8_t *ecn) {
+    uint8_t control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {.iov_base = buf, .iov_len = QUIC_MAX_PACKET_SIZE};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n <= 0) {
+        return -1;
+    }
+    *ecn = QUIC_ECN_NOT_ECT;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+            *ecn = *(const uint8_t *)CMSG_DATA(cmsg) & QUIC_ECN_MASK;
+        }
+    }
+    assert(quic_packet_deserialize(packet, buf, (size_t)n) == 0);
+    return 0;
+}
+
+static quic_ecn_counts_t ack_counts(const quic_packet_t *ack) {
+    assert(ack->length == QUIC_ACK_ECN_SIZE);
+    uint32_t values[3];
+    memcpy(values, ack->payload, sizeof(values));
+    quic_ecn_counts_t counts = {ntohl(values[0]), ntohl(values[1]), ntohl(values[2])};
+    return counts;
+}
+
+/* The engine handles datagrams in order, so once this DATA is acknowledged
+ * everything sent before it has been processed. */
+static quic_packet_t exchange_data(int fd, const struct sockaddr_in *server, uint32_t pn, int tos) {
+    static const uint8_t body[4] = {'e', 'c', 'n', '!'};
+    quic_packet_t data = {
+        .flags = QUIC_FLAG_DATA,
+        .connection_id = 0xEC,
+        .packet_number = pn,
+        .stream_id = 1,
+        .offset = pn * 4,
+        .length = sizeof(body),
+        .payload = body,
+    };
+    send_marked(fd, server, &data, tos);
+    static uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t reply;
+    uint8_t ecn = 0;
+    for (;;) {
+        assert(recv_marked(fd, buf, &reply, &ecn) == 0);
+        if (reply.flags == QUIC_FLAG_ACK && reply.packet_number == pn) {
+            assert(ecn == QUIC_ECN_ECT0);
+            return reply;
+        }
+    }
+}
+
+static void send_ack(int fd, const struct sockaddr_in *server, uint32_t pn, uint32_t ect0, uint32_t ce) {
+    uint32_t counts[3] = {htonl(ect0), 0, htonl(ce)};
+    quic_packet_t ack = {
+        .flags = QUIC_FLAG_ACK,
+        .connection_id = 0xEC,
+        .packet_number = pn,
+        .stream_id = 2,
+        .length = QUIC_ACK_ECN_SIZE,
+        .payload = (const uint8_t *)counts,
+    };
+    send_marked(fd, server, &ack, QUIC_ECN_ECT0);
+}
+
+static void send_server_data(quic_engine_t *engine, int fd, uint32_t pn) {
+    uint8_t body[1000];
+    memset(body, 'v', sizeof(body));
+    quic_packet_t data = {
+        .flags = QUIC_FLAG_DATA,
+        .connection_id = 0xEC,
+        .packet_number = pn,
+        .stream_id = 2,
+        .offset = pn * sizeof(body),
+        .length = sizeof(body),
+        .payload = body,
+    };
+    assert(quic_engine_send_to_connection(engine, &data) == 0);
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t got;
+    uint8_t ecn = 0;
+    assert(recv_marked(fd, buf, &got, &ecn) == 0);
+    assert(got.flags == QUIC_FLAG_DATA && got.packet_number == pn && ecn == QUIC_ECN_ECT0);
+}
+
+int main(void) {
+    unsetenv(QUIC_ECN_ENV);
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    assert(engine->ecn == 1);
+    quic_engine_set_stream_data_handler(engine, on_stream_data, NULL);
+    assert(quic_engine_start(engine) == 0);
+
+    struct sockaddr_in server;
+    socklen_t alen = sizeof(server);
+    assert(getsockname(engine->sockfd, (struct sockaddr *)&server, &alen) == 0);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    int on = 1;
+    assert(setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on)) == 0);
+    struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
+    assert(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t reply;
+    uint8_t ecn = 0;
+
+    /* 핸드셰이크: 서버가 보내는 패킷은 모두 ECT(0) */
+    quic_packet_t initial = {.flags = QUIC_FLAG_INITIAL, .connection_id = 0xEC};
+    send_marked(fd, &server, &initial, QUIC_ECN_NOT_ECT);
+    assert(recv_marked(fd, buf, &reply, &ecn) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK) && ecn == QUIC_ECN_ECT0);
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = 0xEC, .packet_number = 1};
+    send_marked(fd, &server, &hs, QUIC_ECN_NOT_ECT);
+    assert(recv_marked(fd, buf, &reply, &ecn) == 0);
+    assert(reply.flags == QUIC_FLAG_HANDSHAKE && reply.length == QUIC_TICKET_PAYLOAD);
+
+    /* 표시 없는 패킷만 받은 연결은 ECN 카운트 없는 기존 ACK */
+    reply = exchange_data(fd, &server, 2, QUIC_ECN_NOT_ECT);
+    assert(reply.length == 0);
+
+    /* 직접 CE로 표시한 패킷: ACK에 누적 카운트가 실린다 */
+    reply = exchange_data(fd, &server, 3, QUIC_ECN_CE);
+    quic_ecn_counts_t counts = ack_counts(&reply);
+    assert(counts.ect0 == 0 && counts.ect1 == 0 && counts.ce == 1);
+    reply = exchange_data(fd, &server, 4, QUIC_ECN_ECT0);
+    counts = ack_counts(&reply);
+    assert(counts.ect0 == 1 && counts.ce == 1);
+    quic_metrics_t metrics;
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.ecn_ce_received == 1);
+
+    /* 클라이언트가 CE 증가를 보고하면 손실 없이 창을 줄인다 */
+    quic_cc_t before;
+    quic_cc_t after;
+    send_server_data(engine, fd, 100);
+    assert(quic_engine_get_congestion(engine, 0xEC, &before) == 0);
+    assert(before.bytes_in_flight > 0 && before.congestion_events == 0);
+    send_ack(fd, &server, 100, 1, 1);
+    exchange_data(fd, &server, 5, QUIC_ECN_ECT0);
+    assert(quic_engine_get_congestion(engine, 0xEC, &after) == 0);
+    assert(after.congestion_events == 1 && after.bytes_in_flight == 0);
+    assert(after.cwnd < before.cwnd && after.cwnd == after.ssthresh);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.ecn_ce_reported == 1 && metrics.ecn_congestion_events == 1);
+    assert(metrics.datagrams_lost == 0);
+
+    /* 같은 카운트를 다시 보고하거나 늦게 온 ACK가 더 작은 값을 보고해도 반응하지 않는다 */
+    send_server_data(engine, fd, 101);
+    send_ack(fd, &server, 101, 2, 1);
+    send_server_data(engine, fd, 102);
+    send_ack(fd, &server, 102, 1, 0);
+    exchange_data(fd, &server, 6, QUIC_ECN_ECT0);
+    assert(quic_engine_get_congestion(engine, 0xEC, &after) == 0);
+    assert(after.congestion_events == 1 && after.bytes_in_flight == 0);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.ecn_ce_reported == 1);
+
+    /* 복구 시작 이후에 보낸 패킷의 새 CE는 다시 창을 줄인다 */
+    uint64_t reduced = after.cwnd;
+    send_server_data(engine, fd, 103);
+    send_ack(fd, &server, 103, 2, 3);
+    exchange_data(fd, &server, 7, QUIC_ECN_ECT0);
+    assert(quic_engine_get_congestion(engine, 0xEC, &after) == 0);
+    assert(after.congestion_events == 2 && after.cwnd < reduced);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.ecn_ce_reported == 3 && metrics.ecn_congestion_events == 2);
+
+    close(fd);
+    quic_engine_stop(engine);
+    quic_engine_join(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+
+    /* QUIC_ECN=off: 소켓에 표시하지 않는다 */
+    setenv(QUIC_ECN_ENV, "off", 1);
+    engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    assert(engine->ecn == 0);
+    int tos = -1;
+    socklen_t tos_len = sizeof(tos);
+    assert(getsockopt(engine->sockfd, IPPROTO_IP, IP_TOS, &tos, &tos_len) == 0);
+    assert((tos & QUIC_ECN_MASK) == QUIC_ECN_NOT_ECT);
+    quic_engine_destroy(engine);
+    free(engine);
+
+    puts("quic_ecn_test passed");
+    return 0;
+}
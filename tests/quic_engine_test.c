@@ -24,6 +24,12 @@ typedef struct {
     quic_connection_state_t last_state;
     struct sockaddr_in last_state_addr;
     int state_called;
+    uint8_t datagram_buf[QUIC_MAX_PAYLOAD];
+    size_t datagram_len;
+    int datagram_called;
+    uint8_t early_buf[64];
+    size_t early_len;
+    int early_called;
 } handler_state_t;
 
 static void packet_handler(const quic_packet_t *packet, const struct sockaddr_in *addr, void *user_data) {
@@ -66,6 +72,44 @@ static void state_handler(uint64_t connection_id, quic_connection_state_t state,
     pthread_mutex_unlock(&st->lock);
 }
 
+static void datagram_handler(uint64_t connection_id, const uint8_t *data, size_t len, void *user_data) {
+    (void)connection_id;
+    handler_state_t *state = (handler_state_t *)user_data;
+    pthread_mutex_lock(&state->lock);
+    memcpy(state->datagram_buf, data, len);
+    state->datagram_len = len;
+    state->datagram_called++;
+    pthread_mutex_unlock(&state->lock);
+}
+
+static void early_data_handler(uint64_t connection_id, const uint8_t *data, size_t len, const struct sockaddr_in *addr, void *user_data) {
+    (void)connection_id;
+    (void)addr;
+    handler_state_t *state = (handler_state_t *)user_data;
+    pthread_mutex_lock(&state->lock);
+    if (len <= sizeof(state->early_buf)) {
+        memcpy(state->early_buf, data, len);
+        state->early_len = len;
+    }
+    state->early_called++;
+    pthread_cond_broadcast(&state->cond);
+    pthread_mutex_unlock(&state->lock);
+}
+
+/* 지정한 연결/플래그 조합의 패킷이 올 때까지 다른 패킷은 건너뛴다 */
+static int recv_matching(int fd, uint64_t connection_id, uint8_t flags, uint8_t *buf, size_t buf_len, quic_packet_t *out) {
+    for (int i = 0; i < 16; ++i) {
+        ssize_t n = recvfrom(fd, buf, buf_len, 0, NULL, NULL);
+        if (n <= 0) {
+            return -1;
+        }
+        if (quic_packet_deserialize(out, buf, (size_t)n) == 0 && out->connection_id == connection_id && out->flags == flags) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
 static int wait_for_packet(handler_state_t *state) {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
@@ -83,6 +127,24 @@ static int wait_for_packet(handler_state_t *state) {
     return 0;
 }
 
+/* early data 핸들러는 티켓 전송 뒤 엔진 스레드에서 불리므로 기다려야 한다 */
+static int wait_for_early_data(handler_state_t *state, int count) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 1;
+
+    pthread_mutex_lock(&state->lock);
+    while (state->early_called < count) {
+        int rc = pthread_cond_timedwait(&state->cond, &state->lock, &ts);
+        if (rc == ETIMEDOUT) {
+            pthread_mutex_unlock(&state->lock);
+            return -1;
+        }
+    }
+    pthread_mutex_unlock(&state->lock);
+    return 0;
+}
+
 int main(void) {
     handler_state_t state;
     memset(&state, 0, sizeof(state));
@@ -106,6 +168,8 @@ int main(void) {
     }
     quic_engine_set_stream_data_handler(&engine, stream_handler, &state);
     quic_engine_set_state_handler(&engine, state_handler, &state);
+    quic_engine_set_datagram_handler(&engine, datagram_handler, &state);
+    quic_engine_set_early_data_handler(&engine, early_data_handler, &state);
     assert(quic_engine_start(&engine) == 0);
 
     int client_fd1 = socket(AF_INET, SOCK_DGRAM, 0);
@@ -171,6 +235,17 @@ int main(void) {
     assert(quic_packet_serialize(&handshake_packet1, buffer, sizeof(buffer), &len) == 0);
     assert(sendto(client_fd1, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
 
+    /* CONNECTED가 되면 재개 티켓이 온다 (ACK 없는 HANDSHAKE) */
+    recv_len = recvfrom(client_fd1, recv_buf, sizeof(recv_buf), 0, NULL, NULL);
+    assert(recv_len > 0);
+    quic_packet_t ticket_pkt;
+    assert(quic_packet_deserialize(&ticket_pkt, recv_buf, (size_t)recv_len) == 0);
+    assert(ticket_pkt.flags == QUIC_FLAG_HANDSHAKE);
+    assert(ticket_pkt.connection_id == conn_id1);
+    assert(ticket_pkt.length == QUIC_TICKET_PAYLOAD);
+    uint8_t ticket[QUIC_TICKET_SIZE];
+    memcpy(ticket, ticket_pkt.payload, sizeof(ticket));
+
     quic_packet_t data_packet1 = {
         .flags = QUIC_FLAG_DATA,
         .connection_id = conn_id1,
@@ -242,12 +317,12 @@ int main(void) {
         .length = sizeof(payload),
         .payload = payload,
     };
-    assert(quic_packet_serialize(&data_packet2, buffer, sizeof(buffer), &len) == 0);
-    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
-
+    /* 응답이 먼저 도착할 수 있으므로 전송 전에 초기화 */
     pthread_mutex_lock(&state.lock);
     state.received = 0;
     pthread_mutex_unlock(&state.lock);
+    assert(quic_packet_serialize(&data_packet2, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
 
     assert(wait_for_packet(&state) == 0);
     assert(state.packet.connection_id == data_packet2.connection_id);
@@ -317,12 +392,12 @@ int main(void) {
         .length = sizeof(payload),
         .payload = payload,
     };
-    assert(quic_packet_serialize(&migrate_packet, buffer, sizeof(buffer), &len) == 0);
-    assert(sendto(client_fd3, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
     pthread_mutex_lock(&state.lock);
     state.received = 0;
     state.state_called = 0;
     pthread_mutex_unlock(&state.lock);
+    assert(quic_packet_serialize(&migrate_packet, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd3, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
     assert(wait_for_packet(&state) == 0);
 
     quic_metrics_t after_mig;
@@ -335,6 +410,277 @@ int main(void) {
     assert(state_called);
     assert(ntohs(new_addr.sin_port) == ntohs(src_addr3.sin_port));
 
+    /* 비신뢰 datagram: 스트림 재조립/재전송 없이 별도 핸들러로 전달 */
+    pthread_mutex_lock(&state.lock);
+    state.stream_len = 0;
+    pthread_mutex_unlock(&state.lock);
+    const uint8_t media[] = {'f', 'r', 'a', 'm', 'e'};
+    quic_packet_t client_datagram = {
+        .flags = QUIC_FLAG_DATAGRAM,
+        .connection_id = conn_id2,
+        .packet_number = 7,
+        .stream_id = 0,
+        .offset = 0,
+        .length = sizeof(media),
+        .payload = media,
+    };
+    assert(quic_packet_serialize(&client_datagram, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+
+    quic_packet_t dgram_ack;
+    memset(&dgram_ack, 0, sizeof(dgram_ack));
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        recv_len = recvfrom(client_fd2, recv_buf, sizeof(recv_buf), 0, NULL, NULL);
+        assert(recv_len > 0);
+        assert(quic_packet_deserialize(&dgram_ack, recv_buf, (size_t)recv_len) == 0);
+        if ((dgram_ack.flags & QUIC_FLAG_DATAGRAM) && (dgram_ack.flags & QUIC_FLAG_ACK)) {
+            break;
+        }
+    }
+    assert(dgram_ack.flags & QUIC_FLAG_DATAGRAM);
+    assert(dgram_ack.packet_number == client_datagram.packet_number);
+    pthread_mutex_lock(&state.lock);
+    assert(state.datagram_called == 1);
+    assert(state.datagram_len == sizeof(media));
+    assert(memcmp(state.datagram_buf, media, sizeof(media)) == 0);
+    assert(state.stream_len == 0);
+    pthread_mutex_unlock(&state.lock);
+
+    /* 서버->클라이언트 datagram: ACK되면 in-flight에서 빠지고 재전송되지 않는다 */
+    assert(quic_engine_send_datagram(&engine, conn_id2, media, sizeof(media)) == 0);
+    quic_packet_t dgram_rx;
+    memset(&dgram_rx, 0, sizeof(dgram_rx));
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        recv_len = recvfrom(client_fd2, recv_buf, sizeof(recv_buf), 0, NULL, NULL);
+        assert(recv_len > 0);
+        assert(quic_packet_deserialize(&dgram_rx, recv_buf, (size_t)recv_len) == 0);
+        if ((dgram_rx.flags & QUIC_FLAG_DATAGRAM) && !(dgram_rx.flags & QUIC_FLAG_ACK)) {
+            break;
+        }
+    }
+    assert(dgram_rx.flags & QUIC_FLAG_DATAGRAM);
+    assert(dgram_rx.length == sizeof(media));
+    quic_packet_t client_dgram_ack = {
+        .flags = QUIC_FLAG_ACK | QUIC_FLAG_DATAGRAM,
+        .connection_id = conn_id2,
+        .packet_number = dgram_rx.packet_number,
+        .stream_id = 0,
+        .offset = 0,
+        .length = 0,
+        .payload = NULL,
+    };
+    assert(quic_packet_serialize(&client_dgram_ack, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+
+    quic_metrics_t dgram_metrics;
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        quic_engine_get_metrics(&engine, &dgram_metrics);
+        if (dgram_metrics.datagrams_acked == 1) {
+            break;
+        }
+        struct timespec pause = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+        nanosleep(&pause, NULL);
+    }
+    assert(dgram_metrics.datagrams_sent == 1);
+    assert(dgram_metrics.datagrams_received == 1);
+    assert(dgram_metrics.datagrams_acked == 1);
+    quic_cc_t cc;
+    assert(quic_engine_get_congestion(&engine, conn_id2, &cc) == 0);
+    assert(cc.bytes_in_flight == 0);
+    assert(cc.srtt_us > 0);
+
+    /* 혼잡 창이 차면 큐잉하지 않고 거절 */
+    uint8_t frame[1000];
+    memset(frame, 0xAB, sizeof(frame));
+    int accepted = 0;
+    while (quic_engine_send_datagram(&engine, conn_id2, frame, sizeof(frame)) == 0) {
+        accepted++;
+        assert(accepted <= QUIC_MAX_DATAGRAMS_IN_FLIGHT);
+    }
+    assert(accepted == (int)(cc.cwnd / (QUIC_HEADER_SIZE + sizeof(frame))));
+    quic_engine_get_metrics(&engine, &dgram_metrics);
+    assert(dgram_metrics.datagrams_dropped == 1);
+    assert(quic_engine_send_datagram(&engine, conn_id1 + 1000, frame, sizeof(frame)) == -1);
+
+    /* 부분 신뢰성: 마감이 지난 DATA는 재전송 대신 SKIP으로 알린다 */
+    quic_metrics_t before_expire;
+    quic_engine_get_metrics(&engine, &before_expire);
+    quic_packet_t late_data = {
+        .flags = QUIC_FLAG_DATA,
+        .connection_id = conn_id2,
+        .packet_number = 200,
+        .stream_id = 3,
+        .offset = 4096,
+        .length = sizeof(payload),
+        .payload = payload,
+    };
+    quic_send_limit_t limit = {.deadline_us = quic_now_us() + 1000, .expire_offset = 0};
+    assert(quic_engine_send_to_connection_limited(&engine, &late_data, &limit) == 0);
+    sleep(3);
+    quic_packet_t skip_rx;
+    memset(&skip_rx, 0, sizeof(skip_rx));
+    int data_copies = 0;
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        recv_len = recvfrom(client_fd2, recv_buf, sizeof(recv_buf), 0, NULL, NULL);
+        assert(recv_len > 0);
+        assert(quic_packet_deserialize(&skip_rx, recv_buf, (size_t)recv_len) == 0);
+        if ((skip_rx.flags & QUIC_FLAG_DATA) && skip_rx.packet_number == late_data.packet_number) {
+            data_copies++;
+        }
+        if (skip_rx.flags & QUIC_FLAG_SKIP) {
+            break;
+        }
+    }
+    assert(data_copies == 1);
+    assert(skip_rx.flags & QUIC_FLAG_SKIP);
+    assert(skip_rx.stream_id == late_data.stream_id);
+    assert(skip_rx.offset == late_data.offset);
+    assert(skip_rx.length == QUIC_SKIP_PAYLOAD_SIZE);
+    uint32_t gap_be;
+    memcpy(&gap_be, skip_rx.payload, sizeof(gap_be));
+    assert(ntohl(gap_be) == sizeof(payload));
+    quic_packet_t skip_ack = {
+        .flags = QUIC_FLAG_ACK | QUIC_FLAG_SKIP,
+        .connection_id = conn_id2,
+        .packet_number = skip_rx.packet_number,
+        .stream_id = skip_rx.stream_id,
+        .offset = skip_rx.offset,
+        .length = 0,
+        .payload = NULL,
+    };
+    assert(quic_packet_serialize(&skip_ack, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+
+    quic_metrics_t after_expire;
+    quic_engine_get_metrics(&engine, &after_expire);
+    assert(after_expire.packets_expired - before_expire.packets_expired == 1);
+    assert(after_expire.bytes_expired - before_expire.bytes_expired == sizeof(payload));
+    assert(after_expire.skips_sent - before_expire.skips_sent == 1);
+
+    /* 재생 위치가 expire_offset을 지나면 마감 없이도 만료 */
+    quic_packet_t played_data = late_data;
+    played_data.packet_number = 201;
+    played_data.offset = 8192;
+    quic_send_limit_t by_offset = {.deadline_us = 0, .expire_offset = 8192 + sizeof(payload)};
+    assert(quic_engine_send_to_connection_limited(&engine, &played_data, &by_offset) == 0);
+    assert(quic_engine_update_playback(&engine, conn_id2, played_data.stream_id, 4096) == 0);
+    int still_pending = 0;
+    pthread_mutex_lock(&engine.lock);
+    for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
+        if (engine.pending[i].in_use && engine.pending[i].packet_number == 201 && !engine.pending[i].expired) {
+            still_pending = 1;
+        }
+    }
+    pthread_mutex_unlock(&engine.lock);
+    assert(still_pending);
+    assert(quic_engine_update_playback(&engine, conn_id2, played_data.stream_id, by_offset.expire_offset) == 0);
+    pthread_mutex_lock(&engine.lock);
+    for (int i = 0; i < QUIC_MAX_PENDING; ++i) {
+        if (engine.pending[i].in_use && engine.pending[i].packet_number == 201) {
+            assert(engine.pending[i].expired);
+        }
+    }
+    pthread_mutex_unlock(&engine.lock);
+
+    /* 뒤로 탐색해도 이전 위치로 보낸 미확인 DATA는 새 위치 앞뒤 가리지 않고 모두 취소한다.
+     * 아낀 바이트는 재전송 차례에 SKIP으로 바뀐 것만 세고, ACK된 것은 세지 않는다 */
+    quic_packet_t behind = late_data;
+    behind.stream_id = 5;
+    behind.packet_number = 202;
+    behind.offset = 16384;
+    quic_packet_t ahead = behind;
+    ahead.packet_number = 203;
+    ahead.offset = 20480;
+    quic_send_limit_t no_limit = {0};
+    /* 재전송 타이머는 초 단위라 새 초가 시작될 때 보내 ACK할 여유를 둔다 */
+    time_t second = time(NULL);
+    while (time(NULL) == second) {
+        struct timespec tick = {.tv_sec = 0, .tv_nsec = 5 * 1000 * 1000};
+        nanosleep(&tick, NULL);
+    }
+    assert(quic_engine_send_to_connection_limited(&engine, &behind, &no_limit) == 0);
+    assert(quic_engine_send_to_connection_limited(&engine, &ahead, &no_limit) == 0);
+    quic_metrics_t before_cancel;
+    quic_engine_get_metrics(&engine, &before_cancel);
+    uint64_t unacked = 0;
+    assert(quic_engine_cancel_stream(&engine, conn_id2, behind.stream_id + 1, &unacked) == 0);
+    assert(unacked == 0);
+    assert(quic_engine_cancel_stream(&engine, conn_id2, behind.stream_id, &unacked) == 0);
+    assert(unacked == 2 * sizeof(payload));
+    assert(quic_engine_cancel_stream(&engine, conn_id2, behind.stream_id, &unacked) == 0);
+    assert(unacked == 0); /* 이미 취소한 것은 다시 세지 않는다 */
+    quic_packet_t ahead_ack = {
+        .flags = QUIC_FLAG_ACK,
+        .connection_id = conn_id2,
+        .packet_number = ahead.packet_number,
+        .stream_id = ahead.stream_id,
+        .offset = ahead.offset,
+    };
+    assert(quic_packet_serialize(&ahead_ack, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd2, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+    quic_metrics_t after_cancel;
+    for (int i = 0; i < 50; ++i) {
+        quic_engine_get_metrics(&engine, &after_cancel);
+        if (after_cancel.packets_cancelled - before_cancel.packets_cancelled >= 1) {
+            break;
+        }
+        struct timespec tick = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+        nanosleep(&tick, NULL);
+    }
+    struct timespec settle = {.tv_sec = 0, .tv_nsec = 200 * 1000 * 1000};
+    nanosleep(&settle, NULL);
+    quic_engine_get_metrics(&engine, &after_cancel);
+    assert(after_cancel.packets_cancelled - before_cancel.packets_cancelled == 1); /* 203은 ACK됐다 */
+    assert(after_cancel.bytes_cancelled - before_cancel.bytes_cancelled == sizeof(payload));
+
+    /* 0-RTT 재개: 티켓 + early data로 바로 CONNECTED, 다른 포트여도 같은 IP면 허용 */
+    const uint64_t conn_id3 = 0x777777ULL;
+    uint8_t resume_payload[QUIC_TICKET_SIZE + 4];
+    memcpy(resume_payload, ticket, QUIC_TICKET_SIZE);
+    memcpy(resume_payload + QUIC_TICKET_SIZE, "play", 4);
+    quic_packet_t resume_initial = {
+        .flags = QUIC_FLAG_INITIAL,
+        .connection_id = conn_id3,
+        .packet_number = 0,
+        .length = sizeof(resume_payload),
+        .payload = resume_payload,
+    };
+    quic_metrics_t resume_before;
+    quic_engine_get_metrics(&engine, &resume_before);
+    assert(quic_packet_serialize(&resume_initial, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd3, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+    assert(recv_matching(client_fd3, conn_id3, QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK, recv_buf, sizeof(recv_buf), &handshake_resp) == 0);
+    assert(handshake_resp.offset == QUIC_RESUME_ACCEPTED);
+    assert(recv_matching(client_fd3, conn_id3, QUIC_FLAG_HANDSHAKE, recv_buf, sizeof(recv_buf), &ticket_pkt) == 0);
+    assert(ticket_pkt.length == QUIC_TICKET_PAYLOAD);
+    assert(memcmp(ticket_pkt.payload, ticket, QUIC_TICKET_SIZE) != 0);
+    quic_connection_state_t conn_state;
+    assert(quic_engine_get_connection_state(&engine, conn_id3, &conn_state) == 0);
+    assert(conn_state == QUIC_CONN_STATE_CONNECTED);
+    assert(wait_for_early_data(&state, 1) == 0);
+    pthread_mutex_lock(&state.lock);
+    assert(state.early_called == 1);
+    assert(state.early_len == 4 && memcmp(state.early_buf, "play", 4) == 0);
+    pthread_mutex_unlock(&state.lock);
+
+    /* 같은 티켓 재사용(재전송 공격)은 일반 핸드셰이크로 처리 */
+    const uint64_t conn_id4 = 0x888888ULL;
+    resume_initial.connection_id = conn_id4;
+    assert(quic_packet_serialize(&resume_initial, buffer, sizeof(buffer), &len) == 0);
+    assert(sendto(client_fd3, buffer, len, 0, (struct sockaddr *)&addr, sizeof(addr)) == (ssize_t)len);
+    assert(recv_matching(client_fd3, conn_id4, QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK, recv_buf, sizeof(recv_buf), &handshake_resp) == 0);
+    assert(handshake_resp.offset == 0);
+    assert(quic_engine_get_connection_state(&engine, conn_id4, &conn_state) == 0);
+    assert(conn_state == QUIC_CONN_STATE_CONNECTING);
+    quic_metrics_t resume_after;
+    quic_engine_get_metrics(&engine, &resume_after);
+    assert(resume_after.resumptions_accepted - resume_before.resumptions_accepted == 1);
+    assert(resume_after.resumptions_rejected - resume_before.resumptions_rejected == 1);
+    assert(resume_after.early_data_bytes - resume_before.early_data_bytes == 4);
+    pthread_mutex_lock(&state.lock);
+    assert(state.early_called == 1);
+    pthread_mutex_unlock(&state.lock);
+
     /* 타임아웃 정리 검증 */
     pthread_mutex_lock(&engine.lock);
     quic_connection_entry_t *entry = NULL;
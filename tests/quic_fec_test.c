@@ -0,0 +1,197 @@
+#include "server/quic_fec.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_LEN 1000
+
+typedef struct {
+    int calls;
+    uint32_t pns[QUIC_FEC_MAX_K];
+    uint32_t offsets[QUIC_FEC_MAX_K];
+    uint8_t data[QUIC_FEC_MAX_K][256];
+    uint32_t lens[QUIC_FEC_MAX_K];
+} recover_sink_t;
+
+static void on_recover(void *user_data, uint32_t stream_id, uint32_t pn, uint32_t offset, const uint8_t *data, uint32_t len) {
+    recover_sink_t *sink = (recover_sink_t *)user_data;
+    assert(stream_id == 7);
+    assert(len <= sizeof(sink->data[0]));
+    sink->pns[sink->calls] = pn;
+    sink->offsets[sink->calls] = offset;
+    memcpy(sink->data[sink->calls], data, len);
+    sink->lens[sink->calls] = len;
+    sink->calls++;
+}
+
+static void fill_random(uint8_t *buf, size_t len, unsigned *seed) {
+    for (size_t i = 0; i < len; ++i) {
+        *seed = *seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)(*seed >> 16);
+    }
+}
+
+/* k개 원본 중 erase개를 지우고 남은 수리 심볼로 복원 */
+static void check_block(quic_fec_mode_t mode, unsigned k, unsigned m, unsigned erase, unsigned seed) {
+    static uint8_t orig[QUIC_FEC_MAX_K][SYMBOL_LEN];
+    static uint8_t work[QUIC_FEC_MAX_K][SYMBOL_LEN];
+    static uint8_t rep[QUIC_FEC_MAX_M][SYMBOL_LEN];
+    const uint8_t *src[QUIC_FEC_MAX_K];
+    uint8_t *dst[QUIC_FEC_MAX_K];
+    uint8_t *repair[QUIC_FEC_MAX_M];
+    uint8_t src_present[QUIC_FEC_MAX_K];
+    uint8_t repair_present[QUIC_FEC_MAX_M];
+
+    for (unsigned i = 0; i < k; ++i) {
+        fill_random(orig[i], SYMBOL_LEN, &seed);
+        memcpy(work[i], orig[i], SYMBOL_LEN);
+        src[i] = orig[i];
+        dst[i] = work[i];
+        src_present[i] = 1;
+    }
+    for (unsigned j = 0; j < m; ++j) {
+        repair[j] = rep[j];
+        repair_present[j] = 1;
+    }
+    assert(quic_fec_encode(mode, k, m, src, repair, SYMBOL_LEN) == 0);
+
+    for (unsigned e = 0; e < erase; ++e) {
+        unsigned victim;
+        do {
+            seed = seed * 1103515245u + 12345u;
+            victim = (seed >> 16) % k;
+        } while (!src_present[victim]);
+        src_present[victim] = 0;
+        memset(work[victim], 0xAA, SYMBOL_LEN);
+    }
+    /* 남는 수리 심볼은 일부 잃어버려도 된다 */
+    for (unsigned j = 0; j + erase < m; ++j) {
+        repair_present[j] = 0;
+    }
+    assert(quic_fec_decode(mode, k, m, dst, src_present, (const uint8_t *const *)repair, repair_present, SYMBOL_LEN) == 0);
+    for (unsigned i = 0; i < k; ++i) {
+        assert(memcmp(work[i], orig[i], SYMBOL_LEN) == 0);
+    }
+}
+
+int main(void) {
+    /* GF(2^8) 기본 성질 */
+    for (unsigned a = 1; a < 256; ++a) {
+        assert(quic_fec_gf_mul((uint8_t)a, quic_fec_gf_inv((uint8_t)a)) == 1);
+        assert(quic_fec_gf_mul((uint8_t)a, 1) == a);
+        assert(quic_fec_gf_mul((uint8_t)a, 0) == 0);
+    }
+    assert(quic_fec_gf_mul(2, 0x80) == 0x1D);
+    assert(quic_fec_gf_mul(0x53, 0xCA) == quic_fec_gf_mul(0xCA, 0x53));
+
+    /* 모든 SIMD 커널은 scalar와 같은 결과 */
+    uint8_t src[1031];
+    uint8_t expect[sizeof(src)];
+    uint8_t got[sizeof(src)];
+    unsigned seed = 1;
+    fill_random(src, sizeof(src), &seed);
+    const quic_fec_kernel_t kernels[] = {QUIC_FEC_KERNEL_SSSE3, QUIC_FEC_KERNEL_AVX2, QUIC_FEC_KERNEL_NEON};
+    for (unsigned coef = 0; coef < 256; coef += 7) {
+        assert(quic_fec_set_kernel(QUIC_FEC_KERNEL_SCALAR) == 0);
+        memset(expect, 0x5C, sizeof(expect));
+        quic_fec_mul_add(expect, src, (uint8_t)coef, sizeof(src));
+        for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+            if (quic_fec_set_kernel(kernels[i]) != 0) {
+                continue;
+            }
+            memset(got, 0x5C, sizeof(got));
+            quic_fec_mul_add(got, src, (uint8_t)coef, sizeof(src));
+            assert(memcmp(got, expect, sizeof(got)) == 0);
+        }
+    }
+    assert(quic_fec_set_kernel(QUIC_FEC_KERNEL_AUTO) == 0);
+    printf("quic_fec_test kernel=%s\n", quic_fec_kernel_name());
+
+    /* 블록 복원: XOR은 1개, RS는 m개까지 */
+    check_block(QUIC_FEC_XOR, 8, 1, 1, 11);
+    check_block(QUIC_FEC_REED_SOLOMON, 10, 4, 4, 22);
+    check_block(QUIC_FEC_REED_SOLOMON, 32, 8, 8, 33);
+    check_block(QUIC_FEC_REED_SOLOMON, 5, 3, 2, 44);
+    assert(quic_fec_encode(QUIC_FEC_XOR, 4, 2, NULL, NULL, 0) == -1);
+
+    /* 수리 심볼보다 손실이 많으면 실패 */
+    {
+        uint8_t a[16] = {1}, b[16] = {2}, r[16];
+        const uint8_t *s[2] = {a, b};
+        uint8_t *d[2] = {a, b};
+        uint8_t *rp[1] = {r};
+        uint8_t sp[2] = {0, 0}, rpres[1] = {1};
+        assert(quic_fec_encode(QUIC_FEC_XOR, 2, 1, s, rp, sizeof(a)) == 0);
+        assert(quic_fec_decode(QUIC_FEC_XOR, 2, 1, d, sp, (const uint8_t *const *)rp, rpres, sizeof(a)) == -1);
+    }
+
+    /* 설정 문자열 */
+    quic_fec_mode_t mode;
+    unsigned k, m;
+    assert(quic_fec_parse_config("xor:8", &mode, &k, &m) == 0 && mode == QUIC_FEC_XOR && k == 8 && m == 1);
+    assert(quic_fec_parse_config("rs:10:3", &mode, &k, &m) == 0 && mode == QUIC_FEC_REED_SOLOMON && k == 10 && m == 3);
+    assert(quic_fec_parse_config("off", &mode, &k, &m) == 0 && mode == QUIC_FEC_NONE);
+    assert(quic_fec_parse_config("rs:10", &mode, &k, &m) == -1);
+    assert(quic_fec_parse_config("rs:40:2", &mode, &k, &m) == -1);
+    assert(quic_fec_parse_config("xor:8x", &mode, &k, &m) == -1);
+
+    /* 인코더/디코더: 길이가 다른 패킷 4개, 2개 손실, RS(4,2) */
+    quic_fec_encoder_t enc;
+    assert(quic_fec_encoder_init(&enc, QUIC_FEC_REED_SOLOMON, 4, 2) == 0);
+    uint8_t payloads[4][200];
+    uint32_t lens[4] = {200, 37, 150, 1};
+    for (int i = 0; i < 4; ++i) {
+        fill_random(payloads[i], sizeof(payloads[i]), &seed);
+        int rc = quic_fec_encoder_add(&enc, 7, 100 + (uint32_t)i, 5000 + (uint32_t)i * 200, payloads[i], lens[i]);
+        assert(rc == (i == 3 ? 1 : 0));
+    }
+    assert(quic_fec_encoder_add(&enc, 7, 104, 0, payloads[0], 1) == -1);
+    assert(quic_fec_encoder_finish(&enc) == 2);
+
+    quic_fec_decoder_t *dec = quic_fec_decoder_create();
+    assert(dec);
+    recover_sink_t sink = {0};
+    assert(quic_fec_decoder_on_source(dec, 7, 100, 5000, payloads[0], lens[0], on_recover, &sink) == 0);
+    assert(quic_fec_decoder_on_source(dec, 7, 103, 5600, payloads[3], lens[3], on_recover, &sink) == 0);
+    uint8_t wire[QUIC_FEC_PACKET_PAYLOAD];
+    size_t wire_len = 0;
+    assert(quic_fec_encoder_repair_payload(&enc, 0, wire, sizeof(wire), &wire_len) == 0);
+    assert(wire_len == QUIC_FEC_REPAIR_HEADER_SIZE + QUIC_FEC_META_SIZE + 200);
+    assert(quic_fec_decoder_on_repair(dec, 7, wire, wire_len, on_recover, &sink) == 0);
+    assert(sink.calls == 0);
+    assert(quic_fec_encoder_repair_payload(&enc, 1, wire, sizeof(wire), &wire_len) == 0);
+    assert(quic_fec_decoder_on_repair(dec, 7, wire, wire_len, on_recover, &sink) == 2);
+    assert(sink.calls == 2);
+    assert(sink.pns[0] == 101 && sink.offsets[0] == 5200 && sink.lens[0] == 37);
+    assert(memcmp(sink.data[0], payloads[1], 37) == 0);
+    assert(sink.pns[1] == 102 && sink.offsets[1] == 5400 && sink.lens[1] == 150);
+    assert(memcmp(sink.data[1], payloads[2], 150) == 0);
+    assert(dec->recovered == 2);
+
+    /* 수리 패킷이 먼저 오고 원본이 나중에 와도 복원 */
+    quic_fec_encoder_reset(&enc);
+    for (int i = 0; i < 4; ++i) {
+        quic_fec_encoder_add(&enc, 7, 200 + (uint32_t)i, (uint32_t)i * 10, payloads[i], 10);
+    }
+    assert(quic_fec_encoder_finish(&enc) == 2);
+    assert(quic_fec_encoder_repair_payload(&enc, 1, wire, sizeof(wire), &wire_len) == 0);
+    sink.calls = 0;
+    assert(quic_fec_decoder_on_repair(dec, 7, wire, wire_len, on_recover, &sink) == 0);
+    assert(quic_fec_decoder_on_source(dec, 7, 200, 0, payloads[0], 10, on_recover, &sink) == 0);
+    assert(quic_fec_decoder_on_source(dec, 7, 201, 10, payloads[1], 10, on_recover, &sink) == 0);
+    assert(quic_fec_decoder_on_source(dec, 7, 203, 30, payloads[3], 10, on_recover, &sink) == 1);
+    assert(sink.calls == 1 && sink.pns[0] == 202 && memcmp(sink.data[0], payloads[2], 10) == 0);
+
+    /* 잘못된 수리 헤더는 거부 */
+    wire[4] = 0;
+    assert(quic_fec_decoder_on_repair(dec, 7, wire, wire_len, on_recover, &sink) == -1);
+    assert(quic_fec_decoder_on_repair(dec, 7, wire, 3, on_recover, &sink) == -1);
+
+    quic_fec_decoder_destroy(dec);
+    quic_fec_encoder_destroy(&enc);
+
+    puts("quic_fec_test passed");
+    return 0;
+}
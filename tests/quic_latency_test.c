@@ -0,0 +1,133 @@
+#define _GNU_SOURCE /* CPU_SET, pthread_getaffinity_np, setenv */
+
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static void sleep_ms(long ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+static int pinned_to(pthread_t thread, unsigned cpu) {
+    cpu_set_t set;
+    assert(pthread_getaffinity_np(thread, sizeof(set), &set) == 0);
+    return CPU_COUNT(&set) == 1 && CPU_ISSET(cpu, &set);
+}
+
+static void test_config(void) {
+    quic_latency_config_t cfg;
+    assert(quic_latency_parse_config("2", &cfg) == 0);
+    assert(cfg.enabled && cfg.cpu_count == 1 && cfg.cpus[0] == 2 && cfg.spin_us == QUIC_LATENCY_DEFAULT_SPIN_US);
+    assert(quic_latency_parse_config("1,3-5:120", &cfg) == 0);
+    assert(cfg.enabled && cfg.cpu_count == 4 && cfg.spin_us == 120);
+    assert(cfg.cpus[0] == 1 && cfg.cpus[1] == 3 && cfg.cpus[3] == 5);
+    /* 중복 CPU는 한 번만, 스핀 0은 고정만 한다 */
+    assert(quic_latency_parse_config("4,4:0", &cfg) == 0 && cfg.cpu_count == 1 && cfg.spin_us == 0);
+    assert(quic_latency_parse_config("off", &cfg) == 0 && !cfg.enabled);
+    assert(quic_latency_parse_config("", &cfg) == 0 && !cfg.enabled);
+    assert(quic_latency_parse_config("x", &cfg) == -1);
+    assert(quic_latency_parse_config("3-1", &cfg) == -1);
+    assert(quic_latency_parse_config("1:", &cfg) == -1);
+    assert(quic_latency_parse_config("1,", &cfg) == -1);
+    assert(quic_latency_parse_config("99999", &cfg) == -1);
+
+    /* 수신 스레드는 첫 CPU, 워커는 나머지를 돌아가며 쓴다 */
+    assert(quic_latency_parse_config("1,3,4", &cfg) == 0);
+    assert(quic_latency_cpu_for(&cfg, -1) == 1);
+    assert(quic_latency_cpu_for(&cfg, 0) == 3 && quic_latency_cpu_for(&cfg, 1) == 4 && quic_latency_cpu_for(&cfg, 2) == 3);
+    assert(quic_latency_parse_config("2", &cfg) == 0 && quic_latency_cpu_for(&cfg, 5) == 2);
+}
+
+static void *exclude_main(void *arg) {
+    const quic_latency_config_t *cfg = (const quic_latency_config_t *)arg;
+    cpu_set_t before;
+    cpu_set_t after;
+    assert(pthread_getaffinity_np(pthread_self(), sizeof(before), &before) == 0);
+    int rc = quic_latency_exclude_current_thread(cfg);
+    assert(pthread_getaffinity_np(pthread_self(), sizeof(after), &after) == 0);
+    if (CPU_COUNT(&before) == 1 && CPU_ISSET(0, &before)) {
+        /* CPU가 하나뿐이면 비울 수 없으니 그대로 둔다 */
+        assert(rc == -1 && CPU_EQUAL(&before, &after));
+    } else if (CPU_ISSET(0, &before)) {
+        assert(rc == 0 && !CPU_ISSET(0, &after) && CPU_COUNT(&after) == CPU_COUNT(&before) - 1);
+    }
+    return NULL;
+}
+
+static void test_engine(void) {
+    quic_latency_config_t cfg;
+    assert(quic_latency_parse_config("0", &cfg) == 0);
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, exclude_main, &cfg) == 0);
+    pthread_join(thread, NULL);
+
+    setenv(QUIC_LOW_LATENCY_ENV, "0:100", 1);
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    unsetenv(QUIC_LOW_LATENCY_ENV);
+    assert(engine->latency.enabled && engine->latency.spin_us == 100);
+
+    /* 수신 스레드와 디스패치 워커가 모두 지정한 CPU에 고정된다 */
+    assert(quic_engine_set_dispatch(engine, 2, 0) == 0);
+    for (unsigned i = 0; i < engine->dispatch->worker_count; ++i) {
+        assert(pinned_to(engine->dispatch->workers[i].thread, 0));
+    }
+    quic_engine_set_recv_timeout(engine, 1);
+    assert(quic_engine_start(engine) == 0);
+    assert(pinned_to(engine->thread, 0));
+    /* 도는 동안에는 풀을 바꿀 수 없다 */
+    assert(quic_engine_set_dispatch(engine, 0, 0) == -1 && engine->dispatch != NULL);
+
+    /* 스핀 후 블로킹 수신으로 떨어져도 패킷은 그대로 처리된다 */
+    struct sockaddr_in server;
+    socklen_t alen = sizeof(server);
+    assert(getsockname(engine->sockfd, (struct sockaddr *)&server, &alen) == 0);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    size_t len = 0;
+    quic_packet_t initial = {.flags = QUIC_FLAG_INITIAL, .connection_id = 0x71};
+    assert(quic_packet_serialize(&initial, buf, sizeof(buf), &len) == 0);
+    assert(sendto(fd, buf, len, 0, (struct sockaddr *)&server, sizeof(server)) == (ssize_t)len);
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = 0x71, .packet_number = 1};
+    assert(quic_packet_serialize(&hs, buf, sizeof(buf), &len) == 0);
+    assert(sendto(fd, buf, len, 0, (struct sockaddr *)&server, sizeof(server)) == (ssize_t)len);
+
+    quic_connection_state_t state = QUIC_CONN_STATE_IDLE;
+    quic_metrics_t metrics;
+    for (int i = 0; i < 100; ++i) {
+        quic_engine_get_metrics(engine, &metrics);
+        if (quic_engine_get_connection_state(engine, 0x71, &state) == 0 && state == QUIC_CONN_STATE_CONNECTED &&
+            metrics.busy_poll_sleeps > 0) {
+            break;
+        }
+        sleep_ms(10);
+    }
+    assert(state == QUIC_CONN_STATE_CONNECTED);
+    assert(metrics.busy_poll_sleeps > 0);
+
+    close(fd);
+    quic_engine_stop(engine);
+    quic_engine_join(engine);
+    assert(quic_engine_set_dispatch(engine, 0, 0) == 0 && engine->dispatch == NULL);
+    quic_engine_destroy(engine);
+    free(engine);
+}
+
+int main(void) {
+    test_config();
+    test_engine();
+    puts("quic_latency_test passed");
+    return 0;
+}
@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 200809L /* setenv */
+
+#include "quic_test_util.h"
+#include "server/quic.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t connection_id;
+    uint32_t offset;
+    int calls;
+} stream_log_t;
+
+static void record_stream(uint64_t connection_id,
+                          uint32_t stream_id,
+                          uint32_t offset,
+                          const uint8_t *data,
+                          size_t len,
+                          void *user_data) {
+    (void)stream_id;
+    stream_log_t *log = (stream_log_t *)user_data;
+    assert(len == 4 && memcmp(data, "lbok", 4) == 0);
+    log->connection_id = connection_id;
+    log->offset = offset;
+    log->calls++;
+}
+
+/* Connects and returns the id carried by HANDSHAKE|ACK, 0 when there was none. */
+static uint64_t connect_client(quic_engine_t *engine, int fd, uint64_t cid, const struct sockaddr_in *from) {
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t reply;
+    quic_packet_t initial = {.flags = QUIC_FLAG_INITIAL, .connection_id = cid};
+    assert(quic_test_deliver(engine, &initial, from) == 0);
+    assert(quic_test_recv_reply(fd, buf, &reply) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK) && reply.connection_id == cid);
+    uint64_t routable_id = 0;
+    if (reply.length == QUIC_LB_ROUTABLE_ID_SIZE) {
+        for (int i = 0; i < QUIC_LB_ROUTABLE_ID_SIZE; ++i) {
+            routable_id = (routable_id << 8) | reply.payload[i];
+        }
+    } else {
+        assert(reply.length == 0);
+    }
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = cid, .packet_number = 1};
+    assert(quic_test_deliver(engine, &hs, from) == 0);
+    quic_test_drain(fd);
+    return routable_id;
+}
+
+static void test_encoding(void) {
+    /* 서버 id는 그대로 복원되고 설정 비트가 다르거나 id가 0이면 라우팅할 수 없다 */
+    for (unsigned id = 1; id <= 255; ++id) {
+        uint64_t cid = quic_lb_cid_encode((uint8_t)id, 0x0123456789ABCDEFULL * id);
+        uint8_t decoded = 0;
+        assert(quic_lb_cid_server_id(cid, &decoded) == 0 && decoded == id);
+        assert((cid >> 62) == QUIC_LB_CONFIG_ID);
+    }
+    assert(quic_lb_cid_encode(5, 1) != quic_lb_cid_encode(5, 2));
+    assert(quic_lb_cid_server_id(quic_lb_cid_encode(0, 77), NULL) == -1);
+    assert(quic_lb_cid_server_id(0x51, NULL) == -1);
+    assert(quic_lb_cid_server_id(0xC000000000000000ULL | (3ULL << 48), NULL) == -1);
+
+    /* id가 가리키는 백엔드로 가고, 목록에 없는 id는 해시로 간다 */
+    uint8_t ids[4] = {3, 1, 2, 4};
+    assert(quic_lb_route(ids, 3, quic_lb_cid_encode(2, 99)) == 2);
+    assert(quic_lb_route(ids, 3, quic_lb_cid_encode(3, 99)) == 0);
+    int hashed = quic_lb_route(ids, 3, quic_lb_cid_encode(9, 99));
+    assert(hashed >= 0 && hashed < 3);
+    assert(quic_lb_route(ids, 0, 0x51) == -1);
+
+    /* 해시는 안정적이고, 백엔드를 하나 더하면 약 1/4만 새 백엔드로 옮겨 간다 */
+    unsigned per_backend[3] = {0, 0, 0};
+    unsigned moved = 0;
+    for (uint64_t cid = 1; cid <= 10000; ++cid) {
+        int before = quic_lb_route(ids, 3, cid);
+        assert(before >= 0 && before < 3 && quic_lb_route(ids, 3, cid) == before);
+        per_backend[before]++;
+        int after = quic_lb_route(ids, 4, cid);
+        if (after != before) {
+            assert(after == 3);
+            moved++;
+        }
+    }
+    for (int b = 0; b < 3; ++b) {
+        assert(per_backend[b] > 2800 && per_backend[b] < 3900);
+    }
+    assert(moved > 2000 && moved < 3000);
+}
+
+static void test_engine(void) {
+    setenv(QUIC_LB_SERVER_ID_ENV, "7", 1);
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    unsetenv(QUIC_LB_SERVER_ID_ENV);
+    assert(engine->lb_server_id == 7);
+    stream_log_t log = {0};
+    quic_engine_set_stream_data_handler(engine, record_stream, &log);
+
+    struct sockaddr_in home_addr;
+    struct sockaddr_in rebound_addr;
+    int home = quic_test_open_client("127.0.0.1", &home_addr);
+    int rebound = quic_test_open_client("127.0.0.1", &rebound_addr);
+    struct sockaddr_in addr;
+    quic_metrics_t metrics;
+
+    /* HANDSHAKE|ACK에 이 서버를 가리키는 라우팅 가능한 id가 실린다 */
+    uint64_t alias = connect_client(engine, home, 0x61, &home_addr);
+    uint8_t server_id = 0;
+    assert(alias != 0 && alias != 0x61);
+    assert(quic_lb_cid_server_id(alias, &server_id) == 0 && server_id == 7);
+    uint64_t other = connect_client(engine, home, 0x62, &home_addr);
+    assert(other != 0 && other != alias);
+
+    /* 별칭으로 보낸 데이터도 원래 id의 연결로 전달된다 */
+    quic_packet_t data = {
+        .flags = QUIC_FLAG_DATA,
+        .connection_id = alias,
+        .packet_number = 2,
+        .stream_id = 1,
+        .length = 4,
+        .payload = (const uint8_t *)"lbok",
+    };
+    assert(quic_test_deliver(engine, &data, &home_addr) == 0);
+    assert(log.calls == 1 && log.connection_id == 0x61 && log.offset == 0);
+
+    /* 로드밸런서가 새 소켓으로 넘겨도(다른 포트) 같은 연결의 재바인딩으로 본다 */
+    data.packet_number = 3;
+    data.offset = 4;
+    assert(quic_test_deliver(engine, &data, &rebound_addr) == 0);
+    assert(log.calls == 2 && log.connection_id == 0x61 && log.offset == 4);
+    assert(quic_engine_get_connection(engine, 0x61, &addr) == 0);
+    assert(addr.sin_port == rebound_addr.sin_port);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.nat_rebindings == 1 && metrics.connections_migrated == 1);
+    quic_test_drain(rebound);
+
+    /* 다른 서버의 별칭은 이 서버의 연결로 바뀌지 않는다 */
+    data.connection_id = quic_lb_cid_encode(9, alias);
+    data.packet_number = 4;
+    quic_test_deliver(engine, &data, &home_addr);
+    assert(log.calls == 2);
+    quic_test_drain(home);
+
+    /* 끄고 나면 새 연결은 별칭 없이 열린다 */
+    quic_engine_set_lb_server_id(engine, 0);
+    assert(connect_client(engine, home, 0x63, &home_addr) == 0);
+
+    close(home);
+    close(rebound);
+    quic_engine_stop(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+}
+
+int main(void) {
+    test_encoding();
+    test_engine();
+    puts("quic_lb_test passed");
+    return 0;
+}
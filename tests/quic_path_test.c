@@ -0,0 +1,205 @@
+#include "quic_test_util.h"
+#include "server/quic.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The engine thread is never started, so the test may poke entries directly. */
+static quic_connection_entry_t *find_entry(quic_engine_t *engine, uint64_t cid) {
+    for (int i = 0; i < QUIC_MAX_CONNECTIONS; ++i) {
+        if (engine->connections[i].in_use && engine->connections[i].connection_id == cid) {
+            return &engine->connections[i];
+        }
+    }
+    return NULL;
+}
+
+static void warm_up(quic_connection_entry_t *entry) {
+    for (int i = 0; i < 20; ++i) {
+        quic_cc_on_sent(&entry->cc, 1200);
+        quic_cc_on_acked(&entry->cc, 1200, 0, 30000);
+    }
+    assert(entry->cc.cwnd > QUIC_CC_INITIAL_WINDOW && entry->cc.srtt_us > 0);
+}
+
+int main(void) {
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+
+    struct sockaddr_in home_addr;
+    struct sockaddr_in rebound_addr;
+    struct sockaddr_in away_addr;
+    int home = quic_test_open_client("127.0.0.1", &home_addr);
+    int rebound = quic_test_open_client("127.0.0.1", &rebound_addr);
+    int away = quic_test_open_client("127.0.0.2", &away_addr);
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t reply;
+    struct sockaddr_in addr;
+    quic_metrics_t metrics;
+
+    quic_test_connect(engine, 0x51, &home_addr);
+    quic_test_drain(home);
+    quic_connection_entry_t *entry = find_entry(engine, 0x51);
+    assert(entry);
+    warm_up(entry);
+    uint64_t warm_cwnd = entry->cc.cwnd;
+
+    /* NAT 재바인딩: 같은 IP, 다른 포트는 챌린지 없이 바로 전환하고 혼잡 상태를 유지 */
+    quic_packet_t data = {.flags = QUIC_FLAG_DATA, .connection_id = 0x51, .packet_number = 2};
+    assert(quic_test_deliver(engine, &data, &rebound_addr) == 0);
+    assert(quic_engine_get_connection(engine, 0x51, &addr) == 0);
+    assert(addr.sin_port == rebound_addr.sin_port);
+    assert(entry->cc.cwnd == warm_cwnd && !entry->probe.active);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.nat_rebindings == 1 && metrics.connections_migrated == 1);
+    assert(metrics.path_challenges_sent == 0);
+    quic_test_drain(rebound);
+
+    /* 새 IP: 챌린지를 보내고, 검증 전까지는 이전 경로로 보낸다 */
+    data.packet_number = 3;
+    assert(quic_test_deliver(engine, &data, &away_addr) == 0);
+    assert(quic_engine_get_connection(engine, 0x51, &addr) == 0);
+    assert(addr.sin_addr.s_addr == rebound_addr.sin_addr.s_addr && addr.sin_port == rebound_addr.sin_port);
+    uint8_t challenge_data[QUIC_PATH_CHALLENGE_SIZE];
+    assert(quic_test_recv_reply(away, buf, &reply) == 0);
+    assert(reply.flags == QUIC_FLAG_PATH_CHALLENGE);
+    assert(reply.connection_id == 0x51 && reply.length == QUIC_PATH_CHALLENGE_SIZE);
+    memcpy(challenge_data, reply.payload, sizeof(challenge_data));
+    assert(quic_test_recv_reply(away, buf, &reply) == -1);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.path_challenges_sent == 1 && metrics.connections_migrated == 1);
+
+    /* 같은 주소에서 또 와도 챌린지는 하나만 진행 */
+    data.packet_number = 4;
+    assert(quic_test_deliver(engine, &data, &away_addr) == 0);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.path_challenges_sent == 1);
+
+    /* 틀린 응답이나 다른 주소에서 온 응답은 무시 */
+    uint8_t wrong[QUIC_PATH_CHALLENGE_SIZE];
+    memcpy(wrong, challenge_data, sizeof(wrong));
+    wrong[0] ^= 0xFF;
+    quic_packet_t response = {
+        .flags = QUIC_FLAG_PATH_RESPONSE,
+        .connection_id = 0x51,
+        .length = QUIC_PATH_CHALLENGE_SIZE,
+        .payload = wrong,
+    };
+    assert(quic_test_deliver(engine, &response, &away_addr) == -1);
+    response.payload = challenge_data;
+    assert(quic_test_deliver(engine, &response, &home_addr) == -1);
+    assert(quic_engine_get_connection(engine, 0x51, &addr) == 0);
+    assert(addr.sin_addr.s_addr == rebound_addr.sin_addr.s_addr);
+    assert(entry->cc.cwnd == warm_cwnd);
+
+    /* 맞는 응답: 새 경로로 전환하고 RTT와 창은 처음부터 */
+    assert(quic_test_deliver(engine, &response, &away_addr) == 0);
+    assert(quic_engine_get_connection(engine, 0x51, &addr) == 0);
+    assert(addr.sin_addr.s_addr == away_addr.sin_addr.s_addr && addr.sin_port == away_addr.sin_port);
+    assert(entry->cc.cwnd == QUIC_CC_INITIAL_WINDOW && entry->cc.srtt_us == 0);
+    assert(!entry->probe.active);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.connections_migrated == 2 && metrics.path_validation_failed == 0);
+
+    /* 응답이 없는 경로: 재시도 후 포기하고 기존 경로를 유지 */
+    quic_test_connect(engine, 0x52, &home_addr);
+    quic_test_drain(home);
+    quic_packet_t spoofed = {.flags = QUIC_FLAG_DATA, .connection_id = 0x52, .packet_number = 2};
+    assert(quic_test_deliver(engine, &spoofed, &away_addr) == 0);
+    quic_connection_entry_t *victim = find_entry(engine, 0x52);
+    assert(victim && victim->probe.active);
+    for (int i = 0; i < QUIC_PATH_PROBE_ATTEMPTS; ++i) {
+        victim->probe.sent_us -= QUIC_PATH_PROBE_TIMEOUT_US;
+        quic_engine_tick(engine);
+    }
+    assert(!victim->probe.active);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.path_challenges_sent == 1 + QUIC_PATH_PROBE_ATTEMPTS);
+    assert(metrics.path_validation_failed == 1);
+    assert(quic_engine_get_connection(engine, 0x52, &addr) == 0);
+    assert(addr.sin_addr.s_addr == home_addr.sin_addr.s_addr && addr.sin_port == home_addr.sin_port);
+
+    /* 진짜 클라이언트와 위조 주소가 번갈아 와도 진행 중인 챌린지는 바뀌지 않는다 */
+    struct sockaddr_in real_addr;
+    int real = quic_test_open_client("127.0.0.3", &real_addr);
+    quic_test_connect(engine, 0x53, &home_addr);
+    quic_test_drain(home);
+    quic_test_drain(away);
+    quic_connection_entry_t *moving = find_entry(engine, 0x53);
+    assert(moving);
+    quic_engine_get_metrics(engine, &metrics);
+    uint64_t challenges = metrics.path_challenges_sent;
+    quic_packet_t hop = {.flags = QUIC_FLAG_DATA, .connection_id = 0x53, .packet_number = 2};
+    for (int i = 0; i < 4; ++i) {
+        assert(quic_test_deliver(engine, &hop, i % 2 ? &away_addr : &real_addr) == 0);
+        hop.packet_number++;
+    }
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.path_challenges_sent == challenges + 1);
+    assert(quic_test_recv_reply(away, buf, &reply) == -1);
+    assert(quic_test_recv_reply(real, buf, &reply) == 0 && reply.flags == QUIC_FLAG_PATH_CHALLENGE);
+    memcpy(challenge_data, reply.payload, sizeof(challenge_data));
+    response.connection_id = 0x53;
+    response.payload = challenge_data;
+    assert(quic_test_deliver(engine, &response, &real_addr) == 0);
+    assert(quic_engine_get_connection(engine, 0x53, &addr) == 0);
+    assert(addr.sin_addr.s_addr == real_addr.sin_addr.s_addr && addr.sin_port == real_addr.sin_port);
+
+    /* 위조 주소가 먼저 와도 그 챌린지가 끝나면 진짜 클라이언트가 검증된다 */
+    quic_test_connect(engine, 0x54, &home_addr);
+    quic_test_drain(home);
+    quic_test_drain(real);
+    moving = find_entry(engine, 0x54);
+    assert(moving);
+    hop.connection_id = 0x54;
+    hop.packet_number = 2;
+    for (int i = 0; i < 4; ++i) {
+        assert(quic_test_deliver(engine, &hop, i % 2 ? &real_addr : &away_addr) == 0);
+        hop.packet_number++;
+    }
+    assert(moving->probe.active && moving->probe.addr.sin_addr.s_addr == away_addr.sin_addr.s_addr);
+    assert(quic_test_recv_reply(real, buf, &reply) == -1);
+    for (int i = 0; i < QUIC_PATH_PROBE_ATTEMPTS; ++i) {
+        moving->probe.sent_us -= QUIC_PATH_PROBE_TIMEOUT_US;
+        quic_engine_tick(engine);
+    }
+    assert(!moving->probe.active);
+    assert(quic_test_deliver(engine, &hop, &real_addr) == 0);
+    assert(quic_test_recv_reply(real, buf, &reply) == 0 && reply.flags == QUIC_FLAG_PATH_CHALLENGE);
+    memcpy(challenge_data, reply.payload, sizeof(challenge_data));
+    response.connection_id = 0x54;
+    assert(quic_test_deliver(engine, &response, &real_addr) == 0);
+    assert(quic_engine_get_connection(engine, 0x54, &addr) == 0);
+    assert(addr.sin_addr.s_addr == real_addr.sin_addr.s_addr && addr.sin_port == real_addr.sin_port);
+    quic_test_drain(away);
+
+    /* 서버도 클라이언트의 챌린지에 같은 내용으로 응답한다 */
+    quic_test_drain(home);
+    uint8_t nonce[QUIC_PATH_CHALLENGE_SIZE] = {1, 2, 3, 4, 5, 6, 7, 8};
+    quic_packet_t ask = {
+        .flags = QUIC_FLAG_PATH_CHALLENGE,
+        .connection_id = 0x52,
+        .length = QUIC_PATH_CHALLENGE_SIZE,
+        .payload = nonce,
+    };
+    assert(quic_test_deliver(engine, &ask, &home_addr) == 0);
+    assert(quic_test_recv_reply(home, buf, &reply) == 0);
+    assert(reply.flags == QUIC_FLAG_PATH_RESPONSE && reply.length == QUIC_PATH_CHALLENGE_SIZE);
+    assert(memcmp(reply.payload, nonce, sizeof(nonce)) == 0);
+    ask.connection_id = 0x99;
+    assert(quic_test_deliver(engine, &ask, &home_addr) == -1);
+
+    close(home);
+    close(rebound);
+    close(away);
+    close(real);
+    quic_engine_stop(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+    puts("quic_path_test passed");
+    return 0;
+}
@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 200809L /* nanosleep */
+
+#include "quic_test_util.h"
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void test_estimator(void) {
+    quic_rate_t rate;
+    quic_rate_init(&rate);
+    assert(quic_rate_bandwidth_bps(&rate, 0) == 0);
+
+    /* 10ms마다 1000바이트를 보내고 각각 50ms 뒤에 ACK: 정상 상태에서 800 kbit/s */
+    const uint64_t base = 10 * 1000000ULL;
+    quic_rate_packet_t sent[25];
+    for (int k = 0; k < 25; ++k) {
+        uint64_t t = base + (uint64_t)k * 10000;
+        if (k >= 5) {
+            assert(quic_rate_on_acked(&rate, &sent[k - 5], 1000, t, 50000) == 1);
+        }
+        quic_rate_on_sent(&rate, k == 0 ? 0 : 4000, t, &sent[k]);
+        if (k == 5) {
+            /* 첫 ACK는 구간이 RTT 하나뿐: 1000B / 50ms */
+            assert(rate.latest_bps == 160000);
+        }
+    }
+    for (int k = 20; k < 25; ++k) {
+        assert(quic_rate_on_acked(&rate, &sent[k], 1000, base + (uint64_t)(k + 5) * 10000, 50000) == 1);
+    }
+    assert(rate.latest_bps == 800000);
+    assert(rate.delivered == 25000 && rate.samples == 25);
+    uint64_t now = base + 29 * 10000;
+    assert(quic_rate_bandwidth_bps(&rate, now) == 800000);
+
+    /* ACK 압축: 몰려온 ACK라도 보낸 간격보다 빠르게 재지 않는다 */
+    quic_rate_packet_t burst[4];
+    for (int i = 0; i < 4; ++i) {
+        quic_rate_on_sent(&rate, 1000, now + (uint64_t)i * 10000, &burst[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        quic_rate_on_acked(&rate, &burst[i], 1000, now + 80000, 50000);
+    }
+    assert(quic_rate_bandwidth_bps(&rate, now + 80000) == 800000);
+
+    /* min RTT보다 짧은 구간은 표본이 아니다 */
+    quic_rate_packet_t quick;
+    quic_rate_on_sent(&rate, 0, now + 100000, &quick);
+    uint64_t samples = rate.samples;
+    assert(quic_rate_on_acked(&rate, &quick, 1000, now + 110000, 50000) == 0);
+    assert(rate.samples == samples);
+
+    /* 창이 지나면 추정치가 사라지고, 경로가 바뀌면 바로 비운다 */
+    assert(quic_rate_bandwidth_bps(&rate, now + QUIC_RATE_WINDOW_US + 200000) == 0);
+    assert(quic_rate_bandwidth_bps(&rate, now + 110000) > 0);
+    quic_rate_reset_path(&rate);
+    assert(quic_rate_bandwidth_bps(&rate, now + 110000) == 0);
+    assert(rate.delivered == 30000);
+}
+
+/* Skips DATA and other traffic; -1 once the socket is drained. */
+static int recv_rate_report(int fd, quic_packet_t *packet) {
+    static uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    while (quic_test_recv_reply(fd, buf, packet) == 0) {
+        if (packet->flags == QUIC_FLAG_RATE) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void send_round(quic_engine_t *engine, const struct sockaddr_in *client, uint32_t first_pn, int count) {
+    uint8_t body[1000];
+    memset(body, 'r', sizeof(body));
+    for (int i = 0; i < count; ++i) {
+        quic_packet_t data = {
+            .flags = QUIC_FLAG_DATA,
+            .connection_id = 0x7A,
+            .packet_number = first_pn + (uint32_t)i,
+            .stream_id = 2,
+            .offset = (first_pn + (uint32_t)i) * sizeof(body),
+            .length = sizeof(body),
+            .payload = body,
+        };
+        assert(quic_engine_send_to_connection(engine, &data) == 0);
+    }
+    struct timespec rtt = {.tv_sec = 0, .tv_nsec = 20 * 1000000L};
+    nanosleep(&rtt, NULL);
+    for (int i = 0; i < count; ++i) {
+        quic_packet_t ack = {
+            .flags = QUIC_FLAG_ACK,
+            .connection_id = 0x7A,
+            .packet_number = first_pn + (uint32_t)i,
+            .stream_id = 2,
+        };
+        quic_test_deliver(engine, &ack, client);
+    }
+}
+
+static void test_engine(void) {
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+
+    struct sockaddr_in client;
+    int fd = quic_test_open_client("127.0.0.1", &client);
+
+    quic_delivery_rate_t rate;
+    assert(quic_engine_get_delivery_rate(engine, 0x7A, &rate) == -1);
+    quic_test_connect(engine, 0x7A, &client);
+
+    /* ACK 전에는 추정치도 보고도 없다 */
+    assert(quic_engine_get_delivery_rate(engine, 0x7A, &rate) == 0);
+    assert(rate.bandwidth_bps == 0 && rate.samples == 0);
+    quic_packet_t report;
+    assert(recv_rate_report(fd, &report) == -1);
+
+    /* 한 RTT 동안 보낸 바이트가 ACK되면 조회 API와 RATE 보고에 추정치가 나온다 */
+    send_round(engine, &client, 10, 8);
+    assert(quic_engine_get_delivery_rate(engine, 0x7A, &rate) == 0);
+    assert(rate.samples > 0 && rate.delivered_bytes >= 8 * 1000);
+    assert(rate.bandwidth_bps > 0 && rate.min_rtt_us >= 20000);
+    assert(recv_rate_report(fd, &report) == 0);
+    assert(report.connection_id == 0x7A && report.length == QUIC_RATE_REPORT_SIZE);
+    uint64_t reported_bps = 0;
+    for (int i = 0; i < 8; ++i) {
+        reported_bps = (reported_bps << 8) | report.payload[i];
+    }
+    uint32_t min_rtt_be;
+    memcpy(&min_rtt_be, report.payload + 8, sizeof(min_rtt_be));
+    assert(reported_bps > 0 && reported_bps <= rate.bandwidth_bps);
+    assert(ntohl(min_rtt_be) >= rate.min_rtt_us && ntohl(min_rtt_be) >= 20000);
+
+    /* 보고 간격 안에서는 ACK가 더 와도 다시 보내지 않는다 */
+    send_round(engine, &client, 20, 4);
+    assert(recv_rate_report(fd, &report) == -1);
+    quic_metrics_t metrics;
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.rate_reports_sent == 1);
+
+    close(fd);
+    quic_engine_stop(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+}
+
+int main(void) {
+    test_estimator();
+    test_engine();
+    puts("quic_rate_test passed");
+    return 0;
+}
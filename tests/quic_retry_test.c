@@ -0,0 +1,213 @@
+#include "quic_test_util.h"
+#include "server/quic.h"
+#include "server/quic_retry.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static int hex_equal(const uint8_t *got, const char *hex, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned v = 0;
+        sscanf(hex + 2 * i, "%2x", &v);
+        if (got[i] != (uint8_t)v) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void check_hmac(void) {
+    /* RFC 4231 4.2, 4.3, 4.7, 4.8 */
+    uint8_t key[131];
+    uint8_t mac[QUIC_SHA256_SIZE];
+    memset(key, 0x0b, 20);
+    quic_retry_hmac_sha256(key, 20, (const uint8_t *)"Hi There", 8, mac);
+    assert(hex_equal(mac, "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", 32));
+
+    const char *jefe = "what do ya want for nothing?";
+    quic_retry_hmac_sha256((const uint8_t *)"Jefe", 4, (const uint8_t *)jefe, strlen(jefe), mac);
+    assert(hex_equal(mac, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", 32));
+
+    /* 블록보다 긴 키는 먼저 해시된다 */
+    memset(key, 0xaa, sizeof(key));
+    const char *big_key = "Test Using Larger Than Block-Size Key - Hash Key First";
+    quic_retry_hmac_sha256(key, sizeof(key), (const uint8_t *)big_key, strlen(big_key), mac);
+    assert(hex_equal(mac, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54", 32));
+
+    const char *big_data =
+        "This is a test using a larger than block-size key and a larger than block-size data. "
+        "The key needs to be hashed before being used by the HMAC algorithm.";
+    quic_retry_hmac_sha256(key, sizeof(key), (const uint8_t *)big_data, strlen(big_data), mac);
+    assert(hex_equal(mac, "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2", 32));
+}
+
+static void check_token(void) {
+    uint8_t key[QUIC_RETRY_KEY_SIZE];
+    for (size_t i = 0; i < sizeof(key); ++i) {
+        key[i] = (uint8_t)(i * 7 + 1);
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(0xC0A80001);
+    addr.sin_port = htons(50000);
+    const time_t now = 1700000000;
+    uint8_t token[QUIC_RETRY_TOKEN_SIZE];
+    quic_retry_token_mint(key, &addr, 42, now, token);
+
+    assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 42, now) == 0);
+    assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 42, now + QUIC_RETRY_TOKEN_LIFETIME) == 0);
+    /* 만료, 미래 시각, 길이 불일치 */
+    assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 42, now + QUIC_RETRY_TOKEN_LIFETIME + 1) == -1);
+    assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 42, now - 1) == -1);
+    assert(quic_retry_token_validate(key, token, sizeof(token) - 1, &addr, 42, now) == -1);
+    /* 다른 연결 ID, 다른 포트, 다른 IP, 다른 키 */
+    assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 43, now) == -1);
+    struct sockaddr_in other = addr;
+    other.sin_port = htons(50001);
+    assert(quic_retry_token_validate(key, token, sizeof(token), &other, 42, now) == -1);
+    other = addr;
+    other.sin_addr.s_addr = htonl(0xC0A80002);
+    assert(quic_retry_token_validate(key, token, sizeof(token), &other, 42, now) == -1);
+    uint8_t other_key[QUIC_RETRY_KEY_SIZE];
+    memcpy(other_key, key, sizeof(key));
+    other_key[0] ^= 1;
+    assert(quic_retry_token_validate(other_key, token, sizeof(token), &addr, 42, now) == -1);
+    /* 태그나 발급 시각을 한 비트라도 바꾸면 거절 */
+    for (size_t i = 0; i < sizeof(token); ++i) {
+        token[i] ^= 0x01;
+        assert(quic_retry_token_validate(key, token, sizeof(token), &addr, 42, now) == -1);
+        token[i] ^= 0x01;
+    }
+}
+
+static int send_initial(quic_engine_t *engine,
+                        const struct sockaddr_in *from,
+                        uint64_t cid,
+                        const uint8_t *token,
+                        const uint8_t *rest,
+                        uint32_t rest_len) {
+    uint8_t payload[QUIC_RETRY_TOKEN_SIZE + 64];
+    uint32_t len = 0;
+    if (token) {
+        memcpy(payload, token, QUIC_RETRY_TOKEN_SIZE);
+        len = QUIC_RETRY_TOKEN_SIZE;
+    }
+    if (rest_len > 0) {
+        memcpy(payload + len, rest, rest_len);
+        len += rest_len;
+    }
+    quic_packet_t packet = {
+        .flags = QUIC_FLAG_INITIAL,
+        .connection_id = cid,
+        .offset = token ? QUIC_RETRY_TOKEN_SIZE : 0,
+        .length = len,
+        .payload = len ? payload : NULL,
+    };
+    return quic_test_deliver(engine, &packet, from);
+}
+
+static void check_engine(void) {
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    assert(engine);
+    assert(quic_engine_init(engine, 0, NULL, NULL) == 0);
+    assert(engine->retry_threshold == QUIC_RETRY_DEFAULT_THRESHOLD);
+    quic_engine_set_retry_threshold(engine, 1);
+
+    struct sockaddr_in client_addr;
+    struct sockaddr_in other_addr;
+    int client = quic_test_open_client("127.0.0.1", &client_addr);
+    int other = quic_test_open_client("127.0.0.1", &other_addr);
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t reply;
+    quic_connection_state_t state;
+    quic_metrics_t metrics;
+
+    /* 부하 전: 토큰 없이 바로 슬롯을 받는다 */
+    assert(send_initial(engine, &client_addr, 0xA, NULL, NULL, 0) == 0);
+    assert(quic_test_recv_reply(client, buf, &reply) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK));
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = 0xA, .packet_number = 1};
+    size_t hs_len = 0;
+    assert(quic_packet_serialize(&hs, buf, sizeof(buf), &hs_len) == 0);
+    assert(quic_engine_process_datagram(engine, buf, hs_len, &client_addr) == 0);
+    assert(quic_test_recv_reply(client, buf, &reply) == 0);
+    assert(reply.flags == QUIC_FLAG_HANDSHAKE && reply.length == QUIC_TICKET_PAYLOAD);
+    uint8_t ticket[QUIC_TICKET_SIZE];
+    memcpy(ticket, reply.payload, sizeof(ticket));
+
+    /* 임계치 도달: 토큰 없는 INITIAL은 상태 없이 Retry만 받는다 */
+    assert(send_initial(engine, &client_addr, 0xB, NULL, NULL, 0) == -1);
+    assert(quic_test_recv_reply(client, buf, &reply) == 0);
+    assert(reply.flags == QUIC_FLAG_RETRY);
+    assert(reply.connection_id == 0xB && reply.length == QUIC_RETRY_TOKEN_SIZE);
+    uint8_t token[QUIC_RETRY_TOKEN_SIZE];
+    memcpy(token, reply.payload, sizeof(token));
+    assert(quic_engine_get_connection_state(engine, 0xB, &state) == -1);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.retries_sent == 1 && metrics.connections_opened == 1);
+
+    /* 위조 INITIAL 폭주: 슬롯은 하나도 늘지 않는다 */
+    for (uint64_t cid = 0x1000; cid < 0x1000 + 200; ++cid) {
+        assert(send_initial(engine, &other_addr, cid, NULL, NULL, 0) == -1);
+    }
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.retries_sent == 201 && metrics.connections_opened == 1);
+    while (quic_test_recv_reply(other, buf, &reply) == 0) {
+        assert(reply.flags == QUIC_FLAG_RETRY);
+    }
+
+    /* 다른 포트, 다른 연결 ID, 변조된 토큰은 두 번째 Retry 없이 버려진다 */
+    assert(send_initial(engine, &other_addr, 0xB, token, NULL, 0) == -1);
+    assert(send_initial(engine, &client_addr, 0xC, token, NULL, 0) == -1);
+    token[5] ^= 0x80;
+    assert(send_initial(engine, &client_addr, 0xB, token, NULL, 0) == -1);
+    token[5] ^= 0x80;
+    assert(quic_test_recv_reply(client, buf, &reply) == -1);
+    assert(quic_test_recv_reply(other, buf, &reply) == -1);
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.initials_rejected == 3 && metrics.connections_opened == 1);
+
+    /* 토큰을 되돌려 보내면 슬롯과 핸드셰이크를 받는다 */
+    assert(send_initial(engine, &client_addr, 0xB, token, NULL, 0) == 0);
+    assert(quic_test_recv_reply(client, buf, &reply) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK) && reply.offset == 0);
+    assert(quic_engine_get_connection_state(engine, 0xB, &state) == 0 && state == QUIC_CONN_STATE_CONNECTING);
+
+    /* 살아 있는 재개 티켓은 이미 주소를 증명하므로 Retry 없이 0-RTT */
+    assert(send_initial(engine, &client_addr, 0xD, NULL, ticket, sizeof(ticket)) == 0);
+    assert(quic_test_recv_reply(client, buf, &reply) == 0);
+    assert(reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK) && reply.offset == QUIC_RESUME_ACCEPTED);
+    assert(quic_engine_get_connection_state(engine, 0xD, &state) == 0 && state == QUIC_CONN_STATE_CONNECTED);
+    quic_test_drain(client);
+
+    /* Retry 꺼짐: 테이블이 차면 INITIAL이 거절로 집계된다 */
+    quic_engine_set_retry_threshold(engine, QUIC_MAX_CONNECTIONS + 1);
+    quic_engine_get_metrics(engine, &metrics);
+    uint64_t rejected = metrics.initials_rejected;
+    for (uint64_t cid = 0x2000; cid < 0x2000 + QUIC_MAX_CONNECTIONS; ++cid) {
+        send_initial(engine, &other_addr, cid, NULL, NULL, 0);
+    }
+    quic_engine_get_metrics(engine, &metrics);
+    assert(metrics.connections_opened == QUIC_MAX_CONNECTIONS);
+    assert(metrics.initials_rejected == rejected + 3);
+
+    close(client);
+    close(other);
+    quic_engine_stop(engine);
+    quic_engine_destroy(engine);
+    free(engine);
+}
+
+int main(void) {
+    check_hmac();
+    check_token();
+    check_engine();
+    puts("quic_retry_test passed");
+    return 0;
+}
@@ -86,11 +86,53 @@ static void test_reset_and_capacity(void) {
     quic_stream_manager_destroy(&mgr);
 }
 
+static void test_skip_gap(void) {
+    quic_stream_manager_t mgr;
+    quic_stream_manager_init(&mgr);
+
+    uint8_t out[64];
+    size_t out_len = 0;
+    uint32_t out_off = 0;
+
+    /* 0..3 도착, 3..6 유실, 6..9 버퍼링 */
+    assert(quic_stream_on_data(&mgr, 7, 0, (const uint8_t *)"ABC", 3, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_len == 3);
+    assert(quic_stream_on_data(&mgr, 7, 6, (const uint8_t *)"GHI", 3, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_len == 0);
+
+    /* 송신자가 3..6을 포기하면 6부터 바로 전달 */
+    assert(quic_stream_skip(&mgr, 7, 3, 3) == 0);
+    assert(quic_stream_drain(&mgr, 7, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_off == 6 && out_len == 3);
+    assert(memcmp(out, "GHI", 3) == 0);
+    assert(quic_stream_drain(&mgr, 7, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_len == 0);
+
+    /* 늦게 도착한 재전송은 새 데이터로 취급하지 않음 */
+    assert(quic_stream_on_data(&mgr, 7, 3, (const uint8_t *)"DEF", 3, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_len == 0);
+    assert(quic_stream_skip(&mgr, 7, 0, 3) == 0);
+
+    /* 앞선 데이터가 아직 오지 않은 상태의 skip: 앞 데이터 도착 시 연속 구간만 반환, 나머지는 drain */
+    assert(quic_stream_skip(&mgr, 7, 12, 3) == 0);
+    assert(quic_stream_on_data(&mgr, 7, 15, (const uint8_t *)"PQR", 3, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_len == 0);
+    assert(quic_stream_on_data(&mgr, 7, 9, (const uint8_t *)"JKL", 3, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_off == 9 && out_len == 3);
+    assert(memcmp(out, "JKL", 3) == 0);
+    assert(quic_stream_drain(&mgr, 7, out, sizeof(out), &out_off, &out_len) == 0);
+    assert(out_off == 15 && out_len == 3);
+    assert(memcmp(out, "PQR", 3) == 0);
+
+    quic_stream_manager_destroy(&mgr);
+}
+
 int main(void) {
     test_in_order();
     test_out_of_order();
     test_overlap_and_duplicate();
     test_reset_and_capacity();
+    test_skip_gap();
     puts("quic_stream_test passed");
     return 0;
 }
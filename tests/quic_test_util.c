@@ -0,0 +1,50 @@
+#include "quic_test_util.h"
+
+#include <arpa/inet.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/socket.h>
+
+int quic_test_open_client(const char *ip, struct sockaddr_in *addr_out) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(fd >= 0);
+    memset(addr_out, 0, sizeof(*addr_out));
+    addr_out->sin_family = AF_INET;
+    assert(inet_pton(AF_INET, ip, &addr_out->sin_addr) == 1);
+    assert(bind(fd, (struct sockaddr *)addr_out, sizeof(*addr_out)) == 0);
+    socklen_t alen = sizeof(*addr_out);
+    assert(getsockname(fd, (struct sockaddr *)addr_out, &alen) == 0);
+    return fd;
+}
+
+int quic_test_deliver(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *from) {
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    size_t len = 0;
+    assert(quic_packet_serialize(packet, buf, sizeof(buf), &len) == 0);
+    return quic_engine_process_datagram(engine, buf, len, from);
+}
+
+int quic_test_recv_reply(int fd, uint8_t *buf, quic_packet_t *packet) {
+    ssize_t n = recv(fd, buf, QUIC_MAX_PACKET_SIZE, MSG_DONTWAIT);
+    if (n <= 0) {
+        return -1;
+    }
+    assert(quic_packet_deserialize(packet, buf, (size_t)n) == 0);
+    return 0;
+}
+
+void quic_test_drain(int fd) {
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    quic_packet_t packet;
+    while (quic_test_recv_reply(fd, buf, &packet) == 0) {
+    }
+}
+
+void quic_test_connect(quic_engine_t *engine, uint64_t cid, const struct sockaddr_in *from) {
+    quic_packet_t initial = {.flags = QUIC_FLAG_INITIAL, .connection_id = cid};
+    assert(quic_test_deliver(engine, &initial, from) == 0);
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = cid, .packet_number = 1};
+    assert(quic_test_deliver(engine, &hs, from) == 0);
+    quic_connection_state_t state;
+    assert(quic_engine_get_connection_state(engine, cid, &state) == 0 && state == QUIC_CONN_STATE_CONNECTED);
+}
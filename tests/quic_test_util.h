@@ -0,0 +1,24 @@
+#ifndef TESTS_QUIC_TEST_UTIL_H
+#define TESTS_QUIC_TEST_UTIL_H
+
+#include "server/quic.h"
+
+#include <netinet/in.h>
+#include <stdint.h>
+
+/* Drives a quic_engine_t without its thread: datagrams go straight into
+ * quic_engine_process_datagram and replies land on real UDP sockets. */
+
+/* UDP socket bound to ip on an ephemeral port; addr_out gets the bound address. */
+int quic_test_open_client(const char *ip, struct sockaddr_in *addr_out);
+/* Serializes packet and feeds it to the engine as if it came from `from`. */
+int quic_test_deliver(quic_engine_t *engine, const quic_packet_t *packet, const struct sockaddr_in *from);
+/* Replies go out synchronously from process_datagram, so anything not queued
+ * yet never will be: -1 means there is nothing to read. buf holds
+ * QUIC_MAX_PACKET_SIZE bytes and backs packet->payload. */
+int quic_test_recv_reply(int fd, uint8_t *buf, quic_packet_t *packet);
+void quic_test_drain(int fd);
+/* INITIAL then HANDSHAKE from `from`; the connection must end up CONNECTED. */
+void quic_test_connect(quic_engine_t *engine, uint64_t cid, const struct sockaddr_in *from);
+
+#endif // TESTS_QUIC_TEST_UTIL_H
@@ -0,0 +1,308 @@
+#define _GNU_SOURCE /* mkdtemp */
+
+#include "server/segment_cache.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static char dir[] = "/tmp/segment_cache_test_XXXXXX";
+
+static void make_segment(char *path, size_t path_size, int index, size_t len) {
+    snprintf(path, path_size, "%s/chunk-%05d.m4s", dir, index);
+    FILE *fp = fopen(path, "wb");
+    assert(fp);
+    for (size_t i = 0; i < len; ++i) {
+        fputc((int)((i + (size_t)index) & 0xFF), fp);
+    }
+    fclose(fp);
+}
+
+static void check_contents(const segment_buf_t *buf, int index, size_t len) {
+    assert(buf->len == len);
+    for (size_t i = 0; i < len; ++i) {
+        assert(buf->data[i] == (uint8_t)((i + (size_t)index) & 0xFF));
+    }
+}
+
+static void test_hit_and_miss(void) {
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 1024 * 1024) == 0);
+    char path[256];
+    make_segment(path, sizeof(path), 0, 4000);
+
+    segment_buf_t *a = NULL;
+    segment_buf_t *b = NULL;
+    assert(segment_cache_get(&cache, 1, 0, path, &a) == 0);
+    check_contents(a, 0, 4000);
+    assert(segment_cache_get(&cache, 1, 0, path, &b) == 0);
+    assert(a == b); /* 같은 버퍼를 공유한다 */
+
+    /* 같은 파일이라도 키가 다르면 따로 올린다 */
+    segment_buf_t *c = NULL;
+    assert(segment_cache_get(&cache, 2, 0, path, &c) == 0);
+    assert(c != a);
+
+    char missing[256];
+    snprintf(missing, sizeof(missing), "%s/none.m4s", dir);
+    segment_buf_t *d = NULL;
+    assert(segment_cache_get(&cache, 1, 9, missing, &d) == -1);
+    assert(d == NULL);
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.hits == 1);
+    assert(st.misses == 3);
+    assert(st.loads == 2);
+    assert(st.load_failures == 1);
+    assert(st.entries == 2);
+    assert(st.bytes == 8000);
+
+    segment_buf_release(a);
+    segment_buf_release(b);
+    segment_buf_release(c);
+    segment_cache_destroy(&cache);
+}
+
+typedef struct {
+    segment_cache_t *cache;
+    const char *path;
+    segment_buf_t *buf;
+    int rc;
+} getter_t;
+
+static void *getter_main(void *arg) {
+    getter_t *g = (getter_t *)arg;
+    g->rc = segment_cache_get(g->cache, 3, 1, g->path, &g->buf);
+    return NULL;
+}
+
+static void test_single_flight(void) {
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 64 * 1024 * 1024) == 0);
+    char path[256];
+    make_segment(path, sizeof(path), 1, 2 * 1024 * 1024);
+
+    enum { THREADS = 8 };
+    pthread_t threads[THREADS];
+    getter_t getters[THREADS];
+    /* 락을 잡아 둔 채 띄워서 모두가 같은 순간에 조회하게 한다 */
+    pthread_mutex_lock(&cache.lock);
+    for (int i = 0; i < THREADS; ++i) {
+        getters[i] = (getter_t){.cache = &cache, .path = path};
+        assert(pthread_create(&threads[i], NULL, getter_main, &getters[i]) == 0);
+    }
+    usleep(50000);
+    pthread_mutex_unlock(&cache.lock);
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+        assert(getters[i].rc == 0);
+        assert(getters[i].buf == getters[0].buf);
+    }
+    check_contents(getters[0].buf, 1, 2 * 1024 * 1024);
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.loads == 1);
+    assert(st.hits + st.misses == THREADS);
+    assert(st.misses - st.coalesced == 1); /* 디스크를 읽은 건 한 스레드뿐 */
+
+    for (int i = 0; i < THREADS; ++i) {
+        segment_buf_release(getters[i].buf);
+    }
+    segment_cache_destroy(&cache);
+}
+
+static void test_bypass(void) {
+    /* 용량의 1/8을 넘는 파일은 캐시하지 않고 파일로 보내라고 돌려준다 */
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 1000 * SEGMENT_CACHE_MAX_SHARE) == 0);
+    char path[256];
+    make_segment(path, sizeof(path), 10, 1001);
+    segment_buf_t *buf = NULL;
+    assert(segment_cache_get(&cache, 4, 0, path, &buf) == 1);
+    assert(buf == NULL);
+    assert(segment_cache_get(&cache, 4, 0, path, &buf) == 1);
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.bypassed == 2);
+    assert(st.loads == 0);
+    assert(st.entries == 0);
+    segment_cache_destroy(&cache);
+}
+
+static void test_lru_eviction(void) {
+    /* 파일 하나가 정확히 용량의 1/8이라 여덟 개까지만 담긴다 */
+    size_t seg = 1000;
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, seg * SEGMENT_CACHE_MAX_SHARE) == 0);
+    char path[256];
+    segment_buf_t *bufs[12];
+    for (int i = 0; i < 12; ++i) {
+        make_segment(path, sizeof(path), 20 + i, seg);
+        assert(segment_cache_get(&cache, 5, i, path, &bufs[i]) == 0);
+        if (i == 0) {
+            continue;
+        }
+        /* 0번을 계속 건드려 가장 최근 것으로 유지한다 */
+        snprintf(path, sizeof(path), "%s/chunk-%05d.m4s", dir, 20);
+        segment_buf_t *again = NULL;
+        assert(segment_cache_get(&cache, 5, 0, path, &again) == 0);
+        assert(again == bufs[0]);
+        segment_buf_release(again);
+    }
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.bytes <= seg * SEGMENT_CACHE_MAX_SHARE);
+    assert(st.entries == SEGMENT_CACHE_MAX_SHARE);
+    assert(st.evictions == 12 - SEGMENT_CACHE_MAX_SHARE);
+
+    /* 0번은 남고, 가장 오래된 1번은 밀려났다 */
+    segment_buf_t *again = NULL;
+    snprintf(path, sizeof(path), "%s/chunk-%05d.m4s", dir, 20);
+    assert(segment_cache_get(&cache, 5, 0, path, &again) == 0);
+    assert(again == bufs[0]);
+    segment_buf_release(again);
+    snprintf(path, sizeof(path), "%s/chunk-%05d.m4s", dir, 21);
+    assert(segment_cache_get(&cache, 5, 1, path, &again) == 0);
+    assert(again != bufs[1]);
+    segment_buf_release(again);
+
+    /* 밀려난 버퍼도 참조가 남아 있는 동안은 그대로 읽힌다 */
+    check_contents(bufs[1], 21, seg);
+    for (int i = 0; i < 12; ++i) {
+        segment_buf_release(bufs[i]);
+    }
+    segment_cache_destroy(&cache);
+}
+
+static void test_invalidate(void) {
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 1024 * 1024) == 0);
+    char path[256];
+    make_segment(path, sizeof(path), 40, 500);
+    segment_buf_t *a = NULL;
+    segment_buf_t *other = NULL;
+    assert(segment_cache_get(&cache, 6, 0, path, &a) == 0);
+    assert(segment_cache_get(&cache, 7, 0, path, &other) == 0);
+
+    /* 재분할된 것처럼 파일 내용을 바꾼다 */
+    make_segment(path, sizeof(path), 40, 700);
+    segment_buf_t *b = NULL;
+    assert(segment_cache_get(&cache, 6, 0, path, &b) == 0);
+    assert(b == a); /* 무효화 전에는 이전 내용이 나간다 */
+    segment_buf_release(b);
+
+    segment_cache_invalidate_video(&cache, 6);
+    assert(segment_cache_get(&cache, 6, 0, path, &b) == 0);
+    assert(b != a);
+    check_contents(b, 40, 700);
+    check_contents(a, 40, 500);
+
+    segment_buf_t *c = NULL;
+    assert(segment_cache_get(&cache, 7, 0, path, &c) == 0);
+    assert(c == other); /* 다른 영상은 그대로 */
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.invalidations == 1);
+    assert(st.entries == 2);
+    assert(st.bytes == 500 + 700);
+
+    segment_buf_release(a);
+    segment_buf_release(b);
+    segment_buf_release(c);
+    segment_buf_release(other);
+    segment_cache_destroy(&cache);
+}
+
+static int frame_marker_arg;
+
+static size_t frame_marker(int video_id, int index, size_t payload_len, uint8_t head[SEGMENT_CACHE_HEADROOM], void *arg) {
+    assert(arg == &frame_marker_arg);
+    uint8_t *p = head + SEGMENT_CACHE_HEADROOM - 5;
+    p[0] = (uint8_t)video_id;
+    p[1] = (uint8_t)index;
+    p[2] = (uint8_t)(payload_len >> 16);
+    p[3] = (uint8_t)(payload_len >> 8);
+    p[4] = (uint8_t)payload_len;
+    return 5;
+}
+
+/* 프레임 접두는 적재할 때 한 번만 만들어 본문 바로 앞에 붙여 둔다 */
+static void test_framed(void) {
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 1024 * 1024) == 0);
+    segment_cache_set_framer(&cache, frame_marker, &frame_marker_arg);
+    char path[256];
+    make_segment(path, sizeof(path), 60, 3000);
+    segment_buf_t *buf = NULL;
+    assert(segment_cache_get(&cache, 9, 2, path, &buf) == 0);
+    check_contents(buf, 60, 3000);
+    assert(buf->frame_len == 5 + 3000);
+    assert(buf->frame + 5 == buf->data);
+    uint8_t expect[5] = {9, 2, 0, 3000 >> 8, 3000 & 0xFF};
+    assert(memcmp(buf->frame, expect, 5) == 0);
+
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.bytes == 5 + 3000);
+    segment_buf_release(buf);
+    segment_cache_destroy(&cache);
+}
+
+static void test_disabled(void) {
+    segment_cache_t cache;
+    assert(segment_cache_init(&cache, 0) == 0);
+    char path[256];
+    make_segment(path, sizeof(path), 50, 100);
+    segment_buf_t *buf = NULL;
+    assert(segment_cache_get(&cache, 8, 0, path, &buf) == 1);
+    assert(buf == NULL);
+    segment_cache_destroy(&cache);
+}
+
+/* 잘못된 값이나 너무 큰 값은 무시하고 기본 용량을 쓴다 */
+static void test_env(void) {
+    const char *specs[] = {"12x", "-", "99999999999999999999", "65537"};
+    for (size_t i = 0; i < sizeof(specs) / sizeof(specs[0]); ++i) {
+        assert(setenv(SEGMENT_CACHE_ENV, specs[i], 1) == 0);
+        segment_cache_t cache;
+        assert(segment_cache_init_from_env(&cache) == 0);
+        segment_cache_stats_t st;
+        segment_cache_get_stats(&cache, &st);
+        assert(st.capacity == (uint64_t)SEGMENT_CACHE_DEFAULT_MB * 1024 * 1024);
+        segment_cache_destroy(&cache);
+    }
+    assert(setenv(SEGMENT_CACHE_ENV, "3", 1) == 0);
+    segment_cache_t cache;
+    assert(segment_cache_init_from_env(&cache) == 0);
+    segment_cache_stats_t st;
+    segment_cache_get_stats(&cache, &st);
+    assert(st.capacity == 3 * 1024 * 1024);
+    segment_cache_destroy(&cache);
+    unsetenv(SEGMENT_CACHE_ENV);
+}
+
+int main(void) {
+    assert(mkdtemp(dir) != NULL);
+    test_hit_and_miss();
+    test_single_flight();
+    test_bypass();
+    test_lru_eviction();
+    test_invalidate();
+    test_framed();
+    test_disabled();
+    test_env();
+
+    char cmd[300];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    assert(system(cmd) == 0);
+    printf("segment_cache_test passed\n");
+    return 0;
+}
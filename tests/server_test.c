@@ -1,12 +1,21 @@
+#define _GNU_SOURCE /* mkdtemp, setenv */
+
 #include "server/server.h"
+#include "server/websocket.h"
 
 #include <arpa/inet.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
+
+/* 캐시(1 MiB)에 들어가는 세그먼트도 조각으로 나뉘도록 WS_FRAGMENT_KB를 작게 잡는다 */
+enum { FRAGMENT = 32 * 1024 };
 
 static int contains_sequence(const char *buffer, size_t len, const char *sequence, size_t seq_len) {
     if (seq_len == 0 || len < seq_len) {
@@ -47,7 +56,7 @@ static void expect_text_frame(int fd, char *buffer, size_t buf_size) {
     buffer[resp_len] = '\0';
 }
 
-static void websocket_client_ping(uint16_t port) {
+static int connect_client(uint16_t port) {
     int fd = socket(AF_INET, SOCK_STREAM, 0);
     assert(fd >= 0);
 
@@ -62,7 +71,10 @@ static void websocket_client_ping(uint16_t port) {
     inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
 
     assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
 
+static void send_upgrade(int fd, size_t split) {
     const char *key = "dGhlIHNhbXBsZSBub25jZQ==";
     char request[512];
     int req_len = snprintf(request,
@@ -76,14 +88,38 @@ static void websocket_client_ping(uint16_t port) {
                            "\r\n",
                            key);
     assert(req_len > 0);
-    assert(send(fd, request, (size_t)req_len, 0) == req_len);
+    if (split > 0 && split < (size_t)req_len) {
+        /* 헤더가 나뉘어 와도 빈 줄까지 모아서 처리한다 */
+        assert(send(fd, request, split, 0) == (ssize_t)split);
+        struct timespec gap = {.tv_sec = 0, .tv_nsec = 50 * 1000 * 1000};
+        nanosleep(&gap, NULL);
+        assert(send(fd, request + split, (size_t)req_len - split, 0) == (ssize_t)((size_t)req_len - split));
+    } else {
+        assert(send(fd, request, (size_t)req_len, 0) == req_len);
+    }
 
     read_until_sequence(fd, "\r\n\r\n");
 
     char ready_buffer[128];
     expect_text_frame(fd, ready_buffer, sizeof(ready_buffer));
     assert(strstr(ready_buffer, "\"type\":\"ready\""));
+}
+
+static void send_text(int fd, const char *message) {
+    size_t len = strlen(message);
+    assert(len <= 125);
+    uint8_t frame[2 + 4 + 125];
+    frame[0] = 0x81;
+    frame[1] = 0x80 | (uint8_t)len;
+    uint8_t mask[4] = {0x21, 0x43, 0x65, 0x87};
+    memcpy(&frame[2], mask, 4);
+    for (size_t i = 0; i < len; ++i) {
+        frame[6 + i] = ((uint8_t)message[i]) ^ mask[i % 4];
+    }
+    assert(send(fd, frame, 6 + len, 0) == (ssize_t)(6 + len));
+}
 
+static void send_ping(int fd, int byte_by_byte) {
     const char *message = "{\"type\":\"ping\"}";
     size_t len = strlen(message);
     assert(len <= 125);
@@ -97,11 +133,23 @@ static void websocket_client_ping(uint16_t port) {
         frame[6 + i] = ((uint8_t)message[i]) ^ mask[i % 4];
     }
 
-    assert(send(fd, frame, 6 + len, 0) == (ssize_t)(6 + len));
+    if (byte_by_byte) {
+        for (size_t i = 0; i < 6 + len; ++i) {
+            assert(send(fd, &frame[i], 1, 0) == 1);
+        }
+    } else {
+        assert(send(fd, frame, 6 + len, 0) == (ssize_t)(6 + len));
+    }
 
     char response[256];
     expect_text_frame(fd, response, sizeof(response));
     assert(strstr(response, "\"type\":\"pong\""));
+}
+
+static void websocket_client_ping(uint16_t port) {
+    int fd = connect_client(port);
+    send_upgrade(fd, 0);
+    send_ping(fd, 0);
 
     // send close frame
     uint8_t close_frame[2 + 4];
@@ -114,32 +162,436 @@ static void websocket_client_ping(uint16_t port) {
     close(fd);
 }
 
-int main(void) {
-    server_ctx_t server;
+static void write_segment(const char *path, const uint8_t *data, size_t len) {
+    FILE *fp = fopen(path, "wb");
+    assert(fp && fwrite(data, 1, len, fp) == len);
+    fclose(fp);
+}
+
+/* 서버가 보낸 프레임 하나를 읽어 payload 끝에 붙인다. opcode와 FIN을 돌려준다 */
+static uint8_t read_frame(int fd, int *fin, uint8_t **payload, size_t *len) {
+    uint8_t header[10];
+    assert(recv(fd, header, 2, MSG_WAITALL) == 2);
+    assert((header[1] & 0x80) == 0);
+    uint64_t frame_len = header[1] & 0x7F;
+    int ext = frame_len == 126 ? 2 : frame_len == 127 ? 8 : 0;
+    if (ext > 0) {
+        assert(recv(fd, header + 2, (size_t)ext, MSG_WAITALL) == ext);
+        frame_len = 0;
+        for (int i = 0; i < ext; ++i) {
+            frame_len = (frame_len << 8) | header[2 + i];
+        }
+    }
+    *payload = realloc(*payload, *len + frame_len + 1);
+    assert(*payload);
+    if (frame_len > 0) {
+        assert(recv(fd, *payload + *len, frame_len, MSG_WAITALL) == (ssize_t)frame_len);
+    }
+    *len += frame_len;
+    *fin = (header[0] & 0x80) != 0;
+    return header[0] & 0x0F;
+}
+
+/* 이어지는 프레임(continuation)으로 나뉘어 와도 한 메시지로 모아 확인한다. 프레임 수를 돌려준다 */
+static int expect_segment_frame(int fd, int index, const uint8_t *segment, size_t len) {
+    uint8_t *payload = NULL;
+    size_t payload_len = 0;
+    int fin = 0;
+    int frames = 0;
+    while (!fin) {
+        uint8_t opcode = read_frame(fd, &fin, &payload, &payload_len);
+        assert(opcode == (frames == 0 ? 0x2 : 0x0));
+        frames++;
+    }
+    assert(payload_len == len + 8);
+    uint8_t magic[8] = {'S', 'E', 'G', 'M', 0, 0, 0, (uint8_t)index};
+    assert(memcmp(payload, magic, 8) == 0);
+    assert(memcmp(payload + 8, segment, len) == 0);
+    free(payload);
+    return frames;
+}
+
+/* ws_segment를 요청해 바이너리 프레임과 뒤이은 segment-sent 응답을 확인한다 */
+static int expect_segment(int fd, int index, const uint8_t *segment, size_t len) {
+    char request[96];
+    snprintf(request, sizeof(request), "{\"type\":\"ws_segment\",\"video_id\":7,\"segment\":%d}", index);
+    send_text(fd, request);
+    int frames = expect_segment_frame(fd, index, segment, len);
+    char response[256];
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "segment-sent"));
+    return frames;
+}
+
+/* 세그먼트 파일은 메모리에 읽지 않고 보내지만, 클라이언트가 받는 프레임은 그대로이고
+ * 뒤이은 응답도 파일 뒤에 온다. 캐시(1 MiB)에 들어가는 작은 세그먼트는 두 번째부터
+ * 디스크를 읽지 않고 같은 버퍼에서 나간다 */
+static void test_segment_file(uint16_t port, server_ctx_t *server, websocket_context_t *ws) {
+    enum { SEGMENT_SIZE = 300000, SMALL_SIZE = 100000 };
+    char cwd[512];
+    assert(getcwd(cwd, sizeof(cwd)));
+    char dir[] = "/tmp/server_test_XXXXXX";
+    assert(mkdtemp(dir));
+    assert(chdir(dir) == 0);
+    assert(mkdir("data", 0755) == 0 && mkdir("data/segments", 0755) == 0 && mkdir("data/segments/7", 0755) == 0);
+    uint8_t *segment = malloc(SEGMENT_SIZE);
+    assert(segment);
+    for (size_t i = 0; i < SEGMENT_SIZE; ++i) {
+        segment[i] = (uint8_t)(i * 7 + i / 251);
+    }
+    write_segment("data/segments/7/chunk-stream0-00003.m4s", segment, SEGMENT_SIZE);
+    write_segment("data/segments/7/chunk-stream0-00005.m4s", segment + 1, SMALL_SIZE);
+
+    int fd = connect_client(port);
+    send_upgrade(fd, 0);
+    expect_segment(fd, 3, segment, SEGMENT_SIZE);
+    expect_segment(fd, 5, segment + 1, SMALL_SIZE);
+    /* 캐시에는 첫 조각의 헤더까지 붙어 있어 그 조각은 그대로 나가고 나머지만 나뉜다 */
+    assert(expect_segment(fd, 5, segment + 1, SMALL_SIZE) == (SMALL_SIZE + 8 + FRAGMENT - 1) / FRAGMENT);
+
+    char response[256];
+    send_text(fd, "{\"type\":\"ws_segment\",\"video_id\":7,\"segment\":4}");
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "segment-missing"));
+    close(fd);
+
+    server_stats_t stats;
+    for (int i = 0; i < 100; ++i) {
+        server_get_stats(server, &stats);
+        if (stats.open == 0) {
+            break;
+        }
+        struct timespec wait = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+        nanosleep(&wait, NULL);
+    }
+    assert(stats.open == 0);
+    /* 큰 세그먼트만 sendfile로 나갔다 */
+    assert(stats.sendfile_bytes == SEGMENT_SIZE && stats.bytes_sent > SEGMENT_SIZE + 2 * SMALL_SIZE);
+    segment_cache_stats_t cache;
+    segment_cache_get_stats(&ws->segment_cache, &cache);
+    assert(cache.bypassed == 1 && cache.loads == 1 && cache.hits == 1);
+    assert(cache.bytes == 4 + 8 + SMALL_SIZE); /* 첫 조각(126 + 16비트 길이)의 헤더까지 담아 둔다 */
+
+    unlink("data/segments/7/chunk-stream0-00003.m4s");
+    unlink("data/segments/7/chunk-stream0-00005.m4s");
+    rmdir("data/segments/7");
+    rmdir("data/segments");
+    rmdir("data");
+    assert(chdir(cwd) == 0);
+    rmdir(dir);
+    free(segment);
+}
+
+static void expect_silence(int fd) {
+    struct timespec wait = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+    nanosleep(&wait, NULL);
+    uint8_t byte;
+    assert(recv(fd, &byte, 1, MSG_DONTWAIT) == -1);
+}
+
+/* ws_push 뒤에는 요청 없이 창(window)만큼 연달아 보내고, ws_ack로 창이 밀릴 때만 더 보낸다.
+ * 파일로 나가는 큰 세그먼트와 캐시에서 나가는 작은 세그먼트가 섞여도 순서는 그대로다.
+ * ws_segments도 같은 경로로 나간다 */
+static void test_push(uint16_t port) {
+    enum { SEGMENTS = 5, BIG = 200000, SMALL = 50000 };
+    char cwd[512];
+    assert(getcwd(cwd, sizeof(cwd)));
+    char dir[] = "/tmp/server_test_XXXXXX";
+    assert(mkdtemp(dir));
+    assert(chdir(dir) == 0);
+    assert(mkdir("data", 0755) == 0 && mkdir("data/segments", 0755) == 0 && mkdir("data/segments/8", 0755) == 0);
+    uint8_t *data = malloc(BIG + SEGMENTS);
+    assert(data);
+    for (size_t i = 0; i < BIG + SEGMENTS; ++i) {
+        data[i] = (uint8_t)(i * 13 + i / 241);
+    }
+    size_t sizes[SEGMENTS] = {BIG, BIG, SMALL, BIG, SMALL};
+    char path[96];
+    write_segment("data/segments/8/init-stream0.m4s", data, 100);
+    for (int i = 0; i < SEGMENTS; ++i) {
+        snprintf(path, sizeof(path), "data/segments/8/chunk-stream0-%05d.m4s", i);
+        write_segment(path, data + i, sizes[i]);
+    }
+
+    int fd = connect_client(port);
+    send_upgrade(fd, 0);
+    char response[256];
+    send_text(fd, "{\"type\":\"ws_push\",\"video_id\":8,\"segment\":1,\"window\":2}");
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"status\":\"ok\"") && strstr(response, "\"total_segments\":5"));
+    expect_segment_frame(fd, 1, data + 1, sizes[1]);
+    expect_segment_frame(fd, 2, data + 2, sizes[2]);
+    expect_silence(fd);
+
+    send_text(fd, "{\"type\":\"ws_ack\",\"segment\":1}");
+    expect_segment_frame(fd, 3, data + 3, sizes[3]);
+    expect_silence(fd);
+
+    /* 마지막 세그먼트 뒤에는 done으로 끝을 알린다 */
+    send_text(fd, "{\"type\":\"ws_ack\",\"segment\":3}");
+    expect_segment_frame(fd, 4, data + 4, sizes[4]);
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"status\":\"done\""));
+
+    send_text(fd, "{\"type\":\"ws_push\",\"video_id\":8,\"segment\":5}");
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "segment-out-of-range"));
+
+    /* ws_segments는 구간을 ack 없이 한 번에 보내고 요약 하나로 끝낸다. 끝을 넘는 count는 잘린다 */
+    send_text(fd, "{\"type\":\"ws_segments\",\"video_id\":8,\"from\":0,\"count\":3}");
+    for (int i = 0; i < 3; ++i) {
+        expect_segment_frame(fd, i, data + i, sizes[i]);
+    }
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"type\":\"ws_segments\",\"status\":\"ok\"") && strstr(response, "\"from\":0,\"count\":3"));
+    send_text(fd, "{\"type\":\"ws_segments\",\"video_id\":8,\"from\":3,\"count\":10}");
+    expect_segment_frame(fd, 3, data + 3, sizes[3]);
+    expect_segment_frame(fd, 4, data + 4, sizes[4]);
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"from\":3,\"count\":2"));
+    send_text(fd, "{\"type\":\"ws_segments\",\"video_id\":8,\"from\":0,\"count\":0}");
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "bad-count"));
+    close(fd);
+
+    unlink("data/segments/8/init-stream0.m4s");
+    for (int i = 0; i < SEGMENTS; ++i) {
+        snprintf(path, sizeof(path), "data/segments/8/chunk-stream0-%05d.m4s", i);
+        unlink(path);
+    }
+    rmdir("data/segments/8");
+    rmdir("data/segments");
+    rmdir("data");
+    assert(chdir(cwd) == 0);
+    rmdir(dir);
+    free(data);
+}
+
+/* 큰 세그먼트는 조각(기본 256 KiB)으로 나가고, 그 사이에 온 ping의 pong은 세그먼트가
+ * 끝나기를 기다리지 않고 조각 사이에 끼어 나간다 */
+static void test_fragments(uint16_t port) {
+    enum { BIG = 8 * 1024 * 1024 };
+    char cwd[512];
+    assert(getcwd(cwd, sizeof(cwd)));
+    char dir[] = "/tmp/server_test_XXXXXX";
+    assert(mkdtemp(dir));
+    assert(chdir(dir) == 0);
+    assert(mkdir("data", 0755) == 0 && mkdir("data/segments", 0755) == 0 && mkdir("data/segments/9", 0755) == 0);
+    uint8_t *data = malloc(BIG);
+    assert(data);
+    for (size_t i = 0; i < BIG; ++i) {
+        data[i] = (uint8_t)(i * 31 + i / 257);
+    }
+    write_segment("data/segments/9/chunk-stream0-00000.m4s", data, BIG);
+
+    /* 받는 쪽 창을 작게 잡아 세그먼트가 소켓 버퍼에 한 번에 다 들어가지 못하게 한다 */
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(fd >= 0);
+    int rcvbuf = 64 * 1024;
+    assert(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == 0);
+    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+    assert(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    assert(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    send_upgrade(fd, 0);
+
+    send_text(fd, "{\"type\":\"ws_segment\",\"video_id\":9,\"segment\":0}");
+    struct timespec wait = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+    nanosleep(&wait, NULL);
+    uint8_t ping[6 + 4] = {0x89, 0x80 | 4, 1, 2, 3, 4, 'p' ^ 1, 'i' ^ 2, 'n' ^ 3, 'g' ^ 4};
+    assert(send(fd, ping, sizeof(ping), 0) == (ssize_t)sizeof(ping));
+
+    uint8_t *payload = NULL;
+    size_t payload_len = 0;
+    int fin = 0;
+    int frames = 0;
+    int pong_at = -1;
+    while (!fin) {
+        size_t before = payload_len;
+        uint8_t opcode = read_frame(fd, &fin, &payload, &payload_len);
+        if (opcode == 0xA) {
+            /* 제어 프레임은 메시지 중간에 와도 된다 */
+            assert(fin && payload_len - before == 4 && memcmp(payload + before, "ping", 4) == 0);
+            payload_len = before;
+            fin = 0;
+            pong_at = frames;
+            continue;
+        }
+        assert(opcode == (frames == 0 ? 0x2 : 0x0));
+        assert(payload_len - before <= FRAGMENT);
+        frames++;
+    }
+    assert(payload_len == BIG + 8 && memcmp(payload + 8, data, BIG) == 0);
+    assert(frames == (BIG + 8 + FRAGMENT - 1) / FRAGMENT);
+    assert(pong_at > 0 && pong_at < frames);
+    free(payload);
+
+    char response[256];
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "segment-sent"));
+
+    /* 탐색하면 보내던 메시지는 프레임 경계에서 끝나고, 못 보낸 바이트를 알려 준다 */
+    send_text(fd, "{\"type\":\"ws_segment\",\"video_id\":9,\"segment\":0}");
+    nanosleep(&wait, NULL);
+    send_text(fd, "{\"type\":\"stream_seek\",\"video_id\":9,\"segment\":3}");
+    payload = NULL;
+    payload_len = 0;
+    fin = 0;
+    while (!fin) {
+        assert(read_frame(fd, &fin, &payload, &payload_len) != 0xA);
+    }
+    assert(payload_len < BIG + 8 && memcmp(payload, "SEGM", 4) == 0);
+    assert(memcmp(payload + 8, data, payload_len - 8) == 0);
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "segment-sent"));
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"type\":\"stream_seek\"") && strstr(response, "\"segment\":3"));
+    const char *saved = strstr(response, "\"bytes_saved\":");
+    assert(saved);
+    assert(payload_len + strtoull(saved + 14, NULL, 10) == BIG + 8);
+    assert(strstr(response, "\"quic_unacked_cancelled\":0"));
+    free(payload);
+
+    /* 보내는 중인 것이 없으면 아낄 것도 없다 */
+    send_text(fd, "{\"type\":\"stream_stop\"}");
+    expect_text_frame(fd, response, sizeof(response));
+    assert(strstr(response, "\"type\":\"stream_stop\"") && strstr(response, "\"bytes_saved\":0"));
+    close(fd);
+
+    unlink("data/segments/9/chunk-stream0-00000.m4s");
+    rmdir("data/segments/9");
+    rmdir("data/segments");
+    rmdir("data");
+    assert(chdir(cwd) == 0);
+    rmdir(dir);
+    free(data);
+}
+
+static int start_server(server_ctx_t *server, int max_clients, websocket_context_t *ws, uint16_t *port_out) {
     const uint16_t candidate_ports[] = {20080, 21080, 22080, 23080, 24080};
-    int init_ok = 0;
-    uint16_t port = candidate_ports[0];
     for (size_t i = 0; i < sizeof(candidate_ports) / sizeof(candidate_ports[0]); ++i) {
-        port = candidate_ports[i];
-        if (server_init(&server, "127.0.0.1", port, 5) == 0) {
-            init_ok = 1;
-            break;
+        if (server_init(server, "127.0.0.1", candidate_ports[i], max_clients) == 0) {
+            assert(server_set_threads(server, 2, 2) == 0);
+            server_set_websocket_context(server, ws);
+            assert(server_start(server) == 0);
+            *port_out = candidate_ports[i];
+            return 0;
         }
     }
-    if (!init_ok) {
+    return -1;
+}
+
+static void test_thread_config(void) {
+    unsigned io = 0;
+    unsigned workers = 0;
+    assert(server_parse_thread_config("4", &io, &workers) == 0 && io == 4 && workers == SERVER_DEFAULT_WORKERS);
+    assert(server_parse_thread_config("1:16", &io, &workers) == 0 && io == 1 && workers == 16);
+    assert(server_parse_thread_config("0", &io, &workers) == -1);
+    assert(server_parse_thread_config("2:0", &io, &workers) == -1);
+    assert(server_parse_thread_config("2:", &io, &workers) == -1);
+    assert(server_parse_thread_config("x", &io, &workers) == -1);
+    assert(server_parse_thread_config("99", &io, &workers) == -1);
+}
+
+/* 클라이언트마다 스레드를 두지 않으므로 I/O 스레드 2개로 수백 개의 웹소켓을 동시에 연다 */
+static void test_many_clients(uint16_t port, server_ctx_t *server) {
+    enum { CLIENTS = 200 };
+    int *fds = malloc(sizeof(int) * CLIENTS);
+    assert(fds);
+    for (int i = 0; i < CLIENTS; ++i) {
+        fds[i] = connect_client(port);
+        send_upgrade(fds[i], 0);
+    }
+    server_stats_t stats;
+    server_get_stats(server, &stats);
+    assert(stats.open >= CLIENTS && stats.rejected_busy == 0);
+    for (int i = CLIENTS - 1; i >= 0; --i) {
+        send_ping(fds[i], 0);
+    }
+    for (int i = 0; i < CLIENTS; ++i) {
+        close(fds[i]);
+    }
+    free(fds);
+}
+
+/* 조각난 헤더와 한 바이트씩 도착하는 프레임도 같은 연결에서 처리된다 */
+static void test_partial_input(uint16_t port) {
+    int fd = connect_client(port);
+    send_upgrade(fd, 17);
+    send_ping(fd, 1);
+    send_ping(fd, 0);
+    close(fd);
+}
+
+/* 연결 수 상한을 넘으면 바로 거절하고, 종료 시 열린 연결을 닫고 돌아온다 */
+static void test_busy_and_shutdown(void) {
+    server_ctx_t server;
+    uint16_t port = 0;
+    assert(start_server(&server, 1, NULL, &port) == 0);
+    int first = connect_client(port);
+    send_upgrade(first, 0);
+
+    int second = connect_client(port);
+    char buffer[64];
+    ssize_t n = recv(second, buffer, sizeof(buffer) - 1, 0);
+    assert(n > 0);
+    buffer[n] = '\0';
+    assert(strstr(buffer, "Server busy"));
+    close(second);
+
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    server_request_stop(&server);
+    server_join(&server);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    assert(end.tv_sec - start.tv_sec < 3);
+    assert(recv(first, buffer, sizeof(buffer), 0) == 0);
+    close(first);
+
+    server_stats_t stats;
+    server_get_stats(&server, &stats);
+    assert(stats.accepted == 1 && stats.rejected_busy == 1 && stats.open == 0);
+    server_destroy(&server);
+}
+
+int main(void) {
+    test_thread_config();
+
+    setenv(SEGMENT_CACHE_ENV, "1", 1);
+    setenv(WS_FRAGMENT_ENV, "32", 1); /* FRAGMENT */
+    websocket_context_t ws;
+    websocket_context_init(&ws, NULL, NULL);
+
+    server_ctx_t server;
+    uint16_t port = 0;
+    if (start_server(&server, 256, &ws, &port) != 0) {
         fprintf(stderr, "server_init bind failed on candidate ports, skipping test\n");
         return 0;
     }
-    assert(server_start(&server) == 0);
 
-    usleep(100 * 1000);
+    /* 0-RTT 요청은 서버 워커에서 처리하므로, 워커가 있는 동안만 넘겨받는다 */
+    assert(ws.workers && ws.workers == server.workers);
+
+    struct timespec settle = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+    nanosleep(&settle, NULL);
 
     websocket_client_ping(port);
     websocket_client_ping(port);
+    test_partial_input(port);
+    test_segment_file(port, &server, &ws);
+    test_push(port);
+    test_fragments(port);
+    test_many_clients(port, &server);
 
     server_request_stop(&server);
     server_join(&server);
+    assert(ws.workers == NULL);
     server_destroy(&server);
+    websocket_context_destroy(&ws);
+
+    test_busy_and_shutdown();
 
     puts("server_test passed");
     return 0;
@@ -0,0 +1,156 @@
+/* FEC codec throughput per GF kernel.
+ *
+ * Encodes groups of k symbols into m repairs and decodes with m sources
+ * erased (the worst case), reporting MB/s of source data for every kernel
+ * the CPU supports.  Use it to pick k/m for QUIC_FEC and to confirm the SIMD
+ * kernels are actually taken on the deployment hardware. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "server/quic_fec.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--k K] [--m M] [--symbol BYTES] [--mb MB] [--xor]\n"
+            "  --k K          source symbols per group (default 10)\n"
+            "  --m M          repair symbols per group (default 2; forced to 1 with --xor)\n"
+            "  --symbol BYTES symbol size (default 1200)\n"
+            "  --mb MB        source data per measurement (default 256)\n",
+            prog);
+}
+
+typedef struct {
+    quic_fec_kernel_t kernel;
+    const char *name;
+} bench_kernel_t;
+
+int main(int argc, char **argv) {
+    unsigned k = 10;
+    unsigned m = 2;
+    size_t symbol = 1200;
+    long mb = 256;
+    quic_fec_mode_t mode = QUIC_FEC_REED_SOLOMON;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--k") == 0 && i + 1 < argc) {
+            k = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--m") == 0 && i + 1 < argc) {
+            m = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--symbol") == 0 && i + 1 < argc) {
+            symbol = (size_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mb") == 0 && i + 1 < argc) {
+            mb = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--xor") == 0) {
+            mode = QUIC_FEC_XOR;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (mode == QUIC_FEC_XOR) {
+        m = 1;
+    }
+    if (!quic_fec_params_valid(mode, k, m) || symbol == 0 || symbol > QUIC_FEC_MAX_SYMBOL || mb <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t *data = malloc((size_t)k * symbol);
+    uint8_t *work = malloc((size_t)k * symbol);
+    uint8_t *rep = malloc((size_t)m * symbol);
+    if (!data || !work || !rep) {
+        fprintf(stderr, "[fec-bench] out of memory\n");
+        return 1;
+    }
+    unsigned seed = 12345;
+    for (size_t i = 0; i < (size_t)k * symbol; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 16);
+    }
+    const uint8_t *src[QUIC_FEC_MAX_K];
+    uint8_t *dst[QUIC_FEC_MAX_K];
+    uint8_t *repair[QUIC_FEC_MAX_M];
+    uint8_t src_present[QUIC_FEC_MAX_K];
+    uint8_t repair_present[QUIC_FEC_MAX_M];
+    for (unsigned i = 0; i < k; ++i) {
+        src[i] = data + (size_t)i * symbol;
+        dst[i] = work + (size_t)i * symbol;
+    }
+    for (unsigned j = 0; j < m; ++j) {
+        repair[j] = rep + (size_t)j * symbol;
+        repair_present[j] = 1;
+    }
+
+    uint64_t group_bytes = (uint64_t)k * symbol;
+    uint64_t groups = ((uint64_t)mb * 1024 * 1024 + group_bytes - 1) / group_bytes;
+    printf("[fec-bench] mode=%s k=%u m=%u symbol=%zu groups=%llu (%.0f MB per run)\n",
+           mode == QUIC_FEC_XOR ? "xor" : "rs",
+           k,
+           m,
+           symbol,
+           (unsigned long long)groups,
+           (double)(groups * group_bytes) / (1024.0 * 1024.0));
+
+    const bench_kernel_t kernels[] = {
+        {QUIC_FEC_KERNEL_SCALAR, "scalar"},
+        {QUIC_FEC_KERNEL_SSSE3, "ssse3"},
+        {QUIC_FEC_KERNEL_AVX2, "avx2"},
+        {QUIC_FEC_KERNEL_NEON, "neon"},
+    };
+    int rc = 0;
+    for (size_t n = 0; n < sizeof(kernels) / sizeof(kernels[0]); ++n) {
+        if (quic_fec_set_kernel(kernels[n].kernel) != 0) {
+            printf("[fec-bench][result] kernel=%s unsupported\n", kernels[n].name);
+            continue;
+        }
+
+        uint64_t t0 = now_us();
+        for (uint64_t g = 0; g < groups; ++g) {
+            quic_fec_encode(mode, k, m, src, repair, symbol);
+        }
+        uint64_t encode_us = now_us() - t0;
+
+        uint64_t decode_us = 0;
+        for (uint64_t g = 0; g < groups; ++g) {
+            memcpy(work, data, (size_t)k * symbol);
+            for (unsigned i = 0; i < k; ++i) {
+                src_present[i] = 1;
+            }
+            /* m erasures is the worst case the group can still recover from. */
+            for (unsigned e = 0; e < m; ++e) {
+                src_present[(g + e) % k] = 0;
+            }
+            uint64_t d0 = now_us();
+            if (quic_fec_decode(mode, k, m, dst, src_present, (const uint8_t *const *)repair, repair_present, symbol) != 0) {
+                rc = 1;
+            }
+            decode_us += now_us() - d0;
+        }
+        if (memcmp(work, data, (size_t)k * symbol) != 0) {
+            fprintf(stderr, "[fec-bench] kernel=%s decoded data mismatch\n", kernels[n].name);
+            rc = 1;
+        }
+
+        double mbytes = (double)(groups * group_bytes) / (1024.0 * 1024.0);
+        printf("[fec-bench][result] kernel=%s encode=%.0f MB/s decode=%.0f MB/s (erasures=%u)\n",
+               kernels[n].name,
+               encode_us ? mbytes * 1e6 / (double)encode_us : 0.0,
+               decode_us ? mbytes * 1e6 / (double)decode_us : 0.0,
+               m);
+    }
+
+    free(data);
+    free(work);
+    free(rep);
+    return rc;
+}
@@ -0,0 +1,245 @@
+/* Packet-to-handler latency with and without the low-latency mode.
+ *
+ * Runs an engine in-process on a loopback port, connects one client and sends
+ * datagrams spaced --interval-us apart, each carrying its send time.  The
+ * datagram handler (inline on the receive thread) records how long each packet
+ * took from sendto to the handler; datagrams skip reassembly, so a packet the
+ * kernel drops under overload only costs its own sample.  The gap between packets lets the receive
+ * thread go idle, which is where busy polling and pinning pay off.  The run is
+ * repeated with QUIC_LOW_LATENCY unset and set to --cpus/--spin-us. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_CONNECTION_ID 0x1A7E0C0000000001ULL
+#define BENCH_STAMP_SIZE    8
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t *samples_ns;
+    size_t count;
+    size_t cap;
+} latency_log_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts = {.tv_sec = (time_t)(us / 1000000ULL), .tv_nsec = (long)(us % 1000000ULL) * 1000L};
+    nanosleep(&ts, NULL);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double percentile_us(const uint64_t *sorted, size_t count, double p) {
+    if (count == 0) {
+        return 0.0;
+    }
+    size_t idx = (size_t)(p / 100.0 * (double)(count - 1));
+    return (double)sorted[idx] / 1000.0;
+}
+
+static void on_datagram(uint64_t connection_id, const uint8_t *data, size_t len, void *user_data) {
+    (void)connection_id;
+    uint64_t now = now_ns();
+    latency_log_t *log = (latency_log_t *)user_data;
+    if (len != BENCH_STAMP_SIZE) {
+        return;
+    }
+    uint64_t sent = 0;
+    memcpy(&sent, data, sizeof(sent));
+    pthread_mutex_lock(&log->lock);
+    if (log->count < log->cap) {
+        log->samples_ns[log->count++] = now > sent ? now - sent : 0;
+    }
+    pthread_mutex_unlock(&log->lock);
+}
+
+static int send_packet(int fd, const quic_packet_t *packet, const struct sockaddr_in *to) {
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    size_t len = 0;
+    if (quic_packet_serialize(packet, buf, sizeof(buf), &len) != 0) {
+        return -1;
+    }
+    return sendto(fd, buf, len, 0, (const struct sockaddr *)to, sizeof(*to)) == (ssize_t)len ? 0 : -1;
+}
+
+static int handshake(int fd, const struct sockaddr_in *server) {
+    quic_packet_t initial = {.flags = QUIC_FLAG_INITIAL, .connection_id = BENCH_CONNECTION_ID};
+    if (send_packet(fd, &initial, server) != 0) {
+        return -1;
+    }
+    struct timeval tv = {.tv_sec = 2, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    uint8_t buf[QUIC_MAX_PACKET_SIZE];
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        quic_packet_t reply;
+        if (n <= 0) {
+            return -1;
+        }
+        if (quic_packet_deserialize(&reply, buf, (size_t)n) == 0 && reply.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK)) {
+            break;
+        }
+    }
+    quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = BENCH_CONNECTION_ID, .packet_number = 1};
+    return send_packet(fd, &hs, server);
+}
+
+static int run_mode(const char *name, const char *latency_spec, unsigned packets, uint64_t interval_us) {
+    if (latency_spec) {
+        setenv(QUIC_LOW_LATENCY_ENV, latency_spec, 1);
+    } else {
+        unsetenv(QUIC_LOW_LATENCY_ENV);
+    }
+    quic_engine_t *engine = calloc(1, sizeof(*engine));
+    latency_log_t log = {.samples_ns = calloc(packets, sizeof(uint64_t)), .cap = packets};
+    if (!engine || !log.samples_ns || quic_engine_init(engine, 0, NULL, NULL) != 0) {
+        fprintf(stderr, "[latency-bench] cannot start engine\n");
+        free(engine);
+        free(log.samples_ns);
+        return -1;
+    }
+    unsetenv(QUIC_LOW_LATENCY_ENV);
+    pthread_mutex_init(&log.lock, NULL);
+    quic_engine_set_datagram_handler(engine, on_datagram, &log);
+    quic_engine_set_recv_timeout(engine, 1);
+    struct sockaddr_in server;
+    socklen_t alen = sizeof(server);
+    getsockname(engine->sockfd, (struct sockaddr *)&server, &alen);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int rc = quic_engine_start(engine);
+    int started = rc == 0;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (rc != 0 || fd < 0 || handshake(fd, &server) != 0) {
+        fprintf(stderr, "[latency-bench] mode=%s handshake failed\n", name);
+        rc = -1;
+    }
+    sleep_us(10000);
+
+    for (unsigned i = 0; rc == 0 && i < packets; ++i) {
+        uint64_t stamp = now_ns();
+        quic_packet_t data = {
+            .flags = QUIC_FLAG_DATAGRAM,
+            .connection_id = BENCH_CONNECTION_ID,
+            .packet_number = 2 + i,
+            .length = BENCH_STAMP_SIZE,
+            .payload = (const uint8_t *)&stamp,
+        };
+        send_packet(fd, &data, &server);
+        if (interval_us > 0) {
+            sleep_us(interval_us);
+        }
+    }
+    /* Up to a second for stragglers; anything later was dropped. */
+    for (int waited = 0; rc == 0 && waited < 100; ++waited) {
+        pthread_mutex_lock(&log.lock);
+        size_t count = log.count;
+        pthread_mutex_unlock(&log.lock);
+        if (count == packets) {
+            break;
+        }
+        sleep_us(10000);
+    }
+
+    quic_metrics_t metrics;
+    quic_engine_get_metrics(engine, &metrics);
+    if (fd >= 0) {
+        close(fd);
+    }
+    quic_engine_stop(engine);
+    if (started) {
+        quic_engine_join(engine);
+    }
+    quic_engine_destroy(engine);
+    free(engine);
+
+    if (rc == 0) {
+        qsort(log.samples_ns, log.count, sizeof(uint64_t), cmp_u64);
+        printf("[latency-bench][result] mode=%s received=%zu/%u p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f "
+               "busy_poll_hits=%llu busy_poll_sleeps=%llu\n",
+               name,
+               log.count,
+               packets,
+               percentile_us(log.samples_ns, log.count, 50.0),
+               percentile_us(log.samples_ns, log.count, 99.0),
+               percentile_us(log.samples_ns, log.count, 99.9),
+               percentile_us(log.samples_ns, log.count, 100.0),
+               (unsigned long long)metrics.busy_poll_hits,
+               (unsigned long long)metrics.busy_poll_sleeps);
+    }
+    pthread_mutex_destroy(&log.lock);
+    free(log.samples_ns);
+    return rc;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --packets N        packets per mode (default 20000)\n"
+            "  --interval-us US   gap between packets (default 100, 0 = back to back)\n"
+            "  --cpus LIST        CPUs for the low-latency run, e.g. 2 or 2-3 (default 0)\n"
+            "  --spin-us US       spin before sleeping in the low-latency run (default %d)\n",
+            prog,
+            QUIC_LATENCY_DEFAULT_SPIN_US);
+}
+
+int main(int argc, char **argv) {
+    unsigned packets = 20000;
+    uint64_t interval_us = 100;
+    const char *cpus = "0";
+    unsigned spin_us = QUIC_LATENCY_DEFAULT_SPIN_US;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--packets") == 0) {
+            packets = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--interval-us") == 0) {
+            interval_us = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--cpus") == 0) {
+            cpus = val;
+        } else if (strcmp(opt, "--spin-us") == 0) {
+            spin_us = (unsigned)strtoul(val, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    char spec[128];
+    quic_latency_config_t check;
+    snprintf(spec, sizeof(spec), "%s:%u", cpus, spin_us);
+    if (packets == 0 || quic_latency_parse_config(spec, &check) != 0 || !check.enabled) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("[latency-bench][info] packets=%u interval=%lluus low_latency=%s\n", packets, (unsigned long long)interval_us, spec);
+    if (run_mode("default", NULL, packets, interval_us) != 0 || run_mode("low-latency", spec, packets, interval_us) != 0) {
+        return 1;
+    }
+    return 0;
+}
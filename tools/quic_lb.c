@@ -0,0 +1,417 @@
+/* Connection-id aware UDP load balancer for several local ott_server processes.
+ *
+ * Unlike a 4-tuple balancer it picks the backend from the connection id in each
+ * datagram header (quic_lb_route): ids a backend issued name it directly and
+ * anything else, such as the id a client opens with, goes by a consistent hash.
+ * A client that migrates to a new address therefore still reaches the backend
+ * holding its connection, which just sees a new path.  Each (client address,
+ * backend) pair is a flow with its own upstream socket so replies can be mapped
+ * back; ECN bits are carried through in both directions. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LB_MAX_FLOWS      256
+#define LB_MAX_DATAGRAM   65536
+#define LB_FLOW_IDLE_SEC  60
+#define LB_SOCKET_BUFFER  (4 * 1024 * 1024)
+#define LB_ECN_MASK       0x03
+
+typedef struct {
+    struct sockaddr_in addr;
+    uint64_t pkts_up;
+    uint64_t bytes_up;
+    uint64_t pkts_down;
+    uint64_t bytes_down;
+    uint64_t routed_by_id;   /* upstream datagrams whose id named this backend */
+    uint64_t routed_by_hash; /* upstream datagrams placed by the consistent hash */
+} backend_t;
+
+typedef struct {
+    int in_use;
+    int upstream_fd;
+    int backend;
+    struct sockaddr_in client;
+    time_t last_seen;
+} flow_t;
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void handle_signal(int signo) {
+    (void)signo;
+    keep_running = 0;
+}
+
+static int parse_host_port(const char *arg, struct sockaddr_in *out) {
+    char host[64];
+    const char *colon = strrchr(arg, ':');
+    if (!colon || (size_t)(colon - arg) >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, arg, (size_t)(colon - arg));
+    host[colon - arg] = '\0';
+    long port = strtol(colon + 1, NULL, 10);
+    if (port <= 0 || port > 65535) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &out->sin_addr) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/* IP:PORT or IP:PORT=ID; without an id the backend gets its 1-based position. */
+static int parse_backend(const char *arg, unsigned position, struct sockaddr_in *addr, uint8_t *server_id) {
+    char spec[96];
+    if (strlen(arg) >= sizeof(spec)) {
+        return -1;
+    }
+    strcpy(spec, arg);
+    unsigned long id = position + 1;
+    char *eq = strchr(spec, '=');
+    if (eq) {
+        *eq = '\0';
+        char *end = NULL;
+        id = strtoul(eq + 1, &end, 10);
+        if (end == eq + 1 || *end != '\0') {
+            return -1;
+        }
+    }
+    if (id == 0 || id > UINT8_MAX || parse_host_port(spec, addr) != 0) {
+        return -1;
+    }
+    *server_id = (uint8_t)id;
+    return 0;
+}
+
+static void format_addr(const struct sockaddr_in *addr, char *out, size_t out_size) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    snprintf(out, out_size, "%s:%u", ip, (unsigned int)ntohs(addr->sin_port));
+}
+
+static void print_stats(const backend_t *backends, const uint8_t *server_ids, unsigned count,
+                        const flow_t *flows, uint64_t dropped, const char *reason) {
+    for (unsigned b = 0; b < count; ++b) {
+        unsigned flow_count = 0;
+        for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+            if (flows[i].in_use && flows[i].backend == (int)b) {
+                flow_count++;
+            }
+        }
+        char addr[64];
+        format_addr(&backends[b].addr, addr, sizeof(addr));
+        printf("[lb][%s] backend=%u addr=%s flows=%u pkts_up=%llu bytes_up=%llu pkts_down=%llu bytes_down=%llu "
+               "by_id=%llu by_hash=%llu\n",
+               reason,
+               (unsigned int)server_ids[b],
+               addr,
+               flow_count,
+               (unsigned long long)backends[b].pkts_up,
+               (unsigned long long)backends[b].bytes_up,
+               (unsigned long long)backends[b].pkts_down,
+               (unsigned long long)backends[b].bytes_down,
+               (unsigned long long)backends[b].routed_by_id,
+               (unsigned long long)backends[b].routed_by_hash);
+    }
+    printf("[lb][%s] dropped=%llu\n", reason, (unsigned long long)dropped);
+    fflush(stdout);
+}
+
+static int find_flow(const flow_t *flows, const struct sockaddr_in *client, int backend) {
+    for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+        if (flows[i].in_use && flows[i].backend == backend &&
+            flows[i].client.sin_addr.s_addr == client->sin_addr.s_addr &&
+            flows[i].client.sin_port == client->sin_port) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int open_flow(flow_t *flows, const struct sockaddr_in *client, int backend) {
+    for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+        if (flows[i].in_use) {
+            continue;
+        }
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            perror("[lb] socket");
+            return -1;
+        }
+        int sockbuf = LB_SOCKET_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
+        int on = 1;
+        setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on));
+        memset(&flows[i], 0, sizeof(flows[i]));
+        flows[i].in_use = 1;
+        flows[i].upstream_fd = fd;
+        flows[i].backend = backend;
+        flows[i].client = *client;
+        flows[i].last_seen = time(NULL);
+        return i;
+    }
+    return -1;
+}
+
+/* recvfrom plus the ECN bits of the IP header (needs IP_RECVTOS on fd). */
+static ssize_t recv_with_ecn(int fd, uint8_t *buf, size_t cap, struct sockaddr_in *src, uint8_t *ecn) {
+    uint8_t control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {.iov_base = buf, .iov_len = cap};
+    struct msghdr msg = {
+        .msg_name = src,
+        .msg_namelen = sizeof(*src),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    ssize_t n = recvmsg(fd, &msg, 0);
+    *ecn = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+            *ecn = *(const uint8_t *)CMSG_DATA(cmsg) & LB_ECN_MASK;
+        }
+    }
+    return n;
+}
+
+static ssize_t send_with_ecn(int fd, const uint8_t *data, size_t len, const struct sockaddr_in *dst, uint8_t ecn) {
+    uint8_t control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+    struct msghdr msg = {
+        .msg_name = (void *)dst,
+        .msg_namelen = sizeof(*dst),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_TOS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int tos = ecn;
+    memcpy(CMSG_DATA(cmsg), &tos, sizeof(tos));
+    return sendmsg(fd, &msg, 0);
+}
+
+/* The connection id sits right after the flags byte and is never encrypted. */
+static uint64_t datagram_connection_id(const uint8_t *data) {
+    uint64_t cid = 0;
+    for (int i = 1; i <= 8; ++i) {
+        cid = (cid << 8) | data[i];
+    }
+    return cid;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --backend IP:PORT[=ID] [--backend ...] [options]\n"
+            "  --listen PORT          client-facing UDP port (default 9444)\n"
+            "  --backend IP:PORT[=ID] ott_server QUIC address and its %s (default: position, from 1)\n"
+            "  --stats-interval SEC   periodic per-backend stats (default 5, 0 = off)\n",
+            prog,
+            QUIC_LB_SERVER_ID_ENV);
+}
+
+int main(int argc, char **argv) {
+    uint16_t listen_port = 9444;
+    unsigned int stats_interval = 5;
+    static backend_t backends[QUIC_LB_MAX_BACKENDS];
+    uint8_t server_ids[QUIC_LB_MAX_BACKENDS];
+    unsigned backend_count = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--listen") == 0) {
+            long port = strtol(val, NULL, 10);
+            if (port <= 0 || port > 65535) {
+                fprintf(stderr, "[lb] invalid --listen port\n");
+                return 1;
+            }
+            listen_port = (uint16_t)port;
+        } else if (strcmp(opt, "--backend") == 0) {
+            if (backend_count == QUIC_LB_MAX_BACKENDS ||
+                parse_backend(val, backend_count, &backends[backend_count].addr, &server_ids[backend_count]) != 0) {
+                fprintf(stderr, "[lb] invalid --backend %s (expected IPv4:PORT[=1..255])\n", val);
+                return 1;
+            }
+            for (unsigned b = 0; b < backend_count; ++b) {
+                if (server_ids[b] == server_ids[backend_count]) {
+                    fprintf(stderr, "[lb] duplicate server id %u\n", (unsigned int)server_ids[b]);
+                    return 1;
+                }
+            }
+            backend_count++;
+        } else if (strcmp(opt, "--stats-interval") == 0) {
+            stats_interval = (unsigned int)strtoul(val, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (backend_count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listen_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_fd < 0) {
+        perror("[lb] socket");
+        return 1;
+    }
+    int sockbuf = LB_SOCKET_BUFFER;
+    setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
+    int recvtos = 1;
+    setsockopt(listen_fd, IPPROTO_IP, IP_RECVTOS, &recvtos, sizeof(recvtos));
+    struct sockaddr_in bind_addr;
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind_addr.sin_port = htons(listen_port);
+    if (bind(listen_fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        perror("[lb] bind");
+        close(listen_fd);
+        return 1;
+    }
+
+    for (unsigned b = 0; b < backend_count; ++b) {
+        char addr[64];
+        format_addr(&backends[b].addr, addr, sizeof(addr));
+        printf("[lb][info] 127.0.0.1:%u -> backend %u at %s\n", (unsigned int)listen_port, (unsigned int)server_ids[b], addr);
+    }
+    fflush(stdout);
+
+    static flow_t flows[LB_MAX_FLOWS];
+    static uint8_t buffer[LB_MAX_DATAGRAM];
+    uint64_t dropped = 0;
+    time_t last_stats = time(NULL);
+
+    while (keep_running) {
+        struct pollfd pfds[LB_MAX_FLOWS + 1];
+        int flow_of_pfd[LB_MAX_FLOWS + 1];
+        nfds_t nfds = 0;
+        pfds[nfds].fd = listen_fd;
+        pfds[nfds].events = POLLIN;
+        flow_of_pfd[nfds] = -1;
+        nfds++;
+        for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+            if (flows[i].in_use) {
+                pfds[nfds].fd = flows[i].upstream_fd;
+                pfds[nfds].events = POLLIN;
+                flow_of_pfd[nfds] = i;
+                nfds++;
+            }
+        }
+
+        int ready = poll(pfds, nfds, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[lb] poll");
+            break;
+        }
+
+        for (nfds_t p = 0; ready > 0 && p < nfds; ++p) {
+            if (!(pfds[p].revents & POLLIN)) {
+                continue;
+            }
+            struct sockaddr_in src;
+            uint8_t ecn = 0;
+            ssize_t n = recv_with_ecn(pfds[p].fd, buffer, sizeof(buffer), &src, &ecn);
+            if (n <= 0) {
+                continue;
+            }
+            int flow_idx = flow_of_pfd[p];
+            if (flow_idx >= 0) {
+                flow_t *flow = &flows[flow_idx];
+                flow->last_seen = time(NULL);
+                if (send_with_ecn(listen_fd, buffer, (size_t)n, &flow->client, ecn) == n) {
+                    backends[flow->backend].pkts_down++;
+                    backends[flow->backend].bytes_down += (uint64_t)n;
+                }
+                continue;
+            }
+
+            if ((size_t)n < QUIC_HEADER_SIZE) {
+                dropped++;
+                continue;
+            }
+            uint64_t cid = datagram_connection_id(buffer);
+            int backend = quic_lb_route(server_ids, backend_count, cid);
+            flow_idx = find_flow(flows, &src, backend);
+            if (flow_idx < 0) {
+                flow_idx = open_flow(flows, &src, backend);
+                if (flow_idx < 0) {
+                    fprintf(stderr, "[lb][warn] flow table full, dropping datagram\n");
+                    dropped++;
+                    continue;
+                }
+            }
+            flow_t *flow = &flows[flow_idx];
+            flow->last_seen = time(NULL);
+            if (send_with_ecn(flow->upstream_fd, buffer, (size_t)n, &backends[backend].addr, ecn) == n) {
+                backend_t *target = &backends[backend];
+                target->pkts_up++;
+                target->bytes_up += (uint64_t)n;
+                uint8_t named = 0;
+                if (quic_lb_cid_server_id(cid, &named) == 0 && named == server_ids[backend]) {
+                    target->routed_by_id++;
+                } else {
+                    target->routed_by_hash++;
+                }
+            }
+        }
+
+        time_t wall = time(NULL);
+        for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+            if (flows[i].in_use && wall - flows[i].last_seen > LB_FLOW_IDLE_SEC) {
+                close(flows[i].upstream_fd);
+                flows[i].in_use = 0;
+            }
+        }
+        if (stats_interval > 0 && (unsigned int)(wall - last_stats) >= stats_interval) {
+            last_stats = wall;
+            print_stats(backends, server_ids, backend_count, flows, dropped, "stats");
+        }
+    }
+
+    print_stats(backends, server_ids, backend_count, flows, dropped, "final");
+    for (int i = 0; i < LB_MAX_FLOWS; ++i) {
+        if (flows[i].in_use) {
+            close(flows[i].upstream_fd);
+        }
+    }
+    close(listen_fd);
+    return 0;
+}
@@ -0,0 +1,946 @@
+/* QUIC load generator emulating many concurrent viewers.
+ *
+ * Each worker thread owns one UDP socket shared by its viewers (demultiplexed
+ * by connection ID) and one WebSocket control connection that issues
+ * stream_chunk requests on behalf of those viewers.  Viewers perform the
+ * INITIAL -> HANDSHAKE exchange, then request one chunk per interval sized to
+ * the configured bitrate and ACK every DATA packet they receive, echoing the
+ * ECN counts seen so far so the server can react to CE marks. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "server/quic.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_MAX_THREADS      64
+#define LOADGEN_INITIAL_RTO_US   1000000ULL
+#define LOADGEN_INITIAL_RETRIES  3
+#define LOADGEN_WS_BUF           65536
+#define LOADGEN_MAX_CHUNK_PKTS   64
+#define LOADGEN_RECV_BATCH       64
+
+typedef enum {
+    VIEWER_IDLE = 0,
+    VIEWER_INITIAL_SENT,
+    VIEWER_CONNECTED,
+    VIEWER_FAILED
+} viewer_state_t;
+
+typedef struct {
+    uint64_t connection_id;
+    uint64_t wire_id; /* header id to send: connection_id, or the routable id a load-balanced server issued */
+    viewer_state_t state;
+    uint64_t initial_sent_us;
+    uint64_t first_initial_us;
+    int initial_retries;
+    int has_retry_token; /* server answered with a stateless Retry */
+    uint8_t retry_token[QUIC_RETRY_TOKEN_SIZE];
+    uint64_t next_chunk_us;
+    uint32_t next_offset;
+    /* in-flight chunk */
+    int chunk_active;
+    uint32_t chunk_offset;
+    uint32_t chunk_length;
+    uint32_t chunk_received;
+    uint64_t chunk_requested_us;
+    uint64_t chunk_seen_mask; /* bit per packet-sized slice */
+    quic_fec_decoder_t *fec;  /* --fec only */
+    quic_ecn_counts_t ecn;    /* marks seen on this viewer's packets, echoed in ACKs */
+} viewer_t;
+
+typedef struct {
+    uint64_t *items;
+    size_t count;
+    size_t cap;
+} sample_vec_t;
+
+typedef struct {
+    struct sockaddr_in quic_addr;
+    struct sockaddr_in ws_addr;
+    int use_ws;
+    int use_fec;
+    int video_id;
+    uint32_t stream_id;
+    uint32_t chunk_bytes;
+    uint64_t chunk_interval_us;
+    uint64_t chunk_timeout_us;
+    uint64_t ramp_us;
+    uint64_t duration_us;
+} loadgen_config_t;
+
+typedef struct {
+    int index;
+    const loadgen_config_t *cfg;
+    viewer_t *viewers;
+    size_t viewer_count;
+    int udp_fd;
+    int ws_fd;
+    uint8_t ws_buf[LOADGEN_WS_BUF];
+    size_t ws_len;
+    int *ws_pending; /* FIFO of viewer indices awaiting a stream_chunk reply */
+    size_t ws_head;
+    size_t ws_tail;
+    size_t ws_cap;
+    sample_vec_t setup_us;
+    sample_vec_t chunk_us;
+    uint64_t setup_failed;
+    uint64_t setup_retries;
+    uint64_t chunks_requested;
+    uint64_t chunks_completed;
+    uint64_t chunks_timed_out;
+    uint64_t chunks_rejected;
+    uint64_t packets_received;
+    uint64_t packets_duplicate;
+    uint64_t packets_recovered;
+    uint64_t bytes_received;
+    uint64_t acks_sent;
+    uint64_t ecn_ce_received;
+    uint64_t rate_reports;
+    uint64_t rate_bps_sum;
+    uint64_t routable_ids;
+    pthread_t thread;
+} worker_t;
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void handle_signal(int signo) {
+    (void)signo;
+    keep_running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int sample_push(sample_vec_t *vec, uint64_t value) {
+    if (vec->count == vec->cap) {
+        size_t new_cap = vec->cap ? vec->cap * 2 : 1024;
+        uint64_t *items = realloc(vec->items, new_cap * sizeof(*items));
+        if (!items) {
+            return -1;
+        }
+        vec->items = items;
+        vec->cap = new_cap;
+    }
+    vec->items[vec->count++] = value;
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const sample_vec_t *vec, double p) {
+    if (vec->count == 0) {
+        return 0;
+    }
+    size_t idx = (size_t)(p / 100.0 * (double)(vec->count - 1) + 0.5);
+    return vec->items[idx];
+}
+
+static void print_distribution(const char *name, sample_vec_t *vec) {
+    qsort(vec->items, vec->count, sizeof(uint64_t), cmp_u64);
+    printf("%-18s n=%-8zu p50=%.2fms p90=%.2fms p99=%.2fms p99.9=%.2fms max=%.2fms\n",
+           name,
+           vec->count,
+           (double)percentile(vec, 50.0) / 1000.0,
+           (double)percentile(vec, 90.0) / 1000.0,
+           (double)percentile(vec, 99.0) / 1000.0,
+           (double)percentile(vec, 99.9) / 1000.0,
+           vec->count ? (double)vec->items[vec->count - 1] / 1000.0 : 0.0);
+}
+
+static int send_packet(worker_t *w, const quic_packet_t *packet) {
+    uint8_t buffer[QUIC_HEADER_SIZE + 64];
+    size_t len = 0;
+    if (quic_packet_serialize(packet, buffer, sizeof(buffer), &len) != 0) {
+        return -1;
+    }
+    ssize_t sent = sendto(w->udp_fd, buffer, len, 0, (const struct sockaddr *)&w->cfg->quic_addr, sizeof(w->cfg->quic_addr));
+    return sent == (ssize_t)len ? 0 : -1;
+}
+
+static void send_control(worker_t *w, viewer_t *v, uint8_t flags, uint32_t pn) {
+    quic_packet_t packet = {
+        .flags = flags,
+        .connection_id = v->wire_id,
+        .packet_number = pn,
+    };
+    if (flags == QUIC_FLAG_INITIAL && v->has_retry_token) {
+        packet.offset = QUIC_RETRY_TOKEN_SIZE;
+        packet.length = QUIC_RETRY_TOKEN_SIZE;
+        packet.payload = v->retry_token;
+    }
+    send_packet(w, &packet);
+}
+
+static int ws_write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *ptr = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int ws_send_text(worker_t *w, const char *text, size_t len) {
+    uint8_t frame[512];
+    static const uint8_t mask[4] = {0x5A, 0xA5, 0x3C, 0xC3};
+    size_t hlen = 2;
+    if (len > sizeof(frame) - 8) {
+        return -1;
+    }
+    frame[0] = 0x81;
+    if (len <= 125) {
+        frame[1] = 0x80 | (uint8_t)len;
+    } else {
+        frame[1] = 0x80 | 126;
+        frame[2] = (uint8_t)(len >> 8);
+        frame[3] = (uint8_t)(len & 0xFF);
+        hlen = 4;
+    }
+    memcpy(frame + hlen, mask, 4);
+    for (size_t i = 0; i < len; ++i) {
+        frame[hlen + 4 + i] = (uint8_t)text[i] ^ mask[i % 4];
+    }
+    return ws_write_all(w->ws_fd, frame, hlen + 4 + len);
+}
+
+static int ws_connect(worker_t *w) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("[loadgen] socket");
+        return -1;
+    }
+    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr *)&w->cfg->ws_addr, sizeof(w->cfg->ws_addr)) != 0) {
+        perror("[loadgen] ws connect");
+        close(fd);
+        return -1;
+    }
+    const char *req =
+        "GET /loadgen HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n";
+    if (ws_write_all(fd, req, strlen(req)) != 0) {
+        close(fd);
+        return -1;
+    }
+    /* Consume the 101 response byte by byte so no frame bytes are swallowed. */
+    char tail[4] = {0};
+    size_t total = 0;
+    while (total < 4096) {
+        char c;
+        if (recv(fd, &c, 1, 0) != 1) {
+            close(fd);
+            return -1;
+        }
+        total++;
+        memmove(tail, tail + 1, 3);
+        tail[3] = c;
+        if (memcmp(tail, "\r\n\r\n", 4) == 0) {
+            w->ws_fd = fd;
+            return 0;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static viewer_t *viewer_from_cid(worker_t *w, uint64_t cid) {
+    size_t idx = (size_t)(cid & 0xFFFFFFULL);
+    if (idx >= w->viewer_count || w->viewers[idx].connection_id != cid) {
+        return NULL;
+    }
+    return &w->viewers[idx];
+}
+
+static void ws_pending_push(worker_t *w, int viewer_idx) {
+    w->ws_pending[w->ws_tail % w->ws_cap] = viewer_idx;
+    w->ws_tail++;
+}
+
+static void request_chunk(worker_t *w, size_t idx, uint64_t now) {
+    viewer_t *v = &w->viewers[idx];
+    char cmd[256];
+    int len = snprintf(cmd,
+                       sizeof(cmd),
+                       "{\"type\":\"stream_chunk\",\"video_id\":%d,\"offset\":%u,\"length\":%u,"
+                       "\"connection_id\":%llu,\"stream_id\":%u}",
+                       w->cfg->video_id,
+                       v->next_offset,
+                       w->cfg->chunk_bytes,
+                       (unsigned long long)v->connection_id,
+                       w->cfg->stream_id);
+    if (len <= 0 || (size_t)len >= sizeof(cmd) || w->ws_tail - w->ws_head >= w->ws_cap) {
+        return;
+    }
+    if (ws_send_text(w, cmd, (size_t)len) != 0) {
+        return;
+    }
+    ws_pending_push(w, (int)idx);
+    v->chunk_active = 1;
+    v->chunk_offset = v->next_offset;
+    v->chunk_length = w->cfg->chunk_bytes;
+    v->chunk_received = 0;
+    v->chunk_seen_mask = 0;
+    v->chunk_requested_us = now;
+    v->next_offset += w->cfg->chunk_bytes;
+    w->chunks_requested++;
+}
+
+static int contains(const char *hay, size_t hay_len, const char *needle) {
+    size_t n = strlen(needle);
+    for (size_t i = 0; i + n <= hay_len; ++i) {
+        if (memcmp(hay + i, needle, n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void handle_ws_reply(worker_t *w, const char *json, size_t len) {
+    /* Replies arrive in request order; the greeting is not a reply. */
+    if (w->ws_head == w->ws_tail || contains(json, len, "\"type\":\"ready\"")) {
+        return;
+    }
+    int idx = w->ws_pending[w->ws_head % w->ws_cap];
+    w->ws_head++;
+    if (contains(json, len, "\"type\":\"stream_chunk\"") && contains(json, len, "\"status\":\"ok\"")) {
+        return;
+    }
+    viewer_t *v = &w->viewers[idx];
+    /* Past end of file or connection not ready: restart from the beginning. */
+    if (v->chunk_active) {
+        v->chunk_active = 0;
+        w->chunks_rejected++;
+    }
+    v->next_offset = 0;
+}
+
+static void poll_ws(worker_t *w) {
+    ssize_t n = recv(w->ws_fd, w->ws_buf + w->ws_len, sizeof(w->ws_buf) - w->ws_len, MSG_DONTWAIT);
+    if (n <= 0) {
+        return;
+    }
+    w->ws_len += (size_t)n;
+    size_t pos = 0;
+    while (w->ws_len - pos >= 2) {
+        uint8_t *hdr = w->ws_buf + pos;
+        uint64_t plen = hdr[1] & 0x7F;
+        size_t hlen = 2;
+        if (plen == 126) {
+            if (w->ws_len - pos < 4) {
+                break;
+            }
+            plen = ((uint64_t)hdr[2] << 8) | hdr[3];
+            hlen = 4;
+        } else if (plen == 127) {
+            if (w->ws_len - pos < 10) {
+                break;
+            }
+            plen = 0;
+            for (int i = 0; i < 8; ++i) {
+                plen = (plen << 8) | hdr[2 + i];
+            }
+            hlen = 10;
+        }
+        if (plen > sizeof(w->ws_buf) - hlen) {
+            fprintf(stderr, "[loadgen][warn] oversized ws frame, dropping control connection\n");
+            close(w->ws_fd);
+            w->ws_fd = -1;
+            return;
+        }
+        if (w->ws_len - pos < hlen + plen) {
+            break;
+        }
+        if ((hdr[0] & 0x0F) == 0x1) {
+            handle_ws_reply(w, (const char *)hdr + hlen, (size_t)plen);
+        }
+        pos += hlen + (size_t)plen;
+    }
+    memmove(w->ws_buf, w->ws_buf + pos, w->ws_len - pos);
+    w->ws_len -= pos;
+}
+
+typedef struct {
+    worker_t *w;
+    viewer_t *v;
+    uint64_t now;
+} fec_recover_ctx_t;
+
+static void account_data(worker_t *w,
+                         viewer_t *v,
+                         uint32_t packet_number,
+                         uint32_t stream_id,
+                         uint32_t offset,
+                         uint32_t length,
+                         uint8_t flags,
+                         uint64_t now);
+
+/* Rebuilt packets count like received ones and are ACKed so the server stops retransmitting them. */
+static void on_fec_recovered(void *user_data,
+                             uint32_t stream_id,
+                             uint32_t packet_number,
+                             uint32_t offset,
+                             const uint8_t *data,
+                             uint32_t len) {
+    (void)data;
+    fec_recover_ctx_t *rctx = (fec_recover_ctx_t *)user_data;
+    rctx->w->packets_recovered++;
+    account_data(rctx->w, rctx->v, packet_number, stream_id, offset, len, QUIC_FLAG_DATA | QUIC_FLAG_REPAIR, rctx->now);
+}
+
+static void handle_datagram(worker_t *w, const uint8_t *buf, size_t len, uint8_t ecn, uint64_t now) {
+    quic_packet_t packet;
+    if (quic_packet_deserialize(&packet, buf, len) != 0) {
+        return;
+    }
+    viewer_t *v = viewer_from_cid(w, packet.connection_id);
+    if (!v) {
+        return;
+    }
+    w->packets_received++;
+    if (ecn == QUIC_ECN_CE) {
+        v->ecn.ce++;
+        w->ecn_ce_received++;
+    } else if (ecn == QUIC_ECN_ECT0) {
+        v->ecn.ect0++;
+    } else if (ecn == QUIC_ECN_ECT1) {
+        v->ecn.ect1++;
+    }
+
+    if (packet.flags == QUIC_FLAG_RETRY && v->state == VIEWER_INITIAL_SENT && packet.length == QUIC_RETRY_TOKEN_SIZE) {
+        memcpy(v->retry_token, packet.payload, QUIC_RETRY_TOKEN_SIZE);
+        v->has_retry_token = 1;
+        w->setup_retries++;
+        v->initial_sent_us = now;
+        send_control(w, v, QUIC_FLAG_INITIAL, 0);
+        return;
+    }
+
+    if (packet.flags == QUIC_FLAG_PATH_CHALLENGE && packet.length == QUIC_PATH_CHALLENGE_SIZE) {
+        /* A relay or NAT moved us to a new address; echo so the server switches. */
+        quic_packet_t response = packet;
+        response.flags = QUIC_FLAG_PATH_RESPONSE;
+        response.connection_id = v->wire_id;
+        send_packet(w, &response);
+        return;
+    }
+
+    if (packet.flags == QUIC_FLAG_RATE && packet.length == QUIC_RATE_REPORT_SIZE) {
+        uint64_t bps = 0;
+        for (int i = 0; i < 8; ++i) {
+            bps = (bps << 8) | packet.payload[i];
+        }
+        w->rate_reports++;
+        w->rate_bps_sum += bps;
+        return;
+    }
+
+    if ((packet.flags & QUIC_FLAG_HANDSHAKE) && v->state == VIEWER_INITIAL_SENT) {
+        sample_push(&w->setup_us, now - v->first_initial_us);
+        if (packet.length == QUIC_LB_ROUTABLE_ID_SIZE) {
+            uint64_t routable_id = 0;
+            for (int i = 0; i < 8; ++i) {
+                routable_id = (routable_id << 8) | packet.payload[i];
+            }
+            v->wire_id = routable_id;
+            w->routable_ids++;
+        }
+        send_control(w, v, QUIC_FLAG_HANDSHAKE, 1);
+        v->state = VIEWER_CONNECTED;
+        /* Stagger the first request so the server sees the HANDSHAKE first
+         * and viewers do not request in lockstep. */
+        v->next_chunk_us = now + 5000 + (v->connection_id % 997) * (w->cfg->chunk_interval_us / 997);
+        return;
+    }
+
+    if (packet.flags & QUIC_FLAG_CLOSE) {
+        v->state = VIEWER_FAILED;
+        return;
+    }
+
+    if (w->cfg->use_fec && (packet.flags & QUIC_FLAG_REPAIR) && !(packet.flags & QUIC_FLAG_DATA)) {
+        if (!v->fec) {
+            v->fec = quic_fec_decoder_create();
+        }
+        fec_recover_ctx_t rctx = {w, v, now};
+        if (v->fec) {
+            quic_fec_decoder_on_repair(v->fec, packet.stream_id, packet.payload, packet.length, on_fec_recovered, &rctx);
+        }
+        return;
+    }
+    if (!(packet.flags & QUIC_FLAG_DATA)) {
+        return;
+    }
+
+    account_data(w, v, packet.packet_number, packet.stream_id, packet.offset, packet.length, packet.flags, now);
+    if (w->cfg->use_fec && (packet.flags & QUIC_FLAG_REPAIR)) {
+        if (!v->fec) {
+            v->fec = quic_fec_decoder_create();
+        }
+        fec_recover_ctx_t rctx = {w, v, now};
+        if (v->fec) {
+            quic_fec_decoder_on_source(v->fec,
+                                       packet.stream_id,
+                                       packet.packet_number,
+                                       packet.offset,
+                                       packet.payload,
+                                       packet.length,
+                                       on_fec_recovered,
+                                       &rctx);
+        }
+    }
+}
+
+static void account_data(worker_t *w,
+                         viewer_t *v,
+                         uint32_t packet_number,
+                         uint32_t stream_id,
+                         uint32_t offset,
+                         uint32_t length,
+                         uint8_t flags,
+                         uint64_t now) {
+    quic_packet_t ack = {
+        .flags = QUIC_FLAG_ACK,
+        .connection_id = v->wire_id,
+        .packet_number = packet_number,
+        .stream_id = stream_id,
+        .offset = offset,
+    };
+    uint32_t counts[3];
+    if (v->ecn.ect0 || v->ecn.ect1 || v->ecn.ce) {
+        counts[0] = htonl(v->ecn.ect0);
+        counts[1] = htonl(v->ecn.ect1);
+        counts[2] = htonl(v->ecn.ce);
+        ack.length = QUIC_ACK_ECN_SIZE;
+        ack.payload = (const uint8_t *)counts;
+    }
+    if (send_packet(w, &ack) == 0) {
+        w->acks_sent++;
+    }
+
+    if (!v->chunk_active || offset < v->chunk_offset || offset >= v->chunk_offset + v->chunk_length) {
+        w->packets_duplicate++;
+        return;
+    }
+    /* FEC-protected packets carry less payload so a repair symbol fits one packet. */
+    uint32_t slice = (flags & QUIC_FLAG_REPAIR) ? QUIC_FEC_MAX_SOURCE_PAYLOAD : QUIC_MAX_PAYLOAD;
+    uint32_t slot = (offset - v->chunk_offset) / slice;
+    if (slot < LOADGEN_MAX_CHUNK_PKTS) {
+        uint64_t bit = 1ULL << slot;
+        if (v->chunk_seen_mask & bit) {
+            w->packets_duplicate++;
+            return;
+        }
+        v->chunk_seen_mask |= bit;
+    }
+    v->chunk_received += length;
+    w->bytes_received += length;
+    if (v->chunk_received >= v->chunk_length) {
+        sample_push(&w->chunk_us, now - v->chunk_requested_us);
+        w->chunks_completed++;
+        v->chunk_active = 0;
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = (worker_t *)arg;
+    const loadgen_config_t *cfg = w->cfg;
+    uint64_t start = now_us();
+    uint64_t end = start + cfg->ramp_us + cfg->duration_us;
+
+    for (size_t i = 0; i < w->viewer_count; ++i) {
+        viewer_t *v = &w->viewers[i];
+        v->state = VIEWER_IDLE;
+        /* Spread INITIALs evenly over the ramp so the accept path is not hit by one burst. */
+        v->initial_sent_us = start + (w->viewer_count > 1 ? cfg->ramp_us * i / w->viewer_count : 0);
+    }
+
+    uint8_t buffer[QUIC_MAX_PACKET_SIZE];
+    while (keep_running) {
+        uint64_t now = now_us();
+        if (now >= end) {
+            break;
+        }
+
+        for (size_t i = 0; i < w->viewer_count; ++i) {
+            viewer_t *v = &w->viewers[i];
+            switch (v->state) {
+            case VIEWER_IDLE:
+                if (now >= v->initial_sent_us) {
+                    v->first_initial_us = now;
+                    v->initial_sent_us = now;
+                    send_control(w, v, QUIC_FLAG_INITIAL, 0);
+                    v->state = VIEWER_INITIAL_SENT;
+                }
+                break;
+            case VIEWER_INITIAL_SENT:
+                if (now - v->initial_sent_us >= LOADGEN_INITIAL_RTO_US) {
+                    if (v->initial_retries >= LOADGEN_INITIAL_RETRIES) {
+                        v->state = VIEWER_FAILED;
+                        w->setup_failed++;
+                    } else {
+                        v->initial_retries++;
+                        v->initial_sent_us = now;
+                        send_control(w, v, QUIC_FLAG_INITIAL, 0);
+                    }
+                }
+                break;
+            case VIEWER_CONNECTED:
+                if (v->chunk_active && now - v->chunk_requested_us > cfg->chunk_timeout_us) {
+                    v->chunk_active = 0;
+                    w->chunks_timed_out++;
+                }
+                if (cfg->use_ws && w->ws_fd >= 0 && !v->chunk_active && now >= v->next_chunk_us) {
+                    v->next_chunk_us += cfg->chunk_interval_us;
+                    if (v->next_chunk_us < now) {
+                        v->next_chunk_us = now + cfg->chunk_interval_us;
+                    }
+                    request_chunk(w, i, now);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        struct pollfd pfds[2];
+        nfds_t nfds = 0;
+        pfds[nfds].fd = w->udp_fd;
+        pfds[nfds].events = POLLIN;
+        nfds++;
+        if (w->ws_fd >= 0) {
+            pfds[nfds].fd = w->ws_fd;
+            pfds[nfds].events = POLLIN;
+            nfds++;
+        }
+        if (poll(pfds, nfds, 2) < 0 && errno != EINTR) {
+            perror("[loadgen] poll");
+            break;
+        }
+        if (nfds > 1 && (pfds[1].revents & POLLIN)) {
+            poll_ws(w);
+        }
+        if (pfds[0].revents & POLLIN) {
+            for (int i = 0; i < LOADGEN_RECV_BATCH; ++i) {
+                uint8_t control[CMSG_SPACE(sizeof(int))];
+                struct iovec iov = {.iov_base = buffer, .iov_len = sizeof(buffer)};
+                struct msghdr msg = {
+                    .msg_iov = &iov,
+                    .msg_iovlen = 1,
+                    .msg_control = control,
+                    .msg_controllen = sizeof(control),
+                };
+                ssize_t n = recvmsg(w->udp_fd, &msg, MSG_DONTWAIT);
+                if (n <= 0) {
+                    break;
+                }
+                uint8_t ecn = QUIC_ECN_NOT_ECT;
+                for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+                        ecn = *(const uint8_t *)CMSG_DATA(cmsg) & QUIC_ECN_MASK;
+                    }
+                }
+                handle_datagram(w, buffer, (size_t)n, ecn, now_us());
+            }
+        }
+    }
+
+    for (size_t i = 0; i < w->viewer_count; ++i) {
+        if (w->viewers[i].state == VIEWER_CONNECTED) {
+            send_control(w, &w->viewers[i], QUIC_FLAG_CLOSE, 0);
+        } else if (w->viewers[i].state == VIEWER_INITIAL_SENT) {
+            w->setup_failed++;
+        }
+    }
+    return NULL;
+}
+
+static int parse_ipv4(const char *ip, uint16_t port, struct sockaddr_in *out) {
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(port);
+    return inet_pton(AF_INET, ip, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --server IP            server address (default 127.0.0.1)\n"
+            "  --quic-port PORT       QUIC UDP port (default 9443)\n"
+            "  --ws-port PORT         WebSocket control port (default 8080)\n"
+            "  --no-ws                handshake-only load, no chunk requests\n"
+            "  --fec                  decode REPAIR packets (server started with QUIC_FEC)\n"
+            "  --viewers N            emulated viewers (default 1000)\n"
+            "  --threads N            worker threads (default 4)\n"
+            "  --video-id ID          video to request chunks from (default 1)\n"
+            "  --bitrate KBPS         viewer bitrate (default 3000)\n"
+            "  --interval-ms MS       chunk request interval (default 1000)\n"
+            "  --chunk-timeout-ms MS  give up on a chunk after MS (default 5000)\n"
+            "  --ramp-sec SEC         spread connection setup over SEC (default 2)\n"
+            "  --duration SEC         steady-state duration after ramp (default 30)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *server_ip = "127.0.0.1";
+    uint16_t quic_port = 9443;
+    uint16_t ws_port = 8080;
+    size_t viewers = 1000;
+    int threads = 4;
+    uint64_t bitrate_kbps = 3000;
+    uint64_t interval_ms = 1000;
+    uint64_t chunk_timeout_ms = 5000;
+    uint64_t ramp_sec = 2;
+    uint64_t duration_sec = 30;
+    loadgen_config_t cfg = {.use_ws = 1, .video_id = 1, .stream_id = 1};
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--no-ws") == 0) {
+            cfg.use_ws = 0;
+            continue;
+        }
+        if (strcmp(opt, "--fec") == 0) {
+            cfg.use_fec = 1;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--server") == 0) {
+            server_ip = val;
+        } else if (strcmp(opt, "--quic-port") == 0) {
+            quic_port = (uint16_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--ws-port") == 0) {
+            ws_port = (uint16_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--viewers") == 0) {
+            viewers = (size_t)strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--threads") == 0) {
+            threads = (int)strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--video-id") == 0) {
+            cfg.video_id = (int)strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--bitrate") == 0) {
+            bitrate_kbps = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--interval-ms") == 0) {
+            interval_ms = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--chunk-timeout-ms") == 0) {
+            chunk_timeout_ms = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--ramp-sec") == 0) {
+            ramp_sec = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--duration") == 0) {
+            duration_sec = strtoull(val, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (threads <= 0 || threads > LOADGEN_MAX_THREADS || viewers == 0 || interval_ms == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    size_t per_thread = (viewers + (size_t)threads - 1) / (size_t)threads;
+    if (per_thread > 0xFFFFFF) {
+        fprintf(stderr, "[loadgen] too many viewers per thread (max %u)\n", 0xFFFFFFu);
+        return 1;
+    }
+    if (parse_ipv4(server_ip, quic_port, &cfg.quic_addr) != 0 || parse_ipv4(server_ip, ws_port, &cfg.ws_addr) != 0) {
+        fprintf(stderr, "[loadgen] invalid --server address\n");
+        return 1;
+    }
+    uint64_t chunk_bytes = bitrate_kbps * 1000ULL / 8ULL * interval_ms / 1000ULL;
+    uint64_t max_chunk = (uint64_t)QUIC_FEC_MAX_SOURCE_PAYLOAD * LOADGEN_MAX_CHUNK_PKTS;
+    if (chunk_bytes == 0 || chunk_bytes > max_chunk) {
+        fprintf(stderr, "[loadgen] bitrate*interval must give 1..%llu bytes per chunk\n", (unsigned long long)max_chunk);
+        return 1;
+    }
+    cfg.chunk_bytes = (uint32_t)chunk_bytes;
+    cfg.chunk_interval_us = interval_ms * 1000ULL;
+    cfg.chunk_timeout_us = chunk_timeout_ms * 1000ULL;
+    cfg.ramp_us = ramp_sec * 1000000ULL;
+    cfg.duration_us = duration_sec * 1000000ULL;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    worker_t *workers = calloc((size_t)threads, sizeof(*workers));
+    if (!workers) {
+        return 1;
+    }
+    uint64_t cid_base = ((uint64_t)getpid() & 0xFFFFFULL) << 40;
+    size_t assigned = 0;
+    int started = 0;
+    for (int t = 0; t < threads; ++t) {
+        worker_t *w = &workers[t];
+        w->index = t;
+        w->cfg = &cfg;
+        w->ws_fd = -1;
+        w->viewer_count = viewers - assigned < per_thread ? viewers - assigned : per_thread;
+        assigned += w->viewer_count;
+        w->viewers = calloc(w->viewer_count ? w->viewer_count : 1, sizeof(viewer_t));
+        w->ws_cap = w->viewer_count + 1;
+        w->ws_pending = calloc(w->ws_cap, sizeof(int));
+        if (!w->viewers || !w->ws_pending) {
+            fprintf(stderr, "[loadgen] out of memory\n");
+            return 1;
+        }
+        for (size_t i = 0; i < w->viewer_count; ++i) {
+            w->viewers[i].connection_id = cid_base | ((uint64_t)t << 24) | (uint64_t)i;
+            w->viewers[i].wire_id = w->viewers[i].connection_id;
+        }
+        w->udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (w->udp_fd < 0) {
+            perror("[loadgen] socket");
+            return 1;
+        }
+        int rcvbuf = 8 * 1024 * 1024;
+        setsockopt(w->udp_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        int recvtos = 1;
+        setsockopt(w->udp_fd, IPPROTO_IP, IP_RECVTOS, &recvtos, sizeof(recvtos));
+        if (cfg.use_ws && ws_connect(w) != 0) {
+            fprintf(stderr, "[loadgen][warn] thread %d: WebSocket control connection failed, handshake-only\n", t);
+        }
+    }
+
+    printf("[loadgen][info] viewers=%zu threads=%d chunk=%uB every %llums (%llukbps) ramp=%llus duration=%llus\n",
+           viewers,
+           threads,
+           cfg.chunk_bytes,
+           (unsigned long long)interval_ms,
+           (unsigned long long)bitrate_kbps,
+           (unsigned long long)ramp_sec,
+           (unsigned long long)duration_sec);
+    fflush(stdout);
+
+    uint64_t start = now_us();
+    for (int t = 0; t < threads; ++t) {
+        int rc = pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+        if (rc != 0) {
+            errno = rc;
+            perror("[loadgen] pthread_create");
+            keep_running = 0;
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; ++t) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    double elapsed = (double)(now_us() - start) / 1e6;
+
+    sample_vec_t setup = {0};
+    sample_vec_t chunks = {0};
+    worker_t total = {0};
+    for (int t = 0; t < threads; ++t) {
+        worker_t *w = &workers[t];
+        for (size_t i = 0; i < w->setup_us.count; ++i) {
+            sample_push(&setup, w->setup_us.items[i]);
+        }
+        for (size_t i = 0; i < w->chunk_us.count; ++i) {
+            sample_push(&chunks, w->chunk_us.items[i]);
+        }
+        total.setup_failed += w->setup_failed;
+        total.setup_retries += w->setup_retries;
+        total.chunks_requested += w->chunks_requested;
+        total.chunks_completed += w->chunks_completed;
+        total.chunks_timed_out += w->chunks_timed_out;
+        total.chunks_rejected += w->chunks_rejected;
+        total.packets_received += w->packets_received;
+        total.packets_duplicate += w->packets_duplicate;
+        total.packets_recovered += w->packets_recovered;
+        total.bytes_received += w->bytes_received;
+        total.acks_sent += w->acks_sent;
+        total.ecn_ce_received += w->ecn_ce_received;
+        total.rate_reports += w->rate_reports;
+        total.rate_bps_sum += w->rate_bps_sum;
+        total.routable_ids += w->routable_ids;
+    }
+
+    printf("[loadgen][result] elapsed=%.2fs connected=%zu setup_failed=%llu setup_retries=%llu\n",
+           elapsed,
+           setup.count,
+           (unsigned long long)total.setup_failed,
+           (unsigned long long)total.setup_retries);
+    print_distribution("setup_latency", &setup);
+    print_distribution("chunk_completion", &chunks);
+    double lost_chunks = (double)(total.chunks_timed_out);
+    printf("chunks requested=%llu completed=%llu timed_out=%llu rejected=%llu chunk_loss=%.3f%%\n",
+           (unsigned long long)total.chunks_requested,
+           (unsigned long long)total.chunks_completed,
+           (unsigned long long)total.chunks_timed_out,
+           (unsigned long long)total.chunks_rejected,
+           total.chunks_requested ? lost_chunks * 100.0 / (double)total.chunks_requested : 0.0);
+    printf("packets received=%llu duplicate=%llu (retransmit ratio %.3f%%) acks_sent=%llu\n",
+           (unsigned long long)total.packets_received,
+           (unsigned long long)total.packets_duplicate,
+           total.packets_received ? (double)total.packets_duplicate * 100.0 / (double)total.packets_received : 0.0,
+           (unsigned long long)total.acks_sent);
+    printf("ecn ce_marks=%llu\n", (unsigned long long)total.ecn_ce_received);
+    printf("rate reports=%llu mean_delivery_rate=%.2f Mbit/s\n",
+           (unsigned long long)total.rate_reports,
+           total.rate_reports ? (double)total.rate_bps_sum / (double)total.rate_reports / 1e6 : 0.0);
+    printf("lb routable_ids=%llu\n", (unsigned long long)total.routable_ids);
+    if (cfg.use_fec) {
+        printf("fec recovered=%llu packets\n", (unsigned long long)total.packets_recovered);
+    }
+    printf("goodput=%.2f Mbit/s (%llu bytes)\n",
+           elapsed > 0 ? (double)total.bytes_received * 8.0 / elapsed / 1e6 : 0.0,
+           (unsigned long long)total.bytes_received);
+
+    for (int t = 0; t < threads; ++t) {
+        worker_t *w = &workers[t];
+        if (w->ws_fd >= 0) {
+            close(w->ws_fd);
+        }
+        close(w->udp_fd);
+        for (size_t i = 0; i < w->viewer_count; ++i) {
+            quic_fec_decoder_destroy(w->viewers[i].fec);
+        }
+        free(w->viewers);
+        free(w->ws_pending);
+        free(w->setup_us.items);
+        free(w->chunk_us.items);
+    }
+    free(setup.items);
+    free(chunks.items);
+    free(workers);
+    return 0;
+}
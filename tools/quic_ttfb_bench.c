@@ -0,0 +1,535 @@
+/* Playback time-to-first-byte: full handshake vs 0-RTT resumption.
+ *
+ * Alternates two kinds of session against a running server, each on a fresh
+ * UDP socket and connection id:
+ *   full   INITIAL -> HANDSHAKE|ACK -> HANDSHAKE, WebSocket stream_start;
+ *          stream_chunk once both the reply and the ticket (the server's
+ *          CONNECTED confirmation) are in, first DATA
+ *   0-RTT  INITIAL carrying the last ticket plus a WS_EARLY_REQUEST_SIZE
+ *          request, first DATA
+ * and reports time to the first DATA packet and to the complete first chunk.
+ * The WebSocket control connection stays open across sessions, so the full
+ * path is measured without its TCP/upgrade cost.  Run behind udp_impair
+ * --delay to see the effect of RTT. */
+#define _POSIX_C_SOURCE 200809L
+
+#include "server/quic.h"
+#include "server/websocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TTFB_WS_BUF         65536
+#define TTFB_MAX_PACKETS    1024
+#define TTFB_STREAM_ID      1
+
+typedef struct {
+    struct sockaddr_in quic_addr;
+    struct sockaddr_in ws_addr;
+    int video_id;
+    uint32_t first_bytes;
+    uint64_t timeout_us;
+} ttfb_config_t;
+
+typedef struct {
+    const ttfb_config_t *cfg;
+    int ws_fd;
+    uint8_t ws_buf[TTFB_WS_BUF];
+    size_t ws_len;
+    uint8_t ticket[QUIC_TICKET_SIZE];
+    int have_ticket;
+} ttfb_bench_t;
+
+typedef struct {
+    uint64_t *items;
+    size_t count;
+} sample_vec_t;
+
+typedef struct {
+    sample_vec_t ttfb;
+    sample_vec_t chunk;
+    unsigned sessions;
+    unsigned resumed;
+    unsigned retried; /* server was over its retry threshold: one extra round trip */
+    unsigned failed;
+} mode_stats_t;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double percentile_ms(sample_vec_t *vec, double p) {
+    if (vec->count == 0) {
+        return 0.0;
+    }
+    qsort(vec->items, vec->count, sizeof(vec->items[0]), cmp_u64);
+    size_t idx = (size_t)(p / 100.0 * (double)(vec->count - 1));
+    return (double)vec->items[idx] / 1000.0;
+}
+
+static int ws_write_all(int fd, const void *buf, size_t len) {
+    const uint8_t *ptr = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        ptr += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int ws_send_text(ttfb_bench_t *b, const char *text, size_t len) {
+    uint8_t frame[512];
+    static const uint8_t mask[4] = {0x5A, 0xA5, 0x3C, 0xC3};
+    size_t hlen = 2;
+    if (len > sizeof(frame) - 8) {
+        return -1;
+    }
+    frame[0] = 0x81;
+    if (len <= 125) {
+        frame[1] = 0x80 | (uint8_t)len;
+    } else {
+        frame[1] = 0x80 | 126;
+        frame[2] = (uint8_t)(len >> 8);
+        frame[3] = (uint8_t)(len & 0xFF);
+        hlen = 4;
+    }
+    memcpy(frame + hlen, mask, 4);
+    for (size_t i = 0; i < len; ++i) {
+        frame[hlen + 4 + i] = (uint8_t)text[i] ^ mask[i % 4];
+    }
+    return ws_write_all(b->ws_fd, frame, hlen + 4 + len);
+}
+
+static int ws_connect(ttfb_bench_t *b) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("[ttfb] socket");
+        return -1;
+    }
+    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    /* Browsers disable Nagle; without this the stream_chunk request can sit
+     * behind a delayed ACK and the full path pays ~40 ms for nothing. */
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (const struct sockaddr *)&b->cfg->ws_addr, sizeof(b->cfg->ws_addr)) != 0) {
+        perror("[ttfb] ws connect");
+        close(fd);
+        return -1;
+    }
+    const char *req =
+        "GET /ttfb HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "\r\n";
+    if (ws_write_all(fd, req, strlen(req)) != 0) {
+        close(fd);
+        return -1;
+    }
+    /* Consume the 101 response byte by byte so no frame bytes are swallowed. */
+    char tail[4] = {0};
+    for (size_t total = 0; total < 4096; ++total) {
+        char c;
+        if (recv(fd, &c, 1, 0) != 1) {
+            break;
+        }
+        memmove(tail, tail + 1, 3);
+        tail[3] = c;
+        if (memcmp(tail, "\r\n\r\n", 4) == 0) {
+            b->ws_fd = fd;
+            return 0;
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+static int contains(const char *hay, size_t hay_len, const char *needle) {
+    size_t n = strlen(needle);
+    for (size_t i = 0; i + n <= hay_len; ++i) {
+        if (memcmp(hay + i, needle, n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Reads whatever is available; returns 1 once a stream_start reply was seen. */
+static int ws_poll_stream_start(ttfb_bench_t *b) {
+    ssize_t n = recv(b->ws_fd, b->ws_buf + b->ws_len, sizeof(b->ws_buf) - b->ws_len, MSG_DONTWAIT);
+    if (n <= 0) {
+        return 0;
+    }
+    b->ws_len += (size_t)n;
+    int seen = 0;
+    size_t pos = 0;
+    while (b->ws_len - pos >= 2) {
+        uint8_t *hdr = b->ws_buf + pos;
+        uint64_t plen = hdr[1] & 0x7F;
+        size_t hlen = 2;
+        if (plen == 126) {
+            if (b->ws_len - pos < 4) {
+                break;
+            }
+            plen = ((uint64_t)hdr[2] << 8) | hdr[3];
+            hlen = 4;
+        } else if (plen == 127) {
+            if (b->ws_len - pos < 10) {
+                break;
+            }
+            plen = 0;
+            for (int i = 0; i < 8; ++i) {
+                plen = (plen << 8) | hdr[2 + i];
+            }
+            hlen = 10;
+        }
+        if (plen > sizeof(b->ws_buf) - hlen) {
+            /* Not a reply we wait for; drop the buffer rather than stall. */
+            b->ws_len = 0;
+            return seen;
+        }
+        if (b->ws_len - pos < hlen + plen) {
+            break;
+        }
+        if ((hdr[0] & 0x0F) == 0x1 && contains((const char *)hdr + hlen, (size_t)plen, "\"type\":\"stream_start\"")) {
+            seen = 1;
+        }
+        pos += hlen + (size_t)plen;
+    }
+    memmove(b->ws_buf, b->ws_buf + pos, b->ws_len - pos);
+    b->ws_len -= pos;
+    return seen;
+}
+
+static int send_packet(int fd, const quic_packet_t *packet) {
+    uint8_t buffer[QUIC_HEADER_SIZE + QUIC_RETRY_TOKEN_SIZE + QUIC_TICKET_SIZE + WS_EARLY_REQUEST_SIZE];
+    size_t len = 0;
+    if (quic_packet_serialize(packet, buffer, sizeof(buffer), &len) != 0) {
+        return -1;
+    }
+    return send(fd, buffer, len, 0) == (ssize_t)len ? 0 : -1;
+}
+
+static void put_be32(uint8_t *out, uint32_t value) {
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+}
+
+/* One playback start; returns 0 when the whole first chunk arrived. */
+static int run_session(ttfb_bench_t *b, int zero_rtt, uint64_t cid, mode_stats_t *stats) {
+    const ttfb_config_t *cfg = b->cfg;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0 || connect(fd, (const struct sockaddr *)&cfg->quic_addr, sizeof(cfg->quic_addr)) != 0) {
+        perror("[ttfb] udp socket");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    /* The first chunk arrives as one burst; a default-sized buffer drops part of it. */
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    uint64_t t0 = now_us();
+    uint8_t early[QUIC_TICKET_SIZE + WS_EARLY_REQUEST_SIZE];
+    quic_packet_t initial = {
+        .flags = QUIC_FLAG_INITIAL,
+        .connection_id = cid,
+        .packet_number = 0,
+    };
+    if (zero_rtt && b->have_ticket) {
+        memcpy(early, b->ticket, QUIC_TICKET_SIZE);
+        put_be32(early + QUIC_TICKET_SIZE, (uint32_t)cfg->video_id);
+        put_be32(early + QUIC_TICKET_SIZE + 4, TTFB_STREAM_ID);
+        put_be32(early + QUIC_TICKET_SIZE + 8, cfg->first_bytes);
+        put_be32(early + QUIC_TICKET_SIZE + 12, 0);
+        initial.length = sizeof(early);
+        initial.payload = early;
+        b->have_ticket = 0; /* single use */
+    }
+    send_packet(fd, &initial);
+
+    uint32_t seen_offsets[TTFB_MAX_PACKETS];
+    size_t seen_count = 0;
+    uint32_t received = 0;
+    uint64_t first_byte_us = 0;
+    uint64_t chunk_us = 0;
+    int waiting_start = 0;
+    int start_ok = 0;
+    int confirmed = 0;
+    int chunk_requested = 0;
+    uint64_t deadline = t0 + cfg->timeout_us;
+    uint8_t buffer[QUIC_MAX_PACKET_SIZE];
+
+    while (now_us() < deadline && (chunk_us == 0 || !b->have_ticket)) {
+        /* Asking before the HANDSHAKE has landed races the server into
+         * chunk-send-failed, so the full path waits for its ticket too. */
+        if (start_ok && confirmed && !chunk_requested) {
+            chunk_requested = 1;
+            char cmd[256];
+            int len = snprintf(cmd,
+                               sizeof(cmd),
+                               "{\"type\":\"stream_chunk\",\"video_id\":%d,\"offset\":0,\"length\":%u,"
+                               "\"connection_id\":%llu,\"stream_id\":%u}",
+                               cfg->video_id,
+                               cfg->first_bytes,
+                               (unsigned long long)cid,
+                               TTFB_STREAM_ID);
+            ws_send_text(b, cmd, (size_t)len);
+        }
+        struct pollfd pfds[2] = {{.fd = fd, .events = POLLIN}, {.fd = b->ws_fd, .events = POLLIN}};
+        if (poll(pfds, 2, 5) < 0 && errno != EINTR) {
+            break;
+        }
+        if (pfds[1].revents & POLLIN) {
+            int seen = ws_poll_stream_start(b); /* also drains stream_chunk replies */
+            if (waiting_start && seen) {
+                waiting_start = 0;
+                start_ok = 1;
+            }
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
+        for (;;) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n <= 0) {
+                break;
+            }
+            uint64_t now = now_us();
+            quic_packet_t packet;
+            if (quic_packet_deserialize(&packet, buffer, (size_t)n) != 0 || packet.connection_id != cid) {
+                continue;
+            }
+            if (packet.flags == QUIC_FLAG_RETRY && packet.length == QUIC_RETRY_TOKEN_SIZE) {
+                /* Same INITIAL again, with the token in front. */
+                uint8_t retried[QUIC_RETRY_TOKEN_SIZE + sizeof(early)];
+                memcpy(retried, packet.payload, QUIC_RETRY_TOKEN_SIZE);
+                if (initial.length > 0) {
+                    memcpy(retried + QUIC_RETRY_TOKEN_SIZE, initial.payload, initial.length);
+                }
+                quic_packet_t again = initial;
+                again.offset = QUIC_RETRY_TOKEN_SIZE;
+                again.length = QUIC_RETRY_TOKEN_SIZE + initial.length;
+                again.payload = retried;
+                send_packet(fd, &again);
+                stats->retried++;
+            } else if (packet.flags == (QUIC_FLAG_HANDSHAKE | QUIC_FLAG_ACK)) {
+                if (packet.offset == QUIC_RESUME_ACCEPTED) {
+                    stats->resumed++;
+                    continue;
+                }
+                /* Full handshake, or the ticket was refused: fall back to the WebSocket path. */
+                quic_packet_t hs = {.flags = QUIC_FLAG_HANDSHAKE, .connection_id = cid, .packet_number = 1};
+                send_packet(fd, &hs);
+                char cmd[128];
+                int len = snprintf(cmd, sizeof(cmd), "{\"type\":\"stream_start\",\"video_id\":%d}", cfg->video_id);
+                ws_send_text(b, cmd, (size_t)len);
+                waiting_start = 1;
+            } else if (packet.flags == QUIC_FLAG_HANDSHAKE && packet.length == QUIC_TICKET_PAYLOAD) {
+                memcpy(b->ticket, packet.payload, QUIC_TICKET_SIZE);
+                b->have_ticket = 1;
+                confirmed = 1;
+            } else if ((packet.flags & QUIC_FLAG_DATA) && !(packet.flags & QUIC_FLAG_ACK)) {
+                quic_packet_t ack = {
+                    .flags = QUIC_FLAG_ACK,
+                    .connection_id = cid,
+                    .packet_number = packet.packet_number,
+                    .stream_id = packet.stream_id,
+                    .offset = packet.offset,
+                };
+                send_packet(fd, &ack);
+                if (packet.stream_id != TTFB_STREAM_ID) {
+                    continue;
+                }
+                if (first_byte_us == 0) {
+                    first_byte_us = now - t0;
+                }
+                int dup = 0;
+                for (size_t i = 0; i < seen_count; ++i) {
+                    if (seen_offsets[i] == packet.offset) {
+                        dup = 1;
+                        break;
+                    }
+                }
+                if (dup || seen_count >= TTFB_MAX_PACKETS) {
+                    continue;
+                }
+                seen_offsets[seen_count++] = packet.offset;
+                received += packet.length;
+                if (chunk_us == 0 && received >= cfg->first_bytes) {
+                    chunk_us = now - t0;
+                }
+            }
+        }
+    }
+
+    quic_packet_t close_pkt = {.flags = QUIC_FLAG_CLOSE, .connection_id = cid};
+    send_packet(fd, &close_pkt);
+    close(fd);
+
+    stats->sessions++;
+    if (chunk_us == 0) {
+        stats->failed++;
+        return -1;
+    }
+    stats->ttfb.items[stats->ttfb.count++] = first_byte_us;
+    stats->chunk.items[stats->chunk.count++] = chunk_us;
+    return 0;
+}
+
+static void print_stats(const char *name, mode_stats_t *stats) {
+    printf("[ttfb][result] mode=%s sessions=%u resumed=%u retried=%u failed=%u "
+           "ttfb_ms p50=%.2f p90=%.2f max=%.2f first_chunk_ms p50=%.2f p90=%.2f\n",
+           name,
+           stats->sessions,
+           stats->resumed,
+           stats->retried,
+           stats->failed,
+           percentile_ms(&stats->ttfb, 50.0),
+           percentile_ms(&stats->ttfb, 90.0),
+           percentile_ms(&stats->ttfb, 100.0),
+           percentile_ms(&stats->chunk, 50.0),
+           percentile_ms(&stats->chunk, 90.0));
+}
+
+static int parse_ipv4(const char *ip, uint16_t port, struct sockaddr_in *out) {
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons(port);
+    return inet_pton(AF_INET, ip, &out->sin_addr) == 1 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --server IP          server address (default 127.0.0.1)\n"
+            "  --quic-port PORT     QUIC UDP port (default 9443)\n"
+            "  --ws-port PORT       WebSocket control port (default 8080)\n"
+            "  --video-id ID        video to start (default 1)\n"
+            "  --first-bytes N      size of the first chunk (default 262144)\n"
+            "  --sessions N         sessions per mode (default 20)\n"
+            "  --timeout-ms MS      give up on a session after MS (default 3000)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *server_ip = "127.0.0.1";
+    uint16_t quic_port = 9443;
+    uint16_t ws_port = 8080;
+    unsigned sessions = 20;
+    uint64_t timeout_ms = 3000;
+    ttfb_config_t cfg = {.video_id = 1, .first_bytes = 256 * 1024};
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--server") == 0) {
+            server_ip = val;
+        } else if (strcmp(opt, "--quic-port") == 0) {
+            quic_port = (uint16_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--ws-port") == 0) {
+            ws_port = (uint16_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--video-id") == 0) {
+            cfg.video_id = (int)strtol(val, NULL, 10);
+        } else if (strcmp(opt, "--first-bytes") == 0) {
+            cfg.first_bytes = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--sessions") == 0) {
+            sessions = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--timeout-ms") == 0) {
+            timeout_ms = strtoull(val, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (sessions == 0 || cfg.first_bytes == 0 || (uint64_t)cfg.first_bytes > (uint64_t)TTFB_MAX_PACKETS * QUIC_MAX_PAYLOAD ||
+        parse_ipv4(server_ip, quic_port, &cfg.quic_addr) != 0 || parse_ipv4(server_ip, ws_port, &cfg.ws_addr) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.timeout_us = timeout_ms * 1000ULL;
+
+    ttfb_bench_t bench = {.cfg = &cfg, .ws_fd = -1};
+    if (ws_connect(&bench) != 0) {
+        fprintf(stderr, "[ttfb] cannot open WebSocket control connection\n");
+        return 1;
+    }
+
+    mode_stats_t full = {0};
+    mode_stats_t resumed = {0};
+    full.ttfb.items = calloc(sessions, sizeof(uint64_t));
+    full.chunk.items = calloc(sessions, sizeof(uint64_t));
+    resumed.ttfb.items = calloc(sessions, sizeof(uint64_t));
+    resumed.chunk.items = calloc(sessions, sizeof(uint64_t));
+    if (!full.ttfb.items || !full.chunk.items || !resumed.ttfb.items || !resumed.chunk.items) {
+        fprintf(stderr, "[ttfb] out of memory\n");
+        return 1;
+    }
+
+    /* Interleave so both modes see the same server and network conditions;
+     * every session leaves a fresh ticket for the next 0-RTT attempt. */
+    uint64_t cid_base = (now_us() & 0xFFFFFFFFULL) << 24;
+    for (unsigned s = 0; s < sessions; ++s) {
+        run_session(&bench, 0, cid_base + s * 2, &full);
+        if (!bench.have_ticket) {
+            fprintf(stderr, "[ttfb][warn] no resumption ticket after session %u\n", s);
+        }
+        run_session(&bench, 1, cid_base + s * 2 + 1, &resumed);
+    }
+
+    printf("[ttfb] video=%d first_bytes=%u sessions=%u\n", cfg.video_id, cfg.first_bytes, sessions);
+    print_stats("full", &full);
+    print_stats("0rtt", &resumed);
+    double full_p50 = percentile_ms(&full.ttfb, 50.0);
+    double resumed_p50 = percentile_ms(&resumed.ttfb, 50.0);
+    if (full_p50 > 0.0 && resumed_p50 > 0.0) {
+        printf("[ttfb][result] 0rtt saves %.2f ms at p50 (%.0f%%)\n",
+               full_p50 - resumed_p50,
+               (full_p50 - resumed_p50) * 100.0 / full_p50);
+    }
+
+    close(bench.ws_fd);
+    free(full.ttfb.items);
+    free(full.chunk.items);
+    free(resumed.ttfb.items);
+    free(resumed.chunk.items);
+    return full.failed + resumed.failed == 0 ? 0 : 1;
+}
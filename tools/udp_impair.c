@@ -0,0 +1,662 @@
+/* UDP impairment relay for local QUIC benchmarks.
+ *
+ * Sits between a QUIC client and ott_server's UDP port and applies loss,
+ * Gilbert-Elliott burst loss, delay, jitter, reordering and a bandwidth cap
+ * per direction, without needing tc/netem privileges.  Each client address is
+ * a flow with its own upstream socket so replies can be mapped back.  ECN bits
+ * are carried through, and with --ecn-mark-ms the rate queue marks ECT packets
+ * CE once they have waited too long, like an AQM router would. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RELAY_MAX_FLOWS      256
+#define RELAY_MAX_DATAGRAM   65536
+#define RELAY_FLOW_IDLE_SEC  60
+#define RELAY_HEAP_INITIAL   1024
+/* The server bursts whole chunks; a default-sized socket buffer would drop
+ * them in the kernel before the impairment model ever sees them. */
+#define RELAY_SOCKET_BUFFER  (4 * 1024 * 1024)
+#define RELAY_ECN_MASK       0x03
+#define RELAY_ECN_CE         0x03
+
+enum { DIR_UP = 0, DIR_DOWN = 1, DIR_COUNT = 2 };
+
+typedef struct {
+    double loss_pct;
+    double burst_enter_pct; /* good -> bad transition probability per packet */
+    double burst_exit_pct;  /* bad -> good transition probability per packet */
+    double burst_loss_pct;  /* loss probability while in the bad state */
+    uint32_t delay_ms;
+    uint32_t jitter_ms;
+    double reorder_pct;
+    uint32_t reorder_gap_ms;
+    uint64_t rate_kbps; /* 0 = unlimited */
+    uint32_t queue_ms;  /* drop-tail limit of the rate queue */
+    uint32_t ecn_mark_ms; /* CE-mark ECT packets queued longer than this; 0 = off */
+} impair_config_t;
+
+typedef struct {
+    uint64_t pkts_in;
+    uint64_t bytes_in;
+    uint64_t pkts_out;
+    uint64_t bytes_out;
+    uint64_t drop_random;
+    uint64_t drop_burst;
+    uint64_t drop_queue;
+    uint64_t reordered;
+    uint64_t ce_marked;
+    uint64_t delay_sum_us;
+    uint64_t delay_max_us;
+} dir_stats_t;
+
+typedef struct {
+    int in_use;
+    int upstream_fd;
+    struct sockaddr_in client;
+    time_t last_seen;
+    dir_stats_t stats[DIR_COUNT];
+} flow_t;
+
+typedef struct {
+    int burst_bad;
+    uint64_t link_free_us; /* serialization: when the capped link drains */
+} dir_state_t;
+
+typedef struct {
+    uint64_t release_us;
+    uint64_t enqueued_us;
+    uint64_t seq;
+    int flow;
+    int dir;
+    uint8_t ecn;
+    size_t len;
+    uint8_t *data;
+} delayed_pkt_t;
+
+typedef struct {
+    delayed_pkt_t *items;
+    size_t count;
+    size_t cap;
+} pkt_heap_t;
+
+static volatile sig_atomic_t keep_running = 1;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static void handle_signal(int signo) {
+    (void)signo;
+    keep_running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static uint64_t rng_next(void) {
+    /* xorshift64*: cheap and reproducible with --seed */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static int rng_chance(double pct) {
+    if (pct <= 0.0) {
+        return 0;
+    }
+    if (pct >= 100.0) {
+        return 1;
+    }
+    return (double)(rng_next() >> 11) / (double)(1ULL << 53) * 100.0 < pct;
+}
+
+static int heap_less(const delayed_pkt_t *a, const delayed_pkt_t *b) {
+    if (a->release_us != b->release_us) {
+        return a->release_us < b->release_us;
+    }
+    return a->seq < b->seq;
+}
+
+static int heap_push(pkt_heap_t *heap, const delayed_pkt_t *pkt) {
+    if (heap->count == heap->cap) {
+        size_t new_cap = heap->cap ? heap->cap * 2 : RELAY_HEAP_INITIAL;
+        delayed_pkt_t *items = realloc(heap->items, new_cap * sizeof(*items));
+        if (!items) {
+            return -1;
+        }
+        heap->items = items;
+        heap->cap = new_cap;
+    }
+    size_t i = heap->count++;
+    heap->items[i] = *pkt;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!heap_less(&heap->items[i], &heap->items[parent])) {
+            break;
+        }
+        delayed_pkt_t tmp = heap->items[i];
+        heap->items[i] = heap->items[parent];
+        heap->items[parent] = tmp;
+        i = parent;
+    }
+    return 0;
+}
+
+static void heap_pop(pkt_heap_t *heap, delayed_pkt_t *out) {
+    *out = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+    size_t i = 0;
+    while (1) {
+        size_t l = 2 * i + 1;
+        size_t r = l + 1;
+        size_t smallest = i;
+        if (l < heap->count && heap_less(&heap->items[l], &heap->items[smallest])) {
+            smallest = l;
+        }
+        if (r < heap->count && heap_less(&heap->items[r], &heap->items[smallest])) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            break;
+        }
+        delayed_pkt_t tmp = heap->items[i];
+        heap->items[i] = heap->items[smallest];
+        heap->items[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+static int parse_host_port(const char *arg, struct sockaddr_in *out) {
+    char host[64];
+    const char *colon = strrchr(arg, ':');
+    if (!colon || (size_t)(colon - arg) >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, arg, (size_t)(colon - arg));
+    host[colon - arg] = '\0';
+    long port = strtol(colon + 1, NULL, 10);
+    if (port <= 0 || port > 65535) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    out->sin_family = AF_INET;
+    out->sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &out->sin_addr) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+static void format_addr(const struct sockaddr_in *addr, char *out, size_t out_size) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+    snprintf(out, out_size, "%s:%u", ip, (unsigned int)ntohs(addr->sin_port));
+}
+
+static void print_flow_stats(const flow_t *flow, const char *reason) {
+    static const char *dir_names[DIR_COUNT] = {"up", "down"};
+    char client[64];
+    format_addr(&flow->client, client, sizeof(client));
+    for (int d = 0; d < DIR_COUNT; ++d) {
+        const dir_stats_t *s = &flow->stats[d];
+        double avg_ms = s->pkts_out ? (double)s->delay_sum_us / (double)s->pkts_out / 1000.0 : 0.0;
+        printf("[relay][%s] flow=%s dir=%s pkts_in=%llu bytes_in=%llu pkts_out=%llu bytes_out=%llu "
+               "drop_random=%llu drop_burst=%llu drop_queue=%llu reordered=%llu ce_marked=%llu avg_delay_ms=%.2f max_delay_ms=%.2f\n",
+               reason,
+               client,
+               dir_names[d],
+               (unsigned long long)s->pkts_in,
+               (unsigned long long)s->bytes_in,
+               (unsigned long long)s->pkts_out,
+               (unsigned long long)s->bytes_out,
+               (unsigned long long)s->drop_random,
+               (unsigned long long)s->drop_burst,
+               (unsigned long long)s->drop_queue,
+               (unsigned long long)s->reordered,
+               (unsigned long long)s->ce_marked,
+               avg_ms,
+               (double)s->delay_max_us / 1000.0);
+    }
+    fflush(stdout);
+}
+
+static int find_flow(flow_t *flows, const struct sockaddr_in *client) {
+    for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+        if (flows[i].in_use &&
+            flows[i].client.sin_addr.s_addr == client->sin_addr.s_addr &&
+            flows[i].client.sin_port == client->sin_port) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int open_flow(flow_t *flows, const struct sockaddr_in *client) {
+    for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+        if (flows[i].in_use) {
+            continue;
+        }
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            perror("[relay] socket");
+            return -1;
+        }
+        int sockbuf = RELAY_SOCKET_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
+        int on = 1;
+        setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &on, sizeof(on));
+        memset(&flows[i], 0, sizeof(flows[i]));
+        flows[i].in_use = 1;
+        flows[i].upstream_fd = fd;
+        flows[i].client = *client;
+        flows[i].last_seen = time(NULL);
+        return i;
+    }
+    return -1;
+}
+
+static void close_flow(flow_t *flow, const char *reason) {
+    print_flow_stats(flow, reason);
+    close(flow->upstream_fd);
+    flow->upstream_fd = -1;
+    flow->in_use = 0;
+}
+
+/* Decide the fate of one datagram: drop it or schedule its release time. */
+static void impair_packet(const impair_config_t *cfg,
+                          dir_state_t *dir_state,
+                          dir_stats_t *stats,
+                          pkt_heap_t *heap,
+                          uint64_t *seq,
+                          int flow_idx,
+                          int dir,
+                          uint8_t ecn,
+                          const uint8_t *data,
+                          size_t len) {
+    uint64_t now = now_us();
+    stats->pkts_in++;
+    stats->bytes_in += len;
+
+    if (cfg->burst_enter_pct > 0.0) {
+        if (dir_state->burst_bad) {
+            if (rng_chance(cfg->burst_exit_pct)) {
+                dir_state->burst_bad = 0;
+            }
+        } else if (rng_chance(cfg->burst_enter_pct)) {
+            dir_state->burst_bad = 1;
+        }
+        if (dir_state->burst_bad && rng_chance(cfg->burst_loss_pct)) {
+            stats->drop_burst++;
+            return;
+        }
+    }
+    if (rng_chance(cfg->loss_pct)) {
+        stats->drop_random++;
+        return;
+    }
+
+    uint64_t depart = now;
+    if (cfg->rate_kbps > 0) {
+        uint64_t start = dir_state->link_free_us > now ? dir_state->link_free_us : now;
+        if (cfg->queue_ms > 0 && start - now > (uint64_t)cfg->queue_ms * 1000ULL) {
+            stats->drop_queue++;
+            return;
+        }
+        if (cfg->ecn_mark_ms > 0 && ecn != 0 && ecn != RELAY_ECN_CE && start - now > (uint64_t)cfg->ecn_mark_ms * 1000ULL) {
+            ecn = RELAY_ECN_CE;
+            stats->ce_marked++;
+        }
+        /* kbps -> bits per microsecond is rate/1000 */
+        uint64_t tx_us = ((uint64_t)len * 8ULL * 1000ULL) / cfg->rate_kbps;
+        dir_state->link_free_us = start + tx_us;
+        depart = dir_state->link_free_us;
+    }
+
+    uint64_t release = depart + (uint64_t)cfg->delay_ms * 1000ULL;
+    if (cfg->jitter_ms > 0) {
+        release += rng_next() % ((uint64_t)cfg->jitter_ms * 1000ULL + 1);
+    }
+    if (rng_chance(cfg->reorder_pct)) {
+        release += (uint64_t)cfg->reorder_gap_ms * 1000ULL;
+        stats->reordered++;
+    }
+
+    uint8_t *copy = malloc(len);
+    if (!copy) {
+        stats->drop_queue++;
+        return;
+    }
+    memcpy(copy, data, len);
+    delayed_pkt_t pkt = {
+        .release_us = release,
+        .enqueued_us = now,
+        .seq = (*seq)++,
+        .flow = flow_idx,
+        .dir = dir,
+        .ecn = ecn,
+        .len = len,
+        .data = copy,
+    };
+    if (heap_push(heap, &pkt) != 0) {
+        free(copy);
+        stats->drop_queue++;
+    }
+}
+
+/* recvfrom plus the ECN bits of the IP header (needs IP_RECVTOS on fd). */
+static ssize_t recv_with_ecn(int fd, uint8_t *buf, size_t cap, struct sockaddr_in *src, uint8_t *ecn) {
+    uint8_t control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {.iov_base = buf, .iov_len = cap};
+    struct msghdr msg = {
+        .msg_name = src,
+        .msg_namelen = sizeof(*src),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    ssize_t n = recvmsg(fd, &msg, 0);
+    *ecn = 0;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); n > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+            *ecn = *(const uint8_t *)CMSG_DATA(cmsg) & RELAY_ECN_MASK;
+        }
+    }
+    return n;
+}
+
+static ssize_t send_with_ecn(int fd, const uint8_t *data, size_t len, const struct sockaddr_in *dst, uint8_t ecn) {
+    uint8_t control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+    struct msghdr msg = {
+        .msg_name = (void *)dst,
+        .msg_namelen = sizeof(*dst),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_TOS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    int tos = ecn;
+    memcpy(CMSG_DATA(cmsg), &tos, sizeof(tos));
+    return sendmsg(fd, &msg, 0);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --listen PORT          client-facing UDP port (default 9444)\n"
+            "  --upstream IP:PORT     ott_server QUIC address (default 127.0.0.1:9443)\n"
+            "  --loss PCT             random loss percent\n"
+            "  --burst-enter PCT      Gilbert-Elliott good->bad probability per packet\n"
+            "  --burst-exit PCT       bad->good probability per packet (default 30)\n"
+            "  --burst-loss PCT       loss percent in the bad state (default 100)\n"
+            "  --delay MS             one-way delay\n"
+            "  --jitter MS            uniform extra delay 0..MS\n"
+            "  --reorder PCT          percent of packets held back by --reorder-gap\n"
+            "  --reorder-gap MS       hold-back for reordered packets (default 10)\n"
+            "  --rate KBPS            bandwidth cap per direction (0 = unlimited)\n"
+            "  --queue-ms MS          drop-tail limit of the rate queue (default 200)\n"
+            "  --ecn-mark-ms MS       CE-mark ECT packets queued longer than MS (needs --rate)\n"
+            "  --stats-interval SEC   periodic per-flow stats (default 5, 0 = off)\n"
+            "  --seed N               RNG seed for reproducible runs\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    impair_config_t cfg = {
+        .burst_exit_pct = 30.0,
+        .burst_loss_pct = 100.0,
+        .reorder_gap_ms = 10,
+        .queue_ms = 200,
+    };
+    uint16_t listen_port = 9444;
+    struct sockaddr_in upstream;
+    parse_host_port("127.0.0.1:9443", &upstream);
+    unsigned int stats_interval = 5;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--listen") == 0) {
+            long port = strtol(val, NULL, 10);
+            if (port <= 0 || port > 65535) {
+                fprintf(stderr, "[relay] invalid --listen port\n");
+                return 1;
+            }
+            listen_port = (uint16_t)port;
+        } else if (strcmp(opt, "--upstream") == 0) {
+            if (parse_host_port(val, &upstream) != 0) {
+                fprintf(stderr, "[relay] invalid --upstream (expected IPv4:PORT)\n");
+                return 1;
+            }
+        } else if (strcmp(opt, "--loss") == 0) {
+            cfg.loss_pct = strtod(val, NULL);
+        } else if (strcmp(opt, "--burst-enter") == 0) {
+            cfg.burst_enter_pct = strtod(val, NULL);
+        } else if (strcmp(opt, "--burst-exit") == 0) {
+            cfg.burst_exit_pct = strtod(val, NULL);
+        } else if (strcmp(opt, "--burst-loss") == 0) {
+            cfg.burst_loss_pct = strtod(val, NULL);
+        } else if (strcmp(opt, "--delay") == 0) {
+            cfg.delay_ms = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--jitter") == 0) {
+            cfg.jitter_ms = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--reorder") == 0) {
+            cfg.reorder_pct = strtod(val, NULL);
+        } else if (strcmp(opt, "--reorder-gap") == 0) {
+            cfg.reorder_gap_ms = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--rate") == 0) {
+            cfg.rate_kbps = strtoull(val, NULL, 10);
+        } else if (strcmp(opt, "--queue-ms") == 0) {
+            cfg.queue_ms = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--ecn-mark-ms") == 0) {
+            cfg.ecn_mark_ms = (uint32_t)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--stats-interval") == 0) {
+            stats_interval = (unsigned int)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--seed") == 0) {
+            rng_state = strtoull(val, NULL, 10) | 1ULL;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listen_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_fd < 0) {
+        perror("[relay] socket");
+        return 1;
+    }
+    int sockbuf = RELAY_SOCKET_BUFFER;
+    setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &sockbuf, sizeof(sockbuf));
+    int recvtos = 1;
+    setsockopt(listen_fd, IPPROTO_IP, IP_RECVTOS, &recvtos, sizeof(recvtos));
+    struct sockaddr_in bind_addr;
+    memset(&bind_addr, 0, sizeof(bind_addr));
+    bind_addr.sin_family = AF_INET;
+    bind_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind_addr.sin_port = htons(listen_port);
+    if (bind(listen_fd, (struct sockaddr *)&bind_addr, sizeof(bind_addr)) < 0) {
+        perror("[relay] bind");
+        close(listen_fd);
+        return 1;
+    }
+
+    char upstream_str[64];
+    format_addr(&upstream, upstream_str, sizeof(upstream_str));
+    printf("[relay][info] 127.0.0.1:%u -> %s loss=%.2f%% burst_enter=%.2f%% delay=%ums jitter=%ums "
+           "reorder=%.2f%% rate=%llukbps ecn_mark=%ums\n",
+           (unsigned int)listen_port,
+           upstream_str,
+           cfg.loss_pct,
+           cfg.burst_enter_pct,
+           cfg.delay_ms,
+           cfg.jitter_ms,
+           cfg.reorder_pct,
+           (unsigned long long)cfg.rate_kbps,
+           cfg.ecn_mark_ms);
+    fflush(stdout);
+
+    static flow_t flows[RELAY_MAX_FLOWS];
+    static dir_state_t dir_states[RELAY_MAX_FLOWS][DIR_COUNT];
+    pkt_heap_t heap = {0};
+    uint64_t seq = 0;
+    static uint8_t buffer[RELAY_MAX_DATAGRAM];
+    time_t last_stats = time(NULL);
+
+    while (keep_running) {
+        struct pollfd pfds[RELAY_MAX_FLOWS + 1];
+        int flow_of_pfd[RELAY_MAX_FLOWS + 1];
+        nfds_t nfds = 0;
+        pfds[nfds].fd = listen_fd;
+        pfds[nfds].events = POLLIN;
+        flow_of_pfd[nfds] = -1;
+        nfds++;
+        for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+            if (flows[i].in_use) {
+                pfds[nfds].fd = flows[i].upstream_fd;
+                pfds[nfds].events = POLLIN;
+                flow_of_pfd[nfds] = i;
+                nfds++;
+            }
+        }
+
+        int timeout_ms = 1000;
+        if (heap.count > 0) {
+            uint64_t now = now_us();
+            uint64_t next = heap.items[0].release_us;
+            timeout_ms = next <= now ? 0 : (int)((next - now + 999) / 1000);
+            if (timeout_ms > 1000) {
+                timeout_ms = 1000;
+            }
+        }
+
+        int ready = poll(pfds, nfds, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("[relay] poll");
+            break;
+        }
+
+        for (nfds_t p = 0; ready > 0 && p < nfds; ++p) {
+            if (!(pfds[p].revents & POLLIN)) {
+                continue;
+            }
+            struct sockaddr_in src;
+            uint8_t ecn = 0;
+            ssize_t n = recv_with_ecn(pfds[p].fd, buffer, sizeof(buffer), &src, &ecn);
+            if (n <= 0) {
+                continue;
+            }
+            int flow_idx = flow_of_pfd[p];
+            int dir = DIR_DOWN;
+            if (flow_idx < 0) {
+                dir = DIR_UP;
+                flow_idx = find_flow(flows, &src);
+                if (flow_idx < 0) {
+                    flow_idx = open_flow(flows, &src);
+                    if (flow_idx < 0) {
+                        fprintf(stderr, "[relay][warn] flow table full, dropping datagram\n");
+                        continue;
+                    }
+                    memset(dir_states[flow_idx], 0, sizeof(dir_states[flow_idx]));
+                }
+            }
+            flows[flow_idx].last_seen = time(NULL);
+            impair_packet(&cfg,
+                          &dir_states[flow_idx][dir],
+                          &flows[flow_idx].stats[dir],
+                          &heap,
+                          &seq,
+                          flow_idx,
+                          dir,
+                          ecn,
+                          buffer,
+                          (size_t)n);
+        }
+
+        uint64_t now = now_us();
+        while (heap.count > 0 && heap.items[0].release_us <= now) {
+            delayed_pkt_t pkt;
+            heap_pop(&heap, &pkt);
+            flow_t *flow = &flows[pkt.flow];
+            if (flow->in_use) {
+                ssize_t sent;
+                if (pkt.dir == DIR_UP) {
+                    sent = send_with_ecn(flow->upstream_fd, pkt.data, pkt.len, &upstream, pkt.ecn);
+                } else {
+                    sent = send_with_ecn(listen_fd, pkt.data, pkt.len, &flow->client, pkt.ecn);
+                }
+                if (sent == (ssize_t)pkt.len) {
+                    dir_stats_t *s = &flow->stats[pkt.dir];
+                    uint64_t delay = now - pkt.enqueued_us;
+                    s->pkts_out++;
+                    s->bytes_out += pkt.len;
+                    s->delay_sum_us += delay;
+                    if (delay > s->delay_max_us) {
+                        s->delay_max_us = delay;
+                    }
+                }
+            }
+            free(pkt.data);
+        }
+
+        time_t wall = time(NULL);
+        for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+            if (flows[i].in_use && wall - flows[i].last_seen > RELAY_FLOW_IDLE_SEC) {
+                close_flow(&flows[i], "idle");
+            }
+        }
+        if (stats_interval > 0 && (unsigned int)(wall - last_stats) >= stats_interval) {
+            last_stats = wall;
+            for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+                if (flows[i].in_use) {
+                    print_flow_stats(&flows[i], "stats");
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < RELAY_MAX_FLOWS; ++i) {
+        if (flows[i].in_use) {
+            close_flow(&flows[i], "final");
+        }
+    }
+    while (heap.count > 0) {
+        delayed_pkt_t pkt;
+        heap_pop(&heap, &pkt);
+        free(pkt.data);
+    }
+    free(heap.items);
+    close(listen_fd);
+    return 0;
+}
@@ -0,0 +1,389 @@
+/* Concurrent WebSocket viewers against the TCP server.
+ *
+ * Opens --clients connections from one epoll loop, performs the upgrade and
+ * waits for the "ready" message on each, then has every viewer send a ping
+ * once per --interval-ms for --duration seconds and records the pong round
+ * trip.  With a thread per client the server stopped at its client cap; this
+ * shows how many idle-but-open viewers it holds and how quickly it still
+ * answers them. */
+#define _GNU_SOURCE /* memmem, SOCK_NONBLOCK */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_BUF        1024
+#define BENCH_EPOLL_MAX  256
+#define BENCH_PING_TEXT  "{\"type\":\"ping\"}"
+
+typedef enum {
+    CLIENT_CONNECTING = 0,
+    CLIENT_UPGRADING,
+    CLIENT_OPEN,
+    CLIENT_FAILED
+} client_state_t;
+
+typedef struct {
+    int fd;
+    client_state_t state;
+    uint8_t buf[BENCH_BUF];
+    size_t len;
+    int header_done;
+    uint64_t ping_sent_us; /* 0 = no ping outstanding */
+    uint64_t next_ping_us;
+} client_t;
+
+typedef struct {
+    uint64_t *samples_us;
+    size_t count;
+    size_t cap;
+    uint64_t pings;
+    uint64_t pongs;
+    uint64_t late; /* ping due while the previous one was unanswered */
+} rtt_log_t;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static double percentile_ms(const uint64_t *sorted, size_t count, double p) {
+    if (count == 0) {
+        return 0.0;
+    }
+    size_t idx = (size_t)(p / 100.0 * (double)(count - 1));
+    return (double)sorted[idx] / 1000.0;
+}
+
+static void raise_fd_limit(unsigned clients) {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) != 0) {
+        return;
+    }
+    rlim_t needed = (rlim_t)clients + 64;
+    if (lim.rlim_cur < needed) {
+        lim.rlim_cur = lim.rlim_max == RLIM_INFINITY || lim.rlim_max >= needed ? needed : lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    if (lim.rlim_cur < needed) {
+        fprintf(stderr, "[ws-bench] RLIMIT_NOFILE %lu limits the run to fewer clients\n", (unsigned long)lim.rlim_cur);
+    }
+}
+
+static int send_all(int fd, const void *buf, size_t len) {
+    const uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1; /* requests are tiny; a full socket buffer means the run is broken anyway */
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_upgrade(client_t *c) {
+    static const char request[] = "GET /ws HTTP/1.1\r\n"
+                                  "Host: bench\r\n"
+                                  "Upgrade: websocket\r\n"
+                                  "Connection: Upgrade\r\n"
+                                  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                                  "Sec-WebSocket-Version: 13\r\n"
+                                  "\r\n";
+    return send_all(c->fd, request, sizeof(request) - 1);
+}
+
+static int send_ping(client_t *c) {
+    const char *text = BENCH_PING_TEXT;
+    size_t len = strlen(text);
+    uint8_t frame[6 + sizeof(BENCH_PING_TEXT)];
+    const uint8_t mask[4] = {0x11, 0x22, 0x33, 0x44};
+    frame[0] = 0x81;
+    frame[1] = (uint8_t)(0x80 | len);
+    memcpy(frame + 2, mask, 4);
+    for (size_t i = 0; i < len; ++i) {
+        frame[6 + i] = (uint8_t)text[i] ^ mask[i % 4];
+    }
+    return send_all(c->fd, frame, 6 + len);
+}
+
+/* Consumes whole server frames; returns -1 on a malformed or unexpected reply. */
+static int parse_input(client_t *c, rtt_log_t *log, unsigned *opened) {
+    size_t pos = 0;
+    if (!c->header_done) {
+        uint8_t *end = memmem(c->buf, c->len, "\r\n\r\n", 4);
+        if (!end) {
+            return c->len == sizeof(c->buf) ? -1 : 0;
+        }
+        if (c->len < 12 || memcmp(c->buf, "HTTP/1.1 101", 12) != 0) {
+            return -1;
+        }
+        c->header_done = 1;
+        pos = (size_t)(end - c->buf) + 4;
+    }
+    for (;;) {
+        if (c->len - pos < 2) {
+            break;
+        }
+        size_t payload_len = c->buf[pos + 1] & 0x7F;
+        size_t header_len = 2;
+        if (payload_len == 126) {
+            if (c->len - pos < 4) {
+                break;
+            }
+            payload_len = ((size_t)c->buf[pos + 2] << 8) | c->buf[pos + 3];
+            header_len = 4;
+        } else if (payload_len == 127) {
+            return -1;
+        }
+        if (header_len + payload_len > sizeof(c->buf)) {
+            return -1;
+        }
+        if (c->len - pos < header_len + payload_len) {
+            break;
+        }
+        const char *text = (const char *)c->buf + pos + header_len;
+        if (memmem(text, payload_len, "\"type\":\"ready\"", 14)) {
+            if (c->state == CLIENT_UPGRADING) {
+                c->state = CLIENT_OPEN;
+                (*opened)++;
+            }
+        } else if (memmem(text, payload_len, "\"type\":\"pong\"", 13) && c->ping_sent_us) {
+            uint64_t rtt = now_us() - c->ping_sent_us;
+            c->ping_sent_us = 0;
+            log->pongs++;
+            if (log->count < log->cap) {
+                log->samples_us[log->count++] = rtt;
+            }
+        }
+        pos += header_len + payload_len;
+    }
+    memmove(c->buf, c->buf + pos, c->len - pos);
+    c->len -= pos;
+    return 0;
+}
+
+static void fail_client(int epfd, client_t *c, unsigned *failed) {
+    if (c->state == CLIENT_FAILED) {
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    c->state = CLIENT_FAILED;
+    (*failed)++;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --server IP        server address (default 127.0.0.1)\n"
+            "  --port PORT        TCP/WebSocket port (default 8080)\n"
+            "  --clients N        concurrent viewers (default 10000)\n"
+            "  --ramp-sec SEC     spread connection setup over SEC (default 2)\n"
+            "  --interval-ms MS   ping interval per viewer (default 1000)\n"
+            "  --duration SEC     steady-state duration (default 10)\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *server = "127.0.0.1";
+    unsigned port = 8080;
+    unsigned clients_n = 10000;
+    unsigned ramp_sec = 2;
+    unsigned interval_ms = 1000;
+    unsigned duration_sec = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *val = argv[++i];
+        if (strcmp(opt, "--server") == 0) {
+            server = val;
+        } else if (strcmp(opt, "--port") == 0) {
+            port = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--clients") == 0) {
+            clients_n = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--ramp-sec") == 0) {
+            ramp_sec = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--interval-ms") == 0) {
+            interval_ms = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(opt, "--duration") == 0) {
+            duration_sec = (unsigned)strtoul(val, NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (clients_n == 0 || interval_ms == 0 || port == 0 || port > 65535 || inet_pton(AF_INET, server, &addr.sin_addr) != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    raise_fd_limit(clients_n);
+
+    client_t *clients = calloc(clients_n, sizeof(*clients));
+    uint64_t expected = (uint64_t)clients_n * ((uint64_t)duration_sec * 1000 / interval_ms + 1);
+    rtt_log_t log = {.cap = (size_t)expected};
+    log.samples_us = calloc(log.cap, sizeof(uint64_t));
+    int epfd = epoll_create1(0);
+    if (!clients || !log.samples_us || epfd < 0) {
+        fputs("[ws-bench] out of memory\n", stderr);
+        return 1;
+    }
+
+    unsigned started = 0;
+    unsigned opened = 0;
+    unsigned failed = 0;
+    uint64_t t0 = now_us();
+    uint64_t ramp_us = (uint64_t)ramp_sec * 1000000ULL;
+    uint64_t setup_deadline = t0 + ramp_us + 10000000ULL;
+    uint64_t steady_start = 0;
+    uint64_t steady_end = 0;
+    struct epoll_event events[BENCH_EPOLL_MAX];
+
+    for (;;) {
+        uint64_t now = now_us();
+        /* Ramp: start the connections due by now. */
+        while (started < clients_n && (ramp_us == 0 || (now - t0) * clients_n >= ramp_us * started)) {
+            client_t *c = &clients[started++];
+            c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (c->fd < 0) {
+                c->state = CLIENT_FAILED;
+                failed++;
+                continue;
+            }
+            int rc = connect(c->fd, (const struct sockaddr *)&addr, sizeof(addr));
+            if (rc != 0 && errno != EINPROGRESS) {
+                close(c->fd);
+                c->state = CLIENT_FAILED;
+                failed++;
+                continue;
+            }
+            struct epoll_event ev = {.events = EPOLLIN | EPOLLOUT, .data.ptr = c};
+            epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        }
+        if (!steady_start && started == clients_n && (opened + failed == clients_n || now >= setup_deadline)) {
+            printf("[ws-bench][setup] clients=%u open=%u failed=%u setup_ms=%.0f\n",
+                   clients_n,
+                   opened,
+                   failed,
+                   (double)(now - t0) / 1000.0);
+            fflush(stdout);
+            steady_start = now;
+            steady_end = now + (uint64_t)duration_sec * 1000000ULL;
+            /* Spread the first pings over one interval. */
+            for (unsigned i = 0; i < clients_n; ++i) {
+                clients[i].next_ping_us = now + (uint64_t)interval_ms * 1000ULL * i / clients_n;
+            }
+        }
+        if (steady_start && now >= steady_end) {
+            break;
+        }
+        if (steady_start) {
+            for (unsigned i = 0; i < clients_n; ++i) {
+                client_t *c = &clients[i];
+                if (c->state != CLIENT_OPEN || now < c->next_ping_us) {
+                    continue;
+                }
+                c->next_ping_us += (uint64_t)interval_ms * 1000ULL;
+                if (c->ping_sent_us) {
+                    log.late++;
+                    continue;
+                }
+                c->ping_sent_us = now;
+                log.pings++;
+                if (send_ping(c) != 0) {
+                    fail_client(epfd, c, &failed);
+                }
+            }
+        }
+
+        int n = epoll_wait(epfd, events, BENCH_EPOLL_MAX, 1);
+        for (int i = 0; i < n; ++i) {
+            client_t *c = (client_t *)events[i].data.ptr;
+            if (c->state == CLIENT_FAILED) {
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                fail_client(epfd, c, &failed);
+                continue;
+            }
+            if (c->state == CLIENT_CONNECTING && (events[i].events & EPOLLOUT)) {
+                struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+                epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                c->state = CLIENT_UPGRADING;
+                if (send_upgrade(c) != 0) {
+                    fail_client(epfd, c, &failed);
+                    continue;
+                }
+            }
+            if (events[i].events & EPOLLIN) {
+                ssize_t r = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+                if (r <= 0) {
+                    if (r < 0 && (errno == EAGAIN || errno == EINTR)) {
+                        continue;
+                    }
+                    fail_client(epfd, c, &failed);
+                    continue;
+                }
+                c->len += (size_t)r;
+                if (parse_input(c, &log, &opened) != 0) {
+                    fail_client(epfd, c, &failed);
+                }
+            }
+        }
+    }
+
+    unsigned still_open = 0;
+    for (unsigned i = 0; i < clients_n; ++i) {
+        if (clients[i].state == CLIENT_OPEN) {
+            still_open++;
+        }
+        if (clients[i].fd >= 0 && clients[i].state != CLIENT_FAILED) {
+            close(clients[i].fd);
+        }
+    }
+    qsort(log.samples_us, log.count, sizeof(uint64_t), cmp_u64);
+    printf("[ws-bench][result] clients=%u open_at_end=%u failed=%u pings=%llu pongs=%llu late=%llu "
+           "rtt_p50_ms=%.2f rtt_p99_ms=%.2f rtt_max_ms=%.2f\n",
+           clients_n,
+           still_open,
+           failed,
+           (unsigned long long)log.pings,
+           (unsigned long long)log.pongs,
+           (unsigned long long)log.late,
+           percentile_ms(log.samples_us, log.count, 50.0),
+           percentile_ms(log.samples_us, log.count, 99.0),
+           percentile_ms(log.samples_us, log.count, 100.0));
+    close(epfd);
+    free(log.samples_us);
+    free(clients);
+    return failed == 0 ? 0 : 2;
+}
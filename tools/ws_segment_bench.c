@@ -0,0 +1,542 @@
+/* Segment delivery cost over WebSocket, in bytes served per server CPU-second.
+ *
+ * Writes --segments fake .m4s files of --segment-kb each into a scratch
+ * data/segments/1/ directory, then for each mode forks a server process on a
+ * loopback port and has --clients viewers request segments back to back for
+ * --duration seconds ({"type":"ws_segment"} -> binary SEGM frame ->
+ * "segment-sent").  The server runs in its own process so wait4 reports only
+ * its CPU time.  Modes: cached (segments held in the segment cache as ready
+ * frames), sendfile (SEGMENT_CACHE_MB=0) and copy (also SERVER_SENDFILE=0,
+ * file bytes read through a fixed chunk per write).  With
+ * --cert/--key (TLS=1 builds) the viewers use WSS and the modes are ktls
+ * (SERVER_KTLS unset) and userspace (SERVER_KTLS=0); ktls_connections shows
+ * whether the kernel actually took over, which needs the tls module. */
+#define _GNU_SOURCE /* mkdtemp, wait4, realpath */
+
+#include "server/server.h"
+#include "server/websocket.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <limits.h>
+#include <netinet/in.h>
+#ifdef ENABLE_TLS
+#include <openssl/ssl.h>
+#endif
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_VIDEO_ID  1
+#define BENCH_SCRATCH   (64 * 1024)
+
+typedef struct {
+    int fd;
+    SSL *ssl;
+} viewer_t;
+
+typedef struct {
+    uint16_t port;
+    SSL_CTX *tls; /* NULL = plain WebSocket */
+    unsigned index;
+    unsigned segments;
+    volatile int *stop;
+    pthread_t thread;
+    uint64_t bytes;
+    uint64_t frames;
+    int failed;
+} client_t;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int write_segments(unsigned segments, size_t segment_size) {
+    if (mkdir("data", 0755) != 0 || mkdir("data/segments", 0755) != 0 || mkdir("data/segments/1", 0755) != 0) {
+        return -1;
+    }
+    uint8_t *buf = malloc(segment_size);
+    if (!buf) {
+        return -1;
+    }
+    for (size_t i = 0; i < segment_size; ++i) {
+        buf[i] = (uint8_t)(i * 131 + (i >> 9));
+    }
+    int rc = 0;
+    for (unsigned s = 0; rc == 0 && s < segments; ++s) {
+        char path[128];
+        snprintf(path, sizeof(path), "data/segments/%d/chunk-stream0-%05u.m4s", BENCH_VIDEO_ID, s);
+        FILE *fp = fopen(path, "wb");
+        if (!fp || fwrite(buf, 1, segment_size, fp) != segment_size) {
+            rc = -1;
+        }
+        if (fp) {
+            fclose(fp);
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+static void remove_segments(unsigned segments) {
+    for (unsigned s = 0; s < segments; ++s) {
+        char path[128];
+        snprintf(path, sizeof(path), "data/segments/%d/chunk-stream0-%05u.m4s", BENCH_VIDEO_ID, s);
+        unlink(path);
+    }
+    rmdir("data/segments/1");
+    rmdir("data/segments");
+    rmdir("data");
+}
+
+/* Child: serve until SIGTERM, then report stats through the pipe. */
+static void run_server(int report_fd, const char *cert, const char *key) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    websocket_context_t ws;
+    server_ctx_t server;
+    websocket_context_init(&ws, NULL, NULL);
+    uint16_t port = 0;
+    if (server_init(&server, "127.0.0.1", 0, 1024) == 0) {
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        getsockname(server.listen_fd, (struct sockaddr *)&addr, &alen);
+        port = ntohs(addr.sin_port);
+        server_set_websocket_context(&server, &ws);
+        if ((cert && server_enable_tls(&server, cert, key) != 0) || server_start(&server) != 0) {
+            port = 0;
+        }
+    }
+    if (write(report_fd, &port, sizeof(port)) != (ssize_t)sizeof(port) || port == 0) {
+        _exit(1);
+    }
+    int sig = 0;
+    sigwait(&set, &sig);
+    server_request_stop(&server);
+    server_join(&server);
+    server_stats_t stats;
+    server_get_stats(&server, &stats);
+    server_destroy(&server);
+    websocket_context_destroy(&ws);
+    _exit(write(report_fd, &stats, sizeof(stats)) == (ssize_t)sizeof(stats) ? 0 : 1);
+}
+
+static ssize_t viewer_recv(viewer_t *v, void *buf, size_t len) {
+#ifdef ENABLE_TLS
+    if (v->ssl) {
+        int n = SSL_read(v->ssl, buf, len > INT_MAX ? INT_MAX : (int)len);
+        return n > 0 ? n : -1;
+    }
+#endif
+    return recv(v->fd, buf, len, 0);
+}
+
+static int viewer_send(viewer_t *v, const void *buf, size_t len) {
+#ifdef ENABLE_TLS
+    if (v->ssl) {
+        return SSL_write(v->ssl, buf, (int)len) == (int)len ? 0 : -1;
+    }
+#endif
+    return send(v->fd, buf, len, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+static void viewer_close(viewer_t *v) {
+#ifdef ENABLE_TLS
+    if (v->ssl) {
+        SSL_free(v->ssl);
+    }
+#endif
+    if (v->fd >= 0) {
+        close(v->fd);
+    }
+    v->fd = -1;
+    v->ssl = NULL;
+}
+
+static int recv_all(viewer_t *v, void *buf, size_t len) {
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        ssize_t n = viewer_recv(v, p, len);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Reads one server message (its continuation frames too, see WS_FRAGMENT_KB),
+ * discarding the payload; returns its opcode. */
+static int recv_frame(viewer_t *v, uint8_t *scratch, uint64_t *payload_len) {
+    int opcode = -1;
+    *payload_len = 0;
+    for (;;) {
+        uint8_t header[10];
+        if (recv_all(v, header, 2) != 0) {
+            return -1;
+        }
+        if (opcode < 0) {
+            opcode = header[0] & 0x0F;
+        } else if ((header[0] & 0x0F) != 0x0) {
+            return -1;
+        }
+        uint64_t len = header[1] & 0x7F;
+        if (len == 126 || len == 127) {
+            size_t ext = len == 126 ? 2 : 8;
+            if (recv_all(v, header + 2, ext) != 0) {
+                return -1;
+            }
+            len = 0;
+            for (size_t i = 0; i < ext; ++i) {
+                len = (len << 8) | header[2 + i];
+            }
+        }
+        *payload_len += len;
+        while (len > 0) {
+            size_t part = len > BENCH_SCRATCH ? BENCH_SCRATCH : (size_t)len;
+            if (recv_all(v, scratch, part) != 0) {
+                return -1;
+            }
+            len -= part;
+        }
+        if (header[0] & 0x80) {
+            return opcode;
+        }
+    }
+}
+
+static int send_text(viewer_t *v, const char *text) {
+    size_t len = strlen(text);
+    uint8_t frame[6 + 125];
+    if (len > 125) {
+        return -1;
+    }
+    frame[0] = 0x81;
+    frame[1] = 0x80 | (uint8_t)len;
+    memset(frame + 2, 0, 4); /* zero mask key keeps the payload readable */
+    memcpy(frame + 6, text, len);
+    return viewer_send(v, frame, 6 + len);
+}
+
+static int connect_viewer(viewer_t *v, uint16_t port, SSL_CTX *tls) {
+    v->fd = socket(AF_INET, SOCK_STREAM, 0);
+    v->ssl = NULL;
+    if (v->fd < 0) {
+        return -1;
+    }
+    struct timeval tv = {.tv_sec = 5, .tv_usec = 0};
+    setsockopt(v->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(v->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        viewer_close(v);
+        return -1;
+    }
+#ifdef ENABLE_TLS
+    if (tls) {
+        v->ssl = SSL_new(tls);
+        if (!v->ssl || SSL_set_fd(v->ssl, v->fd) != 1 || SSL_connect(v->ssl) != 1) {
+            viewer_close(v);
+            return -1;
+        }
+    }
+#else
+    (void)tls;
+#endif
+    const char *upgrade = "GET /ws HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    if (viewer_send(v, upgrade, strlen(upgrade)) != 0) {
+        viewer_close(v);
+        return -1;
+    }
+    /* Response header, then the "ready" text frame. */
+    char c = 0;
+    uint32_t tail = 0;
+    while (tail != 0x0D0A0D0A) {
+        if (recv_all(v, &c, 1) != 0) {
+            viewer_close(v);
+            return -1;
+        }
+        tail = (tail << 8) | (uint8_t)c;
+    }
+    uint8_t scratch[256];
+    uint64_t len = 0;
+    if (recv_frame(v, scratch, &len) != 0x1) {
+        viewer_close(v);
+        return -1;
+    }
+    return 0;
+}
+
+static void *client_main(void *arg) {
+    client_t *client = (client_t *)arg;
+    uint8_t *scratch = malloc(BENCH_SCRATCH);
+    viewer_t v = {.fd = -1, .ssl = NULL};
+    if (!scratch || connect_viewer(&v, client->port, client->tls) != 0) {
+        client->failed = 1;
+        free(scratch);
+        return NULL;
+    }
+    unsigned next = client->index % client->segments; /* spread start points */
+    while (!*client->stop) {
+        char req[128];
+        snprintf(req, sizeof(req), "{\"type\":\"ws_segment\",\"video_id\":%d,\"segment\":%u}", BENCH_VIDEO_ID, next);
+        next = (next + 1) % client->segments;
+        uint64_t len = 0;
+        if (send_text(&v, req) != 0 || recv_frame(&v, scratch, &len) != 0x2) {
+            client->failed = 1;
+            break;
+        }
+        client->bytes += len;
+        client->frames++;
+        if (recv_frame(&v, scratch, &len) != 0x1) {
+            client->failed = 1;
+            break;
+        }
+    }
+    viewer_close(&v);
+    free(scratch);
+    return NULL;
+}
+
+typedef struct {
+    unsigned clients;
+    unsigned segments;
+    unsigned duration;
+    const char *cert; /* absolute; NULL = plaintext */
+    const char *key;
+    SSL_CTX *tls;
+} bench_config_t;
+
+/* env=value is set for the server of this mode only. */
+static int run_mode(const char *name, const char *env, const char *value, const bench_config_t *cfg) {
+    unsigned clients = cfg->clients;
+    unsetenv(SERVER_SENDFILE_ENV);
+    unsetenv(SERVER_KTLS_ENV);
+    /* Only the cached mode serves from memory. */
+    setenv(SEGMENT_CACHE_ENV, "0", 1);
+    if (env) {
+        setenv(env, value, 1);
+    }
+    int report[2];
+    if (pipe(report) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        close(report[0]);
+        run_server(report[1], cfg->cert, cfg->key);
+    }
+    close(report[1]);
+    uint16_t port = 0;
+    if (read(report[0], &port, sizeof(port)) != (ssize_t)sizeof(port) || port == 0) {
+        fprintf(stderr, "[segment-bench] mode=%s server did not start\n", name);
+        close(report[0]);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+
+    volatile int stop = 0;
+    client_t *pool = calloc(clients, sizeof(*pool));
+    if (!pool) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        close(report[0]);
+        return -1;
+    }
+    double start = now_s();
+    for (unsigned i = 0; i < clients; ++i) {
+        pool[i].port = port;
+        pool[i].index = i;
+        pool[i].tls = cfg->tls;
+        pool[i].segments = cfg->segments;
+        pool[i].stop = &stop;
+        if (pthread_create(&pool[i].thread, NULL, client_main, &pool[i]) != 0) {
+            pool[i].failed = 1;
+            pool[i].thread = pthread_self();
+        }
+    }
+    struct timespec ts = {.tv_sec = (time_t)cfg->duration, .tv_nsec = 0};
+    nanosleep(&ts, NULL);
+    stop = 1;
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    unsigned failed = 0;
+    for (unsigned i = 0; i < clients; ++i) {
+        if (!pthread_equal(pool[i].thread, pthread_self())) {
+            pthread_join(pool[i].thread, NULL);
+        }
+        bytes += pool[i].bytes;
+        frames += pool[i].frames;
+        failed += (unsigned)pool[i].failed;
+    }
+    double elapsed = now_s() - start;
+    free(pool);
+
+    kill(pid, SIGTERM);
+    server_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    if (read(report[0], &stats, sizeof(stats)) != (ssize_t)sizeof(stats)) {
+        fprintf(stderr, "[segment-bench] mode=%s no stats from server\n", name);
+    }
+    close(report[0]);
+    struct rusage usage;
+    int status = 0;
+    if (wait4(pid, &status, 0, &usage) != pid) {
+        return -1;
+    }
+    double cpu = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 + (double)usage.ru_stime.tv_sec +
+                 (double)usage.ru_stime.tv_usec / 1e6;
+    printf("[segment-bench][result] mode=%s clients=%u failed=%u segments_sent=%llu MBps=%.1f server_cpu_s=%.2f "
+           "MB_per_cpu_s=%.1f sendfile_bytes=%llu bytes_sent=%llu ktls_connections=%llu\n",
+           name,
+           clients,
+           failed,
+           (unsigned long long)frames,
+           (double)bytes / elapsed / 1e6,
+           cpu,
+           cpu > 0 ? (double)bytes / cpu / 1e6 : 0.0,
+           (unsigned long long)stats.sendfile_bytes,
+           (unsigned long long)stats.bytes_sent,
+           (unsigned long long)stats.ktls_connections);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --clients N      concurrent viewers (default 16)\n"
+            "  --segments N     distinct segment files (default 8)\n"
+            "  --segment-kb KB  size of each segment (default 2048)\n"
+            "  --duration SEC   seconds per mode (default 10)\n"
+            "  --cert PEM       WSS with this certificate (TLS=1 builds)\n"
+            "  --key PEM        private key for --cert\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    bench_config_t cfg = {.clients = 16, .segments = 8, .duration = 10};
+    unsigned segment_kb = 2048;
+    const char *cert = NULL;
+    const char *key = NULL;
+    for (int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *arg = argv[++i];
+        unsigned val = (unsigned)strtoul(arg, NULL, 10);
+        if (strcmp(opt, "--clients") == 0) {
+            cfg.clients = val;
+        } else if (strcmp(opt, "--segments") == 0) {
+            cfg.segments = val;
+        } else if (strcmp(opt, "--segment-kb") == 0) {
+            segment_kb = val;
+        } else if (strcmp(opt, "--duration") == 0) {
+            cfg.duration = val;
+        } else if (strcmp(opt, "--cert") == 0) {
+            cert = arg;
+        } else if (strcmp(opt, "--key") == 0) {
+            key = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.clients == 0 || cfg.segments == 0 || segment_kb == 0 || cfg.duration == 0 || (!cert != !key)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* The server runs in the scratch directory, so resolve the PEM paths first. */
+    char cert_path[PATH_MAX];
+    char key_path[PATH_MAX];
+    if (cert) {
+#ifdef ENABLE_TLS
+        if (!realpath(cert, cert_path) || !realpath(key, key_path)) {
+            fprintf(stderr, "[segment-bench] cannot find --cert/--key\n");
+            return 1;
+        }
+        cfg.cert = cert_path;
+        cfg.key = key_path;
+        cfg.tls = SSL_CTX_new(TLS_client_method());
+        if (!cfg.tls) {
+            return 1;
+        }
+        SSL_CTX_set_verify(cfg.tls, SSL_VERIFY_NONE, NULL);
+#else
+        (void)cert_path;
+        (void)key_path;
+        fprintf(stderr, "[segment-bench] --cert needs a TLS=1 build\n");
+        return 1;
+#endif
+    }
+
+    char cwd[512];
+    char dir[] = "/tmp/ws_segment_bench_XXXXXX";
+    if (!getcwd(cwd, sizeof(cwd)) || !mkdtemp(dir) || chdir(dir) != 0) {
+        fprintf(stderr, "[segment-bench] cannot create scratch directory\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    int rc = write_segments(cfg.segments, (size_t)segment_kb * 1024);
+    if (rc == 0) {
+        printf("[segment-bench][setup] clients=%u segments=%u segment_kb=%u duration=%us transport=%s\n",
+               cfg.clients,
+               cfg.segments,
+               segment_kb,
+               cfg.duration,
+               cfg.tls ? "wss" : "ws");
+        if (cfg.tls) {
+            rc = run_mode("ktls", NULL, NULL, &cfg);
+            if (rc == 0) {
+                rc = run_mode("userspace", SERVER_KTLS_ENV, "0", &cfg);
+            }
+        } else {
+            /* Room for every segment, and each under the per-file share. */
+            size_t need_kb = (size_t)segment_kb * (cfg.segments > SEGMENT_CACHE_MAX_SHARE ? cfg.segments : SEGMENT_CACHE_MAX_SHARE);
+            char cache_mb[32];
+            snprintf(cache_mb, sizeof(cache_mb), "%zu", need_kb / 1024 + 1);
+            rc = run_mode("cached", SEGMENT_CACHE_ENV, cache_mb, &cfg);
+            if (rc == 0) {
+                rc = run_mode("sendfile", NULL, NULL, &cfg);
+            }
+            if (rc == 0) {
+                rc = run_mode("copy", SERVER_SENDFILE_ENV, "0", &cfg);
+            }
+        }
+    } else {
+        fprintf(stderr, "[segment-bench] cannot write segment files\n");
+    }
+    remove_segments(cfg.segments);
+    if (chdir(cwd) == 0) {
+        rmdir(dir);
+    }
+#ifdef ENABLE_TLS
+    SSL_CTX_free(cfg.tls);
+#endif
+    return rc == 0 ? 0 : 1;
+}
@@ -21,6 +21,7 @@ const CONFIG = {
   SEGMENT_QUEUE_MAX: 5,      // 세그먼트 큐 최대 크기
   MAX_APPEND_RETRIES: 5,     // 버퍼 추가 재시도 횟수
   PROGRESS_SAVE_INTERVAL: 5000, // 진행률 저장 주기 (ms)
+  PUSH_WINDOW: 4,            // ws_push로 미리 받아 둘 세그먼트 수
 };
 
 // ===== 상태 변수 =====
@@ -49,6 +50,10 @@ let pendingTimestampOffset = null; // SourceBuffer timestamp offset 적용 대
 let desiredStartTime = 0; // 이어보기 등 요청된 시작 위치(초)
 let timelineOffset = 0; // 현재 스트림 타임라인의 오프셋(PTS 보정)
 let pendingMessages = []; // 소켓 미연결 시 보낼 메시지 큐
+let pushActive = false; // 서버가 세그먼트를 연달아 보내는 중 (ws_push)
+let pushUnsupported = false; // ws_push를 거절한 서버면 ws_segment로 하나씩 요청
+let ackedSegment = -1; // 마지막으로 ws_ack한 세그먼트
+let seekCancelPending = false; // stream_seek 응답 전에 온 SEGM은 이전 위치 것 (중간에 잘렸을 수 있다)
 
 function recoverStream(reason) {
   const video = document.getElementById('player');
@@ -281,6 +286,7 @@ function connectWebSocket() {
 
   socket.onclose = (ev) => {
     console.log('[WS] WebSocket closed, code:', ev.code, 'reason:', ev.reason);
+    seekCancelPending = false; // 새 연결에는 잘린 메시지가 없다
     
     // 사용자가 일시정지한 경우에는 재연결하지 않음
     if (userPaused) {
@@ -464,6 +470,24 @@ function handleMessage(msg) {
         console.error('[WS] Init failed:', msg.message);
       }
       break;
+    case 'ws_push':
+      if (msg.status === 'ok' && msg.segment !== undefined) {
+        console.log('[WS] Push started from segment:', msg.segment, 'window:', msg.window);
+      } else if (msg.status === 'done') {
+        console.log('[WS] Push finished, all segments sent');
+      } else if (msg.status === 'error') {
+        console.warn('[WS] Push refused, requesting segments one by one:', msg.message);
+        pushActive = false;
+        pushUnsupported = true;
+        requesting = false;
+        requestSegment();
+      }
+      break;
+    case 'stream_seek':
+      seekCancelPending = false;
+      console.log('[WS] Seek cancelled in-flight sends, bytes saved:', msg.bytes_saved,
+        'QUIC unacked cancelled:', msg.quic_unacked_cancelled);
+      break;
     case 'ws_segment':
       if (msg.status === 'error') {
         // segment-missing means end of video, not an error
@@ -705,6 +729,9 @@ function setupMediaSource() {
     segmentQueue = []; // 기존 큐 비우기
     nextSegment = targetSegment;
     requesting = false;
+    // 이전 위치로 보내던 세그먼트와 push를 서버에서 바로 끊는다
+    seekCancelPending = true;
+    send({ type: 'stream_seek', video_id: videoId, segment: targetSegment });
     
     // SourceBuffer 비우기
     if (sourceBuffer && !sourceBuffer.updating && sourceBuffer.buffered.length > 0) {
@@ -854,6 +881,7 @@ function handleBinary(data) {
     }
     
     requesting = false; // 요청 플래그 리셋
+    pushActive = false; // ws_init이 서버의 이전 push를 멈췄다
     
     // nextSegment가 설정되지 않았으면 0으로 초기화
     if (nextSegment === undefined || nextSegment === null) {
@@ -879,6 +907,15 @@ function handleBinary(data) {
       console.log('[WS] Waiting for SourceBuffer to be ready before requesting segments');
     }
   } else if (magic === 'SEGM') {
+    if (seekCancelPending) {
+      console.log('[WS] Dropping segment sent before seek:', idx);
+      return;
+    }
+    // seek 전에 push된 세그먼트가 늦게 도착하면 버린다
+    if (pushActive && idx !== nextSegment) {
+      console.log('[WS] Dropping stale pushed segment:', idx, 'expected:', nextSegment);
+      return;
+    }
     // 세그먼트 큐에 추가 - 다음 요청은 appendNext 성공 후에
     nextSegment = idx + 1;
     requesting = false; // 세그먼트 수신 완료, 다음 요청 가능
@@ -1070,6 +1107,23 @@ function requestSegment() {
     console.warn('[WS] Buffer check error:', e);
   }
   
+  // push 중에는 요청 대신 소비한 세그먼트를 알려 서버의 창을 민다
+  if (pushActive) {
+    if (nextSegment - 1 > ackedSegment) {
+      ackedSegment = nextSegment - 1;
+      send({ type: 'ws_ack', segment: ackedSegment });
+    }
+    return;
+  }
+  if (!pushUnsupported) {
+    console.log('[WS] Starting push from segment:', nextSegment);
+    if (send({ type: 'ws_push', video_id: videoId, segment: nextSegment, window: CONFIG.PUSH_WINDOW })) {
+      pushActive = true;
+      ackedSegment = nextSegment - 1;
+    }
+    return;
+  }
+
   requesting = true; // 요청 시작 플래그 설정
   console.log('[WS] Requesting segment:', nextSegment);
   const sent = send({
@@ -1106,6 +1160,8 @@ function resetMediaSource() {
   seekTargetTime = 0;
   retryCount = 0;
   pendingMessages = [];
+  pushActive = false;
+  ackedSegment = -1;
   
   // interval 정리
   if (cleanupInterval) {